@@ -0,0 +1,40 @@
+#!/usr/bin/cmake -P
+
+# DemoSyncTest.cmake
+#
+# Plays a demo with the given command twice, once with BASE_ARGS and
+# once with ALT_ARGS added, and fails if the game ends up in a different
+# state. The output of the first run must also match BASE_CHECK, which
+# tells that the feature under test actually ran.
+#
+# Usage: cmake -DGAME_CMD=<command;args> -DBASE_ARGS=<args> -DALT_ARGS=<args>
+#              -DBASE_CHECK=<regex> -P DemoSyncTest.cmake
+
+function(play_demo Args Result Output)
+    execute_process(
+        COMMAND ${GAME_CMD} ${Args}
+        RESULT_VARIABLE Error
+        OUTPUT_VARIABLE Out
+        ERROR_VARIABLE Out
+    )
+    string(REGEX MATCH "Demo end state: [^\n]*" State "${Out}")
+    if(NOT State)
+        message(FATAL_ERROR "No demo end state (exit code ${Error}):\n${Out}")
+    endif()
+    set(${Result} "${State}" PARENT_SCOPE)
+    set(${Output} "${Out}" PARENT_SCOPE)
+endfunction()
+
+play_demo("${BASE_ARGS}" Base BaseOutput)
+play_demo("${ALT_ARGS}" Alt AltOutput)
+
+message("${BASE_ARGS}:  ${Base}")
+message("${ALT_ARGS}:  ${Alt}")
+
+if(BASE_CHECK AND NOT BaseOutput MATCHES "${BASE_CHECK}")
+    message(FATAL_ERROR "No \"${BASE_CHECK}\" with ${BASE_ARGS}, nothing was tested:\n${BaseOutput}")
+endif()
+
+if(NOT Base STREQUAL Alt)
+    message(FATAL_ERROR "Demo went out of sync with ${ALT_ARGS}")
+endif()
@@ -25,6 +25,8 @@
 
 #include <stdlib.h>
 #include "d_event.h"
+#include "m_trace.h"
+#include "rd_keybinds.h"
 
 #define MAXEVENTS 64
 
@@ -38,6 +40,13 @@ static int eventtail;
 //
 void D_PostEvent (event_t* ev)
 {
+#ifdef RD_TRACE_EVENTS
+    if (BK_isKeyDown(ev, bk_trace_dump))
+    {
+        TRACE_DUMP();
+    }
+#endif
+
     events[eventhead] = *ev;
     eventhead = (eventhead + 1) % MAXEVENTS;
 }
@@ -36,6 +36,7 @@
 
 #include "m_argv.h"
 #include "m_fixed.h"
+#include "m_trace.h"
 
 #include "net_client.h"
 #include "net_gui.h"
@@ -230,6 +231,8 @@ void NetUpdate (void)
     if (singletics)
         return;
 
+    TRACE_BEGIN("NetUpdate");
+
 #ifdef FEATURE_MULTIPLAYER
 
     // Run network subsystems
@@ -265,6 +268,8 @@ void NetUpdate (void)
             break;
         }
     }
+
+    TRACE_END();
 }
 
 static void D_Disconnected(void)
@@ -739,7 +744,7 @@ static void SinglePlayerClear(ticcmd_set_t *set)
 // TryRunTics
 //
 
-void TryRunTics (void)
+static void TryRunTicsInternal (void)
 {
     int	i;
     int	lowtic;
@@ -862,7 +867,9 @@ void TryRunTics (void)
 
             memcpy(local_playeringame, set->ingame, sizeof(local_playeringame));
 
+            TRACE_BEGIN("RunTic");
             loop_interface->RunTic(set->cmds, set->ingame);
+            TRACE_END();
 	    gametic++;
 
 	    // modify command for duplicated tics
@@ -874,6 +881,13 @@ void TryRunTics (void)
     }
 }
 
+void TryRunTics (void)
+{
+    TRACE_BEGIN("TryRunTics");
+    TryRunTicsInternal();
+    TRACE_END();
+}
+
 void D_RegisterLoopCallbacks(loop_interface_t *i)
 {
     loop_interface = i;
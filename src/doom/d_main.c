@@ -57,12 +57,18 @@
 #include "m_config.h"
 #include "m_misc.h"
 #include "m_menu.h"
+#include "m_perf.h"
 #include "p_local.h"
 #include "i_endoom.h"
 #include "i_controller.h"
 #include "i_input.h"
 #include "i_glob.h"
 #include "i_system.h"
+#include "i_thread.h"
+#include "m_savebuf.h"
+#include "m_cache.h"
+#include "m_starttrace.h"
+#include "m_trace.h"
 #include "i_timer.h"
 #include "i_video.h"
 #include "g_game.h"
@@ -598,6 +604,9 @@ static void DrawTimeAndFPS (void)
                 sprintf (digit, "%9d", rendered_vissprites);
                 RD_M_DrawTextC("SPRITES", 286 + (wide_4_3 ? wide_delta : wide_delta*2), 68);
                 RD_M_DrawTextC(digit, 278 + (wide_4_3 ? wide_delta : wide_delta*2), 75);
+
+                // [JN] Frame phase timings, in milliseconds.
+                M_PerfDrawer(278 + (wide_4_3 ? wide_delta : wide_delta*2), 86);
             }
         }
     }
@@ -664,7 +673,9 @@ void D_Display (void)
         if (automapactive && !automap_overlay)
         {
             // [crispy] update automap while playing
+            TRACE_BEGIN("R_RenderPlayerView");
             R_RenderPlayerView (&players[displayplayer]);
+            TRACE_END();
             AM_Drawer ();
         }
 
@@ -688,7 +699,9 @@ void D_Display (void)
     {
         if (!automapactive || automap_overlay)
         {
+            TRACE_BEGIN("R_RenderPlayerView");
             R_RenderPlayerView (&players[displayplayer]);
+            TRACE_END();
         }
 
         // [JN] Background opacity in automap overlay mode.
@@ -704,7 +717,10 @@ void D_Display (void)
         }
 
         // [JN] Do red-/gold-shifts from damage/items and draw status bar.
+        M_PerfStart(PERF_HUD);
+        TRACE_BEGIN("ST_Drawer");
         ST_Drawer();
+        TRACE_END();
     }
 
     // clean up border stuff
@@ -815,6 +831,7 @@ void D_Display (void)
 
     // [JN] Draw local time and FPS widgets on top of everything, excluding wipes.
     DrawTimeAndFPS();
+    M_PerfStop(PERF_HUD);
 
     // [JN] Performance counters were drawn, reset them.
     R_ClearStats();
@@ -896,6 +913,11 @@ void D_BindVariables(void)
     M_BindIntVariable("screen_wiping",          &screen_wiping);
     M_BindIntVariable("show_endoom",            &show_endoom);
     M_BindIntVariable("flashing_hom",           &flashing_hom);
+    M_BindIntVariable("worker_threads",         &worker_threads);
+    M_BindIntVariable("prelit_flats",           &prelit_flats);
+    M_BindIntVariable("build_reject",           &build_reject);
+    M_BindIntVariable("compress_savegames",     &compress_savegames);
+    M_BindIntVariable("startup_cache",          &startup_cache);
 
     // Display
     M_BindIntVariable("screenblocks",           &screenblocks);
@@ -1086,7 +1108,9 @@ void D_DoomLoop (void)
     I_SetWindowTitle(english_language ? gamedescription_eng : gamedescription_rus);
     I_GraphicsCheckCommandLine();
     I_SetGrabMouseCallback(D_GrabMouseCallback);
+    M_StartTraceBegin("I_InitGraphics");
     I_InitGraphics();
+    M_StartTraceEnd();
     EnableLoadingDisk();
 
     TryRunTics();
@@ -1128,7 +1152,11 @@ void D_DoomLoop (void)
         }
 
         // move positional sounds
+        M_PerfStart(PERF_SOUND);
+        TRACE_BEGIN("S_UpdateSounds");
         S_UpdateSounds (players[displayplayer].mo);
+        TRACE_END();
+        M_PerfStop(PERF_SOUND);
     }
 }
 
@@ -2834,7 +2862,9 @@ void D_DoomMain (void)
 
     // Load configuration files before initialising other subsystems.
     D_BindVariables();
+    M_StartTraceBegin("M_LoadConfig");
     M_LoadConfig();
+    M_StartTraceEnd();
 
     DEH_printf(english_language ?
                "Z_Init: Init zone memory allocation daemon. \n" :
@@ -3017,7 +3047,9 @@ void D_DoomMain (void)
     I_AtExit(M_SaveConfig, true); // [crispy] always save configuration at exit
 
     // Find main IWAD file and load it.
+    M_StartTraceBegin("D_FindIWAD");
     iwadfile = D_FindIWAD(IWAD_MASK_DOOM, &gamemission);
+    M_StartTraceEnd();
 
     // None found?
 
@@ -3132,7 +3164,9 @@ void D_DoomMain (void)
     //  1. IWAD dehacked patches.
     //  2. Command line dehacked patches specified with -deh.
     //  3. PWAD dehacked patches in DEHACKED lumps.
+    M_StartTraceBegin("DEH_ParseCommandLine");
     DEH_ParseCommandLine();
+    M_StartTraceEnd();
 #endif
 
     // Load PWAD files.
@@ -3204,7 +3238,9 @@ void D_DoomMain (void)
     I_AtExit(G_CheckDemoStatusAtExit, true);
 
     // Generate the WAD hash table.  Speed things up a bit.
+    M_StartTraceBegin("W_GenerateHashTable");
     W_GenerateHashTable();
+    M_StartTraceEnd();
 
     // Set the gamedescription string. This is only possible now that
     // we've finished loading Dehacked patches.
@@ -3244,8 +3280,12 @@ void D_DoomMain (void)
                "I_Init: Инициализация состояния компьютера.\n");
     I_CheckIsScreensaver();
     I_InitTimer();
+    M_PerfInit();
+    I_InitThreads(worker_threads);
     I_InitController();
+    M_StartTraceBegin("I_InitSound");
     I_InitSound(true);
+    M_StartTraceEnd();
 
     // [crispy] check for presence of MAP33
     havemap33 = (gamemode == commercial) &&
@@ -3468,18 +3508,24 @@ void D_DoomMain (void)
     DEH_printf(english_language ?
                "R_Init: Init DOOM render system - [" :
                "R_Init: Инициализация рендерера DOOM - [");
+    M_StartTraceBegin("R_Init");
     R_Init ();
+    M_StartTraceEnd();
     printf("]");
 
     DEH_printf(english_language ?
                "\nP_Init: Init Playloop state.\n" :
                "\nP_Init: Инициализация игрового окружения.\n");
+    M_StartTraceBegin("P_Init");
     P_Init ();
+    M_StartTraceEnd();
 
     DEH_printf(english_language ?
                "S_Init: Setting up sound.\n" :
                "S_Init: Активация звуковой системы.\n");
+    M_StartTraceBegin("S_Init");
     S_Init (sfxVolume * 8, musicVolume);
+    M_StartTraceEnd();
 
     DEH_printf(english_language ?
                "D_CheckNetGame: Checking network game status.\n" :
@@ -3570,6 +3616,8 @@ void D_DoomMain (void)
     DEH_printf("\".");
     DEH_printf("\n");
 
+    M_PrintStartupTimes();
+
     endtime = SDL_GetTicks() - starttime;
     DEH_printf(english_language ? "Startup process took %d ms.\n" :
                                   "Процесс запуска занял %d мс.\n", endtime);
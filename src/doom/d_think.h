@@ -57,4 +57,8 @@ typedef struct thinker_s
     struct thinker_s *prev;
     struct thinker_s *next;
     think_t function;
+
+    // [JN] Links in the per-class list, see p_tick.c.
+    struct thinker_s *cprev;
+    struct thinker_s *cnext;
 } thinker_t;
@@ -465,14 +465,31 @@ enum
 
 typedef struct mobj_s
 {
+    // [JN] Fields are ordered by access frequency. Mobjs are allocated at
+    // cache line boundaries, so the first two lines hold everything touched
+    // by P_MobjThinker and R_ProjectSprite each tic, and rarely used fields
+    // go last.
+
     // List: thinker links.
     thinker_t   thinker;
 
     // Info for drawing: position.
+    // Must follow the thinker, see degenmobj_t.
     fixed_t     x;
     fixed_t     y;
     fixed_t     z;
 
+    // Momentums, used to update position.
+    fixed_t momx;
+    fixed_t momy;
+    fixed_t momz;
+
+    int       tics;     // state tic counter
+    int       flags;
+    state_t  *state;
+
+    struct subsector_s *subsector;
+
     // More list: links in sector (if needed)
     struct mobj_s *snext;
     struct mobj_s *sprev;
@@ -482,39 +499,43 @@ typedef struct mobj_s
     spritenum_t sprite; // used to find patch_t and flip value
     int         frame;  // might be ORed with FF_FULLBRIGHT
 
-    // Interaction info, by BLOCKMAP.
-    // Links in blocks (if needed).
-    struct mobj_s      *bnext;
-    struct mobj_s      *bprev;
-    struct subsector_s *subsector;
-
     // The closest interval over all contacted Sectors.
     fixed_t floorz;
     fixed_t ceilingz;
 
-    // killough 11/98: the lowest floor over all contacted Sectors.
-    fixed_t dropoffz;
-
     // For movement checking.
     fixed_t radius;
     fixed_t height;	
 
-    // Momentums, used to update position.
-    fixed_t momx;
-    fixed_t momy;
-    fixed_t momz;
+    mobjtype_t  type;
+    int         health;
 
-    // If == validcount, already checked.
-    int validcount;
+    // [AM] If true, ok to interpolate this tic.
+    boolean interp;
+
+    // [AM] Previous position of mobj before think.
+    //      Used to interpolate between positions.
+    fixed_t oldx;
+    fixed_t oldy;
+    fixed_t oldz;
+    angle_t oldangle;
 
-    mobjtype_t  type;
     mobjinfo_t *info;   // &mobjinfo[mobj->type]
-    
-    int       tics;     // state tic counter
-    state_t  *state;
-    int       flags;
-    int       intflags; // killough 9/15/98: internal flags
-    int       health;
+
+    // Interaction info, by BLOCKMAP.
+    // [JN] Index of the block bucket, -1 if not in the blockmap.
+    int blocknum;
+
+    // [JN] phares 3/14/98: sectors touched by the bounding box.
+    struct msecnode_s  *touching_sectorlist;
+
+    // killough 11/98: the lowest floor over all contacted Sectors.
+    fixed_t dropoffz;
+
+    int intflags; // killough 9/15/98: internal flags
+
+    // If == validcount, already checked.
+    int validcount;
 
     // Movement direction, movement generation (zig-zagging).
     int movedir;    // 0-7
@@ -532,31 +553,18 @@ typedef struct mobj_s
     // no matter what (even if shot)
     int threshold;
 
-    short gear;     // killough 11/98: used in torque simulation
-    int   geartics; // [JN] Duration of torque sumulation.
-
     // Additional info record for player avatars only.
     // Only valid if type == MT_PLAYER
     struct player_s *player;
 
-    // Player number last looked for.
-    int lastlook;	
-
-    // For nightmare respawn.
-    mapthing_t spawnpoint;	
-
     // Thing being chased/attacked for tracers.
     struct mobj_s *tracer;	
 
-    // [AM] If true, ok to interpolate this tic.
-    boolean interp;
+    // Player number last looked for.
+    int lastlook;	
 
-    // [AM] Previous position of mobj before think.
-    //      Used to interpolate between positions.
-    fixed_t oldx;
-    fixed_t oldy;
-    fixed_t oldz;
-    angle_t oldangle;
+    short gear;     // killough 11/98: used in torque simulation
+    int   geartics; // [JN] Duration of torque sumulation.
 
     // [JN] Amplitude of floating powerups, used *only* while rendering.
     fixed_t     float_z;
@@ -565,6 +573,12 @@ typedef struct mobj_s
     // [JN] Animated brightmaps.
     int     bmap_flick;
     int     bmap_glow;
+    int     bmap_anim;  // BMAP_FLICK and BMAP_GLOW bits
+    struct mobj_s *bmap_next;
+    struct mobj_s *bmap_prev;
+
+    // For nightmare respawn.
+    mapthing_t spawnpoint;	
 
 } mobj_t;
 
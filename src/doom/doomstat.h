@@ -242,4 +242,5 @@ extern int bodyqueslot;
 
 // Netgame stuff (buffers and pointers, i.e. indices).
 extern int rndindex;
+extern int prndindex;
 extern ticcmd_t *netcmds;
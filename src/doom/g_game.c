@@ -31,8 +31,12 @@
 #include "z_zone.h"
 #include "f_finale.h"
 #include "m_argv.h"
+#include "m_bench.h"
 #include "m_misc.h"
+#include "m_starttrace.h"
+#include "m_trace.h"
 #include "m_menu.h"
+#include "m_perf.h"
 #include "m_random.h"
 #include "i_system.h"
 #include "i_timer.h"
@@ -708,7 +712,9 @@ void G_DoLoadLevel (void)
         G_PlayerReborn(0);
     }
 
+    M_StartTraceBegin("P_SetupLevel");
     P_SetupLevel (gameepisode, gamemap, gameskill);    
+    M_StartTraceEnd();
     displayplayer = consoleplayer;		// view the guy you are playing    
     gameaction = ga_nothing; 
     Z_CheckHeap ();
@@ -770,7 +776,9 @@ boolean G_Responder (event_t *ev)
         } while (!playeringame[displayplayer] && displayplayer != consoleplayer); 
 
         // [JN] Update sound values for appropriate player.
+        TRACE_BEGIN("S_UpdateSounds");
         S_UpdateSounds(players[displayplayer].mo);
+        TRACE_END();
 
         // [JN] Re-init automap variables for correct player arrow angle.
         if (automapactive)
@@ -1088,7 +1096,11 @@ void G_Ticker (void)
     switch (gamestate) 
     { 
         case GS_LEVEL: 
+        M_PerfStart(PERF_TIC);
+        TRACE_BEGIN("P_Ticker");
         P_Ticker (); 
+        TRACE_END();
+        M_PerfStop(PERF_TIC);
         ST_Ticker (); 
         AM_Ticker (); 
         if (netgame)
@@ -1828,9 +1840,8 @@ void G_DoLoadGame (void)
 
     gameaction = ga_nothing; 
 
-    save_stream = M_fopen(savename, "rb");
-
-    if (save_stream == NULL)
+    // [JN] Read the whole file at once, it's parsed from memory.
+    if (!M_LoadSaveBuf(&save_buffer, savename, SAVESTRINGSIZE))
     {
         return;
     }
@@ -1839,7 +1850,7 @@ void G_DoLoadGame (void)
 
     if (!P_ReadSaveGameHeader())
     {
-        fclose(save_stream);
+        M_SaveBufFree(&save_buffer);
         return;
     }
 
@@ -1863,7 +1874,7 @@ void G_DoLoadGame (void)
                         "Bad savegame" :
                         "Некорректный файл сохранения");
 
-    fclose(save_stream);
+    M_SaveBufFree(&save_buffer);
     
     // [JN] Additional message after game load.
     if (!vanillaparm)
@@ -1901,48 +1912,47 @@ void G_DoSaveGame (void)
     temp_savegame_file = P_TempSaveGameFile();
     savegame_file = P_SaveGameFile(savegameslot);
 
-    // Open the savegame file for writing.  We write to a temporary file
-    // and then rename it at the end if it was successfully written.
-    // This prevents an existing savegame from being overwritten by
-    // a corrupted one, or if a savegame buffer overrun occurs.
-    save_stream = M_fopen(temp_savegame_file, "wb");
+    // [JN] The savegame is built in memory first.
+    P_WriteSaveGameHeader(savedescription);
 
-    if (save_stream == NULL)
+    P_ArchivePlayers ();
+    P_ArchiveWorld ();
+    P_ArchiveThinkers ();
+    P_ArchiveSpecials ();
+    P_ArchiveAutomap ();
+
+    P_WriteSaveGameEOF();
+
+    // Write it to a temporary file and rename it to the actual savegame
+    // file once it was successfully written, overwriting the old savegame
+    // if there was one there. This prevents an existing savegame from
+    // being overwritten by a corrupted one. Both happen in the background.
+    if (!M_WriteSaveBuf(&save_buffer, temp_savegame_file, savegame_file,
+                        SAVESTRINGSIZE))
     {
         // Failed to save the game, so we're going to have to abort. But
         // to be nice, save to somewhere else before we call I_QuitWithError().
         recovery_savegame_file = M_TempFile("recovery.dsg");
-        save_stream = M_fopen(recovery_savegame_file, "wb");
-        if (save_stream == NULL)
+        if (!M_WriteSaveBuf(&save_buffer, recovery_savegame_file, NULL,
+                            SAVESTRINGSIZE))
         {
             I_QuitWithError(english_language ?
                             "Failed to open either '%s' or '%s' to write savegame." :
                             "Невозможно открыть '%s' или '%s' для записи файла сохранения.",
                             temp_savegame_file, recovery_savegame_file);
         }
-    }
-
-    savegame_error = false;
-
-    P_WriteSaveGameHeader(savedescription);
-
-    P_ArchivePlayers ();
-    P_ArchiveWorld ();
-    P_ArchiveThinkers ();
-    P_ArchiveSpecials ();
-    P_ArchiveAutomap ();
-
-    P_WriteSaveGameEOF();
-
-    // Finish up, close the savegame file.
-
-    fclose(save_stream);
 
-    if (recovery_savegame_file != NULL)
-    {
         // We failed to save to the normal location, but we wrote a
         // recovery file to the temp directory. Now we can bomb out
         // with an error.
+        if (!M_FinishSaveWrites())
+        {
+            I_QuitWithError(english_language ?
+                            "Failed to write savegame to either '%s' or '%s'." :
+                            "Невозможно записать файл сохранения в '%s' или '%s'.",
+                            temp_savegame_file, recovery_savegame_file);
+        }
+
         if (english_language)
         {
             I_QuitWithError("Failed to open savegame file '%s' for writing.\n"
@@ -1957,12 +1967,6 @@ void G_DoSaveGame (void)
         }
     }
 
-    // Now rename the temporary savegame file to the actual savegame
-    // file, overwriting the old savegame if there was one there.
-
-    M_remove(savegame_file);
-    M_rename(temp_savegame_file, savegame_file);
-
     gameaction = ga_nothing;
     M_StringCopy(savedescription, "", sizeof(savedescription));
 
@@ -2744,6 +2748,11 @@ void G_DoPlayDemo (void)
     starttime = I_GetTime (); 
     demostarttic = gametic; // [crispy] fix revenant internal demo bug
 
+    if (timingdemo)
+    {
+        M_BenchStartRun();
+    }
+
     usergame = false; 
     demoplayback = true; 
     
@@ -2788,6 +2797,7 @@ void G_TimeDemo (char* name)
 
     timingdemo = true; 
     singletics = true; 
+    M_BenchInit(name);
 
     defdemoname = name; 
     gameaction = ga_playdemo; 
@@ -2812,16 +2822,38 @@ boolean G_CheckDemoStatus (void)
     { 
         endtime = I_GetTime();
         int realtics = endtime - starttime;
-        float fps = ((float) gametic * TICRATE) / realtics;
+        int gametics = gametic - demostarttic;
+        float fps = ((float) gametics * TICRATE) / realtics;
+
+        // [JN] Play the demo once again for the next benchmark run.
+        if (M_BenchEndRun(gametics))
+        {
+            W_ReleaseLumpName(defdemoname);
+            demoplayback = false;
+            gameaction = ga_playdemo;
+            return true;
+        }
 
         // Prevent recursive calls
         timingdemo = false;
         demoplayback = false;
 
+        // [JN] Final state of the game, compared by the demo sync test.
+        if (playeringame[consoleplayer] && players[consoleplayer].mo)
+        {
+            const player_t *player = &players[consoleplayer];
+
+            printf(english_language ?
+                   "Demo end state: gametic %d, prndindex %d, x %d, y %d, health %d, kills %d/%d\n" :
+                   "Состояние в конце демозаписи: gametic %d, prndindex %d, x %d, y %d, здоровье %d, убийства %d/%d\n",
+                   gametic, prndindex, player->mo->x, player->mo->y,
+                   player->health, player->killcount, totalkills);
+        }
+
         I_QuitWithMessage(english_language ?
                           "Timed %i gametics in %i realtics (%f fps)" :
                           "Насчитано %i gametics в %i realtics.\nСреднее значение FPS: %f.",
-                          gametic, realtics, fps);
+                          gametics, realtics, fps);
     }
 
     if (demoplayback)
@@ -6611,6 +6611,9 @@ static void M_ReadSaveStrings()
     int     i;
     char    name[256];
 
+    // [JN] Make sure the latest savegame has reached the disk.
+    M_FinishSaveWrites();
+
     for (i = 0;i < 8;i++)
     {
         M_StringCopy(name, P_SaveGameFile(i), sizeof(name));
@@ -8175,6 +8178,7 @@ static void M_ConfirmDeleteGameResponse(boolean confirmed)
         char name[256];
 
         M_StringCopy(name, P_SaveGameFile(CurrentItPos), sizeof(name));
+        M_FinishSaveWrites();
         M_remove(name);
         M_ReadSaveStrings();
     }
@@ -380,7 +380,7 @@ void EV_VerticalDoor (line_t *line, mobj_t *thing)
     }
     
     // new door thinker
-    door = Z_Malloc (sizeof(*door), PU_LEVSPEC, 0);
+    door = P_AllocThinker (sizeof(*door));
     P_AddThinker (&door->thinker);
     sec->specialdata = door;
     door->thinker.function.acp1 = (actionf_p1) T_VerticalDoor;
@@ -453,7 +453,7 @@ const int EV_DoDoor (const line_t *line, const vldoor_e type)
 
         // new door thinker
         rtn = 1;
-        door = Z_Malloc (sizeof(*door), PU_LEVSPEC, 0);
+        door = P_AllocThinker (sizeof(*door));
         P_AddThinker (&door->thinker);
         sec->specialdata = door;
 
@@ -601,7 +601,7 @@ const int EV_DoLockedDoor (line_t *line, const vldoor_e type, const mobj_t *thin
 
 void P_SpawnDoorCloseIn30 (sector_t *sec)
 {
-    vldoor_t *door = Z_Malloc ( sizeof(*door), PU_LEVSPEC, 0);
+    vldoor_t *door = P_AllocThinker (sizeof(*door));
 
     P_AddThinker (&door->thinker);
 
@@ -623,7 +623,7 @@ void P_SpawnDoorCloseIn30 (sector_t *sec)
 
 void P_SpawnDoorRaiseIn5Mins (sector_t *sec, const int secnum)
 {
-    vldoor_t *door = Z_Malloc ( sizeof(*door), PU_LEVSPEC, 0);
+    vldoor_t *door = P_AllocThinker (sizeof(*door));
 
     P_AddThinker (&door->thinker);
 
@@ -974,6 +974,7 @@ void A_SPosAttack (mobj_t *actor)
     S_StartSound (actor, sfx_shotgn);
     A_FaceTarget (actor);
     bangle = actor->angle;
+    P_BeginHitscanBatch();
     slope = P_AimLineAttack (actor, bangle, MISSILERANGE);
 
     for (int i = 0 ; i < 3 ; i++)
@@ -990,7 +991,9 @@ void A_SPosAttack (mobj_t *actor)
         }
 
         P_LineAttack (actor, angle, MISSILERANGE, slope, damage);
-    }        
+    }
+
+    P_EndHitscanBatch();
 }
 
 // -----------------------------------------------------------------------------
@@ -1235,6 +1238,7 @@ void A_SkelMissile (mobj_t *actor)
 
     mo->x += mo->momx;
     mo->y += mo->momy;
+    P_UpdateThingBox(mo);
     mo->tracer = actor->target;
 }
 
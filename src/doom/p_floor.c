@@ -47,6 +47,9 @@ const result_e T_MovePlane (sector_t *sector, const fixed_t speed, fixed_t dest,
     sector->oldceilingheight = sector->ceilingheight;
     sector->oldgametic = gametic;
 
+    // [JN] Plane heights affect sight checks.
+    P_InvalidateSightCache();
+
     switch (floorOrCeiling)
     {
         case 0:
@@ -276,7 +279,7 @@ const int EV_DoFloor (line_t *line, const floor_e floortype)
 
         // new floor thinker
         rtn = 1;
-        floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+        floor = P_AllocThinker (sizeof(*floor));
         P_AddThinker (&floor->thinker);
         sec->specialdata = floor;
         floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
@@ -487,7 +490,7 @@ const int EV_BuildStairs (line_t *line, const stair_e type)
 
         // new floor thinker
         rtn = 1;
-        floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+        floor = P_AllocThinker (sizeof(*floor));
         P_AddThinker (&floor->thinker);
         sec->specialdata = floor;
         floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
@@ -558,7 +561,7 @@ const int EV_BuildStairs (line_t *line, const stair_e type)
 
                 sec = tsec;
                 secnum = newsecnum;
-                floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+                floor = P_AllocThinker (sizeof(*floor));
 
                 P_AddThinker (&floor->thinker);
 
@@ -381,7 +381,7 @@ boolean P_GivePower (player_t *player, const int power)
 // P_TouchSpecialThing
 // -----------------------------------------------------------------------------
 
-void P_TouchSpecialThing (const mobj_t *special, const mobj_t *toucher)
+void P_TouchSpecialThing (mobj_t *special, const mobj_t *toucher)
 {
     int        sound;
     player_t  *player;
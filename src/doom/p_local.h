@@ -23,6 +23,7 @@
 #pragma once
 
 #include <SDL.h>
+#include "m_savebuf.h"
 #include "r_local.h"
 
 
@@ -143,6 +144,8 @@ void T_VerticalDoor (vldoor_t *door);
 // -----------------------------------------------------------------------------
 
 void P_NoiseAlert (mobj_t *target, mobj_t *emmiter);
+void A_Look (mobj_t *actor);
+void A_Chase (mobj_t *actor);
 
 // -----------------------------------------------------------------------------
 // P_FIX
@@ -254,7 +257,7 @@ extern boolean ultimatemsg;
 boolean P_GivePower (player_t *player, const int power);
 void P_DamageMobj (mobj_t *target, const mobj_t *inflictor, mobj_t *source, int damage);
 void P_SetMessage (player_t *player, char *message, MessageType_t messageType, boolean ultmsg);
-void P_TouchSpecialThing (const mobj_t *special, const mobj_t *toucher);
+void P_TouchSpecialThing (mobj_t *special, const mobj_t *toucher);
 
 // -----------------------------------------------------------------------------
 // P_LIGHTS
@@ -385,8 +388,12 @@ extern fixed_t      openrange;
 extern fixed_t      lowfloor;
 
 boolean P_PathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2, int flags, boolean (*trav)(intercept_t *));
+void P_BeginHitscanBatch (void);
+void P_EndHitscanBatch (void);
 const boolean P_BlockLinesIterator (const int x, const int y, boolean(*func)(line_t*));
 const boolean P_BlockThingsIterator (const int x, const int y, boolean(*func)(mobj_t*));
+const boolean P_BlockThingsIteratorBox (const int x, const int y, const fixed_t *box, boolean(*func)(mobj_t*));
+const boolean P_SectorThingsIterator (sector_t *sector, boolean(*func)(mobj_t*));
 const int64_t P_ApproxDistanceZ (int64_t dx, int64_t dy, int64_t dz);
 const fixed_t P_AproxDistance (fixed_t dx, fixed_t dy);
 const fixed_t P_InterceptVector (const divline_t* v2, const divline_t* v1);
@@ -396,7 +403,12 @@ const int P_PointOnLineSide (const fixed_t x, const fixed_t y, const line_t *lin
 void P_LineOpening (const line_t *linedef);
 void P_MakeDivline (line_t* li, divline_t* dl);
 void P_SetThingPosition (mobj_t* thing);
-void P_UnsetThingPosition (const mobj_t* thing);
+void P_UnsetThingPosition (mobj_t* thing);
+void P_UpdateThingBox (mobj_t *thing);
+void P_InitBlockIndex (void);
+void P_InitSecnodes (void);
+
+extern boolean secnodelists;
 
 // -----------------------------------------------------------------------------
 // P_MOBJ
@@ -421,7 +433,7 @@ mobj_t *P_SpawnMissile (mobj_t *source, mobj_t *dest, mobjtype_t type);
 mobj_t *P_SpawnMobj (const fixed_t x, const fixed_t y, const fixed_t z, const mobjtype_t type);
 mobj_t *P_SubstNullMobj (mobj_t *th);
 void P_MobjThinker (mobj_t *mobj);
-void P_RemoveMobj (const mobj_t *th);
+void P_RemoveMobj (mobj_t *th);
 void P_RespawnSpecials (void);
 void P_SpawnBlood (const fixed_t x, const fixed_t y, fixed_t z, const int damage, mobj_t *target);
 void P_SpawnMapThing (mapthing_t *mthing);
@@ -500,7 +512,7 @@ void P_SetupPsprites (player_t *player);
 #define VERSIONSIZE         16
 #define SAVESTRINGSIZE      24
 
-extern FILE *save_stream;
+extern savebuf_t save_buffer;
 extern boolean savegame_error;
 extern void M_ConfirmDeleteGame (void);
 
@@ -540,7 +552,7 @@ extern int       bmapwidth;
 extern int       bmapheight;    // in mapblocks
 extern fixed_t   bmaporgx;
 extern fixed_t   bmaporgy;      // origin of block map
-extern mobj_t  **blocklinks;    // for thing chains
+extern int       blockmapcount; // length of blockmaplump
 
 extern const vertexfix_t *selected_vertexfix;
 extern const linefix_t   *selected_linefix;
@@ -552,11 +564,23 @@ void P_Init (void);
 void P_SetupLevel (const int episode, const int map, const skill_t skill);
 void P_SetupFixes (const int episode, const int map);
 
+// -----------------------------------------------------------------------------
+// P_REJECT
+// -----------------------------------------------------------------------------
+
+extern byte *rejectbuilt;  // generated REJECT, NULL if not built
+
+void P_BuildReject (void);
+
 // -----------------------------------------------------------------------------
 // P_SIGHT
 // -----------------------------------------------------------------------------
 
 const boolean P_CheckSight (const mobj_t *t1, const mobj_t *t2);
+void P_InitSightCache (void);
+void P_InvalidateSightCache (void);
+void P_PrecomputeSight (void);
+void P_ReportSightCounts (void);
 
 // -----------------------------------------------------------------------------
 // P_SPEC
@@ -643,6 +667,12 @@ extern thinker_t thinkercap;
 void P_AddThinker (thinker_t *thinker);
 void P_InitThinkers (void);
 void P_RemoveThinker (thinker_t *thinker);
+void P_InitThinkerPools (void);
+void P_ClearThinkerPools (void);
+void *P_AllocThinker (const size_t size);
+void P_FreeThinker (thinker_t *thinker);
+void P_LinkBrightmapMobj (mobj_t *mo);
+void P_UnlinkBrightmapMobj (mobj_t *mo);
 void P_Ticker (void);
 
 // -----------------------------------------------------------------------------
@@ -154,7 +154,7 @@ const boolean P_TeleportMove (mobj_t *thing, const fixed_t x, const fixed_t y)
     {
         for (by = yl ; by <= yh ; by++)
         {
-            if (!P_BlockThingsIterator(bx, by, PIT_StompThing))
+            if (!P_BlockThingsIteratorBox(bx, by, tmbbox, PIT_StompThing))
             {
                 return false;
             }
@@ -631,7 +631,7 @@ const boolean P_CheckPosition (mobj_t *thing, const fixed_t x, const fixed_t y)
     {
         for (by = yl ; by <= yh ; by++)
         {
-            if (!P_BlockThingsIterator(bx, by, PIT_CheckThing))
+            if (!P_BlockThingsIteratorBox(bx, by, tmbbox, PIT_CheckThing))
             {
                 return false;
             }
@@ -1749,6 +1749,7 @@ void P_RadiusAttack (mobj_t *spot, mobj_t *source, int damage)
     int     xl, xh;
     int     yl, yh;
     fixed_t dist;
+    fixed_t box[4];
 
     dist = (damage+MAXRADIUS)<<FRACBITS;
     yh = (spot->y + dist - bmaporgy)>>MAPBLOCKSHIFT;
@@ -1759,11 +1760,17 @@ void P_RadiusAttack (mobj_t *spot, mobj_t *source, int damage)
     bombsource = source;
     bombdamage = damage;
 
+    // [JN] Things which PIT_RadiusAttack finds out of range.
+    box[BOXTOP] = spot->y + (damage<<FRACBITS);
+    box[BOXBOTTOM] = spot->y - (damage<<FRACBITS);
+    box[BOXRIGHT] = spot->x + (damage<<FRACBITS);
+    box[BOXLEFT] = spot->x - (damage<<FRACBITS);
+
     for (y = yl ; y <= yh ; y++)
     {
         for (x = xl ; x <= xh ; x++)
         {
-            P_BlockThingsIterator (x, y, PIT_RadiusAttack);
+            P_BlockThingsIteratorBox (x, y, box, PIT_RadiusAttack);
         }
     }
 }
@@ -1816,6 +1823,7 @@ boolean PIT_ChangeSector (mobj_t *thing)
         }
         thing->height = 0;
         thing->radius = 0;
+        P_UpdateThingBox(thing);
 
         // [JN] Play extra crushing sound (D*SLOP2):
         if (crushed_corpses_sfx && !vanillaparm)
@@ -1904,6 +1912,15 @@ boolean P_ChangeSector (sector_t *sector, boolean crunch)
     crushchange = crunch;
     movingsector = sector;
 
+    // [JN] Only visit things touching the sector. Demos and network
+    // games keep vanilla order, which affects P_Random calls.
+    // Lists may be missing if the level was started in a demo.
+    if (secnodelists && singleplayer)
+    {
+        P_SectorThingsIterator(sector, PIT_ChangeSector);
+        return nofit;
+    }
+
     // re-check heights for all things near the moving sector
     for (x = sector->blockbox[BOXLEFT] ; x <= sector->blockbox[BOXRIGHT] ; x++)
     {
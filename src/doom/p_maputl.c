@@ -25,6 +25,7 @@
 
 #include "i_system.h"
 #include "m_bbox.h"
+#include "z_zone.h"
 #include "doomstat.h"
 #include "p_local.h"
 #include "jn.h"
@@ -229,6 +230,383 @@ void P_LineOpening (const line_t *linedef)
 //
 // =============================================================================
 
+// =============================================================================
+//
+// SECTOR TOUCHING LISTS
+// [JN] phares 3/14/98: every thing is linked to all sectors its bounding box
+// touches, so moving sectors can visit only things which are in them.
+//
+// =============================================================================
+
+static msecnode_t *headsecnode;     // free nodes
+static unsigned int secnodechanges; // bumped when any list is changed
+
+boolean secnodelists;  // lists are kept on this level
+
+// -----------------------------------------------------------------------------
+// P_InitSecnodes
+// Nodes are allocated as PU_LEVEL, so free list is dropped on level change.
+// Lists are only read by P_ChangeSector in single player games, so they are
+// not kept at all on levels started in demos, netgames or -vanilla mode.
+// -----------------------------------------------------------------------------
+
+void P_InitSecnodes (void)
+{
+    headsecnode = NULL;
+    secnodelists = singleplayer && !vanillaparm;
+}
+
+// -----------------------------------------------------------------------------
+// P_AddSecnode
+// Adds sector to the list of a thing, unless it is already there.
+// Returns new head of the list.
+// -----------------------------------------------------------------------------
+
+static msecnode_t *P_AddSecnode (sector_t *s, mobj_t *thing, msecnode_t *list)
+{
+    msecnode_t *node;
+
+    for (node = list ; node ; node = node->m_tnext)
+    {
+        if (node->m_sector == s)
+        {
+            return list;
+        }
+    }
+
+    if (headsecnode)
+    {
+        node = headsecnode;
+        headsecnode = node->m_snext;
+    }
+    else
+    {
+        node = Z_Malloc(sizeof(*node), PU_LEVEL, NULL);
+    }
+
+    node->m_sector = s;
+    node->m_thing = thing;
+    node->m_tnext = list;
+    node->visited = false;
+
+    // add to the head of sector list
+    node->m_sprev = NULL;
+    node->m_snext = s->touching_thinglist;
+
+    if (s->touching_thinglist)
+    {
+        s->touching_thinglist->m_sprev = node;
+    }
+
+    s->touching_thinglist = node;
+    secnodechanges++;
+
+    return node;
+}
+
+// -----------------------------------------------------------------------------
+// P_DelSeclist
+// Unlinks all nodes of a thing from sector lists and frees them.
+// -----------------------------------------------------------------------------
+
+static void P_DelSeclist (msecnode_t *node)
+{
+    while (node)
+    {
+        msecnode_t *next = node->m_tnext;
+
+        if (node->m_sprev)
+        {
+            node->m_sprev->m_snext = node->m_snext;
+        }
+        else
+        {
+            node->m_sector->touching_thinglist = node->m_snext;
+        }
+
+        if (node->m_snext)
+        {
+            node->m_snext->m_sprev = node->m_sprev;
+        }
+
+        node->m_snext = headsecnode;
+        headsecnode = node;
+        secnodechanges++;
+
+        node = next;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// P_CreateSecNodeList
+// Collects sectors of all lines crossing the bounding box of a thing, plus
+// sector of its center. Doesn't touch validcount and tm* globals, since
+// things are linked in the middle of other iterations.
+// -----------------------------------------------------------------------------
+
+static msecnode_t *P_CreateSecNodeList (mobj_t *thing)
+{
+    msecnode_t *list = NULL;
+    fixed_t     bbox[4];
+    int         xl, xh, yl, yh;
+
+    bbox[BOXTOP]    = thing->y + thing->radius;
+    bbox[BOXBOTTOM] = thing->y - thing->radius;
+    bbox[BOXRIGHT]  = thing->x + thing->radius;
+    bbox[BOXLEFT]   = thing->x - thing->radius;
+
+    xl = MAX((bbox[BOXLEFT] - bmaporgx) >> MAPBLOCKSHIFT, 0);
+    xh = MIN((bbox[BOXRIGHT] - bmaporgx) >> MAPBLOCKSHIFT, bmapwidth - 1);
+    yl = MAX((bbox[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT, 0);
+    yh = MIN((bbox[BOXTOP] - bmaporgy) >> MAPBLOCKSHIFT, bmapheight - 1);
+
+    for (int by = yl ; by <= yh ; by++)
+    {
+        for (int bx = xl ; bx <= xh ; bx++)
+        {
+            const int32_t *list_p = blockmaplump + blockmap[by*bmapwidth+bx];
+
+            for ( ; *list_p != -1 ; list_p++)
+            {
+                const line_t *ld = &lines[*list_p];
+
+                if (bbox[BOXRIGHT]  <= ld->bbox[BOXLEFT]
+                ||  bbox[BOXLEFT]   >= ld->bbox[BOXRIGHT]
+                ||  bbox[BOXTOP]    <= ld->bbox[BOXBOTTOM]
+                ||  bbox[BOXBOTTOM] >= ld->bbox[BOXTOP]
+                ||  P_BoxOnLineSide(bbox, ld) != -1)
+                {
+                    continue;
+                }
+
+                // this line crosses through the object
+                list = P_AddSecnode(ld->frontsector, thing, list);
+
+                if (ld->backsector)
+                {
+                    list = P_AddSecnode(ld->backsector, thing, list);
+                }
+            }
+        }
+    }
+
+    return P_AddSecnode(thing->subsector->sector, thing, list);
+}
+
+// =============================================================================
+//
+// BLOCK INDEX
+// [JN] Lines of every mapblock are copied into one compact array in block
+// order, so neighbouring blocks share cache lines and lists need no
+// terminator. Things are kept in per-block buckets: an array of bounding
+// boxes and a parallel array of mobj pointers, so iterators can reject
+// things by box without touching the mobjs. Buckets are ordered from the
+// oldest to the newest thing and iterated backwards, which is the order of
+// the old blocklinks chains, where new things were linked at the head.
+//
+// =============================================================================
+
+typedef struct
+{
+    fixed_t (*boxes)[4];
+    mobj_t  **things;
+    int       numthings;
+    int       maxthings;
+    int       busy;       // iterators running on this bucket
+    boolean   holes;      // things removed while busy
+} blockbucket_t;
+
+static blockbucket_t *blockbuckets;
+static int32_t *blocklinestart;  // numblocks+1 offsets into blocklinelist
+static int32_t *blocklinelist;
+
+// Bumped whenever any bucket changes, see hitscan batches.
+static unsigned int blockthingchanges;
+
+// -----------------------------------------------------------------------------
+// P_InitBlockIndex
+// Called after the blockmap has been loaded or created.
+// -----------------------------------------------------------------------------
+
+void P_InitBlockIndex (void)
+{
+    const int numblocks = bmapwidth * bmapheight;
+    int total = 0;
+    int pass, b;
+
+    blockbuckets = Z_Malloc(numblocks * sizeof(*blockbuckets), PU_LEVEL, NULL);
+    memset(blockbuckets, 0, numblocks * sizeof(*blockbuckets));
+
+    blocklinestart = Z_Malloc((numblocks + 1) * sizeof(*blocklinestart), PU_LEVEL, NULL);
+
+    // First pass counts, second pass copies. Lists are kept as they are,
+    // including the leading zero, so lines are checked in vanilla order.
+    for (pass = 0 ; pass < 2 ; pass++)
+    {
+        total = 0;
+
+        for (b = 0 ; b < numblocks ; b++)
+        {
+            int32_t offset = blockmap[b];
+
+            blocklinestart[b] = total;
+
+            if (offset < 0 || offset >= blockmapcount)
+            {
+                continue;
+            }
+
+            for ( ; offset < blockmapcount && blockmaplump[offset] != -1 ; offset++)
+            {
+                if (pass)
+                {
+                    blocklinelist[total] = blockmaplump[offset];
+                }
+                total++;
+            }
+        }
+
+        blocklinestart[numblocks] = total;
+
+        if (!pass)
+        {
+            blocklinelist = Z_Malloc(MAX(total, 1) * sizeof(*blocklinelist), PU_LEVEL, NULL);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// P_SetBucketBox
+// -----------------------------------------------------------------------------
+
+static void P_SetBucketBox (fixed_t *box, const mobj_t *thing)
+{
+    box[BOXTOP] = thing->y + thing->radius;
+    box[BOXBOTTOM] = thing->y - thing->radius;
+    box[BOXRIGHT] = thing->x + thing->radius;
+    box[BOXLEFT] = thing->x - thing->radius;
+}
+
+// -----------------------------------------------------------------------------
+// P_CompactBucket
+// Drops things removed while the bucket was iterated, keeping the order.
+// -----------------------------------------------------------------------------
+
+static void P_CompactBucket (blockbucket_t *bucket)
+{
+    int i, j;
+
+    for (i = j = 0 ; i < bucket->numthings ; i++)
+    {
+        if (bucket->things[i])
+        {
+            memcpy(bucket->boxes[j], bucket->boxes[i], sizeof(bucket->boxes[j]));
+            bucket->things[j++] = bucket->things[i];
+        }
+    }
+
+    bucket->numthings = j;
+    bucket->holes = false;
+}
+
+// -----------------------------------------------------------------------------
+// P_AddToBucket
+// -----------------------------------------------------------------------------
+
+static void P_AddToBucket (blockbucket_t *bucket, mobj_t *thing)
+{
+    if (bucket->numthings == bucket->maxthings)
+    {
+        const int newmax = bucket->maxthings ? bucket->maxthings * 2 : 4;
+        fixed_t (*boxes)[4] = Z_Malloc(newmax * (sizeof(*boxes) + sizeof(mobj_t *)),
+                                       PU_LEVEL, NULL);
+        mobj_t **things = (mobj_t **) (boxes + newmax);
+
+        if (bucket->maxthings)
+        {
+            memcpy(boxes, bucket->boxes, bucket->numthings * sizeof(*boxes));
+            memcpy(things, bucket->things, bucket->numthings * sizeof(*things));
+            Z_Free(bucket->boxes);
+        }
+
+        bucket->boxes = boxes;
+        bucket->things = things;
+        bucket->maxthings = newmax;
+    }
+
+    P_SetBucketBox(bucket->boxes[bucket->numthings], thing);
+    bucket->things[bucket->numthings++] = thing;
+    blockthingchanges++;
+}
+
+// -----------------------------------------------------------------------------
+// P_RemoveFromBucket
+// While the bucket is iterated, the slot is only cleared, so that iterators
+// neither skip nor repeat things.
+// -----------------------------------------------------------------------------
+
+static void P_RemoveFromBucket (blockbucket_t *bucket, const mobj_t *thing)
+{
+    int i;
+
+    for (i = bucket->numthings - 1 ; i >= 0 ; i--)
+    {
+        if (bucket->things[i] == thing)
+        {
+            break;
+        }
+    }
+
+    if (i < 0)
+    {
+        return;
+    }
+
+    blockthingchanges++;
+
+    if (bucket->busy)
+    {
+        bucket->things[i] = NULL;
+        bucket->holes = true;
+        return;
+    }
+
+    bucket->numthings--;
+    memmove(bucket->boxes[i], bucket->boxes[i+1],
+            (bucket->numthings - i) * sizeof(*bucket->boxes));
+    memmove(&bucket->things[i], &bucket->things[i+1],
+            (bucket->numthings - i) * sizeof(*bucket->things));
+}
+
+// -----------------------------------------------------------------------------
+// P_UpdateThingBox
+// [JN] Must be called when position or radius of a thing is changed
+// without unlinking and linking it again.
+// -----------------------------------------------------------------------------
+
+void P_UpdateThingBox (mobj_t *thing)
+{
+    blockbucket_t *bucket;
+    int i;
+
+    if (thing->blocknum < 0)
+    {
+        return;
+    }
+
+    bucket = &blockbuckets[thing->blocknum];
+
+    for (i = bucket->numthings - 1 ; i >= 0 ; i--)
+    {
+        if (bucket->things[i] == thing)
+        {
+            P_SetBucketBox(bucket->boxes[i], thing);
+            blockthingchanges++;
+            return;
+        }
+    }
+}
+
 // -----------------------------------------------------------------------------
 // P_UnsetThingPosition
 // Unlinks a thing from block map and sectors.
@@ -237,7 +615,7 @@ void P_LineOpening (const line_t *linedef)
 // these structures need to be updated.
 // -----------------------------------------------------------------------------
 
-void P_UnsetThingPosition (const mobj_t *thing)
+void P_UnsetThingPosition (mobj_t *thing)
 {
     if (!(thing->flags & MF_NOSECTOR))
     {
@@ -258,31 +636,17 @@ void P_UnsetThingPosition (const mobj_t *thing)
         }
     }
 
-    if (!(thing->flags & MF_NOBLOCKMAP))
+    // inert things don't need to be in blockmap
+    // unlink from block map
+    if (thing->blocknum >= 0)
     {
-        // inert things don't need to be in blockmap
-        // unlink from block map
-        if (thing->bnext)
-        {
-            thing->bnext->bprev = thing->bprev;
-        }
-
-        if (thing->bprev)
-        {
-            thing->bprev->bnext = thing->bnext;
-        }
-        else
-        {
-            int blockx = (thing->x - bmaporgx) >> MAPBLOCKSHIFT;
-            int blocky = (thing->y - bmaporgy) >> MAPBLOCKSHIFT;
-
-            if (blockx >= 0 && blockx < bmapwidth 
-            &&  blocky >= 0 && blocky < bmapheight)
-            {
-                blocklinks[blocky*bmapwidth+blockx] = thing->bnext;
-            }
-        }
+        P_RemoveFromBucket(&blockbuckets[thing->blocknum], thing);
+        thing->blocknum = -1;
     }
+
+    // [JN] Unlink from sector touching lists.
+    P_DelSeclist(thing->touching_sectorlist);
+    thing->touching_sectorlist = NULL;
 }
 
 // -----------------------------------------------------------------------------
@@ -326,23 +690,24 @@ void P_SetThingPosition (mobj_t *thing)
 
         if (blockx >= 0 && blockx < bmapwidth && blocky >= 0 && blocky < bmapheight)
         {
-            mobj_t **link = &blocklinks[blocky*bmapwidth+blockx];
-            thing->bprev = NULL;
-            thing->bnext = *link;
-
-            if (*link)
-            {
-                (*link)->bprev = thing;
-            }
-
-            *link = thing;
+            thing->blocknum = blocky*bmapwidth+blockx;
+            P_AddToBucket(&blockbuckets[thing->blocknum], thing);
         }
         else
         {
             // thing is off the map
-            thing->bnext = thing->bprev = NULL;
+            thing->blocknum = -1;
         }
     }
+    else
+    {
+        thing->blocknum = -1;
+    }
+
+    // [JN] Link into lists of touched sectors. Like the blockmap,
+    // these only have things which are linked into the blockmap.
+    thing->touching_sectorlist = (thing->flags & MF_NOBLOCKMAP) || !secnodelists ?
+                                 NULL : P_CreateSecNodeList(thing);
 }
 
 
@@ -365,19 +730,19 @@ void P_SetThingPosition (mobj_t *thing)
 
 const boolean P_BlockLinesIterator (const int x, const int y, boolean(*func)(line_t*))
 {
-    int offset;
-    int32_t *list;  // [crispy] BLOCKMAP limit
+    const int32_t *list, *end;
+    int block;
 
     if (x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight)
     {
         return true;
     }
 
-    offset = y*bmapwidth+x;
-    offset = *(blockmap+offset);
-    list = blockmaplump+offset;
+    block = y*bmapwidth+x;
+    list = blocklinelist + blocklinestart[block];
+    end = blocklinelist + blocklinestart[block+1];
 
-    for ( ; *list != -1 ; list++)
+    for ( ; list < end ; list++)
     {
         line_t *ld = &lines[*list];
 
@@ -398,21 +763,88 @@ const boolean P_BlockLinesIterator (const int x, const int y, boolean(*func)(lin
 }
 
 // -----------------------------------------------------------------------------
-// P_BlockThingsIterator
+// P_IterateBucket
+// [JN] Calls func for things of the given block. Things outside of box
+// are skipped without touching them. If dx or dy are set, the block is
+// a neighbour of block (x, y) and only things which overlap into (x, y)
+// from that side are taken.
 // -----------------------------------------------------------------------------
 
-const boolean P_BlockThingsIterator (int x, int y, boolean (*func)(mobj_t*))
+static boolean P_IterateBucket (const int x, const int y, const int dx, const int dy,
+                                const fixed_t *box, boolean (*func)(mobj_t*))
 {
-    mobj_t *mobj;
+    blockbucket_t *bucket = &blockbuckets[(y+dy)*bmapwidth+(x+dx)];
+    boolean result = true;
+    int i;
+
+    bucket->busy++;
+
+    // Newest things first.
+    for (i = bucket->numthings - 1 ; i >= 0 ; i--)
+    {
+        const fixed_t *bbox = bucket->boxes[i];
+        mobj_t *mobj;
+
+        if (box && (bbox[BOXRIGHT] <= box[BOXLEFT] || bbox[BOXLEFT] >= box[BOXRIGHT]
+                ||  bbox[BOXTOP] <= box[BOXBOTTOM] || bbox[BOXBOTTOM] >= box[BOXTOP]))
+        {
+            continue;
+        }
+
+        if ((dx < 0 && (bbox[BOXRIGHT] - bmaporgx)>>MAPBLOCKSHIFT != x)
+        ||  (dx > 0 && (bbox[BOXLEFT] - bmaporgx)>>MAPBLOCKSHIFT != x)
+        ||  (dy < 0 && (bbox[BOXTOP] - bmaporgy)>>MAPBLOCKSHIFT != y)
+        ||  (dy > 0 && (bbox[BOXBOTTOM] - bmaporgy)>>MAPBLOCKSHIFT != y))
+        {
+            continue;
+        }
+
+        if ((mobj = bucket->things[i]) == NULL)
+        {
+            continue;  // removed while iterating
+        }
+
+        if (!func(mobj))
+        {
+            result = false;
+            break;
+        }
+    }
+
+    if (--bucket->busy == 0 && bucket->holes)
+    {
+        P_CompactBucket(bucket);
+    }
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------
+// P_BlockThingsIteratorBox
+// [JN] As P_BlockThingsIterator, but things whose bounding box doesn't
+// overlap box are skipped. Only to be used when func would return true
+// for such things without doing anything else.
+// -----------------------------------------------------------------------------
+
+// Neighbour blocks, in order of the blockmap bug fix by Terry Hearst.
+static const int neighbours[8][2] = {
+    {-1, -1}, {0, -1}, {1, -1}, {1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}
+};
+
+const boolean P_BlockThingsIteratorBox (const int x, const int y, const fixed_t *box,
+                                        boolean (*func)(mobj_t*))
+{
+    int i;
 
     if (x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight)
     {
         return true;
     }
 
-    for (mobj = blocklinks[y*bmapwidth+x] ; mobj ; mobj = mobj->bnext)
-        if (!func(mobj))
-            return false;
+    if (!P_IterateBucket(x, y, 0, 0, box, func))
+    {
+        return false;
+    }
 
     // [JN] Do not apply following BLOCKMAP fix for explosion radius damage.
     // Otherwise, explosion damage will be multiplied on ammount of BLOCKMAP 
@@ -428,99 +860,71 @@ const boolean P_BlockThingsIterator (int x, int y, boolean (*func)(mobj_t*))
     // Fixes: http://doom2.net/doom2/research/things.html
     if (singleplayer && improved_collision && !strict_mode && !vanillaparm)
     {
-        // Unwrapped for least number of bounding box checks
-        // (-1, -1)
-        if (x > 0 && y > 0)
-        {
-            for (mobj = blocklinks[(y-1)*bmapwidth+(x-1)] ; mobj ; mobj = mobj->bnext)
-            {
-                int xx = (mobj->x + mobj->radius - bmaporgx)>>MAPBLOCKSHIFT;
-                int yy = (mobj->y + mobj->radius - bmaporgy)>>MAPBLOCKSHIFT;
-                if (xx == x && yy == y)
-                    if (!func( mobj ))
-                        return false;
-            }
-        }
-        // (0, -1)
-        if (y > 0)
+        for (i = 0 ; i < 8 ; i++)
         {
-            for (mobj = blocklinks[(y-1)*bmapwidth+x] ; mobj ; mobj = mobj->bnext)
-            {
-                int yy = (mobj->y + mobj->radius - bmaporgy)>>MAPBLOCKSHIFT;
-                if (yy == y)
-                    if (!func( mobj ))
-                        return false;
-            }
-        }
-        // (1, -1)
-        if (x < (bmapwidth-1) && y > 0)
-        {
-            for (mobj = blocklinks[(y-1)*bmapwidth+(x+1)] ; mobj ; mobj = mobj->bnext)
-            {
-                int xx = (mobj->x - mobj->radius - bmaporgx)>>MAPBLOCKSHIFT;
-                int yy = (mobj->y + mobj->radius - bmaporgy)>>MAPBLOCKSHIFT;
-                if (xx == x && yy == y)
-                    if (!func( mobj ))
-                        return false;
-            }
-        }
-        // (1, 0)
-        if (x < (bmapwidth-1))
-        {
-            for (mobj = blocklinks[y*bmapwidth+(x+1)] ; mobj ; mobj = mobj->bnext)
-            {
-                int xx = (mobj->x - mobj->radius - bmaporgx)>>MAPBLOCKSHIFT;
-                if (xx == x)
-                    if (!func( mobj ))
-                        return false;
-            }
-        }
-        // (1, 1)
-        if (x < (bmapwidth-1) && y < (bmapheight-1))
-        {
-            for (mobj = blocklinks[(y+1)*bmapwidth+(x+1)] ; mobj ; mobj = mobj->bnext)
+            const int nx = x + neighbours[i][0];
+            const int ny = y + neighbours[i][1];
+
+            if (nx < 0 || ny < 0 || nx >= bmapwidth || ny >= bmapheight)
             {
-                int xx = (mobj->x - mobj->radius - bmaporgx)>>MAPBLOCKSHIFT;
-                int yy = (mobj->y - mobj->radius - bmaporgy)>>MAPBLOCKSHIFT;
-                if (xx == x && yy == y)
-                    if (!func( mobj ))
-                        return false;
+                continue;
             }
-        }
-        // (0, 1)
-        if (y < (bmapheight-1))
-        {
-            for (mobj = blocklinks[(y+1)*bmapwidth+x] ; mobj ; mobj = mobj->bnext)
+
+            if (!P_IterateBucket(x, y, neighbours[i][0], neighbours[i][1], box, func))
             {
-                int yy = (mobj->y - mobj->radius - bmaporgy)>>MAPBLOCKSHIFT;
-                if (yy == y)
-                    if (!func( mobj ))
-                        return false;
+                return false;
             }
         }
-        // (-1, 1)
-        if (x > 0 && y < (bmapheight-1))
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// P_BlockThingsIterator
+// -----------------------------------------------------------------------------
+
+const boolean P_BlockThingsIterator (const int x, const int y, boolean (*func)(mobj_t*))
+{
+    return P_BlockThingsIteratorBox(x, y, NULL, func);
+}
+
+// -----------------------------------------------------------------------------
+// P_SectorThingsIterator
+// [JN] killough 4/4/98: calls func for every thing touching the sector.
+// Since func may spawn, move and remove things, the list is scanned again
+// from the beginning whenever it is changed, skipping processed things.
+// -----------------------------------------------------------------------------
+
+const boolean P_SectorThingsIterator (sector_t *sector, boolean (*func)(mobj_t*))
+{
+    msecnode_t *node;
+
+    for (node = sector->touching_thinglist ; node ; node = node->m_snext)
+    {
+        node->visited = false;
+    }
+
+    node = sector->touching_thinglist;
+
+    while (node)
+    {
+        const unsigned int changes = secnodechanges;
+
+        if (node->visited)
         {
-            for (mobj = blocklinks[(y+1)*bmapwidth+(x-1)] ; mobj ; mobj = mobj->bnext)
-            {
-                int xx = (mobj->x + mobj->radius - bmaporgx)>>MAPBLOCKSHIFT;
-                int yy = (mobj->y - mobj->radius - bmaporgy)>>MAPBLOCKSHIFT;
-                if (xx == x && yy == y)
-                    if (!func( mobj ))
-                        return false;
-            }
+            node = node->m_snext;
+            continue;
         }
-        // (-1, 0)
-        if (x > 0)
+
+        node->visited = true;
+
+        if (!func(node->m_thing))
         {
-            for (mobj = blocklinks[y*bmapwidth+(x-1)] ; mobj ; mobj = mobj->bnext)
-            {
-                int xx = (mobj->x + mobj->radius - bmaporgx)>>MAPBLOCKSHIFT;
-                if (xx == x)
-                    if (!func( mobj ))
-                        return false;
-            }
+            return false;
         }
+
+        node = changes == secnodechanges ? node->m_snext : sector->touching_thinglist;
     }
 
     return true;
@@ -559,32 +963,85 @@ static void check_intercept (void)
 }
 
 // -----------------------------------------------------------------------------
-// PIT_AddLineIntercepts.
-// Looks for lines in the given block that intercept the given trace to
-// add to the intercepts list.
+// P_StoreIntercept
+// [JN] Adds an intercept to the list. In vanilla compatible mode, overruns
+// of the original array are emulated. Otherwise the list simply grows.
+// -----------------------------------------------------------------------------
+
+static void P_StoreIntercept (const fixed_t frac, line_t *line, mobj_t *thing)
+{
+    check_intercept(); // [crispy] remove INTERCEPTS limit
+    intercept_p->frac = frac;
+    intercept_p->isaline = line != NULL;
+
+    if (line)
+    {
+        intercept_p->d.line = line;
+    }
+    else
+    {
+        intercept_p->d.thing = thing;
+    }
+
+    if (!singleplayer || strict_mode || vanillaparm)
+    {
+        InterceptsOverrun(intercept_p - intercepts, intercept_p);
+
+        if (intercept_p - intercepts == MAXINTERCEPTS_ORIGINAL + 1)
+        {
+            // [crispy] print a warning
+            printf(english_language ?
+                    "PIT_AddThingIntercepts: Triggered INTERCEPTS overflow!\n" :
+                    "PIT_AddThingIntercepts: произошло переполнение INTERCEPTS!\n");
+        }
+    }
+
+    intercept_p++;
+}
+
+// -----------------------------------------------------------------------------
+// P_PointOnLineGeomSide
+// [JN] Same as P_PointOnLineSide, for a line given by its first vertex
+// and deltas.
+// -----------------------------------------------------------------------------
+
+static int P_PointOnLineGeomSide (const fixed_t x, const fixed_t y, const divline_t *dl)
+{
+    return
+    !dl->dx ? x <= dl->x ? dl->dy > 0 : dl->dy < 0 :
+    !dl->dy ? y <= dl->y ? dl->dx < 0 : dl->dx > 0 :
+    FixedMul(y-dl->y, dl->dx>>FRACBITS) >=
+    FixedMul(dl->dy>>FRACBITS, x-dl->x);
+}
+
+// -----------------------------------------------------------------------------
+// P_AddLineIntercept
+// Adds line ld if it intercepts the trace. dl is the line, v2x and v2y are
+// its second vertex.
 //
 // A line is crossed if its endpoints are on opposite sides of the trace.
-// Returns true if earlyout and a solid line hit.
+// Returns false if earlyout and a solid line hit.
 // -----------------------------------------------------------------------------
 
-static boolean PIT_AddLineIntercepts (line_t *ld)
+static boolean P_AddLineIntercept (line_t *ld, const divline_t *dl,
+                                   const fixed_t v2x, const fixed_t v2y,
+                                   const boolean twosided)
 {
     int        s1;
     int        s2;
     fixed_t    frac;
-    divline_t  dl;
 
     // avoid precision problems with two routines
     if (trace.dx >  FRACUNIT*16 || trace.dy >  FRACUNIT*16
     ||  trace.dx < -FRACUNIT*16 || trace.dy < -FRACUNIT*16)
     {
-        s1 = P_PointOnDivlineSide (ld->v1->x, ld->v1->y, &trace);
-        s2 = P_PointOnDivlineSide (ld->v2->x, ld->v2->y, &trace);
+        s1 = P_PointOnDivlineSide (dl->x, dl->y, &trace);
+        s2 = P_PointOnDivlineSide (v2x, v2y, &trace);
     }
     else
     {
-        s1 = P_PointOnLineSide (trace.x, trace.y, ld);
-        s2 = P_PointOnLineSide (trace.x+trace.dx, trace.y+trace.dy, ld);
+        s1 = P_PointOnLineGeomSide (trace.x, trace.y, dl);
+        s2 = P_PointOnLineGeomSide (trace.x+trace.dx, trace.y+trace.dy, dl);
     }
 
     if (s1 == s2)
@@ -593,8 +1050,7 @@ static boolean PIT_AddLineIntercepts (line_t *ld)
     }
 
     // hit the line
-    P_MakeDivline (ld, &dl);
-    frac = P_InterceptVector (&trace, &dl);
+    frac = P_InterceptVector (&trace, dl);
 
     if (frac < 0)
     {
@@ -602,44 +1058,39 @@ static boolean PIT_AddLineIntercepts (line_t *ld)
     }
 
     // try to early out the check
-    if (earlyout && frac < FRACUNIT && !ld->backsector)
+    if (earlyout && frac < FRACUNIT && !twosided)
     {
         return false;  // stop checking
     }
 
-    check_intercept(); // [crispy] remove INTERCEPTS limit
-    intercept_p->frac = frac;
-    intercept_p->isaline = true;
-    intercept_p->d.line = ld;
-    InterceptsOverrun(intercept_p - intercepts, intercept_p);
-    // [crispy] & [JN] Intercepts overflow guard.
-    if (intercept_p - intercepts == MAXINTERCEPTS_ORIGINAL + 1)
-    {
-        if (singleplayer && !strict_mode && !vanillaparm)
-        {
-            // [JN] Do not trigger overflow.
-            return false;
-        }
-        else
-        {
-            // [crispy] print a warning
-            printf(english_language ?
-                    "PIT_AddThingIntercepts: Triggered INTERCEPTS overflow!\n" :
-                    "PIT_AddThingIntercepts: произошло переполнение INTERCEPTS!\n");
-        }
-    }
-    intercept_p++;
+    P_StoreIntercept(frac, ld, NULL);
 
     return true;  // continue
 }
 
 // -----------------------------------------------------------------------------
-// PIT_AddThingIntercepts
+// PIT_AddLineIntercepts.
+// Looks for lines in the given block that intercept the given trace to
+// add to the intercepts list.
+// -----------------------------------------------------------------------------
+
+static boolean PIT_AddLineIntercepts (line_t *ld)
+{
+    divline_t  dl;
+
+    P_MakeDivline (ld, &dl);
+
+    return P_AddLineIntercept(ld, &dl, ld->v2->x, ld->v2->y, ld->backsector != NULL);
+}
+
+// -----------------------------------------------------------------------------
+// P_AddThingIntercept
 //
 // [JN] killough 5/3/98: reformatted, cleaned up
 // -----------------------------------------------------------------------------
 
-static boolean PIT_AddThingIntercepts (mobj_t *thing)
+static void P_AddThingIntercept (mobj_t *thing, const fixed_t x, const fixed_t y,
+                                 const fixed_t radius)
 {
     fixed_t    x1, y1;
     fixed_t    x2, y2;
@@ -650,17 +1101,17 @@ static boolean PIT_AddThingIntercepts (mobj_t *thing)
     // check a corner to corner crossection for hit
     if ((trace.dx ^ trace.dy) > 0)
     {
-        x1 = thing->x - thing->radius;
-        y1 = thing->y + thing->radius;
-        x2 = thing->x + thing->radius;
-        y2 = thing->y - thing->radius;
+        x1 = x - radius;
+        y1 = y + radius;
+        x2 = x + radius;
+        y2 = y - radius;
     }
     else
     {
-        x1 = thing->x - thing->radius;
-        y1 = thing->y - thing->radius;
-        x2 = thing->x + thing->radius;
-        y2 = thing->y + thing->radius;
+        x1 = x - radius;
+        y1 = y - radius;
+        x2 = x + radius;
+        y2 = y + radius;
     }
 
     s1 = P_PointOnDivlineSide (x1, y1, &trace);
@@ -668,7 +1119,7 @@ static boolean PIT_AddThingIntercepts (mobj_t *thing)
 
     if (s1 == s2)
     {
-        return true;  // line isn't crossed
+        return;  // line isn't crossed
     }
 
     dl.x = x1;
@@ -680,34 +1131,267 @@ static boolean PIT_AddThingIntercepts (mobj_t *thing)
 
     if (frac < 0)
     {
-        return true;  // behind source
+        return;  // behind source
     }
 
-    check_intercept(); // [crispy] remove INTERCEPTS limit
-    intercept_p->frac = frac;
-    intercept_p->isaline = false;
-    intercept_p->d.thing = thing;
-    InterceptsOverrun(intercept_p - intercepts, intercept_p);
-    // [crispy] & [JN] Intercepts overflow guard.
-    if (intercept_p - intercepts == MAXINTERCEPTS_ORIGINAL + 1)
+    P_StoreIntercept(frac, NULL, thing);
+}
+
+// -----------------------------------------------------------------------------
+// PIT_AddThingIntercepts
+// -----------------------------------------------------------------------------
+
+static boolean PIT_AddThingIntercepts (mobj_t *thing)
+{
+    P_AddThingIntercept(thing, thing->x, thing->y, thing->radius);
+
+    return true;  // keep going
+}
+
+// =============================================================================
+//
+// HITSCAN BATCHES
+// [JN] Shotguns fire several pellets in a row, each of them walking mostly
+// the same mapblocks. Within a batch, lines and things of every visited
+// block are gathered once, together with the geometry needed for
+// intercepts, and reused by the following traces. Every trace still
+// walks its own blocks in the same order and gets the very same
+// intercepts, so results and RNG calls don't change. Things are gathered
+// again once anything in the blockmap moved, was spawned or removed.
+//
+// =============================================================================
+
+#define BATCHHASHSIZE 4096  // power of two
+#define MAXBATCHBLOCKS (BATCHHASHSIZE/2)
+
+typedef struct
+{
+    line_t    *line;
+    divline_t  dl;
+    fixed_t    v2x, v2y;
+    boolean    twosided;
+} batchline_t;
+
+typedef struct
+{
+    mobj_t  *thing;
+    fixed_t  x, y, radius;
+} batchthing_t;
+
+typedef struct
+{
+    int          block;
+    int          firstline, numlines;
+    int          firstthing, numthings;
+    unsigned int thingchanges;
+} batchblock_t;
+
+static int           hitscanbatch;  // nesting depth
+static short         batchhash[BATCHHASHSIZE];  // index+1 into batchblocks
+static batchblock_t  batchblocks[MAXBATCHBLOCKS];
+static int           numbatchblocks;
+static batchline_t  *batchlines;
+static int           numbatchlines, maxbatchlines;
+static batchthing_t *batchthings;
+static int           numbatchthings, maxbatchthings;
+
+// -----------------------------------------------------------------------------
+// P_BeginHitscanBatch
+// -----------------------------------------------------------------------------
+
+void P_BeginHitscanBatch (void)
+{
+    hitscanbatch++;
+}
+
+// -----------------------------------------------------------------------------
+// P_EndHitscanBatch
+// -----------------------------------------------------------------------------
+
+void P_EndHitscanBatch (void)
+{
+    int i;
+
+    if (--hitscanbatch > 0)
+    {
+        return;
+    }
+
+    for (i = 0 ; i < numbatchblocks ; i++)
+    {
+        unsigned int h = batchblocks[i].block & (BATCHHASHSIZE-1);
+
+        while (batchhash[h])
+        {
+            batchhash[h] = 0;
+            h = (h + 1) & (BATCHHASHSIZE-1);
+        }
+    }
+
+    numbatchblocks = 0;
+    numbatchlines = 0;
+    numbatchthings = 0;
+}
+
+// -----------------------------------------------------------------------------
+// PIT_GatherBatchThing
+// -----------------------------------------------------------------------------
+
+static boolean PIT_GatherBatchThing (mobj_t *thing)
+{
+    batchthing_t *bt;
+
+    if (numbatchthings == maxbatchthings)
+    {
+        maxbatchthings = maxbatchthings ? maxbatchthings * 2 : 256;
+        batchthings = I_Realloc(batchthings, maxbatchthings * sizeof(*batchthings));
+    }
+
+    bt = &batchthings[numbatchthings++];
+    bt->thing = thing;
+    bt->x = thing->x;
+    bt->y = thing->y;
+    bt->radius = thing->radius;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// P_GatherBatchBlock
+// Returns gathered lines and things of the given block,
+// or NULL if the batch is full.
+// -----------------------------------------------------------------------------
+
+static batchblock_t *P_GatherBatchBlock (const int block, const int x, const int y)
+{
+    unsigned int h = block & (BATCHHASHSIZE-1);
+    batchblock_t *bb;
+    int i;
+
+    while (batchhash[h])
     {
-        if (singleplayer && !strict_mode && !vanillaparm)
+        bb = &batchblocks[batchhash[h] - 1];
+
+        if (bb->block == block)
+        {
+            if (bb->thingchanges != blockthingchanges)
+            {
+                bb->firstthing = numbatchthings;
+                P_BlockThingsIterator(x, y, PIT_GatherBatchThing);
+                bb->numthings = numbatchthings - bb->firstthing;
+                bb->thingchanges = blockthingchanges;
+            }
+
+            return bb;
+        }
+
+        h = (h + 1) & (BATCHHASHSIZE-1);
+    }
+
+    if (numbatchblocks == MAXBATCHBLOCKS)
+    {
+        return NULL;
+    }
+
+    bb = &batchblocks[numbatchblocks++];
+    batchhash[h] = numbatchblocks;
+    bb->block = block;
+
+    // Lines, including the ones already seen in other blocks.
+    bb->firstline = numbatchlines;
+
+    for (i = blocklinestart[block] ; i < blocklinestart[block+1] ; i++)
+    {
+        line_t *ld = &lines[blocklinelist[i]];
+        batchline_t *bl;
+
+        if (numbatchlines == maxbatchlines)
+        {
+            maxbatchlines = maxbatchlines ? maxbatchlines * 2 : 1024;
+            batchlines = I_Realloc(batchlines, maxbatchlines * sizeof(*batchlines));
+        }
+
+        bl = &batchlines[numbatchlines++];
+        bl->line = ld;
+        P_MakeDivline(ld, &bl->dl);
+        bl->v2x = ld->v2->x;
+        bl->v2y = ld->v2->y;
+        bl->twosided = ld->backsector != NULL;
+    }
+
+    bb->numlines = numbatchlines - bb->firstline;
+
+    bb->firstthing = numbatchthings;
+    P_BlockThingsIterator(x, y, PIT_GatherBatchThing);
+    bb->numthings = numbatchthings - bb->firstthing;
+    bb->thingchanges = blockthingchanges;
+
+    return bb;
+}
+
+// -----------------------------------------------------------------------------
+// P_AddBatchIntercepts
+// Does the same as P_BlockLinesIterator and P_BlockThingsIterator with
+// PIT_AddLineIntercepts and PIT_AddThingIntercepts.
+// -----------------------------------------------------------------------------
+
+static boolean P_AddBatchIntercepts (const int x, const int y, const int flags)
+{
+    const batchblock_t *bb;
+    int i;
+
+    if (x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight)
+    {
+        return true;
+    }
+
+    bb = P_GatherBatchBlock(y*bmapwidth+x, x, y);
+
+    if (!bb)
+    {
+        // Batch is full, do it the usual way.
+        if ((flags & PT_ADDLINES) && !P_BlockLinesIterator(x, y, PIT_AddLineIntercepts))
         {
-            // [JN] Do not trigger overflow.
             return false;
         }
-        else
+        if (flags & PT_ADDTHINGS)
         {
-            // [crispy] print a warning
-            printf(english_language ?
-                    "PIT_AddThingIntercepts: Triggered INTERCEPTS overflow!\n" :
-                    "PIT_AddThingIntercepts: произошло переполнение INTERCEPTS!\n");
+            P_BlockThingsIterator(x, y, PIT_AddThingIntercepts);
         }
+        return true;
     }
 
-    intercept_p++;
+    if (flags & PT_ADDLINES)
+    {
+        const batchline_t *bl = &batchlines[bb->firstline];
 
-    return true;  // keep going
+        for (i = 0 ; i < bb->numlines ; i++, bl++)
+        {
+            if (bl->line->validcount == validcount)
+            {
+                continue;  // line has already been checked
+            }
+
+            bl->line->validcount = validcount;
+
+            if (!P_AddLineIntercept(bl->line, &bl->dl, bl->v2x, bl->v2y, bl->twosided))
+            {
+                return false;
+            }
+        }
+    }
+
+    if (flags & PT_ADDTHINGS)
+    {
+        const batchthing_t *bt = &batchthings[bb->firstthing];
+
+        for (i = 0 ; i < bb->numthings ; i++, bt++)
+        {
+            P_AddThingIntercept(bt->thing, bt->x, bt->y, bt->radius);
+        }
+    }
+
+    return true;
 }
 
 // -----------------------------------------------------------------------------
@@ -975,16 +1659,23 @@ boolean P_PathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
 
     for (count = 0 ; count < 64 ; count++)
     {
-        if (flags & PT_ADDLINES)
+        if (hitscanbatch)
         {
-            if (!P_BlockLinesIterator (mapx, mapy,PIT_AddLineIntercepts))
+            if (!P_AddBatchIntercepts (mapx, mapy, flags))
             return false;	// early out
         }
-
-        if (flags & PT_ADDTHINGS)
+        else
         {
-            if (!P_BlockThingsIterator (mapx, mapy,PIT_AddThingIntercepts))
-            return false;	// early out
+            if (flags & PT_ADDLINES)
+            {
+                if (!P_BlockLinesIterator (mapx, mapy,PIT_AddLineIntercepts))
+                return false;	// early out
+            }
+
+            if (flags & PT_ADDTHINGS)
+            {
+                P_BlockThingsIterator (mapx, mapy,PIT_AddThingIntercepts);
+            }
         }
 
         if (mapx == xt2 && mapy == yt2)
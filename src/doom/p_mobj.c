@@ -804,7 +804,7 @@ static mobj_t *P_SpawnMobjSafe (const fixed_t x, const fixed_t y, const fixed_t
     state_t    *st;
     mobjinfo_t *info;
 
-    mobj = Z_Malloc (sizeof(*mobj), PU_LEVEL, NULL);
+    mobj = P_AllocThinker (sizeof(*mobj));
     memset (mobj, 0, sizeof (*mobj));
     info = &mobjinfo[type];
 
@@ -882,6 +882,7 @@ static mobj_t *P_SpawnMobjSafe (const fixed_t x, const fixed_t y, const fixed_t
     mobj->thinker.function.acp1 = (actionf_p1)P_MobjThinker;
 
     P_AddThinker (&mobj->thinker);
+    P_LinkBrightmapMobj(mobj);
 
     return mobj;
 }
@@ -900,7 +901,7 @@ mobj_t *P_SpawnMobj (const fixed_t x, const fixed_t y,
 // P_RemoveMobj
 // -----------------------------------------------------------------------------
 
-void P_RemoveMobj (const mobj_t *mobj)
+void P_RemoveMobj (mobj_t *mobj)
 {
     if ((mobj->flags & MF_SPECIAL) && !(mobj->flags & MF_DROPPED)
     && (mobj->type != MT_INV) && (mobj->type != MT_INS))
@@ -922,6 +923,9 @@ void P_RemoveMobj (const mobj_t *mobj)
     // stop any playing sound
     S_StopSound (mobj);
 
+    // [JN] Stop brightmap animation.
+    P_UnlinkBrightmapMobj(mobj);
+
     // free block
     P_RemoveThinker ((thinker_t*)mobj);
 }
@@ -1366,6 +1370,7 @@ void P_CheckMissileSpawn (mobj_t *th)
     th->x += (th->momx>>1);
     th->y += (th->momy>>1);
     th->z += (th->momz>>1);
+    P_UpdateThingBox(th);
 
     if (!P_TryMove (th, th->x, th->y))
     {
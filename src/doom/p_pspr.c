@@ -763,12 +763,15 @@ void A_FireShotgun (mobj_t *mobj, player_t *player, pspdef_t *psp)
     P_SetMobjState (player->mo, S_PLAY_ATK2);
     DecreaseAmmo(player, weaponinfo[player->readyweapon].ammo, 1);
     P_SetPsprite (player, ps_flash, weaponinfo[player->readyweapon].flashstate);
+    P_BeginHitscanBatch();
     P_BulletSlope (player->mo);
 
     for (int i = 0 ; i < 7 ; i++)
     {
         P_GunShot (player->mo, false);
     }
+
+    P_EndHitscanBatch();
 }
 
 // -----------------------------------------------------------------------------
@@ -789,6 +792,7 @@ void A_FireShotgun2 (mobj_t *mobj, player_t *player, pspdef_t *psp)
     P_SetMobjState (player->mo, S_PLAY_ATK2);
     DecreaseAmmo(player, weaponinfo[player->readyweapon].ammo, 2);
     P_SetPsprite (player, ps_flash, weaponinfo[player->readyweapon].flashstate);
+    P_BeginHitscanBatch();
     P_BulletSlope (player->mo);
 
     for (int i = 0 ; i < 20 ; i++)
@@ -799,6 +803,8 @@ void A_FireShotgun2 (mobj_t *mobj, player_t *player, pspdef_t *psp)
         P_LineAttack (player->mo, angle, MISSILERANGE, 
                       bulletslope + (P_SubRandom() << 5), damage);
     }
+
+    P_EndHitscanBatch();
 }
 
 // -----------------------------------------------------------------------------
@@ -0,0 +1,740 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	REJECT matrix builder for maps with an empty REJECT lump.
+//
+//	Sight between two sectors is only possible through a chain of
+//	two-sided lines ("portals"). Each sector floods through the portal
+//	graph, clipping every next portal to the area which can be seen
+//	through the first and the last crossed portal. Clipping is
+//	conservative: a pair of sectors is rejected only if no straight
+//	line can connect them, whatever the sector heights are.
+//
+//	The flood is memoized per entry portal: a portal is crossed again
+//	only if it is seen through a part of it which was not crossed yet,
+//	and after a few of such widenings it is crossed as a whole. So every
+//	portal is crossed a bounded number of times from each first portal.
+//
+
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i_system.h"
+#include "i_thread.h"
+#include "m_config.h"
+#include "m_misc.h"
+#include "p_local.h"
+#include "sha1.h"
+#include "z_zone.h"
+#include "jn.h"
+
+
+// Bump when the builder starts producing different matrices.
+#define REJECTVERSION 2
+
+// Cache file is the matrix followed by the number of fallen back rows.
+#define CACHEEXTRA 4
+
+// Tolerance in map units. P_CheckSight rounds coordinates to whole
+// map units, so portals are widened and clip planes loosened by it.
+#define EPS 2.0
+
+// Number of times a portal may be widened before it is crossed
+// as a whole, and limit of portal crossings of a single sector flood.
+// When the latter is exceeded, sector is considered to see every
+// other sector.
+#define MAXWIDEN 4
+#define MAXSTEPS 1000000
+
+typedef struct
+{
+    double x1, y1, x2, y2;
+} seg2_t;
+
+typedef struct
+{
+    seg2_t seg;
+    double nx, ny, d;   // Points with nx*x + ny*y > d are beyond the portal.
+    int    to;
+    int    line;
+} portal_t;
+
+// Part of the portal which is already crossed, as fractions of its seg.
+
+typedef struct
+{
+    double lo, hi;
+    int    stamp;       // Crossed in the flood with this stamp.
+    int    widened;
+} crossed_t;
+
+typedef struct
+{
+    int    portal;
+    seg2_t pass;
+} step_t;
+
+typedef struct
+{
+    byte      *visible;
+    crossed_t *crossed;
+    int        stamp;
+    step_t    *stack;
+    int        numstack, maxstack;
+    int        steps;
+    boolean    giveup;
+} flood_t;
+
+int build_reject = 0;
+
+// Generated REJECT, merged with the original one.
+byte *rejectbuilt;
+
+static portal_t *portals;
+static int      *firstportal;
+static byte     *leaky;
+static byte     *fallback;  // Rows which fell back to all-visible.
+
+
+// -----------------------------------------------------------------------------
+// Geometry helpers
+// -----------------------------------------------------------------------------
+
+// Keep the part of segment where nx*x + ny*y >= d - EPS.
+// Returns false if nothing is left.
+
+static boolean ClipSeg (seg2_t *s, const double nx, const double ny, const double d)
+{
+    const double d1 = nx * s->x1 + ny * s->y1 - d + EPS;
+    const double d2 = nx * s->x2 + ny * s->y2 - d + EPS;
+
+    if (d1 < 0 && d2 < 0)
+    {
+        return false;
+    }
+
+    if (d1 < 0)
+    {
+        const double t = d1 / (d1 - d2);
+        s->x1 += (s->x2 - s->x1) * t;
+        s->y1 += (s->y2 - s->y1) * t;
+    }
+    else if (d2 < 0)
+    {
+        const double t = d2 / (d2 - d1);
+        s->x2 += (s->x1 - s->x2) * t;
+        s->y2 += (s->y1 - s->y2) * t;
+    }
+
+    return true;
+}
+
+// Clip segment t to the side of line (ax,ay)-(bx,by) where point (px,py)
+// lies, if the line separates source and pass portals: the other end of
+// the source is on one side of it, and the other end of the pass portal
+// is on the other side.
+
+static boolean ClipSeparator (seg2_t *t,
+                              const double ax, const double ay,
+                              const double bx, const double by,
+                              const double ox, const double oy,
+                              const double px, const double py)
+{
+    const double len = sqrt((bx - ax) * (bx - ax) + (by - ay) * (by - ay));
+    double nx, ny, d, so, sp;
+
+    if (len < EPS)
+    {
+        return true;
+    }
+
+    nx = (ay - by) / len;
+    ny = (bx - ax) / len;
+    d = nx * ax + ny * ay;
+    so = nx * ox + ny * oy - d;
+    sp = nx * px + ny * py - d;
+
+    // Not a separating line, or too close to tell.
+    if (fabs(so) < EPS || fabs(sp) < EPS || (so > 0) == (sp > 0))
+    {
+        return true;
+    }
+
+    if (sp < 0)
+    {
+        nx = -nx;
+        ny = -ny;
+        d = -d;
+    }
+
+    return ClipSeg(t, nx, ny, d);
+}
+
+// Keep the part of t which can be seen from src through pass.
+
+static boolean ClipWedge (seg2_t *t, const seg2_t *src, const seg2_t *pass)
+{
+    const double s[2][2] = { { src->x1, src->y1 }, { src->x2, src->y2 } };
+    const double p[2][2] = { { pass->x1, pass->y1 }, { pass->x2, pass->y2 } };
+
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        for (int j = 0 ; j < 2 ; j++)
+        {
+            if (!ClipSeparator(t, s[i][0], s[i][1], p[j][0], p[j][1],
+                               s[i^1][0], s[i^1][1], p[j^1][0], p[j^1][1]))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Portal flood
+// -----------------------------------------------------------------------------
+
+// Queue crossing of the portal through its part pass, unless this part
+// is crossed already. Otherwise crossed part is widened to cover pass,
+// or to the whole portal once it was widened too many times.
+
+static void CrossPortal (flood_t *f, const int portalnum, const seg2_t *pass)
+{
+    const seg2_t *seg = &portals[portalnum].seg;
+    crossed_t *c = &f->crossed[portalnum];
+    const double dx = seg->x2 - seg->x1;
+    const double dy = seg->y2 - seg->y1;
+    const double len2 = dx * dx + dy * dy;
+    double u1 = 0, u2 = 1, lo, hi;
+    step_t *step;
+
+    if (len2 > 0)
+    {
+        u1 = ((pass->x1 - seg->x1) * dx + (pass->y1 - seg->y1) * dy) / len2;
+        u2 = ((pass->x2 - seg->x1) * dx + (pass->y2 - seg->y1) * dy) / len2;
+    }
+
+    lo = MIN(u1, u2);
+    hi = MAX(u1, u2);
+
+    if (c->stamp == f->stamp)
+    {
+        if (lo >= c->lo && hi <= c->hi)
+        {
+            return;
+        }
+
+        lo = MIN(lo, c->lo);
+        hi = MAX(hi, c->hi);
+
+        if (++c->widened > MAXWIDEN)
+        {
+            lo = MIN(lo, 0);
+            hi = MAX(hi, 1);
+        }
+    }
+    else
+    {
+        c->stamp = f->stamp;
+        c->widened = 0;
+    }
+
+    c->lo = lo;
+    c->hi = hi;
+
+    if (f->numstack == f->maxstack)
+    {
+        f->maxstack = f->maxstack ? f->maxstack * 2 : 1024;
+        f->stack = I_Realloc(f->stack, f->maxstack * sizeof(*f->stack));
+    }
+
+    step = &f->stack[f->numstack++];
+    step->portal = portalnum;
+    step->pass.x1 = seg->x1 + dx * lo;
+    step->pass.y1 = seg->y1 + dy * lo;
+    step->pass.x2 = seg->x1 + dx * hi;
+    step->pass.y2 = seg->y1 + dy * hi;
+}
+
+// Flood through the portals beyond the first crossed portal src.
+// Only the first and the last crossed portals matter for clipping,
+// so whatever is found through a part of a portal is found through
+// any wider part of it as well.
+
+static void FloodPortal (flood_t *f, const int sector, const portal_t *src)
+{
+    f->stamp++;
+    f->numstack = 0;
+    CrossPortal(f, src - portals, &src->seg);
+
+    while (f->numstack > 0 && !f->giveup)
+    {
+        const step_t step = f->stack[--f->numstack];
+        const portal_t *passportal = &portals[step.portal];
+        const int to = passportal->to;
+
+        if (++f->steps > MAXSTEPS || leaky[to])
+        {
+            f->giveup = true;
+            break;
+        }
+
+        for (int i = firstportal[to] ; i < firstportal[to + 1] ; i++)
+        {
+            const portal_t *portal = &portals[i];
+            seg2_t t = portal->seg;
+
+            // Sight doesn't come back into the source sector,
+            // nor straight back through the same line.
+            if (portal->to == sector || portal->line == passportal->line)
+            {
+                continue;
+            }
+
+            // Sight line goes on beyond the first and the last crossed
+            // portal, and through both of them.
+            if (!ClipSeg(&t, passportal->nx, passportal->ny, passportal->d)
+            ||  !ClipSeg(&t, src->nx, src->ny, src->d)
+            ||  !ClipWedge(&t, &src->seg, &step.pass))
+            {
+                continue;
+            }
+
+            f->visible[portal->to] = 1;
+            CrossPortal(f, i, &t);
+        }
+    }
+}
+
+// Find sectors which can be seen from the given one.
+
+static void FloodFrom (flood_t *f, const int sector)
+{
+    memset(f->visible, 0, numsectors);
+    f->steps = 0;
+    f->giveup = leaky[sector];
+    f->visible[sector] = 1;
+
+    for (int i = firstportal[sector] ; i < firstportal[sector + 1] && !f->giveup ; i++)
+    {
+        f->visible[portals[i].to] = 1;
+        FloodPortal(f, sector, &portals[i]);
+    }
+
+    if (f->giveup)
+    {
+        memset(f->visible, 1, numsectors);
+        fallback[sector] = 1;
+    }
+}
+
+// Build rows of eight sectors each, so every job writes whole bytes.
+
+static void BuildRows (int start, int end, void *data)
+{
+    const int n = numsectors;
+    flood_t f = {0};
+
+    f.visible = I_Realloc(NULL, n);
+    f.crossed = I_Realloc(NULL, firstportal[n] * sizeof(*f.crossed));
+    memset(f.crossed, 0, firstportal[n] * sizeof(*f.crossed));
+
+    for (int s1 = start * 8 ; s1 < end * 8 && s1 < n ; s1++)
+    {
+        FloodFrom(&f, s1);
+
+        for (int s2 = 0 ; s2 < n ; s2++)
+        {
+            const int pnum = s1 * n + s2;
+
+            if (!f.visible[s2] && !leaky[s2])
+            {
+                rejectbuilt[pnum >> 3] |= 1 << (pnum & 7);
+            }
+        }
+    }
+
+    free(f.visible);
+    free(f.crossed);
+    free(f.stack);
+}
+
+// -----------------------------------------------------------------------------
+// Level geometry
+// -----------------------------------------------------------------------------
+
+typedef struct
+{
+    int sector;
+    fixed_t x, y;
+} endpoint_t;
+
+static int CompareEndpoints (const void *a, const void *b)
+{
+    const endpoint_t *e1 = a, *e2 = b;
+
+    if (e1->sector != e2->sector)
+    {
+        return e1->sector < e2->sector ? -1 : 1;
+    }
+    if (e1->x != e2->x)
+    {
+        return e1->x < e2->x ? -1 : 1;
+    }
+    if (e1->y != e2->y)
+    {
+        return e1->y < e2->y ? -1 : 1;
+    }
+
+    return 0;
+}
+
+// A sector can be assumed to have no gaps in its outline if every
+// vertex of its boundary lines is shared by an even number of them.
+// Subsectors which don't lie in a single sector mark their sectors as
+// leaky as well. Leaky sectors are never rejected.
+
+static void FindLeakySectors (void)
+{
+    endpoint_t *ends = Z_Malloc(numlines * 4 * sizeof(*ends), PU_STATIC, NULL);
+    int numends = 0;
+
+    for (int i = 0 ; i < numlines ; i++)
+    {
+        const line_t *line = &lines[i];
+        sector_t *sides[2] = { line->frontsector, line->backsector };
+
+        if (sides[0] == sides[1])
+        {
+            continue;
+        }
+
+        for (int j = 0 ; j < 2 ; j++)
+        {
+            if (sides[j] != NULL)
+            {
+                const int sector = sides[j] - sectors;
+
+                ends[numends].sector = sector;
+                ends[numends].x = line->v1->x;
+                ends[numends++].y = line->v1->y;
+                ends[numends].sector = sector;
+                ends[numends].x = line->v2->x;
+                ends[numends++].y = line->v2->y;
+            }
+        }
+    }
+
+    qsort(ends, numends, sizeof(*ends), CompareEndpoints);
+
+    for (int i = 0 ; i < numends ; )
+    {
+        int j = i + 1;
+
+        while (j < numends && !CompareEndpoints(&ends[i], &ends[j]))
+        {
+            j++;
+        }
+
+        if ((j - i) & 1)
+        {
+            leaky[ends[i].sector] = 1;
+        }
+
+        i = j;
+    }
+
+    Z_Free(ends);
+
+    for (int i = 0 ; i < numsubsectors ; i++)
+    {
+        const subsector_t *sub = &subsectors[i];
+
+        for (int j = 0 ; j < sub->numlines ; j++)
+        {
+            const seg_t *seg = &segs[sub->firstline + j];
+
+            if (seg->frontsector != sub->sector)
+            {
+                leaky[sub->sector - sectors] = 1;
+
+                if (seg->frontsector != NULL)
+                {
+                    leaky[seg->frontsector - sectors] = 1;
+                }
+            }
+        }
+    }
+}
+
+static void AddPortal (portal_t *p, const line_t *line, const sector_t *to, const int dir)
+{
+    const double x1 = line->v1->x / (double) FRACUNIT;
+    const double y1 = line->v1->y / (double) FRACUNIT;
+    const double x2 = line->v2->x / (double) FRACUNIT;
+    const double y2 = line->v2->y / (double) FRACUNIT;
+    const double len = sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
+    const double ux = len > 0 ? (x2 - x1) / len : 0;
+    const double uy = len > 0 ? (y2 - y1) / len : 0;
+
+    // Widened at both ends.
+    p->seg.x1 = x1 - ux * EPS;
+    p->seg.y1 = y1 - uy * EPS;
+    p->seg.x2 = x2 + ux * EPS;
+    p->seg.y2 = y2 + uy * EPS;
+
+    // Front side of a line is on the right of v1 -> v2.
+    // Crossing from front to back goes to the left.
+    p->nx = -uy * dir;
+    p->ny = ux * dir;
+    p->d = p->nx * x1 + p->ny * y1;
+    p->to = to - sectors;
+    p->line = line - lines;
+}
+
+static boolean IsPortal (const line_t *line)
+{
+    return line->backsector != NULL && (line->flags & ML_TWOSIDED)
+        && line->frontsector != line->backsector;
+}
+
+static void BuildPortals (void)
+{
+    int *count = firstportal;
+
+    memset(firstportal, 0, (numsectors + 1) * sizeof(*firstportal));
+
+    for (int i = 0 ; i < numlines ; i++)
+    {
+        if (IsPortal(&lines[i]))
+        {
+            count[lines[i].frontsector - sectors + 1]++;
+            count[lines[i].backsector - sectors + 1]++;
+        }
+    }
+
+    for (int i = 0 ; i < numsectors ; i++)
+    {
+        firstportal[i + 1] += firstportal[i];
+    }
+
+    portals = Z_Malloc(firstportal[numsectors] * sizeof(*portals), PU_STATIC, NULL);
+
+    {
+        int *next = Z_Malloc(numsectors * sizeof(*next), PU_STATIC, NULL);
+
+        memcpy(next, firstportal, numsectors * sizeof(*next));
+
+        for (int i = 0 ; i < numlines ; i++)
+        {
+            const line_t *line = &lines[i];
+
+            if (IsPortal(line))
+            {
+                AddPortal(&portals[next[line->frontsector - sectors]++],
+                          line, line->backsector, 1);
+                AddPortal(&portals[next[line->backsector - sectors]++],
+                          line, line->frontsector, -1);
+            }
+        }
+
+        Z_Free(next);
+    }
+}
+
+// P_DivlineSide multiplies coordinate differences in whole map units.
+// On larger maps this overflows and sight may pass through walls,
+// which the builder can't predict.
+
+static boolean MapTooLarge (void)
+{
+    fixed_t minx = INT_MAX, miny = INT_MAX, maxx = INT_MIN, maxy = INT_MIN;
+
+    for (int i = 0 ; i < numvertexes ; i++)
+    {
+        minx = MIN(minx, vertexes[i].x);
+        miny = MIN(miny, vertexes[i].y);
+        maxx = MAX(maxx, vertexes[i].x);
+        maxy = MAX(maxy, vertexes[i].y);
+    }
+
+    return (double) ((maxx >> FRACBITS) - (minx >> FRACBITS) + 1)
+         * (double) ((maxy >> FRACBITS) - (miny >> FRACBITS) + 1) >= 2147483647.0;
+}
+
+// Hash everything the builder looks at.
+
+static void HashLevel (sha1_digest_t digest)
+{
+    sha1_context_t sha1;
+
+    SHA1_Init(&sha1);
+    SHA1_UpdateInt32(&sha1, REJECTVERSION);
+    SHA1_UpdateInt32(&sha1, numsectors);
+    SHA1_UpdateInt32(&sha1, numlines);
+
+    for (int i = 0 ; i < numlines ; i++)
+    {
+        const line_t *line = &lines[i];
+
+        SHA1_UpdateInt32(&sha1, line->v1->x);
+        SHA1_UpdateInt32(&sha1, line->v1->y);
+        SHA1_UpdateInt32(&sha1, line->v2->x);
+        SHA1_UpdateInt32(&sha1, line->v2->y);
+        SHA1_UpdateInt32(&sha1, line->flags & ML_TWOSIDED);
+        SHA1_UpdateInt32(&sha1, line->frontsector ? line->frontsector - sectors : -1);
+        SHA1_UpdateInt32(&sha1, line->backsector ? line->backsector - sectors : -1);
+    }
+
+    SHA1_Update(&sha1, leaky, numsectors);
+    SHA1_Final(digest, &sha1);
+}
+
+static char *CachePath (const sha1_digest_t digest)
+{
+    char *dir = M_GetCacheDir();
+    char name[2 * sizeof(sha1_digest_t) + 5];
+    char *path;
+
+    for (int i = 0 ; i < sizeof(sha1_digest_t) ; i++)
+    {
+        M_snprintf(name + i * 2, 3, "%02x", digest[i]);
+    }
+
+    M_StringCopy(name + 2 * sizeof(sha1_digest_t), ".rej", 5);
+    path = M_StringJoin(dir, DIR_SEPARATOR_S, name, NULL);
+    free(dir);
+
+    return path;
+}
+
+static boolean ReadCache (const char *path, const int length)
+{
+    FILE *handle = fopen(path, "rb");
+    boolean ok;
+
+    if (handle == NULL)
+    {
+        return false;
+    }
+
+    ok = M_FileLength(handle) == length + CACHEEXTRA
+      && fread(rejectbuilt, 1, length + CACHEEXTRA, handle) == (size_t) length + CACHEEXTRA;
+    fclose(handle);
+
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+// P_BuildReject
+// Generate REJECT for the loaded level, or load it from the cache.
+// -----------------------------------------------------------------------------
+
+void P_BuildReject (void)
+{
+    const int length = (numsectors * numsectors + 7) / 8;
+    const unsigned int starttime = SDL_GetTicks();
+    sha1_digest_t digest;
+    char *path;
+    boolean loaded;
+    int fallbacks = 0;
+
+    rejectbuilt = NULL;
+
+    if (MapTooLarge())
+    {
+        printf(english_language ?
+               "P_BuildReject: map is too large, REJECT not built.\n" :
+               "P_BuildReject: карта слишком велика, REJECT не построен.\n");
+        return;
+    }
+
+    leaky = Z_Malloc(numsectors, PU_STATIC, NULL);
+    memset(leaky, 0, numsectors);
+    FindLeakySectors();
+
+    HashLevel(digest);
+    path = CachePath(digest);
+
+    rejectbuilt = Z_Malloc(length + CACHEEXTRA, PU_LEVEL, &rejectbuilt);
+
+    loaded = ReadCache(path, length);
+
+    if (loaded)
+    {
+        for (int i = 0 ; i < CACHEEXTRA ; i++)
+        {
+            fallbacks |= rejectbuilt[length + i] << (8 * i);
+        }
+    }
+    else
+    {
+        firstportal = Z_Malloc((numsectors + 1) * sizeof(*firstportal), PU_STATIC, NULL);
+        BuildPortals();
+
+        fallback = Z_Malloc(numsectors, PU_STATIC, NULL);
+        memset(fallback, 0, numsectors);
+        memset(rejectbuilt, 0, length);
+        I_ParallelFor((numsectors + 7) / 8, 1, BuildRows, NULL);
+
+        for (int i = 0 ; i < numsectors ; i++)
+        {
+            fallbacks += fallback[i];
+        }
+
+        for (int i = 0 ; i < CACHEEXTRA ; i++)
+        {
+            rejectbuilt[length + i] = (fallbacks >> (8 * i)) & 0xff;
+        }
+
+        Z_Free(fallback);
+        Z_Free(portals);
+        Z_Free(firstportal);
+
+        M_WriteFile(path, rejectbuilt, length + CACHEEXTRA);
+    }
+
+    // Never drop rejections of the original lump.
+    for (int i = 0 ; i < length ; i++)
+    {
+        rejectbuilt[i] |= rejectmatrix[i];
+    }
+
+    printf(english_language ?
+           "P_BuildReject: REJECT %s in %u ms.\n" :
+           "P_BuildReject: REJECT %s за %u мс.\n",
+           english_language ? (loaded ? "loaded from cache" : "built") :
+                              (loaded ? "загружен из кэша" : "построен"),
+           SDL_GetTicks() - starttime);
+
+    // Rows which were too expensive to flood reject nothing.
+    if (fallbacks > 0)
+    {
+        printf(english_language ?
+               "P_BuildReject: %d of %d sectors see every sector.\n" :
+               "P_BuildReject: %d из %d секторов видят все секторы.\n",
+               fallbacks, numsectors);
+    }
+
+    Z_Free(leaky);
+    free(path);
+}
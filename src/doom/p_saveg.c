@@ -38,8 +38,7 @@
 
 #include "jn.h"
 
-FILE *save_stream;
-int savegamelength;
+savebuf_t save_buffer;
 boolean savegame_error;
 
 
@@ -85,7 +84,7 @@ static byte saveg_read8(void)
 {
     byte result = -1;
 
-    if (fread(&result, 1, 1, save_stream) < 1)
+    if (!M_SaveBufRead8(&save_buffer, &result))
     {
         if (!savegame_error)
         {
@@ -102,17 +101,7 @@ static byte saveg_read8(void)
 
 static void saveg_write8(byte value)
 {
-    if (fwrite(&value, 1, 1, save_stream) < 1)
-    {
-        if (!savegame_error)
-        {
-            printf(english_language ?
-                            "saveg_write8: Error while writing save game\n" :
-                            "saveg_write8: ошибка записи сохраненной игры.\n");
-
-            savegame_error = true;
-        }
-    }
+    M_SaveBufWrite8(&save_buffer, value);
 }
 
 static short saveg_read16(void)
@@ -187,7 +176,7 @@ static void saveg_read_pad(void)
     int padding;
     int i;
 
-    pos = ftell(save_stream);
+    pos = save_buffer.pos;
 
     padding = (4 - (pos & 3)) & 3;
 
@@ -203,7 +192,7 @@ static void saveg_write_pad(void)
     int padding;
     int i;
 
-    pos = ftell(save_stream);
+    pos = save_buffer.size;
 
     padding = (4 - (pos & 3)) & 3;
 
@@ -364,10 +353,10 @@ static void saveg_read_mobj_t(mobj_t *str)
     str->frame = saveg_read32();
 
     // struct mobj_s* bnext;
-    str->bnext = saveg_readp();
+    saveg_readp();
 
     // struct mobj_s* bprev;
-    str->bprev = saveg_readp();
+    saveg_readp();
 
     // struct subsector_s* subsector;
     str->subsector = saveg_readp();
@@ -482,10 +471,10 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->frame);
 
     // struct mobj_s* bnext;
-    saveg_writep(str->bnext);
+    saveg_writep(NULL);
 
     // struct mobj_s* bprev;
-    saveg_writep(str->bprev);
+    saveg_writep(NULL);
 
     // struct subsector_s* subsector;
     saveg_writep(str->subsector);
@@ -1774,7 +1763,7 @@ void P_UnArchiveThinkers (void)
 	if (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker)
 	    P_RemoveMobj ((mobj_t *)currentthinker);
 	else
-	    Z_Free (currentthinker);
+	    P_FreeThinker (currentthinker);
 
 	currentthinker = next;
     }
@@ -1791,7 +1780,7 @@ void P_UnArchiveThinkers (void)
 			
 	  case tc_mobj:
 	    saveg_read_pad();
-	    mobj = Z_Malloc (sizeof(*mobj), PU_LEVEL, NULL);
+	    mobj = P_AllocThinker (sizeof(*mobj));
             saveg_read_mobj_t(mobj);
 
 	    P_SetThingPosition (mobj);
@@ -1811,6 +1800,7 @@ void P_UnArchiveThinkers (void)
 
 	    mobj->thinker.function.acp1 = (actionf_p1)P_MobjThinker;
 	    P_AddThinker (&mobj->thinker);
+	    P_LinkBrightmapMobj(mobj);
 	    break;
 
 	  default:
@@ -2076,7 +2066,7 @@ void P_UnArchiveSpecials (void)
 			
 	  case tc_ceiling:
 	    saveg_read_pad();
-	    ceiling = Z_Malloc (sizeof(*ceiling), PU_LEVEL, NULL);
+	    ceiling = P_AllocThinker (sizeof(*ceiling));
             saveg_read_ceiling_t(ceiling);
 	    ceiling->sector->specialdata = ceiling;
 
@@ -2089,7 +2079,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_door:
 	    saveg_read_pad();
-	    door = Z_Malloc (sizeof(*door), PU_LEVEL, NULL);
+	    door = P_AllocThinker (sizeof(*door));
             saveg_read_vldoor_t(door);
 	    door->sector->specialdata = door;
 	    door->thinker.function.acp1 = (actionf_p1)T_VerticalDoor;
@@ -2098,7 +2088,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_floor:
 	    saveg_read_pad();
-	    floor = Z_Malloc (sizeof(*floor), PU_LEVEL, NULL);
+	    floor = P_AllocThinker (sizeof(*floor));
             saveg_read_floormove_t(floor);
 	    floor->sector->specialdata = floor;
 	    floor->thinker.function.acp1 = (actionf_p1)T_MoveFloor;
@@ -2107,7 +2097,7 @@ void P_UnArchiveSpecials (void)
 				
 	  case tc_plat:
 	    saveg_read_pad();
-	    plat = Z_Malloc (sizeof(*plat), PU_LEVEL, NULL);
+	    plat = P_AllocThinker (sizeof(*plat));
             saveg_read_plat_t(plat);
 	    plat->sector->specialdata = plat;
 
@@ -72,8 +72,8 @@ int32_t *blockmap;      // [crispy] BLOCKMAP limit
 int32_t *blockmaplump;  // [crispy] BLOCKMAP limit
 // origin of block map
 fixed_t  bmaporgx, bmaporgy;
-// for thing chains
-mobj_t **blocklinks;		
+// [JN] length of blockmaplump
+int      blockmapcount;
 
 
 // REJECT
@@ -739,8 +739,6 @@ static void P_LoadSectors (const int lump)
         ss->floor_yoffs = 0;
         ss->ceiling_xoffs = 0;
         ss->ceiling_yoffs = 0;
-        // [crispy] WiggleFix: [kb] for R_FixWiggle()
-        ss->cachedheight = 0;
         // [AM] Sector interpolation.  Even if we're
         //      not running uncapped, the renderer still
         //      uses this data.
@@ -1706,6 +1704,7 @@ static void P_CreateBlockMap (void)
         
             // Allocate blockmap lump with computed count
             blockmaplump = Z_Malloc(sizeof(*blockmaplump) * count, PU_LEVEL, 0);
+            blockmapcount = count;
         }
 
         // Now compress the blockmap.
@@ -1734,12 +1733,7 @@ static void P_CreateBlockMap (void)
     }
 
     // [crispy] copied over from P_LoadBlockMap()
-    {
-        int count = sizeof(*blocklinks) * bmapwidth * bmapheight;
-        blocklinks = Z_Malloc(count, PU_LEVEL, 0);
-        memset(blocklinks, 0, count);
-        blockmap = blockmaplump+4;
-    }
+    blockmap = blockmaplump+4;
 }
 
 // -----------------------------------------------------------------------------
@@ -1770,6 +1764,7 @@ static const boolean P_LoadBlockMap (const int lump)
     W_ReadLump(lump, wadblockmaplump);
     blockmaplump = Z_Malloc(sizeof(*blockmaplump) * count, PU_LEVEL, NULL);
     blockmap = blockmaplump + 4;
+    blockmapcount = count;
 
     blockmaplump[0] = SHORT(wadblockmaplump[0]);
     blockmaplump[1] = SHORT(wadblockmaplump[1]);
@@ -1792,12 +1787,6 @@ static const boolean P_LoadBlockMap (const int lump)
     bmaporgy = blockmaplump[1]<<FRACBITS;
     bmapwidth = blockmaplump[2];
     bmapheight = blockmaplump[3];
-    
-    // Clear out mobj chains
-
-    count = sizeof(*blocklinks) * bmapwidth * bmapheight;
-    blocklinks = Z_Malloc(count, PU_LEVEL, 0);
-    memset(blocklinks, 0, count);
 
     // [crispy] (re-)create BLOCKMAP if necessary
     return true;
@@ -2049,6 +2038,7 @@ static void PadRejectArray (byte *array, unsigned const int len)
 static void P_LoadReject (const int lumpnum)
 {
     int minlength, lumplen;
+    boolean empty = true;
 
     // Calculate the size that the REJECT lump *should* be.
 
@@ -2071,6 +2061,26 @@ static void P_LoadReject (const int lumpnum)
 
         PadRejectArray(rejectmatrix + lumplen, minlength - lumplen);
     }
+
+    // [JN] Build REJECT for maps shipped with an empty or zero-filled one.
+    // Vanilla sight checks are done with the original matrix.
+
+    rejectbuilt = NULL;
+
+    if (!build_reject)
+    {
+        return;
+    }
+
+    for (int i = 0 ; i < minlength && empty ; i++)
+    {
+        empty = !rejectmatrix[i];
+    }
+
+    if (lumplen < minlength || empty)
+    {
+        P_BuildReject();
+    }
 }
 
 // -----------------------------------------------------------------------------
@@ -2147,6 +2157,9 @@ void P_SetupLevel (const int episode, const int map, const skill_t skill)
     boolean crispy_validblockmap;
     unsigned const int starttime = SDL_GetTicks();
     unsigned int endtime;
+    long startminflt, startmajflt, minflt, majflt;
+    // [JN] Count page faults as well, to see what mapping the WADs buys.
+    const boolean faults = I_GetPageFaults(&startminflt, &startmajflt);
 
     totalkills = totalitems = totalsecret = wminfo.maxfrags = 0;
     wminfo.partime = 180;
@@ -2173,9 +2186,14 @@ void P_SetupLevel (const int episode, const int map, const skill_t skill)
     // Make sure all sounds are stopped before Z_FreeTags.
     S_Start ();			
 
+    // [JN] Report how well generated REJECT did on the previous level.
+    P_ReportSightCounts();
+
     Z_FreeTags (PU_LEVEL, PU_PURGELEVEL-1);
 
     P_InitThinkers ();
+    P_InitSecnodes ();
+    P_ClearThinkerPools ();
 
     // if working with a devlopment map, reload it
     W_Reload ();
@@ -2247,6 +2265,9 @@ void P_SetupLevel (const int episode, const int map, const skill_t skill)
         P_CreateBlockMap();
     }
 
+    // [JN] Compact line lists and empty thing buckets.
+    P_InitBlockIndex();
+
     if (crispy_mapformat & (ZDBSPX | ZDBSPZ))
     {
         P_LoadNodes_ZDBSP (lumpnum+ML_NODES, crispy_mapformat & ZDBSPZ);
@@ -2315,8 +2336,20 @@ void P_SetupLevel (const int episode, const int map, const skill_t skill)
     P_LevelNameInit();
 
     endtime = SDL_GetTicks() - starttime;
-    DEH_printf(english_language ? "loaded in %d ms.\n" :
-                                  "загружен за %d мс.\n", endtime);
+
+    if (faults && I_GetPageFaults(&minflt, &majflt))
+    {
+        DEH_printf(english_language ?
+                   "loaded in %d ms, %ld page faults (%ld from disk).\n" :
+                   "загружен за %d мс, страничных ошибок: %ld (с диска: %ld).\n",
+                   endtime, minflt + majflt - startminflt - startmajflt,
+                   majflt - startmajflt);
+    }
+    else
+    {
+        DEH_printf(english_language ? "loaded in %d ms.\n" :
+                                      "загружен за %d мс.\n", endtime);
+    }
 }
 
 // -----------------------------------------------------------------------------
@@ -2328,4 +2361,8 @@ void P_Init (void)
     P_InitSwitchList ();
     P_InitPicAnims ();
     R_InitSprites (sprnames);
+    P_InitSightCache ();
+    P_InitThinkerPools ();
+
+    I_AtExit(P_ReportSightCounts, false);
 }
@@ -21,17 +21,56 @@
 
 #include "doomstat.h"
 #include "i_system.h"
+#include "i_thread.h"
+#include "m_argv.h"
 #include "p_local.h"
+#include "z_zone.h"
 #include "jn.h"
 
 
-static fixed_t   sightzstart;            // eye z of looker
-static fixed_t   topslope, bottomslope;  // slopes to top and bottom of target
-static fixed_t   t2x, t2y;
-static divline_t strace;                 // from t1 to t2
+// [JN] State of one sight trace. Traces of the perception pre-pass run
+// on several threads, so each thread has its own, with its own line
+// stamps in place of line validcount.
+
+typedef struct
+{
+    fixed_t   sightzstart;            // eye z of looker
+    fixed_t   topslope, bottomslope;  // slopes to top and bottom of target
+    fixed_t   opentop, openbottom;    // opening of the crossed line
+    fixed_t   t2x, t2y;
+    divline_t strace;                 // from t1 to t2
+    int      *linestamps;
+    int       numlinestamps;
+    int       stamp;
+} sighttrace_t;
+
+static sighttrace_t sighttraces[MAXTHREADS];
 
 static int sightcounts[2];
 
+// [JN] Sight check cache. Entries are keyed by exact looker and target
+// positions and are valid until the next tic or plane movement, so
+// cached results are the same as traced ones.
+
+#define SIGHTCACHESIZE 4096  // must be a power of two
+
+typedef struct
+{
+    const mobj_t *t2;
+    fixed_t       t1x, t1y, zstart;
+    fixed_t       t2x, t2y, t2z, t2height;
+    unsigned int  stamp;
+    boolean       result;
+} sightcache_t;
+
+static sightcache_t sightcache[SIGHTCACHESIZE];
+static unsigned int sightstamp = 1;
+static boolean      nosightcache;
+static boolean      nosightprepass;
+static boolean      forcesightprepass;
+static int          sightcachecounts[2];  // hits, misses
+static int          sightprepasscount;    // pairs traced ahead
+
 
 // -----------------------------------------------------------------------------
 // PTR_SightTraverse() for Doom 1.2 sight calculations
@@ -39,6 +78,7 @@ static int sightcounts[2];
 // -----------------------------------------------------------------------------
 static boolean PTR_SightTraverse(intercept_t *in)
 {
+    sighttrace_t *const st = &sighttraces[0];
     line_t *li;
     fixed_t slope;
 
@@ -56,25 +96,25 @@ static boolean PTR_SightTraverse(intercept_t *in)
 
     if (li->frontsector->floorheight != li->backsector->floorheight)
     {
-        slope = FixedDiv(openbottom - sightzstart , in->frac);
+        slope = FixedDiv(openbottom - st->sightzstart , in->frac);
 
-        if (slope > bottomslope)
+        if (slope > st->bottomslope)
         {
-            bottomslope = slope;
+            st->bottomslope = slope;
         }
     }
 
     if (li->frontsector->ceilingheight != li->backsector->ceilingheight)
     {
-        slope = FixedDiv(opentop - sightzstart, in->frac);
+        slope = FixedDiv(opentop - st->sightzstart, in->frac);
 
-        if (slope < topslope)
+        if (slope < st->topslope)
         {
-            topslope = slope;
+            st->topslope = slope;
         }
     }
 
-    if (topslope <= bottomslope)
+    if (st->topslope <= st->bottomslope)
     {
         return false;  // stop
     }
@@ -128,17 +168,16 @@ static const fixed_t P_InterceptVector2 (const divline_t *v2, const divline_t *v
 
 // -----------------------------------------------------------------------------
 // P_CrossSubsector
-// Returns true if strace crosses the given subsector successfully.
+// Returns true if st->strace crosses the given subsector successfully.
 // -----------------------------------------------------------------------------
 
-static const boolean P_CrossSubsector (const int num)
+static const boolean P_CrossSubsector (sighttrace_t *st, const int num)
 {
     seg_t        *seg;
     line_t       *line;
     int           s1, s2, count;
     subsector_t  *sub;
     sector_t     *front, *back;
-    fixed_t       opentop, openbottom;
     divline_t     divl;
     vertex_t     *v1, *v2;
     fixed_t       frac, slope;
@@ -163,17 +202,17 @@ static const boolean P_CrossSubsector (const int num)
         line = seg->linedef;
 
         // allready checked other side?
-        if (line->validcount == validcount)
+        if (st->linestamps[line - lines] == st->stamp)
         {
             continue;
         }
 
-        line->validcount = validcount;
+        st->linestamps[line - lines] = st->stamp;
 
         v1 = line->v1;
         v2 = line->v2;
-        s1 = P_DivlineSide (v1->x,v1->y, &strace);
-        s2 = P_DivlineSide (v2->x, v2->y, &strace);
+        s1 = P_DivlineSide (v1->x,v1->y, &st->strace);
+        s2 = P_DivlineSide (v2->x, v2->y, &st->strace);
 
         // line isn't crossed?
         if (s1 == s2)
@@ -185,8 +224,8 @@ static const boolean P_CrossSubsector (const int num)
         divl.y = v1->y;
         divl.dx = v2->x - v1->x;
         divl.dy = v2->y - v1->y;
-        s1 = P_DivlineSide (strace.x, strace.y, &divl);
-        s2 = P_DivlineSide (t2x, t2y, &divl);
+        s1 = P_DivlineSide (st->strace.x, st->strace.y, &divl);
+        s2 = P_DivlineSide (st->t2x, st->t2y, &divl);
 
         // line isn't crossed?
         if (s1 == s2)
@@ -223,50 +262,50 @@ static const boolean P_CrossSubsector (const int num)
         // because of ceiling height differences
         if (front->ceilingheight < back->ceilingheight)
         {
-            opentop = front->ceilingheight;
+            st->opentop = front->ceilingheight;
         }
         else
         {
-            opentop = back->ceilingheight;
+            st->opentop = back->ceilingheight;
         }
 
         // because of ceiling height differences
         if (front->floorheight > back->floorheight)
         {
-            openbottom = front->floorheight;
+            st->openbottom = front->floorheight;
         }
         else
         {
-            openbottom = back->floorheight;
+            st->openbottom = back->floorheight;
         }
 
         // quick test for totally closed doors
-        if (openbottom >= opentop)
+        if (st->openbottom >= st->opentop)
         {
             return false;  // stop
         }
 
-        frac = P_InterceptVector2 (&strace, &divl);
+        frac = P_InterceptVector2 (&st->strace, &divl);
 
         if (front->floorheight != back->floorheight)
         {
-            slope = FixedDiv (openbottom - sightzstart , frac);
-            if (slope > bottomslope)
+            slope = FixedDiv (st->openbottom - st->sightzstart , frac);
+            if (slope > st->bottomslope)
             {
-                bottomslope = slope;
+                st->bottomslope = slope;
             }
         }
 
         if (front->ceilingheight != back->ceilingheight)
         {
-            slope = FixedDiv (opentop - sightzstart , frac);
-            if (slope < topslope)
+            slope = FixedDiv (st->opentop - st->sightzstart , frac);
+            if (slope < st->topslope)
             {
-                topslope = slope;
+                st->topslope = slope;
             }
         }
 
-        if (topslope <= bottomslope)
+        if (st->topslope <= st->bottomslope)
         {
             return false;  // stop
         }
@@ -278,60 +317,205 @@ static const boolean P_CrossSubsector (const int num)
 
 // -----------------------------------------------------------------------------
 // P_CrossBSPNode
-// Returns true if strace crosses the given node successfully.
+// Returns true if st->strace crosses the given node successfully.
 // -----------------------------------------------------------------------------
 
-static const boolean P_CrossBSPNode (const int bspnum)
+static const boolean P_CrossBSPNode (sighttrace_t *st, const int bspnum)
 {
     node_t *bsp;
     int     side;
 
     if (bspnum & NF_SUBSECTOR)
     {
-        return P_CrossSubsector (bspnum == -1 ? 0 : bspnum&(~NF_SUBSECTOR));
+        return P_CrossSubsector (st, bspnum == -1 ? 0 : bspnum&(~NF_SUBSECTOR));
     }
 
     bsp = &nodes[bspnum];
 
     // decide which side the start point is on
-    side = P_DivlineSide (strace.x, strace.y, (divline_t *)bsp);
+    side = P_DivlineSide (st->strace.x, st->strace.y, (divline_t *)bsp);
     if (side == 2)
     {
         side = 0;  // an "on" should cross both sides
     }
 
     // cross the starting side
-    if (!P_CrossBSPNode(bsp->children[side]))
+    if (!P_CrossBSPNode(st, bsp->children[side]))
     {
         return false;
     }
 
     // the partition plane is crossed here
-    if (side == P_DivlineSide (t2x, t2y,(divline_t *)bsp))
+    if (side == P_DivlineSide (st->t2x, st->t2y,(divline_t *)bsp))
     {
         // the line doesn't touch the other side
         return true;
     }
 
     // cross the ending side		
-    return P_CrossBSPNode (bsp->children[side^1]);
+    return P_CrossBSPNode (st, bsp->children[side^1]);
 }
 
 // -----------------------------------------------------------------------------
-// P_CheckSight
-// Returns true if a straight line between t1 and t2 is unobstructed.
-// Uses REJECT.
+// P_TraceSight
+// Traces a straight line between t1 and t2 through the BSP.
+// st->sightzstart must be set.
 // -----------------------------------------------------------------------------
 
-const boolean P_CheckSight (const mobj_t *t1, const mobj_t *t2)
+static const boolean P_TraceSight (sighttrace_t *st, const mobj_t *t1, const mobj_t *t2)
+{
+    st->topslope = (t2->z+t2->height) - st->sightzstart;
+    st->bottomslope = (t2->z) - st->sightzstart;
+
+    if (gameversion <= exe_doom_1_2)
+    {
+        validcount++;
+        return P_PathTraverse(t1->x, t1->y, t2->x, t2->y,
+                              PT_EARLYOUT | PT_ADDLINES, PTR_SightTraverse);
+    }
+
+    // [JN] Line stamps replace validcount. Grow them with the map.
+    if (st->numlinestamps < numlines)
+    {
+        st->linestamps = I_Realloc(st->linestamps, numlines * sizeof(*st->linestamps));
+        memset(st->linestamps + st->numlinestamps, 0,
+               (numlines - st->numlinestamps) * sizeof(*st->linestamps));
+        st->numlinestamps = numlines;
+    }
+
+    if (++st->stamp == 0)
+    {
+        memset(st->linestamps, 0, st->numlinestamps * sizeof(*st->linestamps));
+        st->stamp = 1;
+    }
+
+    st->strace.x = t1->x;
+    st->strace.y = t1->y;
+    st->t2x = t2->x;
+    st->t2y = t2->y;
+    st->strace.dx = t2->x - t1->x;
+    st->strace.dy = t2->y - t1->y;
+
+    // the head node is the last node output
+    return P_CrossBSPNode (st, numnodes-1);
+}
+
+// -----------------------------------------------------------------------------
+// P_InvalidateSightCache
+// [JN] Called every tic and every time a plane moves.
+// -----------------------------------------------------------------------------
+
+void P_InvalidateSightCache (void)
+{
+    // Zero stamp is never valid.
+    if (++sightstamp == 0)
+    {
+        memset(sightcache, 0, sizeof(sightcache));
+        sightstamp = 1;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// P_InitSightCache
+// -----------------------------------------------------------------------------
+
+void P_InitSightCache (void)
+{
+    //!
+    // @category obscure
+    //
+    // Disable caching of sight check results.
+    //
+
+    nosightcache = M_CheckParm("-nosightcache") > 0;
+
+    //!
+    // @category obscure
+    //
+    // Don't trace sight of monsters on worker threads ahead of
+    // running thinkers.
+    //
+
+    nosightprepass = M_CheckParm("-nosightprepass") > 0;
+
+    //!
+    // @category obscure
+    //
+    // Trace sight of monsters on worker threads ahead of running
+    // thinkers even if there are only a few of them. Used by the
+    // demo sync test.
+    //
+
+    forcesightprepass = M_CheckParm("-sightprepass") > 0;
+}
+
+// -----------------------------------------------------------------------------
+// P_SightRejected
+// Returns true if REJECT says t1 and t2 can't possibly see each other.
+// -----------------------------------------------------------------------------
+
+static boolean P_SightRejected (const mobj_t *t1, const mobj_t *t2)
 {
     // Determine subsector entries in REJECT table.
     const int s1 = (t1->subsector->sector - sectors);
     const int s2 = (t2->subsector->sector - sectors);
     const int pnum = s1*numsectors + s2;
+    // [JN] Generated REJECT assumes fixed P_DivlineSide.
+    const byte *reject = rejectbuilt && singleplayer && !strict_mode && !vanillaparm
+                      && gameversion > exe_doom_1_2 ? rejectbuilt : rejectmatrix;
+
+    return (reject[pnum>>3] & (1 << (pnum&7))) != 0;
+}
+
+// -----------------------------------------------------------------------------
+// P_SightCacheEntry
+// [JN] Returns cache slot of t1 looking at t2.
+// Looker sector, looker position in 32 unit blocks and target are hashed.
+// -----------------------------------------------------------------------------
+
+static sightcache_t *P_SightCacheEntry (const mobj_t *t1, const mobj_t *t2)
+{
+    const unsigned int s1 = t1->subsector->sector - sectors;
+    const unsigned int hash = (s1 * 0x9E3779B1u)
+                            ^ ((unsigned int) (t1->x >> (FRACBITS+5)) * 0x85EBCA6Bu)
+                            ^ ((unsigned int) (t1->y >> (FRACBITS+5)) * 0xC2B2AE35u)
+                            ^ (unsigned int) ((uintptr_t) t2 >> 4);
+
+    return &sightcache[(hash ^ (hash >> 16)) & (SIGHTCACHESIZE-1)];
+}
+
+// -----------------------------------------------------------------------------
+// P_StoreSight
+// -----------------------------------------------------------------------------
+
+static void P_StoreSight (sightcache_t *entry, const mobj_t *t1, const mobj_t *t2,
+                          const fixed_t zstart, const boolean result)
+{
+    entry->result = result;
+    entry->stamp = sightstamp;
+    entry->t2 = t2;
+    entry->t1x = t1->x;
+    entry->t1y = t1->y;
+    entry->zstart = zstart;
+    entry->t2x = t2->x;
+    entry->t2y = t2->y;
+    entry->t2z = t2->z;
+    entry->t2height = t2->height;
+}
+
+// -----------------------------------------------------------------------------
+// P_CheckSight
+// Returns true if a straight line between t1 and t2 is unobstructed.
+// Uses REJECT.
+// -----------------------------------------------------------------------------
+
+const boolean P_CheckSight (const mobj_t *t1, const mobj_t *t2)
+{
+    sighttrace_t *const st = &sighttraces[0];
+    sightcache_t *entry;
 
     // Check for trivial rejection in REJECT table.
-    if (rejectmatrix[pnum>>3] & (1 << (pnum&7)))
+    if (P_SightRejected(t1, t2))
     {
         sightcounts[0]++;
 
@@ -343,25 +527,204 @@ const boolean P_CheckSight (const mobj_t *t1, const mobj_t *t2)
     // Now look from eyes of t1 to any part of t2.
     sightcounts[1]++;
 
-    validcount++;
+    st->sightzstart = t1->z + t1->height - (t1->height>>2);
 
-    sightzstart = t1->z + t1->height - (t1->height>>2);
-    topslope = (t2->z+t2->height) - sightzstart;
-    bottomslope = (t2->z) - sightzstart;
+    if (nosightcache)
+    {
+        return P_TraceSight(st, t1, t2);
+    }
 
-    if (gameversion <= exe_doom_1_2)
+    entry = P_SightCacheEntry(t1, t2);
+
+    if (entry->stamp == sightstamp && entry->t2 == t2
+    &&  entry->t1x == t1->x && entry->t1y == t1->y && entry->zstart == st->sightzstart
+    &&  entry->t2x == t2->x && entry->t2y == t2->y
+    &&  entry->t2z == t2->z && entry->t2height == t2->height)
     {
-        return P_PathTraverse(t1->x, t1->y, t2->x, t2->y,
-                              PT_EARLYOUT | PT_ADDLINES, PTR_SightTraverse);
+        sightcachecounts[0]++;
+        return entry->result;
     }
 
-    strace.x = t1->x;
-    strace.y = t1->y;
-    t2x = t2->x;
-    t2y = t2->y;
-    strace.dx = t2->x - t1->x;
-    strace.dy = t2->y - t1->y;
+    sightcachecounts[1]++;
 
-    // the head node is the last node output
-    return P_CrossBSPNode (numnodes-1);	
+    P_StoreSight(entry, t1, t2, st->sightzstart, P_TraceSight(st, t1, t2));
+
+    return entry->result;
+}
+
+// =============================================================================
+//
+// PERCEPTION PRE-PASS
+// [JN] Before thinkers are run, sight of monsters which are about to call
+// A_Look or A_Chase is traced in parallel, against every player and their
+// current target. Results only go to the sight cache, which verifies exact
+// positions of both mobjs and is cleared whenever a plane moves. So if the
+// looker or the target moved meanwhile, P_CheckSight just traces again,
+// and results are always the same as without the pre-pass. Traces don't
+// touch any shared state (line openings and stamps are per-thread), so
+// it is safe for demos and netgames as well. Range checks are left to
+// the AI functions, since P_CheckMissileRange depends on P_Random.
+//
+// =============================================================================
+
+#define MINPREPASSPAIRS 32  // don't wake worker threads for less
+
+typedef struct
+{
+    const mobj_t *t1, *t2;
+    fixed_t       zstart;
+    boolean       result;
+} sightpair_t;
+
+static sightpair_t *sightpairs;
+static int          numsightpairs, maxsightpairs;
+
+// -----------------------------------------------------------------------------
+// P_AddSightPair
+// -----------------------------------------------------------------------------
+
+static void P_AddSightPair (const mobj_t *t1, const mobj_t *t2)
+{
+    sightpair_t *pair;
+
+    if (!t2 || t2 == t1 || t2->health <= 0 || P_SightRejected(t1, t2))
+    {
+        return;
+    }
+
+    if (numsightpairs == maxsightpairs)
+    {
+        maxsightpairs = maxsightpairs ? maxsightpairs * 2 : 256;
+        sightpairs = I_Realloc(sightpairs, maxsightpairs * sizeof(*sightpairs));
+    }
+
+    pair = &sightpairs[numsightpairs++];
+    pair->t1 = t1;
+    pair->t2 = t2;
+    pair->zstart = t1->z + t1->height - (t1->height>>2);
+}
+
+// -----------------------------------------------------------------------------
+// P_TraceSightPairs
+// Runs on every thread, each one with its own trace state.
+// -----------------------------------------------------------------------------
+
+static void P_TraceSightPairs (int slice, int numslices, void *data)
+{
+    sighttrace_t *const st = &sighttraces[slice];
+    const int start = (int) ((int64_t) numsightpairs * slice / numslices);
+    const int end = (int) ((int64_t) numsightpairs * (slice + 1) / numslices);
+    int i;
+
+    for (i = start ; i < end ; i++)
+    {
+        sightpair_t *const pair = &sightpairs[i];
+
+        st->sightzstart = pair->zstart;
+        pair->result = P_TraceSight(st, pair->t1, pair->t2);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// P_PrecomputeSight
+// Called by P_Ticker before thinkers are run.
+// -----------------------------------------------------------------------------
+
+void P_PrecomputeSight (void)
+{
+    thinker_t *th;
+    int i;
+
+    // Traces are not thread safe in Doom 1.2 mode.
+    if (nosightprepass || nosightcache || gameversion <= exe_doom_1_2
+    ||  I_NumThreads() < 2)
+    {
+        return;
+    }
+
+    numsightpairs = 0;
+
+    for (th = thinkercap.next ; th != &thinkercap ; th = th->next)
+    {
+        const mobj_t *mo = (mobj_t *) th;
+        actionf_p1 action;
+
+        if (th->function.acp1 != (actionf_p1)P_MobjThinker || mo->tics != 1)
+        {
+            continue;
+        }
+
+        action = states[mo->state->nextstate].action.acp1;
+
+        if (action != (actionf_p1)A_Look && action != (actionf_p1)A_Chase)
+        {
+            continue;
+        }
+
+        for (i = 0 ; i < MAXPLAYERS ; i++)
+        {
+            if (playeringame[i] && players[i].mo != mo->target)
+            {
+                P_AddSightPair(mo, players[i].mo);
+            }
+        }
+
+        P_AddSightPair(mo, mo->target);
+    }
+
+    if (numsightpairs < MINPREPASSPAIRS && !(forcesightprepass && numsightpairs > 0))
+    {
+        return;
+    }
+
+    I_RunThreads(P_TraceSightPairs, NULL);
+    sightprepasscount += numsightpairs;
+
+    for (i = 0 ; i < numsightpairs ; i++)
+    {
+        const sightpair_t *pair = &sightpairs[i];
+
+        P_StoreSight(P_SightCacheEntry(pair->t1, pair->t2),
+                     pair->t1, pair->t2, pair->zstart, pair->result);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// P_ReportSightCounts
+// [JN] Prints and resets amount of sight checks rejected by generated REJECT,
+// sight cache hit rate and amount of traces done by the pre-pass.
+// -----------------------------------------------------------------------------
+
+void P_ReportSightCounts (void)
+{
+    const int total = sightcounts[0] + sightcounts[1];
+    const int lookups = sightcachecounts[0] + sightcachecounts[1];
+
+    if (rejectbuilt && total)
+    {
+        printf(english_language ?
+               "P_CheckSight: %d of %d checks rejected (%d%%).\n" :
+               "P_CheckSight: отклонено %d из %d проверок (%d%%).\n",
+               sightcounts[0], total, (int) (100LL * sightcounts[0] / total));
+    }
+
+    if (lookups)
+    {
+        printf(english_language ?
+               "P_CheckSight: %d of %d traces cached (%d%%).\n" :
+               "P_CheckSight: %d из %d трассировок взято из кэша (%d%%).\n",
+               sightcachecounts[0], lookups, (int) (100LL * sightcachecounts[0] / lookups));
+    }
+
+    if (sightprepasscount)
+    {
+        printf(english_language ?
+               "P_PrecomputeSight: %d traces precomputed.\n" :
+               "P_PrecomputeSight: %d трассировок выполнено заранее.\n",
+               sightprepasscount);
+    }
+
+    sightcounts[0] = sightcounts[1] = 0;
+    sightcachecounts[0] = sightcachecounts[1] = 0;
+    sightprepasscount = 0;
 }
@@ -1362,8 +1362,6 @@ static void DonutOverrun(fixed_t *s3_floorheight, short *s3_floorpic,
     static int tmp_s3_floorheight;
     static int tmp_s3_floorpic;
 
-    extern int numflats;
-
     if (first)
     {
         int p;
@@ -1515,7 +1513,7 @@ int EV_DoDonut (line_t *line)
             }
 
             // Spawn rising slime
-            floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+            floor = P_AllocThinker (sizeof(*floor));
             P_AddThinker (&floor->thinker);
             s2->specialdata = floor;
             floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
@@ -1529,7 +1527,7 @@ int EV_DoDonut (line_t *line)
             floor->floordestheight = s3_floorheight;
 
             // Spawn lowering donut-hole
-            floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+            floor = P_AllocThinker (sizeof(*floor));
             P_AddThinker (&floor->thinker);
             s1->specialdata = floor;
             floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
@@ -21,6 +21,8 @@
 
 
 #include <stdlib.h>
+#include "m_trace.h"
+#include "z_pool.h"
 #include "z_zone.h"
 #include "p_local.h"
 #include "doomstat.h"
@@ -32,21 +34,188 @@ int	leveltime;
 // =============================================================================
 // THINKERS
 //
-// All thinkers should be allocated by Z_Malloc so they can be operated
-// on uniformly. The actual structures will vary in size, but the first 
-// element must be thinker_t.
+// All thinkers should be allocated by P_AllocThinker or Z_Malloc so they can
+// be operated on uniformly. The actual structures will vary in size, but the
+// first element must be thinker_t.
 // =============================================================================
 
 // Both the head and tail of the thinker list.
 thinker_t thinkercap;
 
+// [JN] Pools of mobjs and moving sector thinkers.
+static zpool_t mobjpool;
+static zpool_t moverpool;
+
+// -----------------------------------------------------------------------------
+// P_InitThinkerPools
+// -----------------------------------------------------------------------------
+
+void P_InitThinkerPools (void)
+{
+    const int moversize = MAX(MAX(sizeof(ceiling_t), sizeof(vldoor_t)),
+                              MAX(sizeof(plat_t), sizeof(floormove_t)));
+
+    Z_InitPool(&mobjpool, "mobj", sizeof(mobj_t), PU_LEVEL);
+    Z_InitPool(&moverpool, "mover", moversize, PU_LEVEL);
+}
+
+// -----------------------------------------------------------------------------
+// P_ClearThinkerPools
+// Called after level memory has been freed.
+// -----------------------------------------------------------------------------
+
+void P_ClearThinkerPools (void)
+{
+    Z_ResetPool(&mobjpool);
+    Z_ResetPool(&moverpool);
+}
+
+// -----------------------------------------------------------------------------
+// P_AllocThinker
+// [JN] Allocates a thinker of given size from the smallest fitting pool.
+// Memory is not cleared.
+// -----------------------------------------------------------------------------
+
+void *P_AllocThinker (const size_t size)
+{
+    if (size <= moverpool.size)
+    {
+        return Z_PoolAlloc(&moverpool);
+    }
+    if (size <= mobjpool.size)
+    {
+        return Z_PoolAlloc(&mobjpool);
+    }
+
+    return Z_Malloc(size, PU_LEVEL, NULL);
+}
+
+// -----------------------------------------------------------------------------
+// P_FreeThinker
+// -----------------------------------------------------------------------------
+
+void P_FreeThinker (thinker_t *thinker)
+{
+    if (!Z_PoolFree(&moverpool, thinker) && !Z_PoolFree(&mobjpool, thinker))
+    {
+        Z_Free(thinker);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// [JN] Thinker classes.
+//
+// Besides the main list, which keeps vanilla order for demos, netgames and
+// savegames, every thinker is linked into the list of its class. In single
+// player each class is run in a tight loop, so mobjs no longer need to be
+// told apart from sector thinkers by walking the whole list twice.
+// Thinkers which get their function after P_AddThinker wait in the pending
+// list until the next classification.
+// -----------------------------------------------------------------------------
+
+enum
+{
+    th_pending,
+    th_mobj,
+    th_mover,
+    th_light,
+    th_misc,
+    th_removed,
+    NUMTHINKERCLASSES
+};
+
+static thinker_t classcap[NUMTHINKERCLASSES];
+
+// Head of the brightmap animated mobjs list.
+static mobj_t *bmaphead;
+
+static void P_LinkClass (thinker_t *thinker, const int class)
+{
+    thinker_t *cap = &classcap[class];
+
+    cap->cprev->cnext = thinker;
+    thinker->cnext = cap;
+    thinker->cprev = cap->cprev;
+    cap->cprev = thinker;
+}
+
+static void P_UnlinkClass (thinker_t *thinker)
+{
+    thinker->cnext->cprev = thinker->cprev;
+    thinker->cprev->cnext = thinker->cnext;
+}
+
+static int P_ThinkerClass (const thinker_t *thinker)
+{
+    const actionf_p1 func = thinker->function.acp1;
+
+    if (func == NULL)
+    {
+        // Not set yet or in stasis.
+        return th_pending;
+    }
+    if (thinker->function.acv == (actionf_v)(-1))
+    {
+        return th_removed;
+    }
+    if (func == (actionf_p1)P_MobjThinker)
+    {
+        return th_mobj;
+    }
+    if (func == (actionf_p1)T_MoveCeiling
+    ||  func == (actionf_p1)T_VerticalDoor
+    ||  func == (actionf_p1)T_MoveFloor
+    ||  func == (actionf_p1)T_PlatRaise)
+    {
+        return th_mover;
+    }
+    if (func == (actionf_p1)T_LightFlash
+    ||  func == (actionf_p1)T_StrobeFlash
+    ||  func == (actionf_p1)T_Glow
+    ||  func == (actionf_p1)T_FireFlicker)
+    {
+        return th_light;
+    }
+
+    return th_misc;
+}
+
+// -----------------------------------------------------------------------------
+// P_ClassifyPending
+// Moves pending thinkers to the tails of their class lists. Ceilings waiting
+// in stasis still have no function and go to the misc class.
+// -----------------------------------------------------------------------------
+
+static void P_ClassifyPending (void)
+{
+    thinker_t *const cap = &classcap[th_pending];
+
+    while (cap->cnext != cap)
+    {
+        thinker_t *thinker = cap->cnext;
+        const int class = P_ThinkerClass(thinker);
+
+        P_UnlinkClass(thinker);
+        P_LinkClass(thinker, class == th_pending ? th_misc : class);
+    }
+}
+
 // -----------------------------------------------------------------------------
 // P_InitThinkers
 // -----------------------------------------------------------------------------
 
 void P_InitThinkers (void)
 {
+    int i;
+
     thinkercap.prev = thinkercap.next  = &thinkercap;
+
+    for (i = 0 ; i < NUMTHINKERCLASSES ; i++)
+    {
+        classcap[i].cprev = classcap[i].cnext = &classcap[i];
+    }
+
+    bmaphead = NULL;
 }
 
 // -----------------------------------------------------------------------------
@@ -60,6 +229,8 @@ void P_AddThinker (thinker_t *thinker)
     thinker->next = &thinkercap;
     thinker->prev = thinkercap.prev;
     thinkercap.prev = thinker;
+
+    P_LinkClass(thinker, P_ThinkerClass(thinker));
 }
 
 // -----------------------------------------------------------------------------
@@ -73,6 +244,142 @@ void P_RemoveThinker (thinker_t *thinker)
     thinker->function.acv = (actionf_v)(-1);
 }
 
+// -----------------------------------------------------------------------------
+// P_LinkBrightmapMobj
+// [JN] Adds a mobj with animated brightmap to the list of such mobjs,
+// so P_RunThinkers doesn't need to check sprites of every mobj.
+// -----------------------------------------------------------------------------
+
+#define BMAP_FLICK  1
+#define BMAP_GLOW   2
+
+void P_LinkBrightmapMobj (mobj_t *mo)
+{
+    const spritenum_t sprite = mo->sprite;
+
+    mo->bmap_anim = 0;
+    mo->bmap_next = mo->bmap_prev = NULL;
+
+    // Random brightmap flickering effect.
+    if (sprite == SPR_CAND  // Candestick
+    ||  sprite == SPR_CBRA  // Candelabra
+    ||  sprite == SPR_FCAN  // Flaming Barrel
+    ||  sprite == SPR_TBLU  // Tall Blue Torch
+    ||  sprite == SPR_TGRN  // Tall Green Torch
+    ||  sprite == SPR_TRED  // Tall Red Torch
+    ||  sprite == SPR_SMBT  // Short Blue Torch
+    ||  sprite == SPR_SMGT  // Short Green Torch
+    ||  sprite == SPR_SMRT  // Short Red Torch
+    ||  sprite == SPR_POL3) // Pile of Skulls and Candles
+    {
+        mo->bmap_anim |= BMAP_FLICK;
+    }
+
+    // Smooth brightmap glowing effect.
+    if (sprite == SPR_FCAN  // Flaming Barrel
+    ||  sprite == SPR_CEYE  // Evil Eye
+    ||  sprite == SPR_FSKU) // Floating Skull Rock
+    {
+        mo->bmap_anim |= BMAP_GLOW;
+    }
+
+    if (mo->bmap_anim)
+    {
+        mo->bmap_next = bmaphead;
+        if (bmaphead)
+        {
+            bmaphead->bmap_prev = mo;
+        }
+        bmaphead = mo;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// P_UnlinkBrightmapMobj
+// -----------------------------------------------------------------------------
+
+void P_UnlinkBrightmapMobj (mobj_t *mo)
+{
+    if (!mo->bmap_anim)
+    {
+        return;
+    }
+
+    if (mo->bmap_next)
+    {
+        mo->bmap_next->bmap_prev = mo->bmap_prev;
+    }
+    if (mo->bmap_prev)
+    {
+        mo->bmap_prev->bmap_next = mo->bmap_next;
+    }
+    else
+    {
+        bmaphead = mo->bmap_next;
+    }
+
+    mo->bmap_anim = 0;
+    mo->bmap_next = mo->bmap_prev = NULL;
+}
+
+// -----------------------------------------------------------------------------
+// P_RunThinkerClass
+// [JN] Runs all thinkers of one class. Removed thinkers are moved to the
+// removed class and freed by P_RunThinkers once every class has been run.
+// Thinkers spawned in the meantime are classified right away, so the ones
+// of a class which is running or still to come are run in this tic,
+// as they would be in the main list.
+// -----------------------------------------------------------------------------
+
+static void P_RunThinkerClass (const int class)
+{
+    thinker_t *const cap = &classcap[class];
+    thinker_t *currentthinker, *nextthinker;
+
+    for (currentthinker = cap->cnext ; currentthinker != cap ;
+         currentthinker = nextthinker)
+    {
+        if (currentthinker->function.acv == (actionf_v)(-1))
+        {
+            nextthinker = currentthinker->cnext;
+            P_UnlinkClass(currentthinker);
+            P_LinkClass(currentthinker, th_removed);
+            continue;
+        }
+
+        if (currentthinker->function.acp1)
+        {
+            currentthinker->function.acp1 (currentthinker);
+        }
+
+        if (classcap[th_pending].cnext != &classcap[th_pending])
+        {
+            P_ClassifyPending();
+        }
+
+        nextthinker = currentthinker->cnext;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// P_FreeRemovedThinkers
+// -----------------------------------------------------------------------------
+
+static void P_FreeRemovedThinkers (void)
+{
+    thinker_t *const cap = &classcap[th_removed];
+
+    while (cap->cnext != cap)
+    {
+        thinker_t *thinker = cap->cnext;
+
+        P_UnlinkClass(thinker);
+        thinker->next->prev = thinker->prev;
+        thinker->prev->next = thinker->next;
+        P_FreeThinker(thinker);
+    }
+}
+
 // -----------------------------------------------------------------------------
 // P_RunThinkers
 // [JN] Additionally, animate flickering and glowing effect for brightmaps.
@@ -88,90 +395,62 @@ static int bmap_count_glow = 0;
 void P_RunThinkers (void)
 {
     thinker_t *currentthinker, *nextthinker;
+    mobj_t *mo;
 
     // [JN] Run brightmap timers.
     bmap_count_common++;
     bmap_count_glow++;
 
-    // [JN] Prevent dropped item from jittering on moving platforms.
-    // For single player only, really not safe for internal demos.
-    // See: https://github.com/bradharding/doomretro/issues/501
-    if (singleplayer)
-    {
-        currentthinker = thinkercap.next;
-
-        while (currentthinker != &thinkercap)
-        {
-            if (currentthinker->function.acp1)
-                if (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker)
-                    currentthinker->function.acp1 (currentthinker);
-
-            nextthinker = currentthinker->next;
-            currentthinker = nextthinker;
-        }
-    }
-
-    currentthinker = thinkercap.next;
-
-    while (currentthinker != &thinkercap)
+    for (mo = bmaphead ; mo ; mo = mo->bmap_next)
     {
-        if (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker)
+        if (brightmaps && !vanillaparm)
         {
-            mobj_t *mo = (mobj_t *)currentthinker;
-
-            if (brightmaps && !vanillaparm)
+            if (bmap_count_common < 2)
             {
-                if (bmap_count_common < 2)
+                if (mo->bmap_anim & BMAP_FLICK)
                 {
-                    // [JN] Random brightmap flickering effect.
-                    if (mo->sprite == SPR_CAND  // Candestick
-                    ||  mo->sprite == SPR_CBRA  // Candelabra
-                    ||  mo->sprite == SPR_FCAN  // Flaming Barrel
-                    ||  mo->sprite == SPR_TBLU  // Tall Blue Torch
-                    ||  mo->sprite == SPR_TGRN  // Tall Green Torch
-                    ||  mo->sprite == SPR_TRED  // Tall Red Torch
-                    ||  mo->sprite == SPR_SMBT  // Short Blue Torch
-                    ||  mo->sprite == SPR_SMGT  // Short Green Torch
-                    ||  mo->sprite == SPR_SMRT  // Short Red Torch
-                    ||  mo->sprite == SPR_POL3) // Pile of Skulls and Candles
-                    {
-                        mo->bmap_flick = rand() % 16;
-                    }
-
-                    // [JN] Smooth brightmap glowing effect.
-                    if (mo->sprite == SPR_FCAN  // Flaming Barrel
-                    ||  mo->sprite == SPR_CEYE  // Evil Eye
-                    ||  mo->sprite == SPR_FSKU) // Floating Skull Rock
-                    {
-                        mo->bmap_glow = rand() % 6;
-                    }
+                    mo->bmap_flick = rand() % 16;
+                }
+                if (mo->bmap_anim & BMAP_GLOW)
+                {
+                    mo->bmap_glow = rand() % 6;
                 }
-            }
-            else
-            {
-                mo->bmap_flick =  0;
-                mo->bmap_glow = 0;
             }
         }
-
-        if (currentthinker->function.acv == (actionf_v)(-1))
+        else
         {
-            // Time to remove it.
-            nextthinker = currentthinker->next;
-            currentthinker->next->prev = currentthinker->prev;
-            currentthinker->prev->next = currentthinker->next;
-            Z_Free(currentthinker);
+            mo->bmap_flick =  0;
+            mo->bmap_glow = 0;
         }
-        else
+    }
+
+    // [JN] Prevent dropped item from jittering on moving platforms.
+    // For single player only, really not safe for internal demos.
+    // See: https://github.com/bradharding/doomretro/issues/501
+    // All mobjs are run first, then all sector thinkers.
+    if (singleplayer)
+    {
+        P_ClassifyPending();
+        P_RunThinkerClass(th_mobj);
+        P_RunThinkerClass(th_mover);
+        P_RunThinkerClass(th_light);
+        P_RunThinkerClass(th_misc);
+        P_FreeRemovedThinkers();
+    }
+    else
+    {
+        currentthinker = thinkercap.next;
+
+        while (currentthinker != &thinkercap)
         {
-            // [JN] Prevent dropped item from jittering on moving platforms.
-            if (singleplayer)
+            if (currentthinker->function.acv == (actionf_v)(-1))
             {
-                if (currentthinker->function.acp1)
-                    if (currentthinker->function.acp1 != (actionf_p1)P_MobjThinker)
-                        currentthinker->function.acp1 (currentthinker);
-
+                // Time to remove it.
                 nextthinker = currentthinker->next;
+                currentthinker->next->prev = currentthinker->prev;
+                currentthinker->prev->next = currentthinker->next;
+                P_UnlinkClass(currentthinker);
+                P_FreeThinker(currentthinker);
             }
             else
             {
@@ -180,9 +459,9 @@ void P_RunThinkers (void)
 
                 nextthinker = currentthinker->next;
             }
-        }
 
-        currentthinker = nextthinker;
+            currentthinker = nextthinker;
+        }
     }
 
     // [JN] Brightmap glowing effect.
@@ -234,11 +513,19 @@ void P_Ticker (void)
         return;
     }
 
+    // [JN] Sight cache is only valid within a tic.
+    P_InvalidateSightCache();
+
     for (i=0 ; i < MAXPLAYERS ; i++)
         if (playeringame[i])
             P_PlayerThink (&players[i]);
 
+    // [JN] Trace sight of monsters on worker threads.
+    P_PrecomputeSight();
+
+    TRACE_BEGIN("P_RunThinkers");
     P_RunThinkers();
+    TRACE_END();
     P_UpdateSpecials();
     P_RespawnSpecials();
 
@@ -27,6 +27,8 @@
 #include "deh_main.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_timer.h"
+#include "m_cache.h"
 #include "z_zone.h"
 #include "w_wad.h"
 #include "doomdef.h"
@@ -625,15 +627,239 @@ static void GenerateTextureHashTable(void)
     }
 }
 
+// -----------------------------------------------------------------------------
+// R_AllocTextures, R_InitTextureColumns
+// Allocate the texture tables, and the column tables of a single texture.
+// -----------------------------------------------------------------------------
+
+static void R_AllocTextures (void)
+{
+    textures = Z_Malloc (numtextures * sizeof(*textures), PU_STATIC, 0);
+    texturecolumnlump = Z_Malloc (numtextures * sizeof(*texturecolumnlump), PU_STATIC, 0);
+    texturecolumnofs = Z_Malloc (numtextures * sizeof(*texturecolumnofs), PU_STATIC, 0);
+    texturecolumnofs2 = Z_Malloc (numtextures * sizeof(*texturecolumnofs2), PU_STATIC, 0);
+    texturecomposite = Z_Malloc (numtextures * sizeof(*texturecomposite), PU_STATIC, 0);
+    texturecomposite2 = Z_Malloc (numtextures * sizeof(*texturecomposite2), PU_STATIC, 0);
+    texturecompositesize = Z_Malloc (numtextures * sizeof(*texturecompositesize), PU_STATIC, 0);
+    texturewidthmask = Z_Malloc (numtextures * sizeof(*texturewidthmask), PU_STATIC, 0);
+    texturewidth = Z_Malloc (numtextures * sizeof(*texturewidth), PU_STATIC, 0);
+    textureheight = Z_Malloc (numtextures * sizeof(*textureheight), PU_STATIC, 0);
+    texturebrightmap = Z_Malloc (numtextures * sizeof(*texturebrightmap), PU_STATIC, 0);
+}
+
+static void R_InitTextureColumns (const int i)
+{
+    const texture_t *texture = textures[i];
+    int j = 1;
+
+    texturecolumnlump[i] = Z_Malloc (texture->width*sizeof(**texturecolumnlump), PU_STATIC,0);
+    texturecolumnofs[i] = Z_Malloc (texture->width*sizeof(**texturecolumnofs), PU_STATIC,0);
+    texturecolumnofs2[i] = Z_Malloc (texture->width*sizeof(**texturecolumnofs2), PU_STATIC,0);
+
+    while (j*2 <= texture->width)
+        j<<=1;
+
+    texturewidthmask[i] = j-1;
+    textureheight[i] = texture->height<<FRACBITS;
+    // [crispy] texture width for wrapping column getter function
+    texturewidth[i] = texture->width;
+}
+
+// -----------------------------------------------------------------------------
+// R_ReadTextureCache, R_WriteTextureCache
+// [JN] Texture definitions and column lookups only refer to lumps by index,
+// so they are kept in the startup cache as they are. For every texture:
+// name, width, height and patch count, the patches, composite size, then
+// column lumps and both column offset tables.
+// -----------------------------------------------------------------------------
+
+typedef struct
+{
+    char  name[8];
+    short width;
+    short height;
+    short patchcount;
+    short pad;
+    int   compositesize;
+} cachedtexture_t;
+
+static size_t R_CachedTextureSize (const cachedtexture_t *tex)
+{
+    return sizeof(*tex) + tex->patchcount * sizeof(texpatch_t)
+         + tex->width * (sizeof(**texturecolumnlump) + sizeof(**texturecolumnofs)
+                       + sizeof(**texturecolumnofs2));
+}
+
+static boolean R_ReadTextureCache (const void *key, const size_t keylen)
+{
+    size_t length, offset;
+    byte *data = M_LoadStartupCache("textures", key, keylen, &length);
+    cachedtexture_t tex;
+    int count, i;
+
+    if (data == NULL)
+    {
+        return false;
+    }
+
+    // Check the layout before using any of it.
+    count = -1;
+    offset = sizeof(count);
+
+    if (length >= sizeof(count))
+    {
+        memcpy(&count, data, sizeof(count));
+    }
+
+    for (i = 0 ; i < count && offset + sizeof(tex) <= length ; i++)
+    {
+        memcpy(&tex, data + offset, sizeof(tex));
+
+        if (tex.width <= 0 || tex.patchcount < 0)
+        {
+            break;
+        }
+
+        offset += R_CachedTextureSize(&tex);
+    }
+
+    if (count < 0 || i < count || offset != length)
+    {
+        free(data);
+        return false;
+    }
+
+    numtextures = count;
+    R_AllocTextures();
+    offset = sizeof(count);
+
+    for (i = 0 ; i < numtextures ; i++)
+    {
+        texture_t *texture;
+
+        memcpy(&tex, data + offset, sizeof(tex));
+        offset += sizeof(tex);
+
+        texture = textures[i] = Z_Malloc (sizeof(texture_t)
+                + sizeof(texpatch_t)*(tex.patchcount-1), PU_STATIC, 0);
+
+        memcpy(texture->name, tex.name, sizeof(texture->name));
+        texture->width = tex.width;
+        texture->height = tex.height;
+        texture->patchcount = tex.patchcount;
+        memcpy(texture->patches, data + offset, tex.patchcount * sizeof(texpatch_t));
+        offset += tex.patchcount * sizeof(texpatch_t);
+
+        texturebrightmap[i] = R_BrightmapForTexName(texture->name);
+        R_InitTextureColumns(i);
+
+        texturecompositesize[i] = tex.compositesize;
+        memcpy(texturecolumnlump[i], data + offset, tex.width * sizeof(**texturecolumnlump));
+        offset += tex.width * sizeof(**texturecolumnlump);
+        memcpy(texturecolumnofs[i], data + offset, tex.width * sizeof(**texturecolumnofs));
+        offset += tex.width * sizeof(**texturecolumnofs);
+        memcpy(texturecolumnofs2[i], data + offset, tex.width * sizeof(**texturecolumnofs2));
+        offset += tex.width * sizeof(**texturecolumnofs2);
+    }
+
+    free(data);
+
+    return true;
+}
+
+static void R_WriteTextureCache (const void *key, const size_t keylen)
+{
+    cachedtexture_t tex = {0};
+    size_t length, offset;
+    byte *data;
+    int i;
+
+    if (!M_StartupCacheEnabled())
+    {
+        return;
+    }
+
+    length = sizeof(numtextures);
+
+    for (i = 0 ; i < numtextures ; i++)
+    {
+        tex.width = textures[i]->width;
+        tex.patchcount = textures[i]->patchcount;
+        length += R_CachedTextureSize(&tex);
+    }
+
+    data = malloc(length);
+
+    if (data == NULL)
+    {
+        return;
+    }
+
+    memcpy(data, &numtextures, sizeof(numtextures));
+    offset = sizeof(numtextures);
+
+    for (i = 0 ; i < numtextures ; i++)
+    {
+        const texture_t *texture = textures[i];
+
+        memcpy(tex.name, texture->name, sizeof(tex.name));
+        tex.width = texture->width;
+        tex.height = texture->height;
+        tex.patchcount = texture->patchcount;
+        tex.compositesize = texturecompositesize[i];
+        memcpy(data + offset, &tex, sizeof(tex));
+        offset += sizeof(tex);
+
+        memcpy(data + offset, texture->patches, tex.patchcount * sizeof(texpatch_t));
+        offset += tex.patchcount * sizeof(texpatch_t);
+        memcpy(data + offset, texturecolumnlump[i], tex.width * sizeof(**texturecolumnlump));
+        offset += tex.width * sizeof(**texturecolumnlump);
+        memcpy(data + offset, texturecolumnofs[i], tex.width * sizeof(**texturecolumnofs));
+        offset += tex.width * sizeof(**texturecolumnofs);
+        memcpy(data + offset, texturecolumnofs2[i], tex.width * sizeof(**texturecolumnofs2));
+        offset += tex.width * sizeof(**texturecolumnofs2);
+    }
+
+    M_WriteStartupCache("textures", key, keylen, data, length);
+    free(data);
+}
+
+// -----------------------------------------------------------------------------
+// R_PrecalcTextures
+// Generates composites, animation and hash tables of the loaded textures.
+// Column lookups are generated too, unless they came from the cache.
+// -----------------------------------------------------------------------------
+
+static void R_PrecalcTextures (const boolean cached)
+{
+    // Create translation table for global animation.
+    texturetranslation = Z_Malloc ((numtextures+1)*sizeof(*texturetranslation), PU_STATIC, 0);
+
+    for (int i = 0 ; i < numtextures ; i++)
+    {
+        if (!cached)
+        {
+            R_GenerateLookup (i);
+        }
+        // [JN] Generate composite textures at startup.
+        R_GenerateComposite (i);
+        // [JN] Create animation table.
+        texturetranslation[i] = i;
+    }
+
+    GenerateTextureHashTable();
+}
+
 // -----------------------------------------------------------------------------
 // R_InitTextures
 // Initializes the texture list
 //  with the textures from the world map.
+//  Returns true if the texture tables were loaded from the startup cache.
 //
 // [crispy] partly rewritten to merge PNAMES and TEXTURE1/2 lumps
 // -----------------------------------------------------------------------------
 
-static void R_InitTextures (void)
+static boolean R_InitTextures (void)
 {
     int			   i, j, k;
     int			   nummappatches;
@@ -675,6 +901,20 @@ static void R_InitTextures (void)
     int	 numpnameslumps = 0;
     int	 numtexturelumps = 0;
 
+    // [JN] Lumps the texture tables depend on, besides the loaded files.
+    char cachekey[4][8];
+
+    strncpy(cachekey[0], DEH_String("TEXTURE1"), 8);
+    strncpy(cachekey[1], DEH_String("TEXTURE2"), 8);
+    strncpy(cachekey[2], DEH_String("PNAMES"), 8);
+    strncpy(cachekey[3], DEH_String("TEXTURE"), 8);
+
+    if (R_ReadTextureCache(cachekey, sizeof(cachekey)))
+    {
+        R_PrecalcTextures(true);
+        return true;
+    }
+
     // [crispy] allocate memory for the pnameslumps and texturelumps arrays
     pnameslumps = I_Realloc(pnameslumps, maxpnameslumps * sizeof(*pnameslumps));
     texturelumps = I_Realloc(texturelumps, maxtexturelumps * sizeof(*texturelumps));
@@ -757,13 +997,10 @@ static void R_InitTextures (void)
             int p, po;
 
             M_StringCopy(name, pnameslumps[i].name_p + j * 8, sizeof(name));
-            p = po = W_CheckNumForName(name);
+            po = W_CheckNumForName(name);
 
             // [crispy] prevent flat lumps from being mistaken as patches
-            while (p >= firstflat && p <= lastflat)
-            {
-                p = W_CheckNumForNameFromTo (name, p - 1, 0);
-            }
+            p = W_CheckNumForNameNS(name, ns_patches);
 
             // [crispy] if the name is unambiguous, use the lump we found
             patchlookup[k++] = (p == -1) ? po : p;
@@ -809,17 +1046,7 @@ static void R_InitTextures (void)
     // [crispy] pointer to (i.e. actually before) the first texture file
     texturelump = texturelumps - 1; // [crispy] gets immediately increased below
 
-    textures = Z_Malloc (numtextures * sizeof(*textures), PU_STATIC, 0);
-    texturecolumnlump = Z_Malloc (numtextures * sizeof(*texturecolumnlump), PU_STATIC, 0);
-    texturecolumnofs = Z_Malloc (numtextures * sizeof(*texturecolumnofs), PU_STATIC, 0);
-    texturecolumnofs2 = Z_Malloc (numtextures * sizeof(*texturecolumnofs2), PU_STATIC, 0);
-    texturecomposite = Z_Malloc (numtextures * sizeof(*texturecomposite), PU_STATIC, 0);
-    texturecomposite2 = Z_Malloc (numtextures * sizeof(*texturecomposite2), PU_STATIC, 0);
-    texturecompositesize = Z_Malloc (numtextures * sizeof(*texturecompositesize), PU_STATIC, 0);
-    texturewidthmask = Z_Malloc (numtextures * sizeof(*texturewidthmask), PU_STATIC, 0);
-    texturewidth = Z_Malloc (numtextures * sizeof(*texturewidth), PU_STATIC, 0);
-    textureheight = Z_Malloc (numtextures * sizeof(*textureheight), PU_STATIC, 0);
-    texturebrightmap = Z_Malloc (numtextures * sizeof(*texturebrightmap), PU_STATIC, 0);
+    R_AllocTextures();
 
     //	Really complex printing shit...
 
@@ -894,19 +1121,7 @@ static void R_InitTextures (void)
             }
         }
 
-        texturecolumnlump[i] = Z_Malloc (texture->width*sizeof(**texturecolumnlump), PU_STATIC,0);
-        texturecolumnofs[i] = Z_Malloc (texture->width*sizeof(**texturecolumnofs), PU_STATIC,0);
-        texturecolumnofs2[i] = Z_Malloc (texture->width*sizeof(**texturecolumnofs2), PU_STATIC,0);
-
-        j = 1;
-
-        while (j*2 <= texture->width)
-	    j<<=1;
-
-        texturewidthmask[i] = j-1;
-        textureheight[i] = texture->height<<FRACBITS;
-        // [crispy] texture width for wrapping column getter function
-        texturewidth[i] = texture->width;
+        R_InitTextureColumns(i);
     }
 
     Z_Free(patchlookup);
@@ -919,20 +1134,10 @@ static void R_InitTextures (void)
     free(texturelumps);
     
     // Precalculate whatever possible.	
+    R_PrecalcTextures(false);
+    R_WriteTextureCache(cachekey, sizeof(cachekey));
 
-    // Create translation table for global animation.
-    texturetranslation = Z_Malloc ((numtextures+1)*sizeof(*texturetranslation), PU_STATIC, 0);
-
-    for (i=0 ; i<numtextures ; i++)
-    {
-        R_GenerateLookup (i);
-        // [JN] Generate composite textures at startup.
-        R_GenerateComposite (i);
-        // [JN] Create animation table.
-        texturetranslation[i] = i;
-    }
-
-    GenerateTextureHashTable();
+    return false;
 }
 
 // -----------------------------------------------------------------------------
@@ -1082,21 +1287,28 @@ static void R_InitTransMaps (void)
     }
     else
     {
-        // [JN] We do. Generate tables dynamically.
+        // [JN] We do. Generate tables dynamically, unless they are
+        // already in the startup cache for this palette.
 
         // Compose a default transparent filter map based on PLAYPAL.
         unsigned char *playpal = W_CacheLumpName("PLAYPAL", PU_STATIC);
-
-        transtable90 = Z_Malloc(256*256, PU_STATIC, 0);
-        transtable80 = Z_Malloc(256*256, PU_STATIC, 0);
-        transtable70 = Z_Malloc(256*256, PU_STATIC, 0);
-        transtable60 = Z_Malloc(256*256, PU_STATIC, 0);
-        transtable50 = Z_Malloc(256*256, PU_STATIC, 0);
-        transtable40 = Z_Malloc(256*256, PU_STATIC, 0);
-        transtable30 = Z_Malloc(256*256, PU_STATIC, 0);
-        transtable20 = Z_Malloc(256*256, PU_STATIC, 0);
-        transtable10 = Z_Malloc(256*256, PU_STATIC, 0);
-
+        byte *tables = Z_Malloc(9*256*256, PU_STATIC, 0);
+        const int starttime = I_GetTimeMS();
+        boolean cached;
+
+        transtable90 = tables;
+        transtable80 = tables + 1*256*256;
+        transtable70 = tables + 2*256*256;
+        transtable60 = tables + 3*256*256;
+        transtable50 = tables + 4*256*256;
+        transtable40 = tables + 5*256*256;
+        transtable30 = tables + 6*256*256;
+        transtable20 = tables + 7*256*256;
+        transtable10 = tables + 8*256*256;
+
+        cached = M_ReadStartupCache("transmaps", playpal, 768, tables, 9*256*256);
+
+        if (!cached)
         {
             byte *fg, *bg, blend[3];
             byte *tp90 = transtable90;
@@ -1174,8 +1386,11 @@ static void R_InitTransMaps (void)
                     *tp10++ = V_GetPaletteIndex(playpal, blend[r], blend[g], blend[b]);
                 }
             }
+
+            M_WriteStartupCache("transmaps", playpal, 768, tables, 9*256*256);
         }
 
+        M_StartupTime("transmaps", cached, starttime);
         W_ReleaseLumpName("PLAYPAL");
     }
 }
@@ -1188,11 +1403,13 @@ static void R_InitTransMaps (void)
 
 void R_InitData (void)
 {
+    const int starttime = I_GetTimeMS();
+
     // [JN] Moved R_InitFlats to the top, needed for 
     // R_GenerateComposite ivoking while level loading.
     R_InitFlats ();
     R_InitBrightmaps ();
-    R_InitTextures ();
+    M_StartupTime("textures", R_InitTextures(), starttime);
     R_InitSpriteLumps ();
     R_InitColormaps ();
     // [JN] Generate translucency tables
@@ -1207,7 +1424,14 @@ void R_InitData (void)
 int R_FlatNumForName (char *name)
 {
     char namet[9];
-    int i = W_CheckNumForNameFromTo (name, lastflat, firstflat);
+    int i = W_CheckNumForNameNS(name, ns_flats);
+
+    // [JN] Fall back to the range R_InitFlats found, should the
+    // markers differ from the ones of the flats namespace.
+    if (i < firstflat || i > lastflat)
+    {
+        i = W_CheckNumForNameFromTo(name, lastflat, firstflat);
+    }
 
     if (i == -1)
     {
@@ -1279,6 +1503,21 @@ int	R_TextureNumForName (char *name)
     return i;
 }
 
+// -----------------------------------------------------------------------------
+// PrecacheLump
+// [JN] Lumps of memory-mapped WADs are not touched, the kernel is asked
+// to read them ahead instead. This does not stall, so unlike loading
+// them, it is done during demo playback as well.
+// -----------------------------------------------------------------------------
+
+static void PrecacheLump (const int lump)
+{
+    if (!W_PrefetchLumpNum(lump) && !demoplayback)
+    {
+        W_CacheLumpNum(lump, PU_CACHE);
+    }
+}
+
 // -----------------------------------------------------------------------------
 // R_PrecacheLevel
 // Preloads all relevant graphics for the level.
@@ -1292,11 +1531,6 @@ void R_PrecacheLevel (void)
     int   i;
     byte *hitlist;
 
-    if (demoplayback)
-    {
-        return;
-    }
-
     {
         size_t size = numflats > numsprites  ? numflats : numsprites;
         hitlist = malloc(numtextures > size ? numtextures : size);
@@ -1311,7 +1545,7 @@ void R_PrecacheLevel (void)
 
     for (i = numflats ; --i >= 0 ; )
         if (hitlist[i])
-            W_CacheLumpNum(firstflat + i, PU_CACHE);
+            PrecacheLump(firstflat + i);
 
     // Precache textures.
 
@@ -1338,7 +1572,7 @@ void R_PrecacheLevel (void)
             int j = texture->patchcount;
 
             while (--j >= 0)
-            W_CacheLumpNum(texture->patches[j].patch, PU_CACHE);
+            PrecacheLump(texture->patches[j].patch);
         }
 
     // Precache sprites.
@@ -1362,11 +1596,12 @@ void R_PrecacheLevel (void)
                 int k = 7;
 
                 do
-                W_CacheLumpNum(firstspritelump + sflump[k], PU_CACHE);
+                PrecacheLump(firstspritelump + sflump[k]);
                 while (--k >= 0);
             }
         }
 
+    W_FinishPrefetch();
     free(hitlist);
 }
 
@@ -57,15 +57,16 @@ static int   columnofs[MAXWIDTH];
 static byte *background_buffer = NULL;
 
 // R_DrawColumn. Source is the top of the column to scale.
-const lighttable_t *dc_colormap[2];  // [crispy] brightmaps
-const byte         *dc_source;       // First pixel in a column (possibly virtual).
-fixed_t dc_x, dc_yl, dc_yh; 
-fixed_t dc_iscale;
-fixed_t dc_texturemid;
-fixed_t dc_texheight;
+// [JN] Thread local, sky columns are drawn by R_DrawPlanes worker threads.
+THREADLOCAL const lighttable_t *dc_colormap[2];  // [crispy] brightmaps
+THREADLOCAL const byte         *dc_source;       // First pixel in a column (possibly virtual).
+THREADLOCAL fixed_t dc_x, dc_yl, dc_yh;
+THREADLOCAL fixed_t dc_iscale;
+THREADLOCAL fixed_t dc_texturemid;
+THREADLOCAL fixed_t dc_texheight;
 
 // Translated columns.
-const byte *dc_translation;
+THREADLOCAL const byte *dc_translation;
 byte       *translationtables;
 
 // Spectre/Invisibility fuzz effect.
@@ -80,12 +81,34 @@ static const int fuzzoffset[FUZZTABLE] =
    -1,  1,  1,  1,  1, -1,  1,  1, -1,  1  
 };
 
-static int fuzzpos = 0;
+// [JN] With more than one strip, columns are drawn by the strips at the
+// same time, so fuzz position is picked for every column from its screen
+// position and the picture does not depend on the order they are drawn in.
+// With one strip, fuzz runs on through the frame as it always did.
+static THREADLOCAL int fuzzpos = 0;
 static int fuzzpos_tic;
+static int fuzzseed, fuzzseed_tic;
+static boolean fuzzhash;
 
-const lighttable_t *ds_colormap[2];
-const byte         *ds_source;  // start of a 64*64 tile image 
-const byte         *ds_brightmap;
+static inline int R_FuzzHash (const int x, const int y)
+{
+    return (int)((((unsigned)(x + fuzzseed) * 0x9E3779B1u) >> 26) + y) % FUZZTABLE;
+}
+
+// Fuzz position of the first pixel of a column.
+static inline int R_FuzzPos (const int x, const int y)
+{
+    return fuzzhash ? R_FuzzHash(x, y) : fuzzpos;
+}
+
+// [crispy] Random fuzz position, used by improved fuzz.
+static inline int R_FuzzRandom (const int x, const int y)
+{
+    return fuzzhash ? R_FuzzHash(x, y) : Crispy_Random();
+}
+
+THREADLOCAL const lighttable_t *ds_colormap;  // [JN] Fused with flat brightmap.
+THREADLOCAL const byte         *ds_source;    // start of a 64*64 tile image 
 
 
 // -----------------------------------------------------------------------------
@@ -130,8 +153,7 @@ void R_DrawColumn (void)
     // [JN] killough 2/1/98: more performance tuning
     {
         const byte *source = dc_source;
-        const byte *brightmap = dc_brightmap;
-        const lighttable_t *const *colormap = dc_colormap;
+        const lighttable_t *colormap = R_BrightColormap(dc_brightmap, dc_colormap[0], dc_colormap[1]);
         int heightmask = dc_texheight-1;
 
         if (dc_texheight & heightmask)  // not a power of 2 -- killough
@@ -153,7 +175,7 @@ void R_DrawColumn (void)
                 // [crispy] brightmaps
                 const byte src = source[frac>>FRACBITS];
 
-                *dest = colormap[brightmap[src]][src];
+                *dest = colormap[src];
                 dest += screenwidth;
                 if ((frac += fracstep) >= heightmask)
                 {
@@ -170,7 +192,7 @@ void R_DrawColumn (void)
                 // [crispy] brightmaps
                 const byte src = source[(frac>>FRACBITS)&heightmask];
 
-                *dest = colormap[brightmap[src]][src];
+                *dest = colormap[src];
                 dest += screenwidth; 
                 frac += fracstep;
             } while (count--); 
@@ -179,6 +201,172 @@ void R_DrawColumn (void)
 }
 
 
+// -----------------------------------------------------------------------------
+// Quad column drawing
+// [JN] Columns are drawn into a small buffer four columns wide, so adjacent
+// columns share cache lines, and written to the screen four pixels per row.
+// Each queued column keeps own lighting, so output is identical to
+// R_DrawColumn. Columns queued into the same slot twice (i.e. top and bottom
+// wall tiers) are kept as separate ranges and never written over each other.
+// -----------------------------------------------------------------------------
+
+#define QUADRANGES 8  // Maximal number of posts in a queued column.
+
+static THREADLOCAL byte quadbuf[MAXHEIGHT * 4];
+static THREADLOCAL int  quadcol = -1;            // First screen column of queued group.
+static THREADLOCAL int  quadranges[4];
+static THREADLOCAL int  quadyl[4][QUADRANGES];
+static THREADLOCAL int  quadyh[4][QUADRANGES];
+
+void R_FlushColumns (void)
+{
+    int top = 0, bottom = SCREENHEIGHT - 1;
+
+    if (quadcol < 0)
+    {
+        return;
+    }
+
+    // Four-wide copy is only possible between rows every column has.
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        if (quadranges[i] != 1)
+        {
+            top = SCREENHEIGHT;
+            break;
+        }
+        top = MAX(top, quadyl[i][0]);
+        bottom = MIN(bottom, quadyh[i][0]);
+    }
+
+    if (top <= bottom)
+    {
+        byte *dest = ylookup[top] + columnofs[quadcol];
+        const byte *source = quadbuf + top * 4;
+
+        for (int y = top ; y <= bottom ; y++)
+        {
+            memcpy(dest, source, 4);
+            dest += screenwidth;
+            source += 4;
+        }
+    }
+    else
+    {
+        // No common rows, copy everything column by column.
+        top = SCREENHEIGHT;
+        bottom = SCREENHEIGHT - 1;
+    }
+
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        for (int r = 0 ; r < quadranges[i] ; r++)
+        {
+            const int yl = quadyl[i][r];
+            const int yh = quadyh[i][r];
+
+            for (int y = yl ; y <= yh ; y++)
+            {
+                if (y == top)
+                {
+                    y = bottom;  // Already copied, skip.
+                    continue;
+                }
+
+                ylookup[y][columnofs[quadcol + i]] = quadbuf[y * 4 + i];
+            }
+        }
+
+        quadranges[i] = 0;
+    }
+
+    quadcol = -1;
+}
+
+void R_QueueColumn (void)
+{
+    int      count = dc_yh - dc_yl;
+    int      col, slot;
+    byte    *dest;
+    fixed_t  frac, fracstep;
+
+    // Zero length, column does not exceed a pixel.
+    if (count < 0)
+    {
+        return;
+    }
+
+#ifdef RANGECHECK
+    if ((unsigned)dc_x >= screenwidth || dc_yl < 0 || dc_yh >= SCREENHEIGHT)
+    {
+        I_QuitWithError(english_language ?
+                        "R_QueueColumn: %i to %i at %i" :
+                        "R_QueueColumn: %i к %i у %i",
+                        dc_yl, dc_yh, dc_x);
+    }
+#endif
+
+    col = flipviewwidth[dc_x];
+    slot = col & 3;
+
+    if (quadcol != (col & ~3) || quadranges[slot] == QUADRANGES)
+    {
+        R_FlushColumns();
+        quadcol = col & ~3;
+    }
+
+    quadyl[slot][quadranges[slot]] = dc_yl;
+    quadyh[slot][quadranges[slot]] = dc_yh;
+    quadranges[slot]++;
+
+    dest = quadbuf + dc_yl * 4 + slot;
+    fracstep = dc_iscale;
+    frac = dc_texturemid + (dc_yl-centery)*fracstep;
+
+    // Same as R_DrawColumn, but with the buffer stride.
+    {
+        const byte *source = dc_source;
+        const lighttable_t *colormap = R_BrightColormap(dc_brightmap, dc_colormap[0], dc_colormap[1]);
+        int heightmask = dc_texheight-1;
+
+        if (dc_texheight & heightmask)  // not a power of 2 -- killough
+        {
+            heightmask++;
+            heightmask <<= FRACBITS;
+
+            if (frac < 0)
+                while ((frac += heightmask) < 0);
+            else
+                while (frac >= heightmask)
+                    frac -= heightmask;
+
+            do
+            {
+                const byte src = source[frac>>FRACBITS];
+
+                *dest = colormap[src];
+                dest += 4;
+                if ((frac += fracstep) >= heightmask)
+                {
+                    frac -= heightmask;
+                }
+            } while (count--);
+        }
+        else  // texture height is a power of 2 -- killough
+        {
+            do 
+            {
+                const byte src = source[(frac>>FRACBITS)&heightmask];
+
+                *dest = colormap[src];
+                dest += 4;
+                frac += fracstep;
+            } while (count--); 
+        }
+    }
+}
+
+
 void R_DrawColumnLow (void) 
 { 
     int       x;
@@ -215,8 +403,7 @@ void R_DrawColumnLow (void)
     // Inner loop that does the actual texture mapping, e.g. a DDA-lile scaling.
     {
         const byte *source = dc_source;
-        const byte *brightmap = dc_brightmap;
-        const lighttable_t *const *colormap = dc_colormap;
+        const lighttable_t *colormap = R_BrightColormap(dc_brightmap, dc_colormap[0], dc_colormap[1]);
         int heightmask = dc_texheight-1;
 
         if (dc_texheight & heightmask) // not a power of 2 -- killough
@@ -234,7 +421,7 @@ void R_DrawColumnLow (void)
             {
                 // [crispy] brightmaps
                 const byte src = source[frac>>FRACBITS];
-                *dest4 = *dest3 = *dest2 = *dest1 = colormap[brightmap[src]][src];
+                *dest4 = *dest3 = *dest2 = *dest1 = colormap[src];
 
                 dest1 += screenwidth_low;
                 dest2 += screenwidth_low;
@@ -253,7 +440,7 @@ void R_DrawColumnLow (void)
             {
                 // [crispy] brightmaps
                 const byte src = source[(frac>>FRACBITS)&heightmask];
-                *dest4 = *dest3 = *dest2 = *dest1 = colormap[brightmap[src]][src];
+                *dest4 = *dest3 = *dest2 = *dest1 = colormap[src];
 
                 dest1 += screenwidth_low;
                 dest2 += screenwidth_low;
@@ -279,10 +466,13 @@ void R_DrawColumnLow (void)
 void R_SetFuzzPosTic (void)
 {
 	fuzzpos_tic = fuzzpos;
+	fuzzseed_tic++;
 }
 void R_SetFuzzPosDraw (void)
 {
 	fuzzpos = fuzzpos_tic;
+	fuzzseed = fuzzseed_tic;
+	fuzzhash = numstrips > 1;
 }
 
 // -----------------------------------------------------------------------------
@@ -325,6 +515,8 @@ void R_DrawFuzzColumn (void)
     }
 #endif
 
+    fuzzpos = R_FuzzPos(dc_x, dc_yl);
+
     dest = ylookup[dc_yl] + columnofs[flipviewwidth[dc_x]];
 
     // Looks like an attempt at dithering, 
@@ -398,6 +590,8 @@ void R_DrawFuzzColumnLow (void)
     }
 #endif
 
+    fuzzpos = R_FuzzPos(dc_x, dc_yl);
+
     dest1 = ylookup[(dc_yl << hires)] + columnofs[flipviewwidth[x]];
     dest2 = ylookup[(dc_yl << hires)] + columnofs[flipviewwidth[x+1]];
     dest3 = ylookup[(dc_yl << hires) + 1] + columnofs[flipviewwidth[x]];
@@ -469,6 +663,8 @@ void R_DrawFuzzColumnBW (void)
     }
 #endif
 
+    fuzzpos = R_FuzzPos(dc_x, dc_yl);
+
     dest = ylookup[dc_yl] + columnofs[flipviewwidth[dc_x]];
 
     do
@@ -529,6 +725,8 @@ void R_DrawFuzzColumnLowBW (void)
     }
 #endif
 
+    fuzzpos = R_FuzzPos(dc_x, dc_yl);
+
     dest1 = ylookup[(dc_yl << hires)] + columnofs[flipviewwidth[x]];
     dest2 = ylookup[(dc_yl << hires)] + columnofs[flipviewwidth[x+1]];
     dest3 = ylookup[(dc_yl << hires) + 1] + columnofs[flipviewwidth[x]];
@@ -598,6 +796,8 @@ void R_DrawFuzzColumnImproved (void)
     }
 #endif
 
+    fuzzpos = R_FuzzPos(dc_x, dc_yl);
+
     dest = ylookup[dc_yl] + columnofs[flipviewwidth[dc_x]];
 
     do
@@ -606,7 +806,7 @@ void R_DrawFuzzColumnImproved (void)
 
         if (++fuzzpos == FUZZTABLE)
         {
-            fuzzpos = leveltime > oldleveltime ? Crispy_Random() % 49 : 0;
+            fuzzpos = leveltime > oldleveltime ? R_FuzzRandom(dc_x, count) % 49 : 0;
         }
 
         dest += screenwidth;
@@ -655,6 +855,8 @@ void R_DrawFuzzColumnLowImproved (void)
     }
 #endif
 
+    fuzzpos = R_FuzzPos(dc_x, dc_yl);
+
     dest1 = ylookup[(dc_yl << hires)] + columnofs[flipviewwidth[x]];
     dest2 = ylookup[(dc_yl << hires)] + columnofs[flipviewwidth[x+1]];
     dest3 = ylookup[(dc_yl << hires) + 1] + columnofs[flipviewwidth[x]];
@@ -667,7 +869,7 @@ void R_DrawFuzzColumnLowImproved (void)
 
         if (++fuzzpos == FUZZTABLE)
         {
-            fuzzpos = leveltime > oldleveltime ? Crispy_Random() % 49 : 0;
+            fuzzpos = leveltime > oldleveltime ? R_FuzzRandom(dc_x, count) % 49 : 0;
         }
 
         dest1 += screenwidth_low;
@@ -723,6 +925,8 @@ void R_DrawFuzzColumnImprovedBW (void)
     }
 #endif
 
+    fuzzpos = R_FuzzPos(dc_x, dc_yl);
+
     dest = ylookup[dc_yl] + columnofs[flipviewwidth[dc_x]];
 
     do
@@ -731,7 +935,7 @@ void R_DrawFuzzColumnImprovedBW (void)
 
         if (++fuzzpos == FUZZTABLE)
         {
-            fuzzpos = leveltime > oldleveltime ? Crispy_Random() % 49 : 0;
+            fuzzpos = leveltime > oldleveltime ? R_FuzzRandom(dc_x, count) % 49 : 0;
         }
 
         dest += screenwidth;
@@ -784,6 +988,8 @@ void R_DrawFuzzColumnLowImprovedBW (void)
     }
 #endif
 
+    fuzzpos = R_FuzzPos(dc_x, dc_yl);
+
     dest1 = ylookup[(dc_yl << hires)] + columnofs[flipviewwidth[x]];
     dest2 = ylookup[(dc_yl << hires)] + columnofs[flipviewwidth[x+1]];
     dest3 = ylookup[(dc_yl << hires) + 1] + columnofs[flipviewwidth[x]];
@@ -798,7 +1004,7 @@ void R_DrawFuzzColumnLowImprovedBW (void)
 
         if (++fuzzpos == FUZZTABLE)
         {
-            fuzzpos = leveltime > oldleveltime ? Crispy_Random() % 49 : 0;
+            fuzzpos = leveltime > oldleveltime ? R_FuzzRandom(dc_x, count) % 49 : 0;
         }
 
         dest1 += screenwidth_low;
@@ -1480,8 +1686,7 @@ void R_DrawSpan (fixed_t x1, fixed_t x2, const fixed_t y,
 { 
     unsigned int count = x2 - x1;  // We do not check for zero spans here.
     const byte  *source = ds_source;
-    const byte  *brightmap = ds_brightmap;
-    const byte **colormap = ds_colormap;
+    const byte  *colormap = ds_colormap;
 
 #ifdef RANGECHECK
     if (x2 < x1 || x1 < 0 || x2 >= screenwidth || (unsigned)y > SCREENHEIGHT)
@@ -1507,13 +1712,129 @@ void R_DrawSpan (fixed_t x1, fixed_t x2, const fixed_t y,
         unsigned const int spot = ((ds_xfrac >> 16) & 0x3f) | ((ds_yfrac >> 10) & 0x0fc0);
 
         // Lookup pixel from flat texture tile, re-index using light/colormap.
-        *dest = colormap[brightmap[source[spot]]][source[spot]];
+        *dest = colormap[source[spot]];
 
         ds_xfrac += ds_xstep;
         ds_yfrac += ds_ystep;
     } while (count--);
 }
 
+// -----------------------------------------------------------------------------
+// R_DrawSpanLit
+// [JN] Alternate version of R_DrawSpan. The flat is lit once per light level
+// into a 64x64 tile, so the inner loop needs only one lookup per pixel and
+// the row is written eight pixels at a time. Output is identical to
+// R_DrawSpan. Tiles live for one frame, as swirling flats change each tic
+// and flat lumps may be purged between frames.
+// -----------------------------------------------------------------------------
+
+#define LITFLATS     16  // Lit tiles kept per thread.
+#define LITFLATSPAN  32  // Shorter spans are not worth lighting a new tile.
+
+typedef struct
+{
+    const byte         *source;
+    const lighttable_t *colormap;
+    unsigned int        frame;
+    byte                pixels[64*64];
+} litflat_t;
+
+int prelit_flats = 1;
+unsigned int litflatframe;
+
+static THREADLOCAL litflat_t litflats[LITFLATS];
+
+static const byte *R_LitFlat (const boolean build)
+{
+    const uintptr_t key = ((uintptr_t) ds_colormap >> 8) ^ ((uintptr_t) ds_source >> 12);
+    litflat_t *const lit = &litflats[key % LITFLATS];
+
+    if (lit->frame == litflatframe && lit->source == ds_source
+    &&  lit->colormap == ds_colormap)
+    {
+        return lit->pixels;
+    }
+
+    if (!build)
+    {
+        return NULL;
+    }
+
+    for (int i = 0 ; i < 64*64 ; i++)
+    {
+        lit->pixels[i] = ds_colormap[ds_source[i]];
+    }
+
+    lit->source = ds_source;
+    lit->colormap = ds_colormap;
+    lit->frame = litflatframe;
+
+    return lit->pixels;
+}
+
+void R_DrawSpanLit (fixed_t x1, fixed_t x2, const fixed_t y,
+                    fixed_t ds_xfrac, const fixed_t ds_xstep,
+                    fixed_t ds_yfrac, const fixed_t ds_ystep)
+{
+    unsigned int count = x2 - x1 + 1;
+    unsigned int xfrac = ds_xfrac, yfrac = ds_yfrac;
+    unsigned int xstep = ds_xstep, ystep = ds_ystep;
+    const byte  *lit;
+    byte        *dest;
+
+#ifdef RANGECHECK
+    if (x2 < x1 || x1 < 0 || x2 >= screenwidth || (unsigned)y > SCREENHEIGHT)
+    {
+        I_QuitWithError(english_language ?
+                        "R_DrawSpanLit: %i to %i at %i" :
+                        "R_DrawSpanLit: %i к %i у %i",
+                        x1, x2, y);
+    }
+#endif
+
+    if ((lit = R_LitFlat(count >= LITFLATSPAN)) == NULL)
+    {
+        R_DrawSpan(x1, x2, y, ds_xfrac, ds_xstep, ds_yfrac, ds_ystep);
+        return;
+    }
+
+    // Always walk the row from left to right on screen. With flipped
+    // levels, start from the other end of the span and step backwards.
+    if (flipviewwidth[x1] > flipviewwidth[x2])
+    {
+        xfrac += (count - 1) * xstep;
+        yfrac += (count - 1) * ystep;
+        xstep = -xstep;
+        ystep = -ystep;
+        dest = ylookup[y] + columnofs[flipviewwidth[x2]];
+    }
+    else
+    {
+        dest = ylookup[y] + columnofs[flipviewwidth[x1]];
+    }
+
+    for ( ; count >= 8 ; count -= 8, dest += 8)
+    {
+        byte pixels[8];
+
+        for (int i = 0 ; i < 8 ; i++)
+        {
+            pixels[i] = lit[((xfrac >> 16) & 0x3f) | ((yfrac >> 10) & 0x0fc0)];
+            xfrac += xstep;
+            yfrac += ystep;
+        }
+
+        memcpy(dest, pixels, sizeof(pixels));
+    }
+
+    while (count--)
+    {
+        *dest++ = lit[((xfrac >> 16) & 0x3f) | ((yfrac >> 10) & 0x0fc0)];
+        xfrac += xstep;
+        yfrac += ystep;
+    }
+}
+
 // -----------------------------------------------------------------------------
 // R_DrawSpanLow
 // Again..
@@ -1526,8 +1847,7 @@ void R_DrawSpanLow (fixed_t x1, fixed_t x2, const fixed_t y,
     unsigned int count = x2 - x1;  // We do not check for zero spans here.
     const int    ds_y_low = y << hires;
     const byte  *source = ds_source;
-    const byte  *brightmap = ds_brightmap;
-    const byte **colormap = ds_colormap;
+    const byte  *colormap = ds_colormap;
     byte        *dest1, *dest2;
 
 #ifdef RANGECHECK
@@ -1557,13 +1877,13 @@ void R_DrawSpanLow (fixed_t x1, fixed_t x2, const fixed_t y,
 
         // Lowres/blocky mode does it twice, while scale is adjusted appropriately.
          dest1 = ylookup[ds_y_low] + columnofs[flipviewwidth[x1]];
-        *dest1 = colormap[brightmap[source[spot]]][source[spot]];
+        *dest1 = colormap[source[spot]];
          dest2 = ylookup[ds_y_low+1] + columnofs[flipviewwidth[x1++]];
-        *dest2 = colormap[brightmap[source[spot]]][source[spot]];
+        *dest2 = colormap[source[spot]];
          dest1 = ylookup[ds_y_low] + columnofs[flipviewwidth[x1]];
-        *dest1 = colormap[brightmap[source[spot]]][source[spot]];
+        *dest1 = colormap[source[spot]];
          dest2 = ylookup[ds_y_low+1] + columnofs[flipviewwidth[x1++]];
-        *dest2 = colormap[brightmap[source[spot]]][source[spot]];
+        *dest2 = colormap[source[spot]];
 
         // position += step;
         ds_xfrac += ds_xstep;
@@ -117,16 +117,15 @@ typedef	struct
     // list of mobjs in sector
     mobj_t *thinglist;
 
+    // [JN] killough 3/28/98: list of mobjs touching sector
+    struct msecnode_s *touching_thinglist;
+
     // thinker_t for reversable actions
     void   *specialdata;
 
     int             linecount;
     struct line_s **lines;	// [linecount] size
 
-    // [crispy] WiggleFix: [kb] for R_FixWiggle()
-    int     cachedheight;
-    int     scaleindex;
-
     // [AM] Previous position of floor and ceiling before
     //      think.  Used to interpolate between positions.
     fixed_t oldfloorheight;
@@ -147,6 +146,22 @@ typedef	struct
 
 } sector_t;
 
+// -----------------------------------------------------------------------------
+// [JN] phares 3/14/98: sector touching lists. Each node links a thing to
+// one of the sectors its bounding box touches, and is threaded both through
+// the list of the thing and the list of the sector.
+// -----------------------------------------------------------------------------
+
+typedef struct msecnode_s
+{
+    sector_t          *m_sector;  // a sector containing this object
+    struct mobj_s     *m_thing;   // this object
+    struct msecnode_s *m_tnext;   // next msecnode_t for this thing
+    struct msecnode_s *m_sprev;   // prev msecnode_t for this sector
+    struct msecnode_s *m_snext;   // next msecnode_t for this sector
+    boolean            visited;   // already processed by sector iterator
+} msecnode_t;
+
 //
 // The SideDef.
 //
@@ -186,6 +201,18 @@ typedef enum
 
 } slopetype_t;
 
+// [JN] cph: linedef properties, rolled up by R_AddLine.
+// With more than one strip they are worked out again by every strip,
+// as lines are shared by all of them.
+enum
+{
+    RF_TOP_TILE  = 1,   // Upper texture needs tiling
+    RF_MID_TILE  = 2,   // Mid texture needs tiling
+    RF_BOT_TILE  = 4,   // Lower texture needs tiling
+    RF_IGNORE    = 8,   // Renderer can skip this line
+    RF_CLOSED    = 16,  // Line blocks view
+};
+
 //
 // A LineDef.
 //
@@ -229,13 +256,7 @@ typedef struct line_s
 
     // [JN] Improved column clipping.
     int r_validcount;   // cph: if == gametic, r_flags already done
-    enum {              // cph:
-    RF_TOP_TILE  = 1,   // Upper texture needs tiling
-    RF_MID_TILE  = 2,   // Mid texture needs tiling
-    RF_BOT_TILE  = 4,   // Lower texture needs tiling
-    RF_IGNORE    = 8,   // Renderer can skip this line
-    RF_CLOSED    = 16,  // Line blocks view
-    } r_flags;
+    int r_flags;        // RF_* flags, cached with one strip only
 
     // [crispy] calculate sound origin of line to be its midpoint
     degenmobj_t	soundorg;
@@ -370,6 +391,7 @@ typedef struct vissprite_s
 
     fixed_t texturemid;
     int     patch;
+    const patch_t *patchdata;  // [JN] Cached by R_DrawMasked.
 
     // for color translation and shadow draw, maxbright frames as well
     // [crispy] brightmaps for select sprites
@@ -430,6 +452,13 @@ typedef struct visplane_s
     int     minx;
     int     maxx;
 
+    // [JN] Drawing data, resolved by R_DrawPlanes
+    // before the planes are split between threads.
+    const byte    *source;
+    lighttable_t **zlight;  // [JN] Fused with flat brightmap.
+    fixed_t        planeheight;
+    fixed_t        flowx, flowy;
+
     // leave pads for [minx-1]/[maxx+1]
 
     unsigned int pad1;  // [crispy] hires / 32-bit integer math
@@ -457,27 +486,33 @@ extern const byte *R_BrightmapForFlatNum (const int num);
 extern const byte *R_BrightmapForState (const int state);
 extern const byte **texturebrightmap;
 
+extern const lighttable_t *R_BrightColormap (const byte *brightmap,
+                                             const lighttable_t *colormap,
+                                             const lighttable_t *brightcolormap);
+extern lighttable_t **R_BrightZLight (const byte *brightmap, const int light);
+extern void R_FlushBrightZLight (void);
+
 // -----------------------------------------------------------------------------
 // R_BSP
 // -----------------------------------------------------------------------------
 
-extern const seg_t  *curline;
-extern const side_t *sidedef;
-extern line_t       *linedef;
-extern sector_t     *frontsector;
-extern sector_t     *backsector;
-extern drawseg_t    *ds_p;
-extern drawseg_t    *drawsegs;
-extern unsigned      maxdrawsegs;
-extern byte         *solidcol;
-extern boolean       markfloor;		
-extern boolean       markceiling;
+extern THREADLOCAL const seg_t  *curline;
+extern THREADLOCAL const side_t *sidedef;
+extern THREADLOCAL line_t       *linedef;
+extern THREADLOCAL sector_t     *frontsector;
+extern THREADLOCAL sector_t     *backsector;
+extern THREADLOCAL int           lineflags;
+extern THREADLOCAL boolean       markfloor;		
+extern THREADLOCAL boolean       markceiling;
 
+void R_AddBSPSprites (int bspnum);
 void R_ClearClipSegs (void);
 void R_ClearDrawSegs (void);
-void R_InitClipSegs (void);
+void R_InterpolateSectors (void);
+void R_MarkMappedLines (void);
 void R_RenderBSPNode (int bspnum);
-void R_StoreWallRange (const int start, const int stop);
+void R_StoreWallRange (const int start, const int stop,
+                       const int segstart, const int segstop);
 
 // -----------------------------------------------------------------------------
 // R_DATA
@@ -507,22 +542,24 @@ extern byte *green_blood_set;
 // R_DRAW
 // -----------------------------------------------------------------------------
 
-extern const lighttable_t *dc_colormap[2];
-extern const byte         *dc_source;
-extern const byte         *dc_brightmap;
-extern fixed_t     dc_x, dc_yl, dc_yh; 
-extern fixed_t     dc_texheight;
-extern fixed_t     dc_iscale;
-extern fixed_t     dc_texturemid;
-extern const byte *dc_translation;
+extern THREADLOCAL const lighttable_t *dc_colormap[2];
+extern THREADLOCAL const byte         *dc_source;
+extern THREADLOCAL const byte         *dc_brightmap;
+extern THREADLOCAL fixed_t dc_x, dc_yl, dc_yh;
+extern THREADLOCAL fixed_t dc_texheight;
+extern THREADLOCAL fixed_t dc_iscale;
+extern THREADLOCAL fixed_t dc_texturemid;
+extern THREADLOCAL const byte *dc_translation;
 extern byte       *translationtables;
 
-extern const lighttable_t *ds_colormap[2];
-extern const byte         *ds_source;
-extern const byte         *ds_brightmap;
+extern THREADLOCAL const lighttable_t *ds_colormap;
+extern THREADLOCAL const byte         *ds_source;
+extern unsigned int litflatframe;
 
 void R_DrawColumn (void);
 void R_DrawColumnLow (void);
+void R_QueueColumn (void);
+void R_FlushColumns (void);
 void R_DrawFuzzColumn (void);
 void R_DrawFuzzColumnBW (void);
 void R_DrawFuzzColumnImproved (void);
@@ -538,6 +575,9 @@ void R_DrawGhostColumnLow (void);
 void R_DrawSpan (fixed_t x1, fixed_t x2, const fixed_t y,
                  fixed_t ds_xfrac, const fixed_t ds_xstep,
                  fixed_t ds_yfrac, const fixed_t ds_ystep);
+void R_DrawSpanLit (fixed_t x1, fixed_t x2, const fixed_t y,
+                    fixed_t ds_xfrac, const fixed_t ds_xstep,
+                    fixed_t ds_yfrac, const fixed_t ds_ystep);
 void R_DrawSpanLow (fixed_t x1, fixed_t x2, const fixed_t y,
                     fixed_t ds_xfrac, const fixed_t ds_xstep,
                     fixed_t ds_yfrac, const fixed_t ds_ystep);
@@ -594,12 +634,13 @@ extern lighttable_t *scalelight[LIGHTLEVELS][MAXLIGHTSCALE];
 extern lighttable_t *scalelightfixed[MAXLIGHTSCALE];
 extern lighttable_t *zlight[LIGHTLEVELS][MAXLIGHTZ];
 extern void (*basecolfunc) (void);
-extern void (*colfunc) (void);
+extern THREADLOCAL void (*colfunc) (void);
 extern void (*fuzzcolfunc) (void);
 extern void (*tlcolfunc) (void);
 extern void (*transcolfunc) (void);
 extern void (*transtlcolfunc) (void);
 extern void (*ghostcolfunc) (void);
+extern void (*skycolfunc) (void);
 extern void (*spanfunc) (fixed_t x1, fixed_t x2, fixed_t y,
                          fixed_t ds_xfrac, const fixed_t ds_xstep,
                          fixed_t ds_yfrac, const fixed_t ds_ystep);
@@ -619,22 +660,69 @@ void R_RenderMaskedSegRange (drawseg_t *ds, int x1, int x2);
 void R_RenderPlayerView (player_t *player);
 void R_SetViewSize (int blocks);
 
+// -----------------------------------------------------------------------------
+// [JN] View strips.
+// The view is split into vertical strips, one per thread. Every strip walks
+// the BSP tree with own clipping arrays, as if the view was as narrow as the
+// strip, and draws own walls, planes and sprites. Columns outside of the
+// strip are marked solid from the start, so nothing is drawn there.
+// Wall and sprite math doesn't depend on where walls are cut by other walls
+// or by strip edges, so the picture is the same for any number of strips.
+// -----------------------------------------------------------------------------
+
+#define MAXVISPLANES 128  // must be a power of 2
+
+typedef struct
+{
+    int left, right;  // Columns of the strip, inclusive.
+    int width;        // screenwidth the clipping arrays are allocated for.
+
+    byte *solidcol;
+    int  *floorclip, *ceilingclip;  // dropoff overflow
+
+    // [JN] killough: New code which removes 2s linedef limit
+    drawseg_t *drawsegs, *ds_p;
+    unsigned   maxdrawsegs;
+
+    // [JN] killough 1/6/98, 2/1/98: remove limit on openings
+    int    *openings, *lastopening;  // [crispy] 32-bit integer math
+    size_t  maxopenings;
+
+    visplane_t  *visplanes[MAXVISPLANES];  // [JN] killough
+    visplane_t  *freetail;
+    visplane_t **freehead;
+
+    // Strip's own validcount, bumped every frame, and the frames
+    // in which nodes and subsectors were visited by the strip.
+    int  validcount;
+    int *nodeframe, *subsectorframe;
+    int  numnodes, numsubsectors;
+
+    // Lines to be marked on the automap once all strips are done.
+    line_t **mapped;
+    int      nummapped, maxmapped;
+
+    int segs;  // Rendered segs, for perfomance counter.
+} viewstrip_t;
+
+extern viewstrip_t strips[];
+extern int numstrips;
+extern THREADLOCAL viewstrip_t *curstrip;
+
+void R_BindStrip (const int slice);
+
 // -----------------------------------------------------------------------------
 // R_PLANE
 // -----------------------------------------------------------------------------
 
 extern fixed_t  yslopes[MAXHEIGHT][MAXHEIGHT];
 extern fixed_t *yslope, *distscale;
-extern int     *floorclip, *ceilingclip; // dropoff overflow
-extern int     *lastopening; // [crispy] 32-bit integer math
-
 visplane_t *R_CheckPlane (visplane_t *pl, int start, int stop);
 visplane_t *R_DupPlane (const visplane_t *pl, int start, int stop);
 visplane_t *R_FindPlane (fixed_t height, const int picnum, const int lightlevel, const int flow);
 void R_ClearPlanes (void);
 void R_DrawPlanes (void);
 void R_InitPlanesRes (void);
-void R_InitVisplanesRes (void);
 
 // -----------------------------------------------------------------------------
 // R_STATE
@@ -648,7 +736,7 @@ extern int  viewwidth, viewheight;
 extern int  scaledviewwidth, scaledviewheight;
 extern int *flipscreenwidth;
 extern int *flipviewwidth;
-extern int  firstflat;
+extern int  firstflat, numflats;
 extern int *flattranslation, *texturetranslation;
 extern int  firstspritelump, lastspritelump, numspritelumps;
 
@@ -682,10 +770,10 @@ extern angle_t *xtoviewangle;
 extern angle_t *linearskyangle;
 
 // angle to line origin
-extern int rw_angle1;
+extern THREADLOCAL int rw_angle1;
 
-extern visplane_t *floorplane;
-extern visplane_t *ceilingplane;
+extern THREADLOCAL visplane_t *floorplane;
+extern THREADLOCAL visplane_t *ceilingplane;
 
 // -----------------------------------------------------------------------------
 // R_SWIRL
@@ -714,8 +802,8 @@ extern const fall_t fall[];
 extern void R_FlowPlane (const int flow);
 extern fixed_t FlowFactor_X, FlowFactor_X_old;
 extern fixed_t FlowFactor_Y, FlowFactor_Y_old;
-extern fixed_t FlowDelta_X;
-extern fixed_t FlowDelta_Y;
+extern THREADLOCAL fixed_t FlowDelta_X;
+extern THREADLOCAL fixed_t FlowDelta_Y;
 extern fixed_t FallFactor_100, FallFactor_100_old;
 extern fixed_t FallFactor_101, FallFactor_101_old;
 extern fixed_t FallFactor_102, FallFactor_102_old;
@@ -732,10 +820,10 @@ void R_FallLinedef (void);
 
 extern int     *negonearray;       // [JN] killough 2/8/98: // dropoff overflow
 extern int     *screenheightarray; //      change to MAX_*  // dropoff overflow
-extern int     *mfloorclip;
-extern int     *mceilingclip;
-extern fixed_t  spryscale;
-extern int64_t  sprtopscreen; // [crispy] WiggleFix
+extern THREADLOCAL int     *mfloorclip;
+extern THREADLOCAL int     *mceilingclip;
+extern THREADLOCAL fixed_t  spryscale;
+extern THREADLOCAL int64_t  sprtopscreen; // [crispy] WiggleFix
 extern fixed_t  pspritescale;
 extern fixed_t  pspriteiscale;
 extern int      bmap_flick;   // [JN] Animated brightmaps.
@@ -21,7 +21,11 @@
 //
 
 
+#include <string.h>
 #include "doomstat.h" // [AM] leveltime, paused, menuactive
+#include "i_system.h"
+#include "i_thread.h"
+#include "m_perf.h"
 #include "p_local.h"
 #include "z_zone.h"
 #include "v_video.h"
@@ -88,19 +92,18 @@ lighttable_t *scalelight[LIGHTLEVELS][MAXLIGHTSCALE];
 lighttable_t *scalelightfixed[MAXLIGHTSCALE];
 lighttable_t *zlight[LIGHTLEVELS][MAXLIGHTZ];
 
-extern lighttable_t **walllights;
-
 // sky mapping
 int skyflatnum, skytexture, skytexturemid;
 
 
-void (*colfunc) (void);
+THREADLOCAL void (*colfunc) (void);
 void (*basecolfunc) (void);
 void (*fuzzcolfunc) (void);
 void (*transcolfunc) (void);
 void (*tlcolfunc) (void);
 void (*transtlcolfunc) (void);
 void (*ghostcolfunc) (void);
+void (*skycolfunc) (void);
 void (*spanfunc) (fixed_t x1, fixed_t x2, fixed_t const y,
                   fixed_t ds_xfrac, const fixed_t ds_xstep,
                   fixed_t ds_yfrac, const fixed_t ds_ystep);
@@ -489,6 +492,9 @@ void R_InitLightTables (void)
             zlight[i][j] = colormaps + level*256;
         }
     }
+
+    // [JN] Fused brightmap tables of flats are built from zlight.
+    R_FlushBrightZLight();
 }
 
 // -----------------------------------------------------------------------------
@@ -622,7 +628,10 @@ void R_ExecuteSetViewSize (void)
 
     if (!detailshift)
     {
-        colfunc = basecolfunc = R_DrawColumn;
+        // [JN] Walls, masked textures and sprites are drawn four columns
+        // at a time. Sky is drawn by R_DrawPlanes threads, keep it unqueued.
+        colfunc = basecolfunc = vanillaparm ? R_DrawColumn : R_QueueColumn;
+        skycolfunc = R_DrawColumn;
         fuzzcolfunc = (vanillaparm || improved_fuzz == 0) ? R_DrawFuzzColumn :
                                       improved_fuzz == 1  ? R_DrawFuzzColumnBW :
                                       improved_fuzz == 2  ? R_DrawFuzzColumnImproved :
@@ -632,11 +641,11 @@ void R_ExecuteSetViewSize (void)
         tlcolfunc = R_DrawTLColumn;
         transtlcolfunc = R_DrawTranslatedTLColumn;
         ghostcolfunc = R_DrawGhostColumn;
-        spanfunc = R_DrawSpan;
+        spanfunc = prelit_flats ? R_DrawSpanLit : R_DrawSpan;
     }
     else
     {
-        colfunc = basecolfunc = R_DrawColumnLow;
+        colfunc = basecolfunc = skycolfunc = R_DrawColumnLow;
         fuzzcolfunc = (vanillaparm || improved_fuzz == 0) ? R_DrawFuzzColumnLow :
                                       improved_fuzz == 1  ? R_DrawFuzzColumnLowBW :
                                       improved_fuzz == 2  ? R_DrawFuzzColumnLowImproved :
@@ -766,10 +775,8 @@ void R_Init (void)
         original_playpal = false;
     }
 
-    R_InitClipSegs ();
     R_InitSpritesRes ();
     R_InitPlanesRes ();
-    R_InitVisplanesRes ();
     
     R_InitData ();
     printf (".");
@@ -921,8 +928,6 @@ static void R_SetupFrame (player_t *player)
             fixedcolormap = colormaps;
         }
 
-        walllights = scalelightfixed;
-
         for (int i = 0 ; i < MAXLIGHTSCALE ; i++)
         {
             scalelightfixed[i] = fixedcolormap;
@@ -948,19 +953,111 @@ void R_ClearStats (void)
 }
 
 // -----------------------------------------------------------------------------
-// R_RenderView
+// [JN] View strips, see viewstrip_t.
 // -----------------------------------------------------------------------------
 
-void R_RenderPlayerView (player_t *player)
+viewstrip_t strips[MAXTHREADS];
+int numstrips;
+THREADLOCAL viewstrip_t *curstrip;
+
+// -----------------------------------------------------------------------------
+// R_BindStrip
+// [JN] Makes the given strip current for the calling thread.
+// -----------------------------------------------------------------------------
+
+void R_BindStrip (const int slice)
 {
-    R_SetupFrame (player);
+    curstrip = &strips[slice];
+    colfunc = basecolfunc;
+}
+
+// -----------------------------------------------------------------------------
+// R_SetupStrips
+// [JN] Splits the view into one strip per thread,
+// and makes sure strip arrays are big enough for the level.
+// -----------------------------------------------------------------------------
+
+static void R_SetupStrips (void)
+{
+    numstrips = I_NumThreads();
+
+    for (int i = 0 ; i < numstrips ; i++)
+    {
+        viewstrip_t *const strip = &strips[i];
+
+        strip->left = viewwidth * i / numstrips;
+        strip->right = viewwidth * (i + 1) / numstrips - 1;
+
+        if (strip->width != screenwidth)
+        {
+            strip->width = screenwidth;
+            strip->solidcol = I_Realloc(strip->solidcol, screenwidth * sizeof(*strip->solidcol));
+            strip->floorclip = I_Realloc(strip->floorclip, screenwidth * sizeof(*strip->floorclip));
+            strip->ceilingclip = I_Realloc(strip->ceilingclip, screenwidth * sizeof(*strip->ceilingclip));
+        }
+
+        if (strip->numnodes < numnodes)
+        {
+            strip->numnodes = numnodes;
+            strip->nodeframe = I_Realloc(strip->nodeframe, numnodes * sizeof(*strip->nodeframe));
+            memset(strip->nodeframe, 0, numnodes * sizeof(*strip->nodeframe));
+        }
+
+        if (strip->numsubsectors < numsubsectors)
+        {
+            strip->numsubsectors = numsubsectors;
+            strip->subsectorframe = I_Realloc(strip->subsectorframe, numsubsectors * sizeof(*strip->subsectorframe));
+            memset(strip->subsectorframe, 0, numsubsectors * sizeof(*strip->subsectorframe));
+        }
+
+        if (strip->freehead == NULL)
+        {
+            strip->freehead = &strip->freetail;
+        }
+
+        strip->validcount++;
+        strip->nummapped = 0;
+        strip->segs = 0;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// R_RenderStrip
+// [JN] Walks the BSP tree and draws walls of one strip, marking visplanes.
+// -----------------------------------------------------------------------------
+
+static void R_RenderStrip (const int slice, const int numslices, void *data)
+{
+    R_BindStrip(slice);
 
     // Clear buffers.
     R_ClearClipSegs ();
     R_ClearDrawSegs ();
+    R_ClearPlanes ();
+
+    // The head node is the last node output.
+    R_RenderBSPNode (numnodes-1);
+}
+
+// -----------------------------------------------------------------------------
+// R_RenderView
+// [JN] The view is rendered in strips, one per thread. Everything that is
+// shared by the strips, i.e. sectors, lines, sprites and lumps, is prepared
+// or applied here, on the main thread, so strips are only reading it.
+// -----------------------------------------------------------------------------
+
+void R_RenderPlayerView (player_t *player)
+{
+    R_SetupFrame (player);
+    R_SetupStrips ();
+
+    // [AM] Interpolate sector movement before the strips walk the BSP tree.
+    R_InterpolateSectors ();
+
     if (automapactive && !automap_overlay)
     {
-        R_RenderBSPNode (numnodes-1);
+        I_RunThreads(R_RenderStrip, NULL);
+        R_MarkMappedLines ();
         return;
     }
 
@@ -976,7 +1073,6 @@ void R_RenderPlayerView (player_t *player)
         return;
     }
 
-    R_ClearPlanes ();
     R_ClearSprites ();
 
     // check for new console commands.
@@ -985,13 +1081,23 @@ void R_RenderPlayerView (player_t *player)
     // [crispy] smooth texture scrolling
     R_InterpolateTextureOffsets();
 
-    // The head node is the last node output.
-    R_RenderBSPNode (numnodes-1);
+    M_PerfStart(PERF_BSP);
+    I_RunThreads(R_RenderStrip, NULL);
+    R_MarkMappedLines ();
+    R_AddBSPSprites (numnodes-1);
+    M_PerfStop(PERF_BSP);
+
+    for (int i = 0 ; i < numstrips ; i++)
+    {
+        rendered_segs += strips[i].segs;
+    }
 
     // Check for new console commands.
     NetUpdate ();
 
+    M_PerfStart(PERF_PLANES);
     R_DrawPlanes ();
+    M_PerfStop(PERF_PLANES);
 
     // Check for new console commands.
     NetUpdate ();
@@ -1003,7 +1109,9 @@ void R_RenderPlayerView (player_t *player)
         R_SetFuzzPosDraw();
     }
 
+    M_PerfStart(PERF_MASKED);
     R_DrawMasked ();
+    M_PerfStop(PERF_MASKED);
 
     // Check for new console commands.
     NetUpdate ();				
@@ -27,6 +27,7 @@
 #include "z_zone.h"
 #include "w_wad.h"
 #include "r_local.h"
+#include "i_thread.h"
 #include "jn.h"
 
 
@@ -37,14 +38,12 @@
 // and memory and time overheads creep in.
 //
 // Lee Killough
+//
+// [JN] Visplane hash tables, free lists, openings and clipping arrays are 
+// kept by every view strip, see viewstrip_t.
 // -----------------------------------------------------------------------------
 
-#define MAXVISPLANES	128                  // must be a power of 2
-
-static visplane_t *visplanes[MAXVISPLANES];  // [JN] killough
-static visplane_t *freetail;                 // [JN] killough
-static visplane_t **freehead = &freetail;    // [JN] killough
-visplane_t *floorplane, *ceilingplane;
+THREADLOCAL visplane_t *floorplane, *ceilingplane;
 
 // [JN] killough -- hash function for visplanes
 // Empirically verified to be fairly uniform:
@@ -52,41 +51,27 @@ visplane_t *floorplane, *ceilingplane;
 #define visplane_hash(picnum, lightlevel, height) \
     ((unsigned)((picnum) * 3 + (lightlevel) + (height) * 7) & (MAXVISPLANES - 1))
 
-// [JN] killough 8/1/98: set static number of openings to be large enough
-// (a static limit is okay in this case and avoids difficulties in r_segs.c)
-
-size_t maxopenings;
-int *openings, *lastopening; // [crispy] 32-bit integer math
-
-//
-// Clip values are the solid pixel bounding the range.
-//  floorclip starts out SCREENHEIGHT
-//  ceilingclip starts out -1
-//
-
-// [JN] Andrey Budko: resolution limitation is removed
-int *floorclip = NULL;    // dropoff overflow
-int *ceilingclip = NULL;  // dropoff overflow
-
 //
 // spanstart holds the start of a plane span
 // initialized to 0 at start
 //
+// [JN] Span and texture mapping state is thread local,
+// every thread draws its own vertical strip of planes.
+//
 
-// [JN] Andrey Budko: resolution limitation is removed
-static int *spanstart = NULL;  // killough 2/8/98
+static THREADLOCAL int spanstart[MAXHEIGHT];  // killough 2/8/98
 
 
 //
 // texture mapping
 //
 
-static lighttable_t **planezlight;
-static fixed_t planeheight;
-static fixed_t cachedheight[MAXHEIGHT];
-static fixed_t cacheddistance[MAXHEIGHT];
-static fixed_t cachedxstep[MAXHEIGHT];
-static fixed_t cachedystep[MAXHEIGHT];
+static THREADLOCAL lighttable_t **planezlight;
+static THREADLOCAL fixed_t planeheight;
+static THREADLOCAL fixed_t cachedheight[MAXHEIGHT];
+static THREADLOCAL fixed_t cacheddistance[MAXHEIGHT];
+static THREADLOCAL fixed_t cachedxstep[MAXHEIGHT];
+static THREADLOCAL fixed_t cachedystep[MAXHEIGHT];
 
 // [JN] Andrey Budko: resolution limitation is removed
 fixed_t *yslope = NULL;
@@ -100,18 +85,6 @@ fixed_t  yslopes[MAXHEIGHT][MAXHEIGHT];
 
 void R_InitPlanesRes (void)
 {
-    if (floorclip)
-    {
-        free(floorclip);
-    }
-    if (ceilingclip)
-    {
-        free(ceilingclip);
-    }
-    if (spanstart)
-    {
-        free(spanstart);
-    }
     if (yslope)
     {
         free(yslope);
@@ -121,28 +94,10 @@ void R_InitPlanesRes (void)
         free(distscale);
     }
 
-    floorclip = calloc(1, screenwidth * sizeof(*floorclip));
-    ceilingclip = calloc(1, screenwidth * sizeof(*ceilingclip));
-    spanstart = calloc(1, screenwidth * sizeof(*spanstart));
     yslope = calloc(1, screenwidth * sizeof(*yslope));
     distscale = calloc(1, screenwidth * sizeof(*distscale));
 }
 
-// -----------------------------------------------------------------------------
-// R_InitPlanesRes
-// -----------------------------------------------------------------------------
-
-void R_InitVisplanesRes (void)
-{
-    freetail = NULL;
-    freehead = &freetail;
-
-    for (int i = 0; i < MAXVISPLANES; i++)
-    {
-        visplanes[i] = 0;
-    }
-}
-
 // -----------------------------------------------------------------------------
 // R_MapPlane
 //
@@ -201,7 +156,7 @@ static void R_MapPlane (const int y, const int x1, const int x2)
 
     if (fixedcolormap)
     {
-        ds_colormap[0] = ds_colormap[1] = fixedcolormap;
+        ds_colormap = fixedcolormap;
     }
     else
     {
@@ -211,8 +166,7 @@ static void R_MapPlane (const int y, const int x1, const int x2)
         if (index >= maxlightz)
             index = maxlightz-1;
 
-        ds_colormap[0] = planezlight[index];
-        ds_colormap[1] = colormaps;
+        ds_colormap = planezlight[index];
     }
 
     // high or low detail
@@ -226,23 +180,23 @@ static void R_MapPlane (const int y, const int x1, const int x2)
 
 void R_ClearPlanes (void)
 {
+    viewstrip_t *const strip = curstrip;
     int i;
 
     // opening / clipping determination
-    for (i = 0 ; i < viewwidth ; i++)
+    //  floorclip starts out SCREENHEIGHT
+    //  ceilingclip starts out -1
+    for (i = strip->left ; i <= strip->right ; i++)
     {
-        floorclip[i] = viewheight;
-        ceilingclip[i] = -1;
+        strip->floorclip[i] = viewheight;
+        strip->ceilingclip[i] = -1;
     }
 
     for (i = 0; i < MAXVISPLANES; i++)  // [JN] new code -- killough
-        for (*freehead = visplanes[i], visplanes[i] = NULL ; *freehead ; )
-            freehead = &(*freehead)->next;
+        for (*strip->freehead = strip->visplanes[i], strip->visplanes[i] = NULL ; *strip->freehead ; )
+            strip->freehead = &(*strip->freehead)->next;
 
-    lastopening = openings;
-
-    // texture calculation
-    memset (cachedheight, 0, sizeof(cachedheight));
+    strip->lastopening = strip->openings;
 }
 
 // -----------------------------------------------------------------------------
@@ -252,19 +206,23 @@ void R_ClearPlanes (void)
 
 static visplane_t *new_visplane (unsigned const int hash)
 {
-    visplane_t *check = freetail;
+    viewstrip_t *const strip = curstrip;
+    visplane_t *check = strip->freetail;
 
     if (!check)
     {
         check = calloc(1, sizeof(*check));
     }
-    else if (!(freetail = freetail->next))
+    else if (!(strip->freetail = strip->freetail->next))
     {
-        freehead = &freetail;
+        strip->freehead = &strip->freetail;
     }
 
-    check->next = visplanes[hash];
-    visplanes[hash] = check;
+    check->next = strip->visplanes[hash];
+    strip->visplanes[hash] = check;
+
+    // [JN] Only columns of the strip are ever looked at.
+    memset(check->top + strip->left, UINT_MAX, (strip->right - strip->left + 1) * sizeof(*check->top));
 
     return check;
 }
@@ -290,7 +248,7 @@ visplane_t *R_FindPlane (fixed_t height, const int picnum, const int lightlevel,
     // New visplane algorithm uses hash table -- killough
     hash = visplane_hash(picnum, lightlevel, height);
 
-    for (check = visplanes[hash]; check; check = check->next)
+    for (check = curstrip->visplanes[hash]; check; check = check->next)
         if (height == check->height && picnum == check->picnum 
         && lightlevel == check->lightlevel && flow == check->flow)
             return check;
@@ -304,8 +262,6 @@ visplane_t *R_FindPlane (fixed_t height, const int picnum, const int lightlevel,
     check->minx = screenwidth;
     check->maxx = -1;
 
-    memset(check->top, UINT_MAX, sizeof(check->top));
-
     return check;
 }
 
@@ -324,8 +280,6 @@ visplane_t *R_DupPlane(const visplane_t *pl, const int start, const int stop)
     new_pl->minx = start;
     new_pl->maxx = stop;
 
-    memset(new_pl->top, UINT_MAX, sizeof(new_pl->top));
-
     return new_pl;
 }
 
@@ -396,16 +350,46 @@ R_MakeSpans (const int x, unsigned int t1, unsigned int b1, // [crispy] 32-bit i
 }
 
 // -----------------------------------------------------------------------------
-// R_DrawPlanes
-// At the end of each frame.
+// R_DrawPlaneColumns
+// [JN] Draws columns x1...x2 of a plane. Columns outside of given range
+// are treated as empty, so a plane can be split between several threads.
 // -----------------------------------------------------------------------------
 
-void R_DrawPlanes (void) 
+static void R_DrawPlaneColumns (const visplane_t *pl, const int x1, const int x2)
 {
+    R_MakeSpans(x1, UINT_MAX, 0, pl->top[x1], pl->bottom[x1]);
+
+    for (int x = x1 + 1 ; x <= x2 ; x++)
+    {
+        R_MakeSpans(x, pl->top[x-1], pl->bottom[x-1], pl->top[x], pl->bottom[x]);
+    }
+
+    R_MakeSpans(x2 + 1, pl->top[x2], pl->bottom[x2], UINT_MAX, 0);
+}
+
+// -----------------------------------------------------------------------------
+// R_DrawPlanesSlice
+// [JN] Draws visplanes of one view strip.
+// -----------------------------------------------------------------------------
+
+static void R_DrawPlanesSlice (const int slice, const int numslices, void *data)
+{
+    const viewstrip_t *strip = &strips[slice];
+
+    // texture calculation
+    memset (cachedheight, 0, sizeof(cachedheight));
+
     for (int i = 0 ; i < MAXVISPLANES ; i++)
-    for (visplane_t *pl = visplanes[i] ; pl ; pl = pl->next, rendered_visplanes++)
-    if (pl->minx <= pl->maxx)
+    for (visplane_t *pl = strip->visplanes[i] ; pl ; pl = pl->next)
     {
+        const int x1 = pl->minx;
+        const int x2 = pl->maxx;
+
+        if (x1 > x2)
+        {
+            continue;
+        }
+
         // sky flat
         if (pl->picnum == skyflatnum)
         {
@@ -433,7 +417,7 @@ void R_DrawPlanes (void)
             dc_texturemid = skytexturemid;
             dc_texheight = textureheight[skytexture]>>FRACBITS;
 
-            for (int x = pl->minx ; x <= pl->maxx ; x++)
+            for (int x = x1 ; x <= x2 ; x++)
             {
                 if ((dc_yl = pl->top[x]) != UINT_MAX && dc_yl <= (dc_yh = pl->bottom[x])) // [crispy] 32-bit integer math
                 {
@@ -442,54 +426,84 @@ void R_DrawPlanes (void)
                                         linearskyangle[x] : xtoviewangle[x]))^flip_levels)>>ANGLETOSKYSHIFT;
                     dc_x = x;
                     dc_source = R_GetColumn(skytexture, angle);
-                    colfunc ();
+                    skycolfunc ();
                 }
             }
         }
         else  // regular flat
         {
-            int light = (pl->lightlevel >> LIGHTSEGSHIFT) + extralight;
-            const int stop = pl->maxx + 1;
-            const int lumpnum = firstflat + flattranslation[pl->picnum];
+            ds_source = pl->source;
+            FlowDelta_X = pl->flowx;
+            FlowDelta_Y = pl->flowy;
+            planeheight = pl->planeheight;
+            planezlight = pl->zlight;
 
-            // [crispy] add support for SMMU swirling flats
-            ds_source = (flattranslation[pl->picnum] == -1) ?
-                         R_DistortedFlat(pl->picnum) : W_CacheLumpNum(lumpnum, PU_STATIC);
-            ds_brightmap = R_BrightmapForFlatNum(lumpnum-firstflat);
+            R_DrawPlaneColumns(pl, x1, x2);
+        }
+    }
+}
 
-            // [JN] Apply flow effect to swirling liquids.
-            if (swirling_liquids && flattranslation[pl->picnum] == -1 && !vanillaparm)
-            {
-                R_FlowPlane(pl->flow);
-            }
-            else
-            {
-                FlowDelta_X = 0;
-                FlowDelta_Y = 0;
-            }
+// -----------------------------------------------------------------------------
+// R_DrawPlanes
+// At the end of each frame.
+// [JN] Flat data is looked up here, on the main thread, and
+// every view strip draws own visplanes on its own thread.
+// -----------------------------------------------------------------------------
 
-            planeheight = abs(pl->height-viewz);
-            if (light >= LIGHTLEVELS)
-            {
-                light = LIGHTLEVELS-1;
-            }
-            if (light < 0)
-            {
-                light = 0;
-            }
-            planezlight = zlight[light];
-            pl->top[pl->minx-1] = pl->top[stop] = UINT_MAX; // [crispy] 32-bit integer math
+void R_DrawPlanes (void) 
+{
+    for (int s = 0 ; s < numstrips ; s++)
+    for (int i = 0 ; i < MAXVISPLANES ; i++)
+    for (visplane_t *pl = strips[s].visplanes[i] ; pl ; pl = pl->next, rendered_visplanes++)
+    if (pl->minx <= pl->maxx && pl->picnum != skyflatnum)
+    {
+        int light = (pl->lightlevel >> LIGHTSEGSHIFT) + extralight;
+        const int lumpnum = firstflat + flattranslation[pl->picnum];
 
-            for (int x = pl->minx ; x <= stop ; x++)
-            {
-                R_MakeSpans(x,pl->top[x-1], pl->bottom[x-1], pl->top[x], pl->bottom[x]);
-            }
+        // [crispy] add support for SMMU swirling flats
+        pl->source = (flattranslation[pl->picnum] == -1) ?
+                     (const byte *) R_DistortedFlat(pl->picnum) : W_CacheLumpNum(lumpnum, PU_STATIC);
 
-            // [crispy] add support for SMMU swirling flats
-            if (flattranslation[pl->picnum] != -1)
-            {
-                W_ReleaseLumpNum(lumpnum);
-            }
+        // [JN] Apply flow effect to swirling liquids.
+        if (swirling_liquids && flattranslation[pl->picnum] == -1 && !vanillaparm)
+        {
+            R_FlowPlane(pl->flow);
+            pl->flowx = FlowDelta_X;
+            pl->flowy = FlowDelta_Y;
+        }
+        else
+        {
+            pl->flowx = 0;
+            pl->flowy = 0;
+        }
+
+        pl->planeheight = abs(pl->height-viewz);
+        if (light >= LIGHTLEVELS)
+        {
+            light = LIGHTLEVELS-1;
+        }
+        if (light < 0)
+        {
+            light = 0;
+        }
+        // [JN] Brightmapped flats use zlight fused with the brightmap.
+        pl->zlight = R_BrightZLight(R_BrightmapForFlatNum(lumpnum-firstflat), light);
+    }
+
+    // [JN] Lit flat tiles from the previous frame are stale now.
+    litflatframe++;
+
+    I_RunThreads(R_DrawPlanesSlice, NULL);
+
+    for (int s = 0 ; s < numstrips ; s++)
+    for (int i = 0 ; i < MAXVISPLANES ; i++)
+    for (visplane_t *pl = strips[s].visplanes[i] ; pl ; pl = pl->next)
+    if (pl->minx <= pl->maxx && pl->picnum != skyflatnum)
+    {
+        // [crispy] add support for SMMU swirling flats
+        if (flattranslation[pl->picnum] != -1)
+        {
+            W_ReleaseLumpNum(firstflat + flattranslation[pl->picnum]);
         }
     }
 }
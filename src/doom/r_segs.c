@@ -32,37 +32,41 @@
 #define SPARKLEFIX      64
 
 
-static int toptexture, bottomtexture, midtexture;
-static int rw_x, rw_stopx; // regular wall
-static int worldtop, worldbottom, worldhigh, worldlow;
+// [JN] All of the wall state is per thread, as every strip
+// stores and draws own walls at the same time.
+
+static THREADLOCAL int toptexture, bottomtexture, midtexture;
+static THREADLOCAL int rw_x, rw_stopx; // regular wall
+static THREADLOCAL int worldtop, worldbottom, worldhigh, worldlow;
 
 // True if any of the segs textures might be visible.
-static boolean segtextured;
+static THREADLOCAL boolean segtextured;
 
 // False if the back side is the same plane.
-boolean markfloor, markceiling, maskedtexture;
+THREADLOCAL boolean markfloor, markceiling;
+static THREADLOCAL boolean maskedtexture;
 
-int    rw_angle1;  // angle to line origin
-static angle_t rw_normalangle, rw_centerangle;
+THREADLOCAL int rw_angle1;  // angle to line origin
+static THREADLOCAL angle_t rw_normalangle, rw_centerangle;
 
-static fixed_t rw_offset;
-static fixed_t rw_distance;
-static fixed_t rw_scale;
-static fixed_t rw_scalestep;
-static fixed_t rw_midtexturemid;
-static fixed_t rw_toptexturemid;
-static fixed_t rw_bottomtexturemid;
+static THREADLOCAL fixed_t rw_offset;
+static THREADLOCAL fixed_t rw_distance;
+static THREADLOCAL fixed_t rw_scale;
+static THREADLOCAL fixed_t rw_scalestep;
+static THREADLOCAL fixed_t rw_midtexturemid;
+static THREADLOCAL fixed_t rw_toptexturemid;
+static THREADLOCAL fixed_t rw_bottomtexturemid;
 
-static int64_t pixhigh, pixlow;  // [crispy] WiggleFix
-static fixed_t pixhighstep, pixlowstep;
+static THREADLOCAL int64_t pixhigh, pixlow;  // [crispy] WiggleFix
+static THREADLOCAL fixed_t pixhighstep, pixlowstep;
 
-static int64_t topfrac, bottomfrac;  // [crispy] WiggleFix
-static fixed_t topstep, bottomstep;
+static THREADLOCAL int64_t topfrac, bottomfrac;  // [crispy] WiggleFix
+static THREADLOCAL fixed_t topstep, bottomstep;
 
 
-lighttable_t** walllights;
+static THREADLOCAL lighttable_t **walllights;
 
-static int *maskedtexturecol;  // [crispy] 32-bit integer math
+static THREADLOCAL int *maskedtexturecol;  // [crispy] 32-bit integer math
 
 
 // -----------------------------------------------------------------------------
@@ -107,10 +111,10 @@ static int *maskedtexturecol;  // [crispy] 32-bit integer math
 //   possibly, creating a noticable performance penalty.
 // -----------------------------------------------------------------------------
 
-static int max_rwscale = 64 * FRACUNIT;
-static int heightbits = 12;
-static int heightunit = (1 << 12);
-static int invhgtbits = 4;
+static THREADLOCAL int max_rwscale = 64 * FRACUNIT;
+static THREADLOCAL int heightbits = 12;
+static THREADLOCAL int heightunit = (1 << 12);
+static THREADLOCAL int invhgtbits = 4;
 
 static const struct
 {
@@ -134,9 +138,11 @@ static const struct
 //
 // -----------------------------------------------------------------------------
 
-static void R_FixWiggle (sector_t *sector)
+static void R_FixWiggle (const sector_t *sector)
 {
-    static int lastheight = 0;
+    // [JN] Scale index is not cached in the sector,
+    // as sectors are shared by all of the strips.
+    static THREADLOCAL int lastheight = 0;
     int height = (sector->interpceilingheight - sector->interpfloorheight) >> FRACBITS;
 
     // disallow negative heights. using 1 forces cache initialization
@@ -148,23 +154,18 @@ static void R_FixWiggle (sector_t *sector)
     // early out?
     if (height != lastheight)
     {
-        lastheight = height;
+        int scaleindex = 0;
 
-        // initialize, or handle moving sector
-        if (height != sector->cachedheight)
-        {
-            sector->cachedheight = height;
-            sector->scaleindex = 0;
-            height >>= 7;
+        lastheight = height;
+        height >>= 7;
 
-            // calculate adjustment
-            while (height >>= 1)
-            sector->scaleindex++;
-        }
+        // calculate adjustment
+        while (height >>= 1)
+        scaleindex++;
 
         // fine-tune renderer for this wall
-        max_rwscale = scale_values[sector->scaleindex].clamp;
-        heightbits = scale_values[sector->scaleindex].heightbits;
+        max_rwscale = scale_values[scaleindex].clamp;
+        heightbits = scale_values[scaleindex].heightbits;
         heightunit = (1 << heightbits);
         invhgtbits = FRACBITS - heightbits;
     }
@@ -289,6 +290,9 @@ void R_RenderMaskedSegRange (drawseg_t *ds, const int x1, const int x2)
 
         spryscale += rw_scalestep;
     }
+
+    // [JN] Write out last queued columns.
+    R_FlushColumns();
 }
 
 // -----------------------------------------------------------------------------
@@ -302,13 +306,16 @@ void R_RenderMaskedSegRange (drawseg_t *ds, const int x1, const int x2)
 // Many thanks to Brad Harding for his research and fixing this bug!
 // -----------------------------------------------------------------------------
 
-static boolean didsolidcol;  // True if at least one column was marked solid
+static THREADLOCAL boolean didsolidcol;  // True if at least one column was marked solid
 
 static void R_RenderSegLoop (void)
 {
+    int *const floorclip = curstrip->floorclip;
+    int *const ceilingclip = curstrip->ceilingclip;
+    byte *const solidcol = curstrip->solidcol;
     fixed_t texturecolumn = 0;  // [JN] Purely to shut up the compiler.
 
-    rendered_segs++;
+    curstrip->segs++;
 
     for ( ; rw_x < rw_stopx ; rw_x++)
     {
@@ -485,6 +492,9 @@ static void R_RenderSegLoop (void)
     topfrac += topstep;
     bottomfrac += bottomstep;
     }
+
+    // [JN] Write out last queued columns.
+    R_FlushColumns();
 }
 
 // -----------------------------------------------------------------------------
@@ -527,23 +537,34 @@ static fixed_t R_ScaleFromGlobalAngle (const angle_t visangle)
 // -----------------------------------------------------------------------------
 // R_StoreWallRange
 // A wall segment will be drawn between start and stop pixels (inclusive).
+// [JN] segstart and segstop are the columns of the whole visible seg, before
+// it was cut by other walls or by strip edges. If the seg crosses an edge of
+// the strip, scale and texture edges are stepped from segstart, so its pieces
+// in every strip line up. Otherwise the wall is worked out from start.
 // -----------------------------------------------------------------------------
 
-void R_StoreWallRange (const int start, const int stop)
+void R_StoreWallRange (const int start, const int stop,
+                       const int segstart, const int segstop)
 {
+    viewstrip_t *const strip = curstrip;
+    drawseg_t   *ds_p;
     fixed_t     vtop;
+    fixed_t     scale1;
+    int         skip;
     int         lightnum;
     int64_t     dx, dy, dx1, dy1, dist; // [crispy] fix long wall wobble
     const uint32_t len = curline->length;
+    const boolean splitseg = segstart < strip->left || segstop > strip->right;
 
     // [crispy] remove MAXDRAWSEGS Vanilla limit
-    if (ds_p == drawsegs+maxdrawsegs)
+    if (strip->ds_p == strip->drawsegs+strip->maxdrawsegs)
     {
-        unsigned newmax = maxdrawsegs ? maxdrawsegs*2 : 128; // killough
-        drawsegs = I_Realloc(drawsegs,newmax*sizeof(*drawsegs));
-        ds_p = drawsegs+maxdrawsegs;
-        maxdrawsegs = newmax;
+        unsigned newmax = strip->maxdrawsegs ? strip->maxdrawsegs*2 : 128; // killough
+        strip->drawsegs = I_Realloc(strip->drawsegs,newmax*sizeof(*strip->drawsegs));
+        strip->ds_p = strip->drawsegs+strip->maxdrawsegs;
+        strip->maxdrawsegs = newmax;
     }
+    ds_p = strip->ds_p;
 
 #ifdef RANGECHECK
     if (start >=viewwidth || start > stop)
@@ -556,7 +577,17 @@ void R_StoreWallRange (const int start, const int stop)
     linedef = curline->linedef;
 
     // mark the segment as visible for auto map
-    linedef->flags |= ML_MAPPED;
+    // [JN] Lines are shared by all strips, so marking
+    // is done by R_MarkMappedLines once strips are done.
+    if (!(linedef->flags & ML_MAPPED))
+    {
+        if (strip->nummapped == strip->maxmapped)
+        {
+            strip->maxmapped = strip->maxmapped ? strip->maxmapped*2 : 64;
+            strip->mapped = I_Realloc(strip->mapped, strip->maxmapped*sizeof(*strip->mapped));
+        }
+        strip->mapped[strip->nummapped++] = linedef;
+    }
 
     // [crispy] (flags & ML_MAPPED) is all we need to know for automap
     if (automapactive && !automap_overlay)
@@ -585,32 +616,30 @@ void R_StoreWallRange (const int start, const int stop)
 
     // [JN] killough 1/6/98, 2/1/98: remove limit on openings
     {     
-        extern int *openings; // dropoff overflow
-        extern size_t maxopenings;
-        const size_t pos = lastopening - openings;
-        const size_t need = (rw_stopx - start)*sizeof(*lastopening) + pos;
+        const size_t pos = strip->lastopening - strip->openings;
+        const size_t need = (rw_stopx - start)*sizeof(*strip->lastopening) + pos;
 
-        if (need > maxopenings)
+        if (need > strip->maxopenings)
         {
-            drawseg_t *ds;                // jff 8/9/98 needed for fix from ZDoom
-            int *oldopenings = openings;  // dropoff overflow
-            int *oldlast = lastopening;   // dropoff overflow
+            drawseg_t *ds;                       // jff 8/9/98 needed for fix from ZDoom
+            int *oldopenings = strip->openings;  // dropoff overflow
+            int *oldlast = strip->lastopening;   // dropoff overflow
 
             do
             {
-                maxopenings = maxopenings ? maxopenings*2 : 16384;
-            } while (need > maxopenings);
+                strip->maxopenings = strip->maxopenings ? strip->maxopenings*2 : 16384;
+            } while (need > strip->maxopenings);
 
-            openings = I_Realloc(openings, maxopenings * sizeof(*openings));
-            lastopening = openings + pos;
+            strip->openings = I_Realloc(strip->openings, strip->maxopenings * sizeof(*strip->openings));
+            strip->lastopening = strip->openings + pos;
 
             // jff 8/9/98 borrowed fix for openings from ZDOOM1.14
             // [RH] We also need to adjust the openings pointers that
             //    were already stored in drawsegs.
-            for (ds = drawsegs; ds < ds_p; ds++)
+            for (ds = strip->drawsegs; ds < ds_p; ds++)
             {
 #define ADJUST(p) if (ds->p + ds->x1 >= oldopenings && ds->p + ds->x1 <= oldlast)\
-            ds->p = ds->p - oldopenings + openings;
+            ds->p = ds->p - oldopenings + strip->openings;
                 ADJUST (maskedtexturecol);
                 ADJUST (sprtopclip);
                 ADJUST (sprbottomclip);
@@ -623,18 +652,39 @@ void R_StoreWallRange (const int start, const int stop)
     // right before calls to R_ScaleFromGlobalAngle:
     R_FixWiggle(frontsector);
 
-    // calculate scale at both ends and step
-    ds_p->scale1 = rw_scale = 
-    R_ScaleFromGlobalAngle (viewangle + xtoviewangle[start]);
-
-    if (stop > start )
+    if (!splitseg)
     {
-        ds_p->scale2 = R_ScaleFromGlobalAngle (viewangle + xtoviewangle[stop]);
-        ds_p->scalestep = rw_scalestep = (ds_p->scale2 - rw_scale) / (stop-start);
+        // calculate scale at both ends and step
+        ds_p->scale1 = rw_scale = 
+        R_ScaleFromGlobalAngle (viewangle + xtoviewangle[start]);
+
+        if (stop > start )
+        {
+            ds_p->scale2 = R_ScaleFromGlobalAngle (viewangle + xtoviewangle[stop]);
+            ds_p->scalestep = rw_scalestep = (ds_p->scale2 - rw_scale) / (stop-start);
+        }
+        else
+        {
+            ds_p->scale2 = ds_p->scale1;
+        }
+
+        scale1 = rw_scale;
+        skip = 0;
     }
     else
     {
-        ds_p->scale2 = ds_p->scale1;
+        // [JN] calculate scale at both ends of the whole seg and step,
+        // then step to the first column of this piece
+        const fixed_t scale2 = segstop > segstart ?
+            R_ScaleFromGlobalAngle (viewangle + xtoviewangle[segstop]) : 0;
+
+        scale1 = R_ScaleFromGlobalAngle (viewangle + xtoviewangle[segstart]);
+        rw_scalestep = segstop > segstart ? (scale2 - scale1) / (segstop-segstart) : 0;
+        skip = start - segstart;
+
+        ds_p->scalestep = rw_scalestep;
+        ds_p->scale1 = rw_scale = scale1 + skip*rw_scalestep;
+        ds_p->scale2 = rw_scale + (stop-start)*rw_scalestep;
     }
 
     // calculate texture boundaries
@@ -692,7 +742,7 @@ void R_StoreWallRange (const int start, const int stop)
         ds_p->silhouette = 0;
 
         // [JN] cph - closed 2S line e.g. door
-        if (linedef->r_flags & RF_CLOSED)
+        if (lineflags & RF_CLOSED)
         {
             // cph - killough's (outdated) comment follows - this deals with both 
             // "automap fixes", his and mine
@@ -838,8 +888,8 @@ void R_StoreWallRange (const int start, const int stop)
         {
             // masked midtexture
             maskedtexture = true;
-            ds_p->maskedtexturecol = maskedtexturecol = lastopening - rw_x;
-            lastopening += rw_stopx - rw_x;
+            ds_p->maskedtexturecol = maskedtexturecol = strip->lastopening - rw_x;
+            strip->lastopening += rw_stopx - rw_x;
         }
     }
 
@@ -895,16 +945,19 @@ void R_StoreWallRange (const int start, const int stop)
     }
 
     // calculate incremental stepping values for texture edges
+    // [JN] Edges of a split seg are worked out at segstart and stepped to start.
     worldtop >>= invhgtbits;
     worldbottom >>= invhgtbits;
 
     topstep = -FixedMul (rw_scalestep, worldtop);
     topfrac = ((int64_t)centeryfrac >> invhgtbits)
-            - (((int64_t)worldtop * rw_scale) >> FRACBITS); // [crispy] WiggleFix
+            - (((int64_t)worldtop * scale1) >> FRACBITS) // [crispy] WiggleFix
+            + (int64_t)skip * topstep;
 
     bottomstep = -FixedMul (rw_scalestep,worldbottom);
     bottomfrac = ((int64_t)centeryfrac >> invhgtbits)
-               - (((int64_t)worldbottom * rw_scale) >> FRACBITS); // [crispy] WiggleFix
+               - (((int64_t)worldbottom * scale1) >> FRACBITS) // [crispy] WiggleFix
+               + (int64_t)skip * bottomstep;
 
     if (backsector)
     {
@@ -913,16 +966,18 @@ void R_StoreWallRange (const int start, const int stop)
 
         if (worldhigh < worldtop)
         {
-            pixhigh = ((int64_t)centeryfrac >> invhgtbits)
-                    - (((int64_t)worldhigh * rw_scale) >> FRACBITS); // [crispy] WiggleFix
             pixhighstep = -FixedMul (rw_scalestep, worldhigh);
+            pixhigh = ((int64_t)centeryfrac >> invhgtbits)
+                    - (((int64_t)worldhigh * scale1) >> FRACBITS) // [crispy] WiggleFix
+                    + (int64_t)skip * pixhighstep;
         }
 
         if (worldlow > worldbottom)
         {
-            pixlow = ((int64_t)centeryfrac>>invhgtbits)
-                   - (((int64_t)worldlow * rw_scale) >> FRACBITS); // [crispy] WiggleFix
             pixlowstep = -FixedMul (rw_scalestep, worldlow);
+            pixlow = ((int64_t)centeryfrac>>invhgtbits)
+                   - (((int64_t)worldlow * scale1) >> FRACBITS) // [crispy] WiggleFix
+                   + (int64_t)skip * pixlowstep;
         }
     }
 
@@ -966,8 +1021,10 @@ void R_StoreWallRange (const int start, const int stop)
     R_RenderSegLoop ();
 
     // [JN] cph - if a column was made solid by this wall, 
-    // we _must_ save full clipping info.
-    if (backsector && didsolidcol)
+    // we _must_ save full clipping info. For a split seg it is decided
+    // for the whole seg, not for the columns of this piece,
+    // so the strips agree on it.
+    if (backsector && (splitseg ? (markceiling || markfloor) : didsolidcol))
     {
         if (!(ds_p->silhouette & SIL_BOTTOM))
         {
@@ -984,16 +1041,16 @@ void R_StoreWallRange (const int start, const int stop)
     // save sprite clipping info
     if ( ((ds_p->silhouette & SIL_TOP) || maskedtexture) && !ds_p->sprtopclip)
     {
-        memcpy (lastopening, ceilingclip+start, sizeof(*lastopening)*(rw_stopx-start));
-        ds_p->sprtopclip = lastopening - start;
-        lastopening += rw_stopx - start;
+        memcpy (strip->lastopening, strip->ceilingclip+start, sizeof(*strip->lastopening)*(rw_stopx-start));
+        ds_p->sprtopclip = strip->lastopening - start;
+        strip->lastopening += rw_stopx - start;
     }
 
     if ( ((ds_p->silhouette & SIL_BOTTOM) || maskedtexture) && !ds_p->sprbottomclip)
     {
-        memcpy (lastopening, floorclip+start, sizeof(*lastopening)*(rw_stopx-start));
-        ds_p->sprbottomclip = lastopening - start;
-        lastopening += rw_stopx - start;	
+        memcpy (strip->lastopening, strip->floorclip+start, sizeof(*strip->lastopening)*(rw_stopx-start));
+        ds_p->sprbottomclip = strip->lastopening - start;
+        strip->lastopening += rw_stopx - start;	
     }
 
     if (maskedtexture && !(ds_p->silhouette&SIL_TOP))
@@ -1006,5 +1063,5 @@ void R_StoreWallRange (const int start, const int stop)
         ds_p->silhouette |= SIL_BOTTOM;
         ds_p->bsilheight = INT_MAX;
     }
-    ds_p++;
+    strip->ds_p++;
 }
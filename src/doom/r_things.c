@@ -23,6 +23,9 @@
 #include "deh_main.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_thread.h"
+#include "i_timer.h"
+#include "m_cache.h"
 #include "z_zone.h"
 #include "w_wad.h"
 #include "r_local.h"
@@ -61,14 +64,18 @@ spritedef_t *sprites;
 static spriteframe_t sprtemp[29];
 
 // initialization functions
-int *mfloorclip, *mceilingclip;
+THREADLOCAL int *mfloorclip, *mceilingclip;
 
-fixed_t spryscale;
-int64_t sprtopscreen; // [crispy] WiggleFix
+THREADLOCAL fixed_t spryscale;
+THREADLOCAL int64_t sprtopscreen; // [crispy] WiggleFix
 
 static size_t num_vissprite, num_vissprite_alloc, num_vissprite_ptrs; // killough
 static vissprite_t *vissprites, **vissprite_ptrs;                     // killough
 
+// [JN] Player sprites, projected by R_AddPSprites.
+static vissprite_t pspritevis[NUMPSPRITES];
+static int numpspritevis;
+
 
 typedef struct drawseg_xrange_item_s
 {
@@ -82,12 +89,13 @@ typedef struct drawsegs_xrange_s
     int count;
 } drawsegs_xrange_t;
 
+// [JN] Drawseg ranges are built by every strip for own drawsegs.
 #define DS_RANGES_COUNT 3
-static drawsegs_xrange_t drawsegs_xranges[DS_RANGES_COUNT];
+static THREADLOCAL drawsegs_xrange_t drawsegs_xranges[DS_RANGES_COUNT];
 
-static drawseg_xrange_item_t *drawsegs_xrange;
-static unsigned int drawsegs_xrange_size = 0;
-static int drawsegs_xrange_count = 0;
+static THREADLOCAL drawseg_xrange_item_t *drawsegs_xrange;
+static THREADLOCAL unsigned int drawsegs_xrange_size = 0;
+static THREADLOCAL int drawsegs_xrange_count = 0;
 
 
 // -----------------------------------------------------------------------------
@@ -210,6 +218,100 @@ static void R_InstallSpriteLump (const int lump, unsigned const frame, char rot,
     sprtemp[frame].rotate = true;
 }
 
+// -----------------------------------------------------------------------------
+// Startup cache of sprite definitions: the frame count of each sprite,
+// followed by the frames of all sprites. The key is the list of sprite
+// names, as they may be changed by DEHACKED.
+// -----------------------------------------------------------------------------
+
+static byte *SpriteDefsKey (char **namelist, size_t *keylen)
+{
+    const int info[3] = {
+        firstspritelump, lastspritelump, modifiedgame
+    };
+    byte *key;
+
+    *keylen = sizeof(info) + numsprites * 4;
+    key = Z_Malloc(*keylen, PU_STATIC, NULL);
+    memcpy(key, info, sizeof(info));
+
+    for (int i = 0 ; i < numsprites ; i++)
+    {
+        strncpy((char *) key + sizeof(info) + i * 4, DEH_String(namelist[i]), 4);
+    }
+
+    return key;
+}
+
+static boolean LoadSpriteDefs (const byte *key, const size_t keylen)
+{
+    size_t length, numframes = 0;
+    int *data = M_LoadStartupCache("spritedefs", key, keylen, &length);
+    const spriteframe_t *frames;
+
+    if (data == NULL)
+    {
+        return false;
+    }
+
+    for (int i = 0 ; i < numsprites && length >= numsprites * sizeof(int) ; i++)
+    {
+        numframes += data[i] > 0 ? data[i] : 0;
+    }
+
+    if (length != numsprites * sizeof(int) + numframes * sizeof(spriteframe_t))
+    {
+        free(data);
+        return false;
+    }
+
+    frames = (const spriteframe_t *) (data + numsprites);
+
+    for (int i = 0 ; i < numsprites ; i++)
+    {
+        sprites[i].numframes = data[i];
+        sprites[i].spriteframes = NULL;
+
+        if (data[i] > 0)
+        {
+            sprites[i].spriteframes = Z_Malloc(data[i] * sizeof(spriteframe_t), PU_STATIC, NULL);
+            memcpy(sprites[i].spriteframes, frames, data[i] * sizeof(spriteframe_t));
+            frames += data[i];
+        }
+    }
+
+    free(data);
+    return true;
+}
+
+static void SaveSpriteDefs (const byte *key, const size_t keylen)
+{
+    size_t length = numsprites * sizeof(int);
+    byte *data, *p;
+
+    for (int i = 0 ; i < numsprites ; i++)
+    {
+        length += sprites[i].numframes * sizeof(spriteframe_t);
+    }
+
+    data = Z_Malloc(length, PU_STATIC, NULL);
+    p = data + numsprites * sizeof(int);
+
+    for (int i = 0 ; i < numsprites ; i++)
+    {
+        memcpy(data + i * sizeof(int), &sprites[i].numframes, sizeof(int));
+
+        if (sprites[i].numframes > 0)
+        {
+            memcpy(p, sprites[i].spriteframes, sprites[i].numframes * sizeof(spriteframe_t));
+            p += sprites[i].numframes * sizeof(spriteframe_t);
+        }
+    }
+
+    M_WriteStartupCache("spritedefs", key, keylen, data, length);
+    Z_Free(data);
+}
+
 // -----------------------------------------------------------------------------
 // R_InitSpriteDefs
 // Pass a null terminated list of sprite names (4 chars exactly) to be used.
@@ -233,6 +335,9 @@ static void R_InitSpriteDefs (char **namelist)
     int    end;
     int    patched;
     char **check;
+    byte  *key;
+    size_t keylen;
+    const int starttime = I_GetTimeMS();
 
     // count the number of sprite names
     check = namelist;
@@ -250,6 +355,15 @@ static void R_InitSpriteDefs (char **namelist)
 
     sprites = Z_Malloc(numsprites *sizeof(*sprites), PU_STATIC, NULL);
 
+    key = SpriteDefsKey(namelist, &keylen);
+
+    if (LoadSpriteDefs(key, keylen))
+    {
+        Z_Free(key);
+        M_StartupTime("spritedefs", true, starttime);
+        return;
+    }
+
     start = firstspritelump-1;
     end = lastspritelump+1;
 
@@ -344,6 +458,10 @@ static void R_InitSpriteDefs (char **namelist)
         sprites[i].spriteframes = Z_Malloc (maxframe * sizeof(spriteframe_t), PU_STATIC, NULL);
         memcpy (sprites[i].spriteframes, sprtemp, maxframe*sizeof(spriteframe_t));
     }
+
+    SaveSpriteDefs(key, keylen);
+    Z_Free(key);
+    M_StartupTime("spritedefs", false, starttime);
 }
 
 // -----------------------------------------------------------------------------
@@ -457,16 +575,15 @@ void R_DrawMaskedColumn (const column_t *column)
 // -----------------------------------------------------------------------------
 // R_DrawVisSprite
 //  mfloorclip and mceilingclip should also be set.
+// [JN] Draws columns x1...x2 of the sprite, patch must be cached already.
 // -----------------------------------------------------------------------------
 
 static void R_DrawVisSprite (const vissprite_t *vis, const int x1, const int x2)
 {
-    column_t *column;
-    int       texturecolumn;
-    fixed_t   frac;
-    patch_t  *patch;
-
-    patch = W_CacheLumpNum (vis->patch+firstspritelump, PU_CACHE);
+    const column_t *column;
+    int             texturecolumn;
+    fixed_t         frac;
+    const patch_t  *patch = vis->patchdata;
 
     // [crispy] brightmaps for select sprites
     dc_colormap[0] = vis->colormap[0];
@@ -510,11 +627,11 @@ static void R_DrawVisSprite (const vissprite_t *vis, const int x1, const int x2)
 
     dc_iscale = abs(vis->xiscale)>>(detailshift && !hires);
     dc_texturemid = vis->texturemid;
-    frac = vis->startfrac;
+    frac = vis->startfrac + (x1 - vis->x1) * vis->xiscale;
     spryscale = vis->scale;
     sprtopscreen = centeryfrac - FixedMul(dc_texturemid,spryscale);
 
-    for (dc_x = vis->x1 ; dc_x <= vis->x2 ; dc_x++, frac += vis->xiscale)
+    for (dc_x = x1 ; dc_x <= x2 ; dc_x++, frac += vis->xiscale)
     {
         texturecolumn = frac>>FRACBITS;
 #ifdef RANGECHECK
@@ -523,10 +640,13 @@ static void R_DrawVisSprite (const vissprite_t *vis, const int x1, const int x2)
                             "R_DrawVisSprite: bad texturecolumn" :
                             "R_DrawVisSprite: некорректныая информация texturecolumn");
 #endif
-        column = (column_t *) ((byte *)patch + LONG(patch->columnofs[texturecolumn]));
+        column = (const column_t *) ((const byte *)patch + LONG(patch->columnofs[texturecolumn]));
         R_DrawMaskedColumn (column);
     }
 
+    // [JN] Write out last queued columns.
+    R_FlushColumns();
+
     colfunc = basecolfunc;
 }
 
@@ -956,10 +1076,12 @@ static inline void R_ApplyWeaponBob (fixed_t *sx, boolean bobx, fixed_t *sy, boo
 }
 
 // -----------------------------------------------------------------------------
-// R_DrawPSprite
+// R_ProjectPSprite
+// [JN] Generates a vissprite for the player sprite,
+// it is drawn by every strip in R_DrawMaskedSlice.
 // -----------------------------------------------------------------------------
 
-static void R_DrawPSprite (const pspdef_t *psp)
+static void R_ProjectPSprite (const pspdef_t *psp)
 {
     int             x1, x2;
     int             lump;
@@ -968,7 +1090,6 @@ static void R_DrawPSprite (const pspdef_t *psp)
     spritedef_t    *sprdef;
     spriteframe_t  *sprframe;
     vissprite_t    *vis;
-    vissprite_t     avis;
     boolean         flip;
 
     const int state = viewplayer->psprites[ps_weapon].state - states;       // [crispy]
@@ -978,16 +1099,16 @@ static void R_DrawPSprite (const pspdef_t *psp)
 #ifdef RANGECHECK
     if((unsigned)psp->state->sprite >= (unsigned int) numsprites)
         I_QuitWithError(english_language ?
-                        "R_DrawPSprite: invalid sprite number %i " :
-                        "R_DrawPSprite: некорректный номер спрайта %i ",
+                        "R_ProjectPSprite: invalid sprite number %i " :
+                        "R_ProjectPSprite: некорректный номер спрайта %i ",
                         psp->state->sprite);
 #endif
     sprdef = &sprites[psp->state->sprite];
 #ifdef RANGECHECK
     if((psp->state->frame & FF_FRAMEMASK) >= sprdef->numframes)
         I_QuitWithError(english_language ?
-                        "R_DrawPSprite: invalid sprite frame %i : %i " :
-                        "R_DrawPSprite: некорректный фрейм спрайта %i : %i ",
+                        "R_ProjectPSprite: invalid sprite frame %i : %i " :
+                        "R_ProjectPSprite: некорректный фрейм спрайта %i : %i ",
                         psp->state->sprite, psp->state->frame);
 #endif
     sprframe = &sprdef->spriteframes[ psp->state->frame & FF_FRAMEMASK ];
@@ -1045,7 +1166,7 @@ static void R_DrawPSprite (const pspdef_t *psp)
     }
 
     // store information in a vissprite
-    vis = &avis;
+    vis = &pspritevis[numpspritevis++];
     vis->translation = NULL;
     vis->mobjflags = 0;
 
@@ -1170,15 +1291,15 @@ static void R_DrawPSprite (const pspdef_t *psp)
 
     // [JN] Mouselook: also move HUD weapons while mouse look
     vis->texturemid += FixedMul(((centery - viewheight / 2) << FRACBITS), pspriteiscale);
-
-    R_DrawVisSprite (vis, vis->x1, vis->x2);
 }
 
 // -----------------------------------------------------------------------------
-// R_DrawPlayerSprites
+// R_AddPSprites
+// [JN] Projects the player sprites on the main thread,
+// weapon bobbing interpolation is not to be done twice.
 // -----------------------------------------------------------------------------
 
-static void R_DrawPlayerSprites (void)
+void R_AddPSprites (void)
 {
     int i;
     const pspdef_t *psp;
@@ -1186,17 +1307,21 @@ static void R_DrawPlayerSprites (void)
     const int lightnum = (viewplayer->mo->subsector->sector->lightlevel >> LIGHTSEGSHIFT) + extralight;
 
     spritelights = scalelight[BETWEEN(0, LIGHTLEVELS-1, lightnum)];
+    numpspritevis = 0;
 
-    // clip to screen bounds
-    mfloorclip = screenheightarray;
-    mceilingclip = negonearray;
+    // draw the psprites on top of everything
+    //  but does not draw on side views
+    if (viewangleoffset)
+    {
+        return;
+    }
 
     // add all active psprites
     for (i = 0, psp = viewplayer->psprites ; i < NUMPSPRITES ; i++, psp++)
     {
         if (psp->state)
         {
-            R_DrawPSprite (psp);
+            R_ProjectPSprite (psp);
         }
     }
 }
@@ -1286,15 +1411,17 @@ static void R_SortVisSprites (void)
 
 // -------------------------------------------------------------------------
 // R_DrawSprite
+// [JN] Draws the sprite within x1...x2 columns, i.e. within current strip.
+// Clipping arrays are shared, as strips never touch columns of each other.
 // -------------------------------------------------------------------------
 
-static void R_DrawSprite (const vissprite_t *spr)
+static void R_DrawSprite (const vissprite_t *spr, const int x1, const int x2)
 {
     int x, r1, r2;
     drawseg_t *ds;
     fixed_t scale, lowscale;
 
-    for (x = spr->x1 ; x<=spr->x2 ; x++)
+    for (x = x1 ; x<=x2 ; x++)
     {
         clipbot[x] = cliptop[x] = -2;
     }
@@ -1315,7 +1442,7 @@ static void R_DrawSprite (const vissprite_t *spr)
         while (++curr <= last)
         {
         // determine if the drawseg obscures the sprite
-        if (curr->x1 > spr->x2 || curr->x2 < spr->x1)
+        if (curr->x1 > x2 || curr->x2 < x1)
         {
             continue;      // does not cover sprite
         }
@@ -1338,15 +1465,15 @@ static void R_DrawSprite (const vissprite_t *spr)
         {
             if (ds->maskedtexturecol)       // masked mid texture?
             {
-                r1 = ds->x1 < spr->x1 ? spr->x1 : ds->x1;
-                r2 = ds->x2 > spr->x2 ? spr->x2 : ds->x2;
+                r1 = ds->x1 < x1 ? x1 : ds->x1;
+                r2 = ds->x2 > x2 ? x2 : ds->x2;
                 R_RenderMaskedSegRange(ds, r1, r2);
             }
             continue;               // seg is behind sprite
         }
     
-        r1 = ds->x1 < spr->x1 ? spr->x1 : ds->x1;
-        r2 = ds->x2 > spr->x2 ? spr->x2 : ds->x2;
+        r1 = ds->x1 < x1 ? x1 : ds->x1;
+        r2 = ds->x2 > x2 ? x2 : ds->x2;
     
         // clip this piece of the sprite
         // killough 3/27/98: optimized and made much shorter
@@ -1365,7 +1492,7 @@ static void R_DrawSprite (const vissprite_t *spr)
 
     // all clipping has been performed, so draw the sprite
     // check for unclipped columns
-    for (x = spr->x1 ; x<=spr->x2 ; x++)
+    for (x = x1 ; x<=x2 ; x++)
     {
         if (clipbot[x] == -2)
         {
@@ -1379,21 +1506,24 @@ static void R_DrawSprite (const vissprite_t *spr)
 
     mfloorclip = clipbot;
     mceilingclip = cliptop;
-    R_DrawVisSprite (spr, spr->x1, spr->x2);
+    R_DrawVisSprite (spr, x1, x2);
 }
 
 // -------------------------------------------------------------------------
-//
-// R_DrawMasked
-//
+// R_DrawMaskedSlice
+// [JN] Draws sprites, masked mid textures and player sprites of one strip.
 // -------------------------------------------------------------------------
 
-void R_DrawMasked (void)
+static void R_DrawMaskedSlice (const int slice, const int numslices, void *data)
 {
+    const viewstrip_t *strip = &strips[slice];
+    const int left = strip->left;
+    const int right = strip->right;
+    const int middle = (left + right + 1) / 2;
     int        i;
     drawseg_t *ds;
 
-    R_SortVisSprites();
+    colfunc = basecolfunc;
 
     // [JN] Andrey Budko
     // Makes sense for scenes with huge amount of drawsegs.
@@ -1405,9 +1535,9 @@ void R_DrawMasked (void)
 
     if (num_vissprite > 0)
     {
-        if (drawsegs_xrange_size < maxdrawsegs)
+        if (drawsegs_xrange_size < strip->maxdrawsegs)
         {
-            drawsegs_xrange_size = 2 * maxdrawsegs;
+            drawsegs_xrange_size = 2 * strip->maxdrawsegs;
 
             for(i = 0; i < DS_RANGES_COUNT; i++)
             {
@@ -1417,7 +1547,7 @@ void R_DrawMasked (void)
             }
         }
 
-        for (ds = ds_p; ds-- > drawsegs;)
+        for (ds = strip->ds_p; ds-- > strip->drawsegs;)
         {
             if (ds->silhouette || ds->maskedtexturecol)
             {
@@ -1426,13 +1556,14 @@ void R_DrawMasked (void)
                 drawsegs_xranges[0].items[drawsegs_xranges[0].count].user = ds;
 
                 // [JN] Andrey Budko: ~13% of speed improvement on sunder.wad map10
-                if (ds->x1 < centerx)
+                // Split at the middle of the strip, not of the view.
+                if (ds->x1 < middle)
                 {
                     drawsegs_xranges[1].items[drawsegs_xranges[1].count] = 
                     drawsegs_xranges[0].items[drawsegs_xranges[0].count];
                     drawsegs_xranges[1].count++;
                 }
-                if (ds->x2 >= centerx)
+                if (ds->x2 >= middle)
                 {
                     drawsegs_xranges[2].items[drawsegs_xranges[2].count] = 
                     drawsegs_xranges[0].items[drawsegs_xranges[0].count];
@@ -1446,17 +1577,23 @@ void R_DrawMasked (void)
 
     // draw all vissprites back to front
 
-    rendered_vissprites = num_vissprite;
     for (i = num_vissprite ; --i>=0 ; )
     {
-        vissprite_t* spr = vissprite_ptrs[i];
+        const vissprite_t *spr = vissprite_ptrs[i];
+        const int x1 = MAX(spr->x1, left);
+        const int x2 = MIN(spr->x2, right);
 
-        if (spr->x2 < centerx)
+        if (x1 > x2)
+        {
+            continue;
+        }
+
+        if (x2 < middle)
         {
             drawsegs_xrange = drawsegs_xranges[1].items;
             drawsegs_xrange_count = drawsegs_xranges[1].count;
         }
-        else if (spr->x1 >= centerx)
+        else if (x1 >= middle)
         {
             drawsegs_xrange = drawsegs_xranges[2].items;
             drawsegs_xrange_count = drawsegs_xranges[2].count;
@@ -1467,7 +1604,7 @@ void R_DrawMasked (void)
             drawsegs_xrange_count = drawsegs_xranges[0].count;
         }
 
-        R_DrawSprite(vissprite_ptrs[i]);    // [JN] killough
+        R_DrawSprite(spr, x1, x2);    // [JN] killough
     }
 
     // render any remaining masked mid textures
@@ -1475,14 +1612,61 @@ void R_DrawMasked (void)
     // Modified by Lee Killough:
     // (pointer check was originally nonportable
     // and buggy, by going past LEFT end of array):
-    for (ds = ds_p ; ds-- > drawsegs ; )
+    for (ds = strip->ds_p ; ds-- > strip->drawsegs ; )
         if (ds->maskedtexturecol)
             R_RenderMaskedSegRange (ds, ds->x1, ds->x2);
 
     // draw the psprites on top of everything
-    //  but does not draw on side views
-    if (!viewangleoffset)
+    // clip to screen bounds
+    mfloorclip = screenheightarray;
+    mceilingclip = negonearray;
+
+    for (i = 0 ; i < numpspritevis ; i++)
+    {
+        const vissprite_t *vis = &pspritevis[i];
+        const int x1 = MAX(vis->x1, left);
+        const int x2 = MIN(vis->x2, right);
+
+        if (x1 <= x2)
+        {
+            R_DrawVisSprite (vis, x1, x2);
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+//
+// R_DrawMasked
+// [JN] Sprites are sorted and their patches are cached on the main
+// thread, and every view strip draws own part of them on its own thread.
+//
+// -------------------------------------------------------------------------
+
+void R_DrawMasked (void)
+{
+    int i;
+
+    R_SortVisSprites();
+    R_AddPSprites();
+
+    for (i = 0 ; i < (int)num_vissprite ; i++)
+    {
+        vissprites[i].patchdata = W_CacheLumpNum(vissprites[i].patch + firstspritelump, PU_STATIC);
+    }
+    for (i = 0 ; i < numpspritevis ; i++)
+    {
+        pspritevis[i].patchdata = W_CacheLumpNum(pspritevis[i].patch + firstspritelump, PU_STATIC);
+    }
+
+    rendered_vissprites = num_vissprite;
+    I_RunThreads(R_DrawMaskedSlice, NULL);
+
+    for (i = 0 ; i < (int)num_vissprite ; i++)
+    {
+        W_ReleaseLumpNum(vissprites[i].patch + firstspritelump);
+    }
+    for (i = 0 ; i < numpspritevis ; i++)
     {
-        R_DrawPlayerSprites ();
+        W_ReleaseLumpNum(pspritevis[i].patch + firstspritelump);
     }
 }
@@ -89,6 +89,15 @@
 
 #define PACKED_STRUCT(...) PACKEDPREFIX struct __VA_ARGS__ PACKEDATTR
 
+// Variables marked as thread local have a separate copy in every thread.
+// Used by the renderer for state that worker threads modify while drawing.
+
+#if defined(_MSC_VER)
+#define THREADLOCAL __declspec(thread)
+#else
+#define THREADLOCAL __thread
+#endif
+
 // C99 integer types; with gcc we just use this.  Other compilers 
 // should add conditional statements that define the C99 types.
 
@@ -25,7 +25,11 @@
 #include "i_timer.h"
 #include "i_system.h"
 #include "m_argv.h"
+#include "m_bench.h"
 #include "m_misc.h"
+#include "m_starttrace.h"
+#include "m_trace.h"
+#include "m_perf.h"
 #include "p_local.h"
 #include "rd_keybinds.h"
 #include "s_sound.h"
@@ -87,6 +91,7 @@ boolean usergame;               // ok to save / end game
 boolean timingdemo;             // if true, exit with report on completion
 boolean nodrawers = false;      // [crispy] for the demowarp feature
 int starttime;                  // for comparative timing purposes
+static int starttic;            // [JN] first gametic of timedemo run
 
 boolean deathmatch;             // only if started as net death
 boolean netgame;                // only true if packets are broadcast
@@ -742,7 +747,9 @@ static void G_DoLoadLevel (void)
         G_PlayerReborn(0);
     }
 
+    M_StartTraceBegin("P_SetupLevel");
     P_SetupLevel(gameepisode, gamemap, 0, gameskill);
+    M_StartTraceEnd();
     displayplayer = consoleplayer;      // view the guy you are playing
     gameaction = ga_nothing;
     Z_CheckHeap();
@@ -842,7 +849,9 @@ boolean G_Responder(event_t * ev)
                && displayplayer != consoleplayer);
                
         // [JN] Update sound values for appropriate player.
+        TRACE_BEGIN("S_UpdateSounds");
         S_UpdateSounds(players[displayplayer].mo);
+        TRACE_END();
 
         // [JN] Re-init automap variables for correct player arrow angle.
         if (automapactive)
@@ -1185,7 +1194,11 @@ void G_Ticker(void)
     switch (gamestate)
     {
         case GS_LEVEL:
+            M_PerfStart(PERF_TIC);
+            TRACE_BEGIN("P_Ticker");
             P_Ticker();
+            TRACE_END();
+            M_PerfStop(PERF_TIC);
             SB_Ticker();
             AM_Ticker();
             // [JN] Not used outside of multiplayer game.
@@ -1653,6 +1666,7 @@ void G_DoLoadGame(void)
 
     if (strncmp(readversion, vcheck, VERSIONSIZE) != 0)
     {   // Bad version
+        SV_CloseRead();
         return;
     }
     gameskill = SV_ReadByte();
@@ -1699,6 +1713,8 @@ void G_DoLoadGame(void)
                         "Некорректный файл сохранения");
     }
 
+    SV_CloseRead();
+
     P_SetMessage(&players[consoleplayer], DEH_String(txt_gameloaded), msg_system, false);
 }
 
@@ -2255,6 +2271,14 @@ static void G_DoPlayDemo (void)
     usergame = false;
     demoplayback = true;
 
+    // [JN] Next run of -timedemo -benchruns.
+    if (timingdemo)
+    {
+        starttime = I_GetTime();
+        starttic = gametic;
+        M_BenchStartRun();
+    }
+
     if (netgame)
     {
         netdemo = true;
@@ -2286,6 +2310,10 @@ void G_TimeDemo(char *name)
     int episode, map, i;
     int lumpnum, lumplength; // [crispy]
 
+    // [JN] Demo name is needed for releasing and replaying it.
+    defdemoname = name;
+    M_BenchInit(name);
+
     demobuffer = demo_p = W_CacheLumpName(name, PU_STATIC);
 
     // [crispy] ignore empty demo lumps
@@ -2327,6 +2355,8 @@ void G_TimeDemo(char *name)
 
     G_InitNew(skill, episode, map, 0);
     starttime = I_GetTime();
+    starttic = gametic;
+    M_BenchStartRun();
 
     usergame = false;
     demoplayback = true;
@@ -2354,18 +2384,28 @@ void G_TimeDemo(char *name)
 
 boolean G_CheckDemoStatus(void)
 {
-    int endtime, realtics;
+    int endtime, realtics, gametics;
 
     if(timingdemo)
     {
         endtime = I_GetTime();
         realtics = endtime - starttime;
-        float fps = ((float) gametic * TICRATE) / realtics;
+        gametics = gametic - starttic;
+        float fps = ((float) gametics * TICRATE) / realtics;
+
+        // [JN] Play the demo once again for the next benchmark run.
+        if (M_BenchEndRun(gametics))
+        {
+            W_ReleaseLumpName(defdemoname);
+            demoplayback = false;
+            gameaction = ga_playdemo;
+            return true;
+        }
 
         I_QuitWithMessage(english_language ?
                           "Timed %i gametics in %i realtics (%f fps)" :
                           "Насчитано %i gametics в %i realtics.\nСреднее значение FPS: %f.",
-                          gametic, realtics, fps);
+                          gametics, realtics, fps);
     }
 
     if (demoplayback)
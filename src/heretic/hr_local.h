@@ -374,6 +374,7 @@ typedef struct thinker_s
 {
     struct thinker_s *prev, *next;
     think_t function;
+    struct thinker_s *cprev, *cnext;  // [JN] Per-class list, see p_tick.c
 } thinker_t;
 
 typedef union
@@ -398,6 +399,7 @@ typedef struct mobj_s
 // interaction info
     struct mobj_s *bnext, *bprev;       // links in blocks (if needed)
     struct subsector_s *subsector;
+    struct msecnode_s *touching_sectorlist; // [JN] sectors touched by bounding box
     fixed_t floorz, ceilingz;   // closest together of contacted secs
     fixed_t dropoffz;           // killough 11/98: the lowest floor over all contacted Sectors.
     fixed_t radius, height;     // for movement checking
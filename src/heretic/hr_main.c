@@ -41,11 +41,17 @@
 #include "i_glob.h"
 #include "i_sound.h"
 #include "i_system.h"
+#include "i_thread.h"
+#include "m_savebuf.h"
+#include "m_cache.h"
+#include "m_starttrace.h"
+#include "m_trace.h"
 #include "i_timer.h"
 #include "i_video.h"
 #include "m_argv.h"
 #include "m_config.h"
 #include "m_misc.h"
+#include "m_perf.h"
 #include "p_local.h"
 #include "rd_keybinds.h"
 #include "s_sound.h"
@@ -555,6 +561,9 @@ static void DrawPerformance (void)
             sprintf (digit, "%9d", rendered_vissprites);
             RD_M_DrawTextC("SPRITES", 289 + wide_width, 71);
             RD_M_DrawTextC(digit, 281 + wide_width, 78);
+
+            // [JN] Frame phase timings, in milliseconds.
+            M_PerfDrawer(281 + wide_width, 89);
         }
     }
 }
@@ -609,7 +618,9 @@ void D_Display(void)
             if (automapactive)
             {
                 // [crispy] update automap while playing
+                TRACE_BEGIN("R_RenderPlayerView");
                 R_RenderPlayerView(&players[displayplayer]);
+                TRACE_END();
 
                 // [JN] Background opacity in automap overlay mode.
                 if (automap_overlay)
@@ -627,9 +638,13 @@ void D_Display(void)
             }
             else
             {
+                TRACE_BEGIN("R_RenderPlayerView");
                 R_RenderPlayerView(&players[displayplayer]);
+                TRACE_END();
             }
 
+            M_PerfStart(PERF_HUD);
+
             if (automapactive || stats_level_name)
             {
                 SB_MapNameDrawer();
@@ -641,7 +656,9 @@ void D_Display(void)
                 CT_Drawer();
             }
             UpdateState |= I_FULLVIEW;
+            TRACE_BEGIN("SB_Drawer");
             SB_Drawer();
+            TRACE_END();
             break;
         case GS_INTERMISSION:
             IN_Drawer();
@@ -690,6 +707,8 @@ void D_Display(void)
         DrawPerformance();
     }
 
+    M_PerfStop(PERF_HUD);
+
     // [JN] Performance counters were drawn, reset them.
     R_ClearStats();
 
@@ -728,7 +747,9 @@ void D_DoomLoop(void)
 {
     I_GraphicsCheckCommandLine();
     I_SetGrabMouseCallback(D_GrabMouseCallback);
+    M_StartTraceBegin("I_InitGraphics");
     I_InitGraphics();
+    M_StartTraceEnd();
 
     main_loop_started = true;
 
@@ -756,7 +777,11 @@ void D_DoomLoop(void)
         }
 
         // Move positional sounds
+        M_PerfStart(PERF_SOUND);
+        TRACE_BEGIN("S_UpdateSounds");
         S_UpdateSounds(players[displayplayer].mo);
+        TRACE_END();
+        M_PerfStop(PERF_SOUND);
     }
 }
 
@@ -1055,6 +1080,10 @@ void D_BindVariables(void)
     M_BindIntVariable("smoothlight",            &smoothlight);
     M_BindIntVariable("show_endoom",            &show_endoom);
     M_BindIntVariable("flashing_hom",           &flashing_hom);
+    M_BindIntVariable("worker_threads",         &worker_threads);
+    M_BindIntVariable("prelit_flats",           &prelit_flats);
+    M_BindIntVariable("compress_savegames",     &compress_savegames);
+    M_BindIntVariable("startup_cache",          &startup_cache);
 
     // Display
     M_BindIntVariable("screenblocks",           &screenblocks);
@@ -1294,7 +1323,9 @@ void D_DoomMain(void)
 
     // Load defaults before initing other systems
     D_BindVariables();
+    M_StartTraceBegin("M_LoadConfig");
     M_LoadConfig();
+    M_StartTraceEnd();
 
     DEH_printf(english_language ?
                "Z_Init: Init zone memory allocation daemon.\n" :
@@ -1458,7 +1489,9 @@ void D_DoomMain(void)
                "W_Init: Init WAD files.\n" :
                "W_Init: Инициализация WAD-файлов.\n");
 
+    M_StartTraceBegin("D_FindIWAD");
     iwadfile = D_FindIWAD(IWAD_MASK_HERETIC, &gamemission);
+    M_StartTraceEnd();
 
     if (iwadfile == NULL)
     {
@@ -1479,7 +1512,9 @@ void D_DoomMain(void)
 
 #ifdef FEATURE_DEHACKED
     // Load dehacked patches specified on the command line.
+    M_StartTraceBegin("DEH_ParseCommandLine");
     DEH_ParseCommandLine();
+    M_StartTraceEnd();
 #endif
 
     // Load PWAD files.
@@ -1545,7 +1580,9 @@ void D_DoomMain(void)
     }
 
     // [JN] Addition: also generate the WAD hash table.  Speed things up a bit.
+    M_StartTraceBegin("W_GenerateHashTable");
     W_GenerateHashTable();
+    M_StartTraceEnd();
 
     //!
     // @category demo
@@ -1631,7 +1668,11 @@ void D_DoomMain(void)
     }
 
     I_InitTimer();
+    M_PerfInit();
+    I_InitThreads(worker_threads);
+    M_StartTraceBegin("I_InitSound");
     I_InitSound(false);
+    M_StartTraceEnd();
 
 #ifdef FEATURE_MULTIPLAYER
     DEH_printf(english_language ?
@@ -1662,13 +1703,17 @@ void D_DoomMain(void)
     DEH_printf(english_language ?
                "R_Init: Init Heretic render system - [" :
                "R_Init: Инициализация рендерера Heretic - [");
+    M_StartTraceBegin("R_Init");
     R_Init();
+    M_StartTraceEnd();
     DEH_printf("]\n");
 
     DEH_printf(english_language ?
                "P_Init: Init Playloop state.\n" :
                "P_Init: Инициализация игрового окружения.\n");
+    M_StartTraceBegin("P_Init");
     P_Init();
+    M_StartTraceEnd();
 
     DEH_printf(english_language ? 
                "I_Init: Setting up machine state.\n" :
@@ -1679,7 +1724,9 @@ void D_DoomMain(void)
     DEH_printf(english_language ?
                "S_Init: Setting up sound.\n" :
                "S_Init: Активация звуковой системы.\n");
+    M_StartTraceBegin("S_Init");
     S_Init();
+    M_StartTraceEnd();
     //IO_StartupTimer();
     S_Start();
 
@@ -1794,6 +1841,8 @@ void D_DoomMain(void)
     DEH_printf("\".");
     DEH_printf("\n");
 
+    M_PrintStartupTimes();
+
     endtime = SDL_GetTicks() - starttime;
     DEH_printf(english_language ? "Startup process took %d ms.\n" :
                                   "Процесс запуска занял %d мс.\n", endtime);
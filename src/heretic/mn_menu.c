@@ -29,6 +29,7 @@
 #include "i_swap.h"
 #include "i_timer.h" // [JN] I_GetTime()
 #include "m_misc.h"
+#include "m_savebuf.h"
 #include "p_local.h"
 #include "rd_keybinds.h"
 #include "rd_menu.h"
@@ -1912,6 +1913,9 @@ static void MN_LoadSlotText(void)
     int i;
     char *filename;
 
+    // [JN] Make sure the latest savegame has reached the disk.
+    M_FinishSaveWrites();
+
     for (i = 0; i < 7; i++)
     {
         filename = SV_Filename(i);
@@ -6427,6 +6431,7 @@ boolean MN_Responder(event_t * event)
                 {
                     // Find name of saved game file.
                     name = SV_Filename(CurrentItPos);
+                    M_FinishSaveWrites();
                     M_remove(name);
                     free(name);
                     // Truncate text of saved game slot.
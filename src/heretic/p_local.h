@@ -299,6 +299,7 @@ typedef boolean (*traverser_t) (intercept_t *in);
 
 extern boolean P_BlockLinesIterator (int x, int y, boolean(*func) (line_t *));
 extern boolean P_BlockThingsIterator (int x, int y, boolean(*func) (mobj_t *));
+extern boolean P_SectorThingsIterator (sector_t *sector, boolean(*func) (mobj_t *));
 extern boolean P_PathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
                                int flags, boolean(*trav) (intercept_t *));
 
@@ -319,6 +320,7 @@ extern void P_LineOpening (line_t *linedef);
 extern void P_MakeDivline (line_t *li, divline_t *dl);
 extern void P_SetThingPosition (mobj_t *thing);
 extern void P_UnsetThingPosition (mobj_t *thing);
+extern void P_InitSecnodes (void);
 
 /*
 ================================================================================
@@ -383,6 +385,7 @@ extern char *SV_Filename (int slot);
 extern uint16_t SV_ReadWord (void);
 extern uint32_t SV_ReadLong (void);
 extern void SV_Close (char *fileName);
+extern void SV_CloseRead (void);
 extern void SV_Open (char *fileName);
 extern void SV_OpenRead (char *fileName);
 extern void SV_Read (void *buffer, int size);
@@ -1929,6 +1929,14 @@ boolean P_ChangeSector(sector_t * sector, boolean crunch)
     crushchange = crunch;
     movingsector = sector;
 
+    // [JN] Only visit things touching the sector. Demos and network
+    // games keep vanilla order, which affects P_Random calls.
+    if (singleplayer && !vanillaparm)
+    {
+        P_SectorThingsIterator(sector, PIT_ChangeSector);
+        return nofit;
+    }
+
 // recheck heights for all things near the moving sector
 
     for (x = sector->blockbox[BOXLEFT]; x <= sector->blockbox[BOXRIGHT]; x++)
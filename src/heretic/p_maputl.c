@@ -259,6 +259,183 @@ void P_LineOpening(line_t *linedef)
 }
 
 
+/*
+================================================================================
+
+                          SECTOR TOUCHING LISTS
+
+[JN] phares 3/14/98: every thing is linked to all sectors its bounding box
+touches, so moving sectors can visit only things which are in them.
+
+================================================================================
+*/
+
+static msecnode_t *headsecnode;     // free nodes
+static unsigned int secnodechanges; // bumped when any list is changed
+
+/*
+================================================================================
+=
+= P_InitSecnodes
+=
+= Nodes are allocated as PU_LEVEL, so free list is dropped on level change.
+=
+================================================================================
+*/
+
+void P_InitSecnodes(void)
+{
+    headsecnode = NULL;
+}
+
+/*
+================================================================================
+=
+= P_AddSecnode
+=
+= Adds sector to the list of a thing, unless it is already there.
+= Returns new head of the list.
+=
+================================================================================
+*/
+
+static msecnode_t *P_AddSecnode(sector_t *s, mobj_t *thing, msecnode_t *list)
+{
+    msecnode_t *node;
+
+    for (node = list; node; node = node->m_tnext)
+    {
+        if (node->m_sector == s)
+        {
+            return list;
+        }
+    }
+
+    if (headsecnode)
+    {
+        node = headsecnode;
+        headsecnode = node->m_snext;
+    }
+    else
+    {
+        node = Z_Malloc(sizeof(*node), PU_LEVEL, NULL);
+    }
+
+    node->m_sector = s;
+    node->m_thing = thing;
+    node->m_tnext = list;
+    node->visited = false;
+
+    // add to the head of sector list
+    node->m_sprev = NULL;
+    node->m_snext = s->touching_thinglist;
+    if (s->touching_thinglist)
+    {
+        s->touching_thinglist->m_sprev = node;
+    }
+    s->touching_thinglist = node;
+    secnodechanges++;
+
+    return node;
+}
+
+/*
+================================================================================
+=
+= P_DelSeclist
+=
+= Unlinks all nodes of a thing from sector lists and frees them.
+=
+================================================================================
+*/
+
+static void P_DelSeclist(msecnode_t *node)
+{
+    while (node)
+    {
+        msecnode_t *next = node->m_tnext;
+
+        if (node->m_sprev)
+        {
+            node->m_sprev->m_snext = node->m_snext;
+        }
+        else
+        {
+            node->m_sector->touching_thinglist = node->m_snext;
+        }
+        if (node->m_snext)
+        {
+            node->m_snext->m_sprev = node->m_sprev;
+        }
+
+        node->m_snext = headsecnode;
+        headsecnode = node;
+        secnodechanges++;
+
+        node = next;
+    }
+}
+
+/*
+================================================================================
+=
+= P_CreateSecNodeList
+=
+= Collects sectors of all lines crossing the bounding box of a thing, plus
+= sector of its center. Doesn't touch validcount and tm* globals, since
+= things are linked in the middle of other iterations.
+=
+================================================================================
+*/
+
+static msecnode_t *P_CreateSecNodeList(mobj_t *thing)
+{
+    msecnode_t *list = NULL;
+    fixed_t bbox[4];
+    int xl, xh, yl, yh;
+
+    bbox[BOXTOP] = thing->y + thing->radius;
+    bbox[BOXBOTTOM] = thing->y - thing->radius;
+    bbox[BOXRIGHT] = thing->x + thing->radius;
+    bbox[BOXLEFT] = thing->x - thing->radius;
+
+    xl = MAX((bbox[BOXLEFT] - bmaporgx) >> MAPBLOCKSHIFT, 0);
+    xh = MIN((bbox[BOXRIGHT] - bmaporgx) >> MAPBLOCKSHIFT, bmapwidth - 1);
+    yl = MAX((bbox[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT, 0);
+    yh = MIN((bbox[BOXTOP] - bmaporgy) >> MAPBLOCKSHIFT, bmapheight - 1);
+
+    for (int by = yl; by <= yh; by++)
+    {
+        for (int bx = xl; bx <= xh; bx++)
+        {
+            const int32_t *list_p = blockmaplump + blockmap[by * bmapwidth + bx];
+
+            for (; *list_p != -1; list_p++)
+            {
+                const line_t *ld = &lines[*list_p];
+
+                if (bbox[BOXRIGHT] <= ld->bbox[BOXLEFT]
+                ||  bbox[BOXLEFT] >= ld->bbox[BOXRIGHT]
+                ||  bbox[BOXTOP] <= ld->bbox[BOXBOTTOM]
+                ||  bbox[BOXBOTTOM] >= ld->bbox[BOXTOP]
+                ||  P_BoxOnLineSide(bbox, ld) != -1)
+                {
+                    continue;
+                }
+
+                // this line crosses through the object
+                list = P_AddSecnode(ld->frontsector, thing, list);
+                if (ld->backsector)
+                {
+                    list = P_AddSecnode(ld->backsector, thing, list);
+                }
+            }
+        }
+    }
+
+    return P_AddSecnode(thing->subsector->sector, thing, list);
+}
+
 /*
 ================================================================================
 
@@ -322,6 +499,10 @@ void P_UnsetThingPosition(mobj_t *thing)
             }
         }
     }
+
+    // [JN] Unlink from sector touching lists.
+    P_DelSeclist(thing->touching_sectorlist);
+    thing->touching_sectorlist = NULL;
 }
 
 /*
@@ -385,6 +566,11 @@ void P_SetThingPosition (mobj_t *thing)
             thing->bnext = thing->bprev = NULL;
         }
     }
+
+    // [JN] Link into lists of touched sectors. Like the blockmap,
+    // these only have things which are linked into the blockmap.
+    thing->touching_sectorlist = (thing->flags & MF_NOBLOCKMAP) ?
+                                 NULL : P_CreateSecNodeList(thing);
 }
 
 
@@ -581,6 +767,50 @@ boolean P_BlockThingsIterator (int x, int y, boolean(*func) (mobj_t *))
     return true;
 }
 
+/*
+================================================================================
+=
+= P_SectorThingsIterator
+=
+= [JN] killough 4/4/98: calls func for every thing touching the sector.
+= Since func may spawn, move and remove things, the list is scanned again
+= from the beginning whenever it is changed, skipping processed things.
+=
+================================================================================
+*/
+
+boolean P_SectorThingsIterator(sector_t *sector, boolean(*func) (mobj_t *))
+{
+    msecnode_t *node;
+
+    for (node = sector->touching_thinglist; node; node = node->m_snext)
+    {
+        node->visited = false;
+    }
+
+    node = sector->touching_thinglist;
+    while (node)
+    {
+        const unsigned int changes = secnodechanges;
+
+        if (node->visited)
+        {
+            node = node->m_snext;
+            continue;
+        }
+
+        node->visited = true;
+        if (!func(node->m_thing))
+        {
+            return false;
+        }
+
+        node = changes == secnodechanges ? node->m_snext : sector->touching_thinglist;
+    }
+
+    return true;
+}
+
 
 /*
 ================================================================================
@@ -25,11 +25,12 @@
 #include "i_swap.h"
 #include "i_system.h"
 #include "m_misc.h"
+#include "m_savebuf.h"
 #include "p_local.h"
 #include "v_video.h"
 #include "jn.h"
 
-static FILE *SaveGameFP;
+static savebuf_t SaveGameBuf;
 
 
 //==========================================================================
@@ -58,29 +59,45 @@ char *SV_Filename(int slot)
 //
 // SV_Open
 //
+// [JN] The savegame is built in memory, and only written out by SV_Close.
+//
 //==========================================================================
 
 void SV_Open(char *fileName)
 {
-    SaveGameFP = M_fopen(fileName, "wb");
+    M_SaveBufFree(&SaveGameBuf);
 }
 
 void SV_OpenRead(char *filename)
 {
-    SaveGameFP = M_fopen(filename, "rb");
+    M_LoadSaveBuf(&SaveGameBuf, filename, SAVESTRINGSIZE);
 }
 
 //==========================================================================
 //
 // SV_Close
 //
+// [JN] Hands the savegame over to a background write.
+//
 //==========================================================================
 
 void SV_Close(char *fileName)
 {
     SV_WriteByte(SAVE_GAME_TERMINATOR);
 
-    fclose(SaveGameFP);
+    if (!M_WriteSaveBuf(&SaveGameBuf, fileName, NULL, SAVESTRINGSIZE))
+    {
+        printf(english_language ?
+               "SV_Close: Couldn't open %s for writing\n" :
+               "SV_Close: невозможно открыть файл %s для записи\n",
+               fileName);
+        M_SaveBufFree(&SaveGameBuf);
+    }
+}
+
+void SV_CloseRead(void)
+{
+    M_SaveBufFree(&SaveGameBuf);
 }
 
 //==========================================================================
@@ -91,12 +108,12 @@ void SV_Close(char *fileName)
 
 void SV_Write(void *buffer, int size)
 {
-    fwrite(buffer, size, 1, SaveGameFP);
+    M_SaveBufWrite(&SaveGameBuf, buffer, size);
 }
 
 void SV_WriteByte(byte val)
 {
-    SV_Write(&val, sizeof(byte));
+    M_SaveBufWrite8(&SaveGameBuf, val);
 }
 
 void SV_WriteWord(unsigned short val)
@@ -132,7 +149,7 @@ void SV_WritePtr(void *ptr)
 
 void SV_Read(void *buffer, int size)
 {
-    int retval = fread(buffer, 1, size, SaveGameFP);
+    int retval = M_SaveBufRead(&SaveGameBuf, buffer, size);
     if (retval != size)
     {
         I_QuitWithError(english_language ?
@@ -145,7 +162,11 @@ void SV_Read(void *buffer, int size)
 byte SV_ReadByte(void)
 {
     byte result;
-    SV_Read(&result, sizeof(byte));
+
+    if (!M_SaveBufRead8(&SaveGameBuf, &result))
+    {
+        SV_Read(&result, sizeof(byte));
+    }
     return result;
 }
 
@@ -548,8 +548,6 @@ void P_LoadSectors (int lump)
         ss->floor_yoffs = 0;
         ss->ceiling_xoffs = 0;
         ss->ceiling_yoffs = 0;
-        // [crispy] WiggleFix: [kb] for R_FixWiggle()
-        ss->cachedheight = 0;
         // [AM] Sector interpolation.  Even if we're
         //      not running uncapped, the renderer still
         //      uses this data.
@@ -2002,6 +2000,7 @@ void P_SetupLevel (int episode, int map, int playermask, skill_t skill)
     Z_FreeTags(PU_LEVEL, PU_PURGELEVEL - 1);
 
     P_InitThinkers();
+    P_InitSecnodes();
 
     // look for a regular (development) map first
     DEH_snprintf(lumpname, 9, "E%dM%d", episode, map);
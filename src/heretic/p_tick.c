@@ -21,6 +21,7 @@
 
 #include "hr_local.h"
 #include "i_system.h"
+#include "m_trace.h"
 #include "p_local.h"
 #include "v_video.h"
 #include "jn.h"
@@ -42,6 +43,93 @@ The actual structures will vary in size, but the first element must be thinker_t
 
 thinker_t thinkercap;  // both the head and tail of the thinker list
 
+// [JN] Besides the main list, which keeps vanilla order for demos, netgames
+// and savegames, every thinker is linked into the list of its class.
+// In single player each class is run in a tight loop. Thinkers which get
+// their function after P_AddThinker wait in the pending list.
+
+enum
+{
+    th_pending,
+    th_mobj,
+    th_mover,
+    th_light,
+    th_misc,
+    th_removed,
+    NUMTHINKERCLASSES
+};
+
+static thinker_t classcap[NUMTHINKERCLASSES];
+
+static void P_LinkClass (thinker_t *thinker, const int class)
+{
+    thinker_t *cap = &classcap[class];
+
+    cap->cprev->cnext = thinker;
+    thinker->cnext = cap;
+    thinker->cprev = cap->cprev;
+    cap->cprev = thinker;
+}
+
+static void P_UnlinkClass (thinker_t *thinker)
+{
+    thinker->cnext->cprev = thinker->cprev;
+    thinker->cprev->cnext = thinker->cnext;
+}
+
+static int P_ThinkerClass (const thinker_t *thinker)
+{
+    const think_t func = thinker->function;
+
+    if (func == NULL)
+    {
+        return th_pending;
+    }
+    if (func == (think_t) - 1)
+    {
+        return th_removed;
+    }
+    if (func == P_MobjThinker || func == P_BlasterMobjThinker)
+    {
+        return th_mobj;
+    }
+    if (func == T_MoveCeiling || func == T_VerticalDoor
+    ||  func == T_MoveFloor || func == T_PlatRaise)
+    {
+        return th_mover;
+    }
+    if (func == T_LightFlash || func == T_StrobeFlash || func == T_Glow)
+    {
+        return th_light;
+    }
+
+    return th_misc;
+}
+
+/*
+================================================================================
+=
+= P_ClassifyPending
+=
+= Moves pending thinkers to the tails of their class lists
+=
+================================================================================
+*/
+
+static void P_ClassifyPending (void)
+{
+    thinker_t *const cap = &classcap[th_pending];
+
+    while (cap->cnext != cap)
+    {
+        thinker_t *thinker = cap->cnext;
+        const int class = P_ThinkerClass(thinker);
+
+        P_UnlinkClass(thinker);
+        P_LinkClass(thinker, class == th_pending ? th_misc : class);
+    }
+}
+
 /*
 ================================================================================
 =
@@ -53,6 +141,11 @@ thinker_t thinkercap;  // both the head and tail of the thinker list
 void P_InitThinkers (void)
 {
     thinkercap.prev = thinkercap.next = &thinkercap;
+
+    for (int i = 0; i < NUMTHINKERCLASSES; i++)
+    {
+        classcap[i].cprev = classcap[i].cnext = &classcap[i];
+    }
 }
 
 
@@ -72,6 +165,8 @@ void P_AddThinker (thinker_t *thinker)
     thinker->next = &thinkercap;
     thinker->prev = thinkercap.prev;
     thinkercap.prev = thinker;
+
+    P_LinkClass(thinker, P_ThinkerClass(thinker));
 }
 
 /*
@@ -90,6 +185,71 @@ void P_RemoveThinker (thinker_t *thinker)
     thinker->function = (think_t) - 1;
 }
 
+/*
+================================================================================
+=
+= P_RunThinkerClass
+=
+= [JN] Removed thinkers are moved to the removed class and freed once every
+= class has been run. Spawned thinkers are classified right away, so they
+= are run in this tic if their class is not done yet.
+=
+================================================================================
+*/
+
+static void P_RunThinkerClass (const int class)
+{
+    thinker_t *const cap = &classcap[class];
+    thinker_t *currentthinker, *nextthinker;
+
+    for (currentthinker = cap->cnext; currentthinker != cap;
+         currentthinker = nextthinker)
+    {
+        if (currentthinker->function == (think_t) - 1)
+        {
+            nextthinker = currentthinker->cnext;
+            P_UnlinkClass(currentthinker);
+            P_LinkClass(currentthinker, th_removed);
+            continue;
+        }
+
+        if (currentthinker->function)
+        {
+            currentthinker->function(currentthinker);
+        }
+
+        if (classcap[th_pending].cnext != &classcap[th_pending])
+        {
+            P_ClassifyPending();
+        }
+
+        nextthinker = currentthinker->cnext;
+    }
+}
+
+/*
+================================================================================
+=
+= P_FreeRemovedThinkers
+=
+================================================================================
+*/
+
+static void P_FreeRemovedThinkers (void)
+{
+    thinker_t *const cap = &classcap[th_removed];
+
+    while (cap->cnext != cap)
+    {
+        thinker_t *thinker = cap->cnext;
+
+        P_UnlinkClass(thinker);
+        thinker->next->prev = thinker->prev;
+        thinker->prev->next = thinker->next;
+        Z_Free(thinker);
+    }
+}
+
 /*
 ================================================================================
 =
@@ -105,18 +265,16 @@ static void P_RunThinkers (void)
     // [JN] Prevent dropped item from jittering on moving platforms.
     // For single player only, really not safe for internal demos.
     // See: https://github.com/bradharding/doomretro/issues/501
+    // All mobjs are run first, then all sector thinkers.
     if (singleplayer)
     {
-        currentthinker = thinkercap.next;
-        while (currentthinker != &thinkercap)
-        {
-            if (currentthinker->function)
-                if (currentthinker->function == P_MobjThinker)
-                    currentthinker->function (currentthinker);
-            
-            nextthinker = currentthinker->next;
-            currentthinker = nextthinker;
-        }
+        P_ClassifyPending();
+        P_RunThinkerClass(th_mobj);
+        P_RunThinkerClass(th_mover);
+        P_RunThinkerClass(th_light);
+        P_RunThinkerClass(th_misc);
+        P_FreeRemovedThinkers();
+        return;
     }
 
     currentthinker = thinkercap.next;
@@ -127,26 +285,15 @@ static void P_RunThinkers (void)
             nextthinker = currentthinker->next;
             currentthinker->next->prev = currentthinker->prev;
             currentthinker->prev->next = currentthinker->next;
+            P_UnlinkClass(currentthinker);
             Z_Free(currentthinker);
         }
         else
         {
-            // [JN] Prevent dropped item from jittering on moving platforms.
-            if (singleplayer)
-            {
-                if (currentthinker->function)
-                    if (currentthinker->function != P_MobjThinker)
-                        currentthinker->function (currentthinker);
-
-                nextthinker = currentthinker->next;
-            }
-            else
-            {
-                if (currentthinker->function)
-                    currentthinker->function(currentthinker);
-
-                nextthinker = currentthinker->next;
-            }
+            if (currentthinker->function)
+                currentthinker->function(currentthinker);
+
+            nextthinker = currentthinker->next;
         }
         currentthinker = nextthinker;
     }
@@ -183,7 +330,9 @@ void P_Ticker (void)
         }
     }
 
+    TRACE_BEGIN("P_RunThinkers");
     P_RunThinkers();
+    TRACE_END();
     P_UpdateSpecials();
     P_AmbientSound();
     leveltime++;
@@ -36,15 +36,16 @@ static byte *ylookup[MAXHEIGHT];
 static int   columnofs[MAXWIDTH]; 
 
 // R_DrawColumn. Source is the top of the column to scale.
-const lighttable_t *dc_colormap[2];  // [crispy] brightmaps
-const byte         *dc_source;       // First pixel in a column (possibly virtual).
-fixed_t dc_x, dc_yl, dc_yh;
-fixed_t dc_iscale;
-fixed_t dc_texturemid;
-fixed_t dc_texheight;
+// [JN] Thread local, sky columns are drawn by R_DrawPlanes worker threads.
+THREADLOCAL const lighttable_t *dc_colormap[2];  // [crispy] brightmaps
+THREADLOCAL const byte         *dc_source;       // First pixel in a column (possibly virtual).
+THREADLOCAL fixed_t dc_x, dc_yl, dc_yh;
+THREADLOCAL fixed_t dc_iscale;
+THREADLOCAL fixed_t dc_texturemid;
+THREADLOCAL fixed_t dc_texheight;
 
 // Translated columns.
-byte *dc_translation;
+THREADLOCAL byte *dc_translation;
 byte *translationtables;
 
 // Spans.
@@ -52,9 +53,8 @@ int     ds_y, ds_x1, ds_x2;
 fixed_t ds_xfrac, ds_yfrac;
 fixed_t ds_xstep, ds_ystep;
 
-const lighttable_t *ds_colormap[2];
-const byte         *ds_source;  // start of a 64*64 tile image 
-const byte         *ds_brightmap;
+THREADLOCAL const lighttable_t *ds_colormap;  // [JN] Fused with flat brightmap.
+THREADLOCAL const byte         *ds_source;  // start of a 64*64 tile image 
 
 
 /*
@@ -94,8 +94,7 @@ void R_DrawColumn (void)
     // [JN] killough 2/1/98: more performance tuning
     {
         const byte *source = dc_source;
-        const byte *brightmap = dc_brightmap;
-        const lighttable_t *const *colormap = dc_colormap;
+        const lighttable_t *colormap = R_BrightColormap(dc_brightmap, dc_colormap[0], dc_colormap[1]);
         int heightmask = dc_texheight - 1;
 
         if (dc_texheight & heightmask)   // not a power of 2 -- killough
@@ -117,7 +116,7 @@ void R_DrawColumn (void)
                 // [crispy] brightmaps
                 const byte src = source[frac>>FRACBITS];
 
-                *dest = colormap[brightmap[src]][src];
+                *dest = colormap[src];
                 dest += screenwidth;
                 if ((frac += fracstep) >= heightmask)
                 {
@@ -132,7 +131,7 @@ void R_DrawColumn (void)
                 // [crispy] brightmaps
                 const byte src = source[(frac>>FRACBITS)&heightmask];
 
-                *dest = colormap[brightmap[src]][src];
+                *dest = colormap[src];
                 dest += screenwidth; 
                 frac += fracstep;
             } while (count--); 
@@ -140,6 +139,191 @@ void R_DrawColumn (void)
     }
 }
 
+/*
+================================================================================
+=
+= Quad column drawing
+=
+= [JN] Columns are drawn into a small buffer four columns wide, so adjacent
+= columns share cache lines, and written to the screen four pixels per row.
+= Each queued column keeps own lighting, so output is identical to
+= R_DrawColumn. Columns queued into the same slot twice (i.e. top and bottom
+= wall tiers) are kept as separate ranges and never written over each other.
+=
+================================================================================
+*/
+
+#define QUADRANGES 8  // Maximal number of posts in a queued column.
+
+static THREADLOCAL byte quadbuf[MAXHEIGHT * 4];
+static THREADLOCAL int  quadcol = -1;            // First screen column of queued group.
+static THREADLOCAL int  quadranges[4];
+static THREADLOCAL int  quadyl[4][QUADRANGES];
+static THREADLOCAL int  quadyh[4][QUADRANGES];
+
+/*
+================================================================================
+=
+= R_FlushColumns
+=
+================================================================================
+*/
+
+void R_FlushColumns (void)
+{
+    int top = 0, bottom = SCREENHEIGHT - 1;
+
+    if (quadcol < 0)
+    {
+        return;
+    }
+
+    // Four-wide copy is only possible between rows every column has.
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        if (quadranges[i] != 1)
+        {
+            top = SCREENHEIGHT;
+            break;
+        }
+        top = MAX(top, quadyl[i][0]);
+        bottom = MIN(bottom, quadyh[i][0]);
+    }
+
+    if (top <= bottom)
+    {
+        byte *dest = ylookup[top] + columnofs[quadcol];
+        const byte *source = quadbuf + top * 4;
+
+        for (int y = top ; y <= bottom ; y++)
+        {
+            memcpy(dest, source, 4);
+            dest += screenwidth;
+            source += 4;
+        }
+    }
+    else
+    {
+        // No common rows, copy everything column by column.
+        top = SCREENHEIGHT;
+        bottom = SCREENHEIGHT - 1;
+    }
+
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        for (int r = 0 ; r < quadranges[i] ; r++)
+        {
+            const int yl = quadyl[i][r];
+            const int yh = quadyh[i][r];
+
+            for (int y = yl ; y <= yh ; y++)
+            {
+                if (y == top)
+                {
+                    y = bottom;  // Already copied, skip.
+                    continue;
+                }
+
+                ylookup[y][columnofs[quadcol + i]] = quadbuf[y * 4 + i];
+            }
+        }
+
+        quadranges[i] = 0;
+    }
+
+    quadcol = -1;
+}
+
+/*
+================================================================================
+=
+= R_QueueColumn
+=
+================================================================================
+*/
+
+void R_QueueColumn (void)
+{
+    int      count = dc_yh - dc_yl;
+    int      col, slot;
+    byte    *dest;
+    fixed_t  frac, fracstep;
+
+    // Zero length, column does not exceed a pixel.
+    if (count < 0)
+    {
+        return;
+    }
+
+#ifdef RANGECHECK
+    if ((unsigned)dc_x >= screenwidth || dc_yl < 0 || dc_yh >= SCREENHEIGHT)
+        I_QuitWithError(english_language ?
+                     "R_QueueColumn: %i to %i at %i" :
+                     "R_QueueColumn: %i к %i в %i",
+                     dc_yl, dc_yh, dc_x);
+#endif
+
+    col = flipviewwidth[dc_x];
+    slot = col & 3;
+
+    if (quadcol != (col & ~3) || quadranges[slot] == QUADRANGES)
+    {
+        R_FlushColumns();
+        quadcol = col & ~3;
+    }
+
+    quadyl[slot][quadranges[slot]] = dc_yl;
+    quadyh[slot][quadranges[slot]] = dc_yh;
+    quadranges[slot]++;
+
+    dest = quadbuf + dc_yl * 4 + slot;
+    fracstep = dc_iscale;
+    frac = dc_texturemid + (dc_yl-centery) * fracstep;
+
+    // Same as R_DrawColumn, but with the buffer stride.
+    {
+        const byte *source = dc_source;
+        const lighttable_t *colormap = R_BrightColormap(dc_brightmap, dc_colormap[0], dc_colormap[1]);
+        int heightmask = dc_texheight - 1;
+
+        if (dc_texheight & heightmask)  // not a power of 2 -- killough
+        {
+            heightmask++;
+            heightmask <<= FRACBITS;
+
+            if (frac < 0)
+                while ((frac += heightmask) < 0);
+            else
+                while (frac >= heightmask)
+                    frac -= heightmask;
+
+            do
+            {
+                const byte src = source[frac>>FRACBITS];
+
+                *dest = colormap[src];
+                dest += 4;
+                if ((frac += fracstep) >= heightmask)
+                {
+                    frac -= heightmask;
+                }
+            } while (count--);
+        }
+        else  // texture height is a power of 2 -- killough
+        {
+            do 
+            {
+                const byte src = source[(frac>>FRACBITS)&heightmask];
+
+                *dest = colormap[src];
+                dest += 4;
+                frac += fracstep;
+            } while (count--); 
+        }
+    }
+}
+
+
 /*
 ================================================================================
 =
@@ -180,8 +364,7 @@ void R_DrawColumnLow (void)
     // Inner loop that does the actual texture mapping, e.g. a DDA-lile scaling.
     {
         const byte *source = dc_source;
-        const byte *brightmap = dc_brightmap;
-        const lighttable_t *const *colormap = dc_colormap;
+        const lighttable_t *colormap = R_BrightColormap(dc_brightmap, dc_colormap[0], dc_colormap[1]);
         int heightmask = dc_texheight - 1;
 
         if (dc_texheight & heightmask)  // not a power of 2 -- killough
@@ -199,7 +382,7 @@ void R_DrawColumnLow (void)
             {
                 // [crispy] brightmaps
                 const byte src = source[frac>>FRACBITS];
-                *dest4 = *dest3 = *dest2 = *dest1 = colormap[brightmap[src]][src];
+                *dest4 = *dest3 = *dest2 = *dest1 = colormap[src];
 
                 dest1 += screenwidth << hires;
                 dest2 += screenwidth << hires;
@@ -218,7 +401,7 @@ void R_DrawColumnLow (void)
             {
                 // [crispy] brightmaps
                 const byte src = source[(frac>>FRACBITS)&heightmask];
-                *dest4 = *dest3 = *dest2 = *dest1 = colormap[brightmap[src]][src];
+                *dest4 = *dest3 = *dest2 = *dest1 = colormap[src];
 
                 dest1 += screenwidth << hires;
                 dest2 += screenwidth << hires;
@@ -589,8 +772,7 @@ void R_DrawExtraTLColumn (void)
 
     {
         const byte *source = dc_source;
-        const byte *brightmap = dc_brightmap;
-        const lighttable_t *const *colormap = dc_colormap;
+        const lighttable_t *colormap = R_BrightColormap(dc_brightmap, dc_colormap[0], dc_colormap[1]);
         int heightmask = dc_texheight - 1;
 
         if (dc_texheight & heightmask)  // not a power of 2 -- killough
@@ -608,7 +790,7 @@ void R_DrawExtraTLColumn (void)
             {
                 const byte src = source[frac >> FRACBITS];
 
-                *dest = transtable80[(*dest << 8) + colormap[brightmap[src]][src]];
+                *dest = transtable80[(*dest << 8) + colormap[src]];
                 dest += screenwidth;
                 if ((frac += fracstep) >= heightmask)
                 {
@@ -622,7 +804,7 @@ void R_DrawExtraTLColumn (void)
             {
                 const byte src = source[(frac >> FRACBITS) & heightmask];
                 
-                *dest = transtable80[(*dest << 8) + colormap[brightmap[src]][src]];
+                *dest = transtable80[(*dest << 8) + colormap[src]];
                 dest += screenwidth;
                 frac += fracstep;
             } while (count--);
@@ -671,8 +853,7 @@ void R_DrawExtraTLColumnLow (void)
 
     {
         const byte *source = dc_source;
-        const byte *brightmap = dc_brightmap;
-        const lighttable_t *const *colormap = dc_colormap;
+        const lighttable_t *colormap = R_BrightColormap(dc_brightmap, dc_colormap[0], dc_colormap[1]);
         int heightmask = dc_texheight - 1;
 
         if (dc_texheight & heightmask) // not a power of 2 -- killough
@@ -690,10 +871,10 @@ void R_DrawExtraTLColumnLow (void)
             {
                 const byte src = source[frac >> FRACBITS];
 
-                *dest1 = transtable80[(*dest1 << 8) + colormap[brightmap[src]][src]];
-                *dest2 = transtable80[(*dest2 << 8) + colormap[brightmap[src]][src]];
-                *dest4 = transtable80[(*dest4 << 8) + colormap[brightmap[src]][src]];
-                *dest3 = transtable80[(*dest3 << 8) + colormap[brightmap[src]][src]];
+                *dest1 = transtable80[(*dest1 << 8) + colormap[src]];
+                *dest2 = transtable80[(*dest2 << 8) + colormap[src]];
+                *dest4 = transtable80[(*dest4 << 8) + colormap[src]];
+                *dest3 = transtable80[(*dest3 << 8) + colormap[src]];
 
                 dest1 += screenwidth << hires;
                 dest2 += screenwidth << hires;
@@ -712,10 +893,10 @@ void R_DrawExtraTLColumnLow (void)
             {
                 const byte src = source[(frac>>FRACBITS)&heightmask];
 
-                *dest1 = transtable80[(*dest1 << 8) + colormap[brightmap[src]][src]];
-                *dest2 = transtable80[(*dest2 << 8) + colormap[brightmap[src]][src]];
-                *dest3 = transtable80[(*dest3 << 8) + colormap[brightmap[src]][src]];
-                *dest4 = transtable80[(*dest4 << 8) + colormap[brightmap[src]][src]];
+                *dest1 = transtable80[(*dest1 << 8) + colormap[src]];
+                *dest2 = transtable80[(*dest2 << 8) + colormap[src]];
+                *dest3 = transtable80[(*dest3 << 8) + colormap[src]];
+                *dest4 = transtable80[(*dest4 << 8) + colormap[src]];
 
                 dest1 += screenwidth << hires;
                 dest2 += screenwidth << hires;
@@ -963,8 +1144,7 @@ void R_DrawSpan (fixed_t x1, fixed_t x2, const fixed_t y,
 {
     unsigned int count = x2 - x1;  // We do not check for zero spans here.
     const byte  *source = ds_source;
-    const byte  *brightmap = ds_brightmap;
-    const byte **colormap = ds_colormap;
+    const byte  *colormap = ds_colormap;
 
 #ifdef RANGECHECK
     if (x2 < x1 || x1 < 0 || x2 >= screenwidth
@@ -990,13 +1170,133 @@ void R_DrawSpan (fixed_t x1, fixed_t x2, const fixed_t y,
         unsigned const int spot = ((ds_xfrac >> 16) & 0x3f) | ((ds_yfrac >> 10) & 0x0fc0);
 
         // Lookup pixel from flat texture tile, re-index using light/colormap.
-        *dest = colormap[brightmap[source[spot]]][source[spot]];
+        *dest = colormap[source[spot]];
 
         ds_xfrac += ds_xstep;
         ds_yfrac += ds_ystep;
     } while (count--);
 }
 
+/*
+================================================================================
+=
+= R_DrawSpanLit
+=
+= [JN] Alternate version of R_DrawSpan. The flat is lit once per light level
+= into a 64x64 tile, so the inner loop needs only one lookup per pixel and
+= the row is written eight pixels at a time. Output is identical to
+= R_DrawSpan. Tiles live for one frame, as swirling flats change each tic
+= and flat lumps may be purged between frames.
+=
+================================================================================
+*/
+
+#define LITFLATS     16  // Lit tiles kept per thread.
+#define LITFLATSPAN  32  // Shorter spans are not worth lighting a new tile.
+
+typedef struct
+{
+    const byte         *source;
+    const lighttable_t *colormap;
+    unsigned int        frame;
+    byte                pixels[64*64];
+} litflat_t;
+
+int prelit_flats = 1;
+unsigned int litflatframe;
+
+static THREADLOCAL litflat_t litflats[LITFLATS];
+
+static const byte *R_LitFlat (const boolean build)
+{
+    const uintptr_t key = ((uintptr_t) ds_colormap >> 8) ^ ((uintptr_t) ds_source >> 12);
+    litflat_t *const lit = &litflats[key % LITFLATS];
+
+    if (lit->frame == litflatframe && lit->source == ds_source
+    &&  lit->colormap == ds_colormap)
+    {
+        return lit->pixels;
+    }
+
+    if (!build)
+    {
+        return NULL;
+    }
+
+    for (int i = 0 ; i < 64*64 ; i++)
+    {
+        lit->pixels[i] = ds_colormap[ds_source[i]];
+    }
+
+    lit->source = ds_source;
+    lit->colormap = ds_colormap;
+    lit->frame = litflatframe;
+
+    return lit->pixels;
+}
+
+void R_DrawSpanLit (fixed_t x1, fixed_t x2, const fixed_t y,
+                    fixed_t ds_xfrac, const fixed_t ds_xstep,
+                    fixed_t ds_yfrac, const fixed_t ds_ystep)
+{
+    unsigned int count = x2 - x1 + 1;
+    unsigned int xfrac = ds_xfrac, yfrac = ds_yfrac;
+    unsigned int xstep = ds_xstep, ystep = ds_ystep;
+    const byte  *lit;
+    byte        *dest;
+
+#ifdef RANGECHECK
+    if (x2 < x1 || x1 < 0 || x2 >= screenwidth
+        || (unsigned) y > SCREENHEIGHT)
+        I_QuitWithError(english_language ?
+                     "R_DrawSpanLit: %i to %i at %i" :
+                     "R_DrawSpanLit: %i к %i в %i",
+                     x1, x2, y);
+#endif
+
+    if ((lit = R_LitFlat(count >= LITFLATSPAN)) == NULL)
+    {
+        R_DrawSpan(x1, x2, y, ds_xfrac, ds_xstep, ds_yfrac, ds_ystep);
+        return;
+    }
+
+    // Always walk the row from left to right on screen. With flipped
+    // levels, start from the other end of the span and step backwards.
+    if (flipviewwidth[x1] > flipviewwidth[x2])
+    {
+        xfrac += (count - 1) * xstep;
+        yfrac += (count - 1) * ystep;
+        xstep = -xstep;
+        ystep = -ystep;
+        dest = ylookup[y] + columnofs[flipviewwidth[x2]];
+    }
+    else
+    {
+        dest = ylookup[y] + columnofs[flipviewwidth[x1]];
+    }
+
+    for ( ; count >= 8 ; count -= 8, dest += 8)
+    {
+        byte pixels[8];
+
+        for (int i = 0 ; i < 8 ; i++)
+        {
+            pixels[i] = lit[((xfrac >> 16) & 0x3f) | ((yfrac >> 10) & 0x0fc0)];
+            xfrac += xstep;
+            yfrac += ystep;
+        }
+
+        memcpy(dest, pixels, sizeof(pixels));
+    }
+
+    while (count--)
+    {
+        *dest++ = lit[((xfrac >> 16) & 0x3f) | ((yfrac >> 10) & 0x0fc0)];
+        xfrac += xstep;
+        yfrac += ystep;
+    }
+}
+
 /*
 ================================================================================
 =
@@ -1014,8 +1314,7 @@ void R_DrawSpanLow (fixed_t x1, fixed_t x2, const fixed_t y,
     unsigned int count = x2 - x1;  // We do not check for zero spans here.
     const int    ds_y_low = y << hires;
     const byte  *source = ds_source;
-    const byte  *brightmap = ds_brightmap;
-    const byte **colormap = ds_colormap;
+    const byte  *colormap = ds_colormap;
     byte        *dest1, *dest2;
 
 #ifdef RANGECHECK
@@ -1045,13 +1344,13 @@ void R_DrawSpanLow (fixed_t x1, fixed_t x2, const fixed_t y,
 
         // Lowres/blocky mode does it twice, while scale is adjusted appropriately.
          dest1 = ylookup[ds_y_low] + columnofs[flipviewwidth[x1]];
-        *dest1 = colormap[brightmap[source[spot]]][source[spot]];
+        *dest1 = colormap[source[spot]];
          dest2 = ylookup[ds_y_low + 1] + columnofs[flipviewwidth[x1++]];
-        *dest2 = colormap[brightmap[source[spot]]][source[spot]];
+        *dest2 = colormap[source[spot]];
          dest1 = ylookup[ds_y_low] + columnofs[flipviewwidth[x1]];
-        *dest1 = colormap[brightmap[source[spot]]][source[spot]];
+        *dest1 = colormap[source[spot]];
          dest2 = ylookup[ds_y_low + 1] + columnofs[flipviewwidth[x1++]];
-        *dest2 = colormap[brightmap[source[spot]]][source[spot]];
+        *dest2 = colormap[source[spot]];
 
         // position += step;
         ds_xfrac += ds_xstep;
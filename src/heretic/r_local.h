@@ -65,14 +65,11 @@ typedef struct
 
     int validcount;             // if == validcount, already checked
     mobj_t *thinglist;          // list of mobjs in sector
+    struct msecnode_s *touching_thinglist;  // [JN] killough 3/28/98: mobjs touching sector
     void *specialdata;          // thinker_t for reversable actions
     int linecount;
     struct line_s **lines;      // [linecount] size
 
-    // [crispy] WiggleFix: [kb] for R_FixWiggle()
-    int cachedheight;
-    int scaleindex;    
-
     // [AM] Previous position of floor and ceiling before
     //      think.  Used to interpolate between positions.
     fixed_t	oldfloorheight;
@@ -92,6 +89,20 @@ typedef struct
     fixed_t interpceilingheight;
 } sector_t;
 
+// [JN] phares 3/14/98: sector touching lists. Each node links a thing to
+// one of the sectors its bounding box touches, and is threaded both through
+// the list of the thing and the list of the sector.
+
+typedef struct msecnode_s
+{
+    sector_t *m_sector;         // a sector containing this object
+    struct mobj_s *m_thing;     // this object
+    struct msecnode_s *m_tnext; // next msecnode_t for this thing
+    struct msecnode_s *m_sprev; // prev msecnode_t for this sector
+    struct msecnode_s *m_snext; // next msecnode_t for this sector
+    boolean visited;            // already processed by sector iterator
+} msecnode_t;
+
 typedef struct
 {
     fixed_t textureoffset;      // add this to the calculated texture col
@@ -104,6 +115,18 @@ typedef struct
 typedef enum
 { ST_HORIZONTAL, ST_VERTICAL, ST_POSITIVE, ST_NEGATIVE } slopetype_t;
 
+// [JN] cph: linedef properties, rolled up by R_AddLine.
+// With more than one strip they are worked out again by every strip,
+// as lines are shared by all of them.
+enum
+{
+    RF_TOP_TILE  = 1,   // Upper texture needs tiling
+    RF_MID_TILE  = 2,   // Mid texture needs tiling
+    RF_BOT_TILE  = 4,   // Lower texture needs tiling
+    RF_IGNORE    = 8,   // Renderer can skip this line
+    RF_CLOSED    = 16,  // Line blocks view
+};
+
 typedef struct line_s
 {
     vertex_t *v1, *v2;
@@ -119,13 +142,7 @@ typedef struct line_s
     void *specialdata;          // thinker_t for reversable actions
     // [JN] Improved column clipping.
     int r_validcount;   // cph: if == gametic, r_flags already done
-    enum {              // cph:
-    RF_TOP_TILE  = 1,   // Upper texture needs tiling
-    RF_MID_TILE  = 2,   // Mid texture needs tiling
-    RF_BOT_TILE  = 4,   // Lower texture needs tiling
-    RF_IGNORE    = 8,   // Renderer can skip this line
-    RF_CLOSED    = 16,  // Line blocks view
-    } r_flags;
+    int r_flags;        // RF_* flags, cached with one strip only
     // [crispy] calculate sound origin of line to be its midpoint
     degenmobj_t	soundorg;
 } line_t;
@@ -181,6 +198,12 @@ typedef struct visplane_s
     int lightlevel;
     int special;
     int minx, maxx;
+    // [JN] Drawing data, resolved by R_DrawPlanes
+    // before the planes are split between threads.
+    const byte    *source;
+    lighttable_t **zlight;  // [JN] Fused with flat brightmap.
+    fixed_t        planeheight;
+    fixed_t        scrollx, scrolly;
     unsigned int pad1;                // [crispy] hires / 32-bit integer math
     unsigned int top[MAXWIDTH];       // [crispy] hires / 32-bit integer math
     unsigned int pad2;                // [crispy] hires / 32-bit integer math
@@ -222,6 +245,7 @@ typedef struct vissprite_s
     fixed_t xiscale;            // negative if flipped
     fixed_t texturemid;
     int patch;
+    const patch_t *patchdata;   // [JN] Cached by R_DrawMasked.
     // [crispy] brightmaps for select sprites
     lighttable_t *colormap[2];
     const byte *brightmap;
@@ -232,7 +256,7 @@ typedef struct vissprite_s
 } vissprite_t;
 
 
-extern visplane_t *floorplane, *ceilingplane;
+extern THREADLOCAL visplane_t *floorplane, *ceilingplane;
 
 // Sprites are patches with a special naming convention so they can be 
 // recognized by R_InitSprites.  The sprite and frame specified by a 
@@ -308,6 +332,12 @@ extern const byte *R_BrightmapForSprite (const int state);
 extern const byte *R_BrightmapForFlatNum (const int num);
 extern const byte *R_BrightmapForState (const int state);
 
+extern const lighttable_t *R_BrightColormap (const byte *brightmap,
+                                             const lighttable_t *colormap,
+                                             const lighttable_t *brightcolormap);
+extern lighttable_t **R_BrightZLight (const byte *brightmap, const int light);
+extern void R_FlushBrightZLight (void);
+
 /*
 ================================================================================
 =
@@ -318,29 +348,27 @@ extern const byte *R_BrightmapForState (const int state);
 
 typedef void (*drawfunc_t) (int start, int stop);
 
-extern boolean markceiling;
-extern boolean markfloor;  // false if the back side is the same plane
+extern THREADLOCAL boolean markceiling;
+extern THREADLOCAL boolean markfloor;  // false if the back side is the same plane
 extern boolean skymap;
 
-extern byte *solidcol;  // [JN] Improved column clipping.
-
-extern drawseg_t *drawsegs, *ds_p;
-
 extern lighttable_t **hscalelight, **vscalelight, **dscalelight;
 
-extern line_t   *linedef;
-extern sector_t *frontsector, *backsector;
-extern seg_t    *curline;
-extern side_t   *sidedef;
-
-extern unsigned maxdrawsegs;  // [JN] killough: New code which removes 2s linedef limit
+extern THREADLOCAL line_t   *linedef;
+extern THREADLOCAL sector_t *frontsector, *backsector;
+extern THREADLOCAL seg_t    *curline;
+extern THREADLOCAL side_t   *sidedef;
+extern THREADLOCAL int       lineflags;
 
+extern void R_AddBSPSprites (int bspnum);
 extern void R_ClearClipSegs (void);
 extern void R_ClearDrawSegs (void);
-extern void R_InitClipSegs (void);
 extern void R_InitSkyMap (void);
+extern void R_InterpolateSectors (void);
+extern void R_MarkMappedLines (void);
 extern void R_RenderBSPNode (int bspnum);
-extern void R_StoreWallRange (const int start, const int stop);
+extern void R_StoreWallRange (const int start, const int stop,
+                              const int segstart, const int segstop);
 
 /*
 ================================================================================
@@ -351,6 +379,8 @@ extern void R_StoreWallRange (const int start, const int stop);
 */
 
 extern const byte *R_GetColumn (const int tex, int col, const boolean opaque);
+extern const byte *R_GetMaskedColumn (const int tex, int col);
+extern void R_LockTexturePatches (const int tex, const boolean lock);
 
 extern fixed_t *spriteoffset;
 extern fixed_t *spritetopoffset;
@@ -379,22 +409,22 @@ extern void R_PrecacheLevel (void);
 ================================================================================
 */
 
-extern byte *dc_translation;
+extern THREADLOCAL byte *dc_translation;
 extern byte *translationtables;
 
-extern const byte *dc_brightmap;
-extern const byte *dc_source;         // first pixel in a column
-extern const byte *ds_brightmap;
-extern const byte *ds_source;         // start of a 64*64 tile image
-extern const lighttable_t *dc_colormap[2];
-extern const lighttable_t *ds_colormap[2];
-
-extern fixed_t dc_iscale;
-extern fixed_t dc_texheight;
-extern fixed_t dc_texturemid;
-extern fixed_t dc_x;
-extern fixed_t dc_yh;
-extern fixed_t dc_yl;
+extern THREADLOCAL const byte *dc_brightmap;
+extern THREADLOCAL const byte *dc_source;         // first pixel in a column
+extern THREADLOCAL const byte *ds_source;         // start of a 64*64 tile image
+extern THREADLOCAL const lighttable_t *dc_colormap[2];
+extern THREADLOCAL const lighttable_t *ds_colormap;
+extern unsigned int litflatframe;
+
+extern THREADLOCAL fixed_t dc_iscale;
+extern THREADLOCAL fixed_t dc_texheight;
+extern THREADLOCAL fixed_t dc_texturemid;
+extern THREADLOCAL fixed_t dc_x;
+extern THREADLOCAL fixed_t dc_yh;
+extern THREADLOCAL fixed_t dc_yl;
 extern fixed_t skyiscale;
 extern fixed_t skyiscale_low;
 extern fixed_t skytextureheight;
@@ -402,6 +432,8 @@ extern int     skytexturemid;
 
 extern void R_DrawColumn (void);
 extern void R_DrawColumnLow (void);
+extern void R_QueueColumn (void);
+extern void R_FlushColumns (void);
 extern void R_DrawExtraTLColumn (void);
 extern void R_DrawExtraTLColumnLow (void);
 extern void R_DrawSkyColumn (void);
@@ -415,6 +447,9 @@ extern void R_DrawTranslatedTLColumnLow (void);
 extern void R_DrawSpan (fixed_t x1, fixed_t x2, const fixed_t y,
                         fixed_t ds_xfrac, const fixed_t ds_xstep,
                         fixed_t ds_yfrac, const fixed_t ds_ystep);
+extern void R_DrawSpanLit (fixed_t x1, fixed_t x2, const fixed_t y,
+                           fixed_t ds_xfrac, const fixed_t ds_xstep,
+                           fixed_t ds_yfrac, const fixed_t ds_ystep);
 extern void R_DrawSpanLow (fixed_t x1, fixed_t x2, const fixed_t y,
                            fixed_t ds_xfrac, const fixed_t ds_xstep,
                            fixed_t ds_yfrac, const fixed_t ds_ystep);
@@ -490,7 +525,6 @@ extern const int R_PointOnSegSide (fixed_t x, fixed_t y, const seg_t *line);
 extern const int R_PointOnSide (fixed_t x, fixed_t y, const node_t *node);
 extern const int R_TextureNumForName (const char *name);
 
-extern lighttable_t **walllights;
 extern lighttable_t *fixedcolormap;
 extern lighttable_t *scalelight[LIGHTLEVELS][MAXLIGHTSCALE];
 extern lighttable_t *scalelightfixed[MAXLIGHTSCALE];
@@ -499,7 +533,7 @@ extern lighttable_t *zlight[LIGHTLEVELS][MAXLIGHTZ];
 extern const subsector_t *R_PointInSubsector (const fixed_t x, const fixed_t y);
 
 extern void (*basecolfunc) (void);
-extern void (*colfunc) (void);
+extern THREADLOCAL void (*colfunc) (void);
 extern void (*extratlcolfunc) (void);
 extern void (*skycolfunc) (void);
 extern void (*tlcolfunc) (void);
@@ -519,6 +553,62 @@ extern void R_InterpolateTextureOffsets (void); // [crispy] smooth texture scrol
 extern void R_RenderPlayerView (const player_t *player);
 extern void R_SetViewSize (const int blocks);
 
+/*
+================================================================================
+=
+= View strips
+=
+= [JN] The view is split into vertical strips, one per thread. Every strip
+= walks the BSP tree with own clipping arrays, as if the view was as narrow
+= as the strip, and draws own walls, planes and sprites. Columns outside of
+= the strip are marked solid from the start, so nothing is drawn there.
+= Wall and sprite math doesn't depend on where walls are cut by other walls
+= or by strip edges, so the picture is the same for any number of strips.
+=
+================================================================================
+*/
+
+#define MAXVISPLANES 128  // must be a power of 2
+
+typedef struct
+{
+    int left, right;  // Columns of the strip, inclusive.
+    int width;        // screenwidth the clipping arrays are allocated for.
+
+    byte *solidcol;
+    int  *floorclip, *ceilingclip;  // dropoff overflow
+
+    // [JN] killough: New code which removes 2s linedef limit
+    drawseg_t *drawsegs, *ds_p;
+    unsigned   maxdrawsegs;
+
+    // [JN] killough 1/6/98, 2/1/98: remove limit on openings
+    int    *openings, *lastopening;  // [crispy] 32-bit integer math
+    size_t  maxopenings;
+
+    visplane_t  *visplanes[MAXVISPLANES];  // [JN] killough
+    visplane_t  *freetail;
+    visplane_t **freehead;
+
+    // Strip's own validcount, bumped every frame, and the frames
+    // in which nodes and subsectors were visited by the strip.
+    int  validcount;
+    int *nodeframe, *subsectorframe;
+    int  numnodes, numsubsectors;
+
+    // Lines to be marked on the automap once all strips are done.
+    line_t **mapped;
+    int      nummapped, maxmapped;
+
+    int segs;  // Rendered segs, for perfomance counter.
+} viewstrip_t;
+
+extern viewstrip_t strips[];
+extern int numstrips;
+extern THREADLOCAL viewstrip_t *curstrip;
+
+extern void R_BindStrip (const int slice);
+
 /*
 ================================================================================
 =
@@ -539,8 +629,6 @@ extern fixed_t FlatScrollFactor_Y, FlatScrollFactor_Y_old;
 // [JN] Circular flowing effect for swirling liquids.
 extern fixed_t FlowAmplitude_X, FlowAmplitude_Y;
 
-extern int *floorclip, *ceilingclip; // [JN] dropoff overflow
-extern int *lastopening; // [crispy] 32-bit integer math
 extern int  skyflatnum;
 
 extern planefunction_t floorfunc, ceilingfunc;
@@ -553,7 +641,6 @@ extern void R_ClearPlanes (void);
 extern void R_DrawPlanes (void);
 extern void R_InitPlanes (void);
 extern void R_InitPlanesRes (void);
-extern void R_InitVisplanesRes (void);
 
 /*
 ================================================================================
@@ -568,7 +655,7 @@ extern void R_InitVisplanesRes (void);
 //  that appear at the bottom of some columns.
 #define SPARKLEFIX 64
 
-extern int rw_angle1;  // angle to line origin
+extern THREADLOCAL int rw_angle1;  // angle to line origin
 
 extern void R_RenderMaskedSegRange (drawseg_t *ds, const int x1, const int x2);
 
@@ -600,13 +687,13 @@ extern int *negonearray;       // [JN] killough 2/8/98: // dropoff overflow
 extern int *screenheightarray; //      change to MAX_*  // dropoff overflow
 
 extern fixed_t pspritescale, pspriteiscale;
-extern fixed_t spryscale;
+extern THREADLOCAL fixed_t spryscale;
 
-extern int *mceilingclip; // [crispy] 32-bit integer math
-extern int *mfloorclip;   // [crispy] 32-bit integer math
+extern THREADLOCAL int *mceilingclip; // [crispy] 32-bit integer math
+extern THREADLOCAL int *mfloorclip;   // [crispy] 32-bit integer math
 
-extern int64_t sprbotscreen;
-extern int64_t sprtopscreen;
+extern THREADLOCAL int64_t sprbotscreen;
+extern THREADLOCAL int64_t sprtopscreen;
 
 extern void R_AddPSprites (void);
 extern void R_AddSprites (const sector_t *sec);
@@ -23,6 +23,7 @@
 #include "deh_str.h"
 #include "i_system.h"
 #include "r_local.h"
+#include "i_thread.h"
 #include "jn.h"
 
 
@@ -36,15 +37,13 @@
 =
 = Lee Killough
 =
+= [JN] Visplane hash tables, free lists, openings and clipping arrays are 
+= kept by every view strip, see viewstrip_t.
+=
 ================================================================================
 */
 
-#define MAXVISPLANES	128                  // must be a power of 2
-
-static visplane_t  *visplanes[MAXVISPLANES]; // [JN] killough
-static visplane_t  *freetail;                // [JN] killough
-static visplane_t **freehead = &freetail;    // [JN] killough
-visplane_t         *floorplane, *ceilingplane;
+THREADLOCAL visplane_t *floorplane, *ceilingplane;
 
 // [JN] killough -- hash function for visplanes
 // Empirically verified to be fairly uniform:
@@ -52,38 +51,27 @@ visplane_t         *floorplane, *ceilingplane;
 #define visplane_hash(picnum, lightlevel, height) \
     ((unsigned int)((picnum) * 3 + (lightlevel) + (height) * 7) & (MAXVISPLANES - 1))
 
-// [JN] killough 8/1/98: set static number of openings to be large enough
-// (a static limit is okay in this case and avoids difficulties in r_segs.c)
-
-size_t  maxopenings;
-int     *openings, *lastopening;  // [crispy] 32-bit integer math    
-    
-// clip values are the solid pixel bounding the range
-// floorclip starts out SCREENHEIGHT
-// ceilingclip starts out -1
-//
-// [JN] e6y: resolution limitation is removed
-
-int *floorclip = NULL;    // dropoff overflow
-int *ceilingclip = NULL;  // dropoff overflow
-
 // spanstart holds the start of a plane span
 // initialized to 0 at start
 //
-// [JN] e6y: resolution limitation is removed
+// [JN] Span and texture mapping state is thread local,
+// every thread draws its own vertical strip of planes.
 
-static int *spanstart = NULL;  // killough 2/8/98
+static THREADLOCAL int spanstart[MAXHEIGHT];  // killough 2/8/98
 
 //
 // texture mapping
 //
 
-static lighttable_t **planezlight;
-static fixed_t planeheight;
-static fixed_t cachedheight[MAXHEIGHT];
-static fixed_t cacheddistance[MAXHEIGHT];
-static fixed_t cachedxstep[MAXHEIGHT];
-static fixed_t cachedystep[MAXHEIGHT];
+static THREADLOCAL lighttable_t **planezlight;
+static THREADLOCAL fixed_t planeheight;
+static THREADLOCAL fixed_t cachedheight[MAXHEIGHT];
+static THREADLOCAL fixed_t cacheddistance[MAXHEIGHT];
+static THREADLOCAL fixed_t cachedxstep[MAXHEIGHT];
+static THREADLOCAL fixed_t cachedystep[MAXHEIGHT];
+
+// [JN] Sky columns of current frame, looked up by R_DrawPlanes.
+static const byte **skycolumns = NULL;
 
 //
 // sky mapping
@@ -103,8 +91,8 @@ fixed_t yslopes[MAXHEIGHT][MAXHEIGHT];
 // [JN] Smooth plane scrolling.
 fixed_t FlatScrollFactor_X, FlatScrollFactor_X_old;
 fixed_t FlatScrollFactor_Y, FlatScrollFactor_Y_old;
-static fixed_t FlatScrollDelta_X;
-static fixed_t FlatScrollDelta_Y;
+static THREADLOCAL fixed_t FlatScrollDelta_X;
+static THREADLOCAL fixed_t FlatScrollDelta_Y;
 // [JN] Circular flowing effect for swirling liquids.
 fixed_t FlowAmplitude_X, FlowAmplitude_Y;
 
@@ -124,17 +112,9 @@ fixed_t FlowAmplitude_X, FlowAmplitude_Y;
 
 void R_InitPlanesRes (void)
 {
-    if (floorclip)
-    {
-        free(floorclip);
-    }
-    if (ceilingclip)
-    {
-        free(ceilingclip);
-    }
-    if (spanstart)
+    if (skycolumns)
     {
-        free(spanstart);
+        free(skycolumns);
     }
     if (yslope)
     {
@@ -145,32 +125,11 @@ void R_InitPlanesRes (void)
         free(distscale);
     }
 
-    floorclip = calloc(1, screenwidth * sizeof(*floorclip));
-    ceilingclip = calloc(1, screenwidth * sizeof(*ceilingclip));
-    spanstart = calloc(1, screenwidth * sizeof(*spanstart));
+    skycolumns = calloc(1, screenwidth * sizeof(*skycolumns));
     yslope = calloc(1, screenwidth * sizeof(*yslope));
     distscale = calloc(1, screenwidth * sizeof(*distscale));
 }
 
-/*
-================================================================================
-=
-= R_InitVisplanesRes
-=
-================================================================================
-*/
-
-void R_InitVisplanesRes (void)
-{
-    freetail = NULL;
-    freehead = &freetail;
-
-    for (int i = 0 ; i < MAXVISPLANES ; i++)
-    {
-        visplanes[i] = 0;
-    }
-}
-
 /*
 ================================================================================
 =
@@ -254,7 +213,7 @@ static void R_MapPlane (const int y, const int x1, const int x2)
     
     if (fixedcolormap)
     {
-        ds_colormap[0] = ds_colormap[1] = fixedcolormap;
+        ds_colormap = fixedcolormap;
     }
     else
     {
@@ -265,8 +224,7 @@ static void R_MapPlane (const int y, const int x1, const int x2)
             index = maxlightz - 1;
         }
 
-        ds_colormap[0] = planezlight[index];
-        ds_colormap[1] = colormaps;
+        ds_colormap = planezlight[index];
     }
 
     // High or low detail
@@ -285,27 +243,27 @@ static void R_MapPlane (const int y, const int x1, const int x2)
 
 void R_ClearPlanes (void)
 {
+    viewstrip_t *const strip = curstrip;
     int i;
 
     // opening / clipping determination
-    for (i = 0 ; i < viewwidth ; i++)
+    // floorclip starts out SCREENHEIGHT
+    // ceilingclip starts out -1
+    for (i = strip->left ; i <= strip->right ; i++)
     {
-        floorclip[i] = viewheight;
-        ceilingclip[i] = -1;
+        strip->floorclip[i] = viewheight;
+        strip->ceilingclip[i] = -1;
     }
 
     for (i = 0 ; i < MAXVISPLANES ; i++)  // [JN] new code -- killough
     {
-        for (*freehead = visplanes[i], visplanes[i] = NULL ; *freehead ; )
+        for (*strip->freehead = strip->visplanes[i], strip->visplanes[i] = NULL ; *strip->freehead ; )
         {
-            freehead = &(*freehead)->next;
+            strip->freehead = &(*strip->freehead)->next;
         }
     }
 
-    lastopening = openings;
-
-    // Texture calculation
-    memset(cachedheight, 0, sizeof(cachedheight));
+    strip->lastopening = strip->openings;
 }
 
 /*
@@ -321,18 +279,23 @@ void R_ClearPlanes (void)
 
 static const visplane_t *new_visplane (unsigned const int hash)
 {
-    visplane_t *check = freetail;
+    viewstrip_t *const strip = curstrip;
+    visplane_t *check = strip->freetail;
 
     if (!check)
     {
         check = calloc(1, sizeof(*check));
     }
-    else if (!(freetail = freetail->next))
+    else if (!(strip->freetail = strip->freetail->next))
     {
-        freehead = &freetail;
+        strip->freehead = &strip->freetail;
     }
-    check->next = visplanes[hash];
-    visplanes[hash] = check;
+    check->next = strip->visplanes[hash];
+    strip->visplanes[hash] = check;
+
+    // [JN] Only columns of the strip are ever looked at.
+    memset(check->top + strip->left, UINT_MAX, (strip->right - strip->left + 1) * sizeof(*check->top));
+
     return check;
 }
 
@@ -362,7 +325,7 @@ const visplane_t *R_FindPlane (fixed_t height, const int picnum, const int light
     // New visplane algorithm uses hash table -- killough
     hash = visplane_hash(picnum, lightlevel, height);
 
-    for (check = visplanes[hash]; check; check = check->next)
+    for (check = curstrip->visplanes[hash]; check; check = check->next)
         if (height == check->height && picnum == check->picnum
         && lightlevel == check->lightlevel && special == check->special)
             return check;
@@ -376,8 +339,6 @@ const visplane_t *R_FindPlane (fixed_t height, const int picnum, const int light
     check->minx = screenwidth;
     check->maxx = -1;
 
-    memset(check->top, UINT_MAX, sizeof(check->top));
-
     return (check);
 }
 
@@ -401,8 +362,6 @@ const visplane_t *R_DupPlane (const visplane_t *pl, const int start, const int s
     new_pl->minx = start;
     new_pl->maxx = stop;
 
-    memset(new_pl->top, UINT_MAX, sizeof(new_pl->top));
-
     return new_pl;
 }
 
@@ -483,35 +442,63 @@ R_MakeSpans (int x, unsigned int t1, unsigned int b1, // [crispy] 32-bit integer
 /*
 ================================================================================
 =
-= R_DrawPlanes
+= R_DrawPlaneColumns
 =
-= At the end of each frame.
+= [JN] Draws columns x1...x2 of a plane. Columns outside of given range
+= are treated as empty, so a plane can be split between several threads.
 =
 ================================================================================
 */
 
-void R_DrawPlanes (void)
+static void R_DrawPlaneColumns (const visplane_t *pl, const int x1, const int x2)
 {
-    visplane_t  *pl;
-    int          i;
-    int          x;
+    R_MakeSpans(x1, UINT_MAX, 0, pl->top[x1], pl->bottom[x1]);
 
-    for (i = 0 ; i < MAXVISPLANES ; i++)
-    for (pl = visplanes[i] ; pl ; pl = pl->next, rendered_visplanes++)
-    if (pl->minx <= pl->maxx)
+    for (int x = x1 + 1 ; x <= x2 ; x++)
     {
+        R_MakeSpans(x, pl->top[x-1], pl->bottom[x-1], pl->top[x], pl->bottom[x]);
+    }
+
+    R_MakeSpans(x2 + 1, pl->top[x2], pl->bottom[x2], UINT_MAX, 0);
+}
+
+/*
+================================================================================
+=
+= R_DrawPlanesSlice
+=
+= [JN] Draws visplanes of one view strip.
+=
+================================================================================
+*/
+
+static void R_DrawPlanesSlice (const int slice, const int numslices, void *data)
+{
+    const viewstrip_t *strip = &strips[slice];
+
+    // Texture calculation
+    memset(cachedheight, 0, sizeof(cachedheight));
+
+    for (int i = 0 ; i < MAXVISPLANES ; i++)
+    for (visplane_t *pl = strip->visplanes[i] ; pl ; pl = pl->next)
+    {
+        const int x1 = pl->minx;
+        const int x2 = pl->maxx;
+
+        if (x1 > x2)
+        {
+            continue;
+        }
+
         // Sky flat
         if (pl->picnum == skyflatnum)
         {
-            for (x = pl->minx; x <= pl->maxx; x++)
+            for (int x = x1 ; x <= x2 ; x++)
             {
                 if ((dc_yl = pl->top[x]) != UINT_MAX && dc_yl <= (dc_yh = pl->bottom[x])) // [crispy] 32-bit integer math
                 {
-                    // [crispy] Optionally draw skies horizontally linear.
-                    const int angle = ((viewangle + (linear_sky && !vanillaparm ?
-                                        linearskyangle[x] : xtoviewangle[x])) ^ flip_levels) >> ANGLETOSKYSHIFT;
                     dc_x = x;
-                    dc_source = R_GetColumn(skytexture, angle , false);
+                    dc_source = skycolumns[x];
 
                     if (invul_sky && !vanillaparm)
                     {
@@ -537,133 +524,163 @@ void R_DrawPlanes (void)
                     skycolfunc ();
                 }
             }
-            continue;
         }
         // Regular flat
         else
+        {
+            ds_source = pl->source;
+            FlatScrollDelta_X = pl->scrollx;
+            FlatScrollDelta_Y = pl->scrolly;
+            planeheight = pl->planeheight;
+            planezlight = pl->zlight;
+
+            R_DrawPlaneColumns(pl, x1, x2);
+        }
+    }
+}
+
+/*
+================================================================================
+=
+= R_DrawPlanes
+=
+= At the end of each frame.
+= [JN] Flat data and sky columns are looked up here, on the main thread,
+= and every view strip draws own visplanes on its own thread.
+=
+================================================================================
+*/
+
+void R_DrawPlanes (void)
+{
+    for (int s = 0 ; s < numstrips ; s++)
+    for (int i = 0 ; i < MAXVISPLANES ; i++)
+    for (visplane_t *pl = strips[s].visplanes[i] ; pl ; pl = pl->next, rendered_visplanes++)
+    if (pl->minx <= pl->maxx)
+    {
+        // Regular flat
+        if (pl->picnum != skyflatnum)
         {
             int light = (pl->lightlevel >> LIGHTSEGSHIFT) + extralight;
-            const int stop = pl->maxx + 1;
             const int lumpnum = firstflat + flattranslation[pl->picnum];
+
             // [crispy] add support for SMMU swirling flats
-            const byte *tempSource = (flattranslation[pl->picnum] == -1) ?
-                                      R_DistortedFlat(pl->picnum) :
-                                      W_CacheLumpNum(lumpnum, PU_STATIC);
+            pl->source = (flattranslation[pl->picnum] == -1) ?
+                         (const byte *) R_DistortedFlat(pl->picnum) :
+                         W_CacheLumpNum(lumpnum, PU_STATIC);
 
             // [JN] Handle smooth scrolling flats.
             switch (pl->special)
             {
                 // Scroll_EastLavaDamage
                 case 4:
-                    FlatScrollDelta_X = -FlatScrollFactor_X;
-                    FlatScrollDelta_Y = 0;
-                    FlatScrollDelta_X *= FLAT_SCROLL_FASTEST;
+                    pl->scrollx = -FlatScrollFactor_X;
+                    pl->scrolly = 0;
+                    pl->scrollx *= FLAT_SCROLL_FASTEST;
                 break;
                 // Scroll_East
                 case 20: case 21: case 22: case 23: case 24:
-                    FlatScrollDelta_X = -FlatScrollFactor_X;
-                    FlatScrollDelta_Y = 0;
+                    pl->scrollx = -FlatScrollFactor_X;
+                    pl->scrolly = 0;
                     if (pl->special == 20)  
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_SLOWEST;
+                        pl->scrollx *= FLAT_SCROLL_SLOWEST;
                     }
                     if (pl->special == 22)
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_MEDIUM;
+                        pl->scrollx *= FLAT_SCROLL_MEDIUM;
                     }
                     if (pl->special == 23)
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_FAST;
+                        pl->scrollx *= FLAT_SCROLL_FAST;
                     }
                     if (pl->special == 24)
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_FASTEST;
+                        pl->scrollx *= FLAT_SCROLL_FASTEST;
                     }
                 break;
 
                 // Scroll_North
                 case 25: case 26: case 27: case 28: case 29:
-                    FlatScrollDelta_X = 0;
-                    FlatScrollDelta_Y = FlatScrollFactor_Y;
+                    pl->scrollx = 0;
+                    pl->scrolly = FlatScrollFactor_Y;
                     if (pl->special == 25)  
                     {
-                        FlatScrollDelta_Y *= FLAT_SCROLL_SLOWEST;
+                        pl->scrolly *= FLAT_SCROLL_SLOWEST;
                     }
                     if (pl->special == 27)
                     {
-                        FlatScrollDelta_Y *= FLAT_SCROLL_MEDIUM;
+                        pl->scrolly *= FLAT_SCROLL_MEDIUM;
                     }
                     if (pl->special == 28)
                     {
-                        FlatScrollDelta_Y *= FLAT_SCROLL_FAST;
+                        pl->scrolly *= FLAT_SCROLL_FAST;
                     }
                     if (pl->special == 29)
                     {
-                        FlatScrollDelta_Y *= FLAT_SCROLL_FASTEST;
+                        pl->scrolly *= FLAT_SCROLL_FASTEST;
                     }
                 break;
 
                 // Scroll_South
                 case 30: case 31: case 32: case 33: case 34:
-                    FlatScrollDelta_X = 0;
-                    FlatScrollDelta_Y = -FlatScrollFactor_Y;
+                    pl->scrollx = 0;
+                    pl->scrolly = -FlatScrollFactor_Y;
                     if (pl->special == 30)  
                     {
-                        FlatScrollDelta_Y *= FLAT_SCROLL_SLOWEST;
+                        pl->scrolly *= FLAT_SCROLL_SLOWEST;
                     }
                     if (pl->special == 32)
                     {
-                        FlatScrollDelta_Y *= FLAT_SCROLL_MEDIUM;
+                        pl->scrolly *= FLAT_SCROLL_MEDIUM;
                     }
                     if (pl->special == 33)
                     {
-                        FlatScrollDelta_Y *= FLAT_SCROLL_FAST;
+                        pl->scrolly *= FLAT_SCROLL_FAST;
                     }
                     if (pl->special == 34)
                     {
-                        FlatScrollDelta_Y *= FLAT_SCROLL_FASTEST;
+                        pl->scrolly *= FLAT_SCROLL_FASTEST;
                     }
                 break;
 
                 // Scroll_West
                 case 35: case 36: case 37: case 38: case 39:
-                    FlatScrollDelta_X = FlatScrollFactor_X;
-                    FlatScrollDelta_Y = 0;
+                    pl->scrollx = FlatScrollFactor_X;
+                    pl->scrolly = 0;
                     if (pl->special == 35)  
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_SLOWEST;
+                        pl->scrollx *= FLAT_SCROLL_SLOWEST;
                     }
                     if (pl->special == 37)  
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_MEDIUM;
+                        pl->scrollx *= FLAT_SCROLL_MEDIUM;
                     }
                     if (pl->special == 38)
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_FAST;
+                        pl->scrollx *= FLAT_SCROLL_FAST;
                     }
                     if (pl->special == 39)
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_FASTEST;
+                        pl->scrollx *= FLAT_SCROLL_FASTEST;
                     }
                 break;
 
                 default:
-                    FlatScrollDelta_X = 0;
-                    FlatScrollDelta_Y = 0;
+                    pl->scrollx = 0;
+                    pl->scrolly = 0;
                 break;
             }
 
             // [JN] Apply circular flowing effect to swirling liquids.
             if (swirling_liquids && flattranslation[pl->picnum] == -1 && !vanillaparm)
             {
-                FlatScrollDelta_X = FlowAmplitude_X;
-                FlatScrollDelta_Y = FlowAmplitude_Y;
+                pl->scrollx = FlowAmplitude_X;
+                pl->scrolly = FlowAmplitude_Y;
             }
 
-            ds_source = tempSource;
-            ds_brightmap = R_BrightmapForFlatNum(lumpnum-firstflat);
 
-            planeheight = abs(pl->height - viewz);
+            pl->planeheight = abs(pl->height - viewz);
             if (light >= LIGHTLEVELS)
             {
                 light = LIGHTLEVELS-1;
@@ -672,19 +689,42 @@ void R_DrawPlanes (void)
             {
                 light = 0;
             }
-            planezlight = zlight[light];
-            pl->top[pl->minx-1] = pl->top[stop] = UINT_MAX; // [crispy] 32-bit integer math
+            // [JN] Brightmapped flats use zlight fused with the brightmap.
+            pl->zlight = R_BrightZLight(R_BrightmapForFlatNum(lumpnum-firstflat), light);
+        }
+    }
 
-            for (x = pl->minx ; x <= stop ; x++)
-            {
-                R_MakeSpans(x,pl->top[x-1], pl->bottom[x-1], pl->top[x], pl->bottom[x]);
-            }
+    // [JN] Sky columns are looked up after all flats are cached,
+    // since single patch sky may be purged by any zone allocation.
+    for (int s = 0 ; s < numstrips ; s++)
+    for (int i = 0 ; i < MAXVISPLANES ; i++)
+    for (visplane_t *pl = strips[s].visplanes[i] ; pl ; pl = pl->next)
+    if (pl->minx <= pl->maxx && pl->picnum == skyflatnum)
+    {
+        for (int x = pl->minx ; x <= pl->maxx ; x++)
+        {
+            // [crispy] Optionally draw skies horizontally linear.
+            const int angle = ((viewangle + (linear_sky && !vanillaparm ?
+                                linearskyangle[x] : xtoviewangle[x])) ^ flip_levels) >> ANGLETOSKYSHIFT;
 
-            // [crispy] add support for SMMU swirling flats
-            if (flattranslation[pl->picnum] != -1)
-            {
-                W_ReleaseLumpNum(lumpnum);
-            }
+            skycolumns[x] = R_GetColumn(skytexture, angle, false);
+        }
+    }
+
+    // [JN] Lit flat tiles from the previous frame are stale now.
+    litflatframe++;
+
+    I_RunThreads(R_DrawPlanesSlice, NULL);
+
+    for (int s = 0 ; s < numstrips ; s++)
+    for (int i = 0 ; i < MAXVISPLANES ; i++)
+    for (visplane_t *pl = strips[s].visplanes[i] ; pl ; pl = pl->next)
+    if (pl->minx <= pl->maxx && pl->picnum != skyflatnum)
+    {
+        // [crispy] add support for SMMU swirling flats
+        if (flattranslation[pl->picnum] != -1)
+        {
+            W_ReleaseLumpNum(firstflat + flattranslation[pl->picnum]);
         }
     }
 }
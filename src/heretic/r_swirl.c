@@ -21,6 +21,8 @@
 
 // [crispy] adapted from smmu/r_ripple.c, by Simon Howard
 
+#include <stdlib.h>
+
 #include "tables.h"
 #include "i_system.h"
 #include "w_wad.h"
@@ -89,23 +91,42 @@ void R_InitDistortedFlats()
 	}
 }
 
+// [JN] Every swirling flat gets its own buffer, so R_DrawPlanes can resolve
+// all visplanes of a frame before they are drawn by worker threads.
+
 const char *R_DistortedFlat (const int flatnum)
 {
 	static int swirltic = -1;
-	static int swirlflat = -1;
-	static char distortedflat[FLATSIZE];
+	static int *swirltics = NULL;
+	static char **distortedflats = NULL;
+
+	if (distortedflats == NULL)
+	{
+		distortedflats = calloc(numflats, sizeof(*distortedflats));
+		swirltics = malloc(numflats * sizeof(*swirltics));
+
+		for (int i = 0; i < numflats; i++)
+		{
+			swirltics[i] = -1;
+		}
+	}
 
 	if (swirltic != leveltime)
 	{
 		offset = offsets + ((leveltime & (SEQUENCE - 1)) * FLATSIZE);
 
 		swirltic = leveltime;
-		swirlflat = -1;
 	}
 
-	if (swirlflat != flatnum)
+	if (distortedflats[flatnum] == NULL)
+	{
+		distortedflats[flatnum] = malloc(FLATSIZE);
+	}
+
+	if (swirltics[flatnum] != leveltime)
 	{
 		char *normalflat;
+		char *distortedflat = distortedflats[flatnum];
 		int i;
 
         // [JN] Use defined flat
@@ -119,8 +140,8 @@ const char *R_DistortedFlat (const int flatnum)
 
 		//Z_ChangeTag(normalflat, PU_CACHE);
 
-		swirlflat = flatnum;
+		swirltics[flatnum] = leveltime;
 	}
 
-	return distortedflat;
+	return distortedflats[flatnum];
 }
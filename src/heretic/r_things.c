@@ -23,6 +23,9 @@
 #include "deh_str.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_thread.h"
+#include "i_timer.h"
+#include "m_cache.h"
 #include "p_local.h"
 #include "r_local.h"
 #include "v_trans.h"
@@ -51,14 +54,18 @@ spritedef_t   *sprites;
 spriteframe_t  sprtemp[26];
 
 // Initialization functions.
-int *mfloorclip, *mceilingclip;  // [crispy] 32-bit integer math
+THREADLOCAL int *mfloorclip, *mceilingclip;  // [crispy] 32-bit integer math
 
-fixed_t spryscale;
-int64_t sprtopscreen, sprbotscreen;  // [crispy] WiggleFix
+THREADLOCAL fixed_t spryscale;
+THREADLOCAL int64_t sprtopscreen, sprbotscreen;  // [crispy] WiggleFix
 
 static size_t num_vissprite, num_vissprite_alloc, num_vissprite_ptrs; // [JN] killough
 static vissprite_t *vissprites, **vissprite_ptrs;                     // [JN] killough
 
+// [JN] Player sprites, projected by R_AddPSprites.
+static vissprite_t pspritevis[NUMPSPRITES];
+static int numpspritevis;
+
 
 typedef struct drawseg_xrange_item_s
 {
@@ -72,12 +79,13 @@ typedef struct drawsegs_xrange_s
     int count;
 } drawsegs_xrange_t;
 
+// [JN] Drawseg ranges are built by every strip for own drawsegs.
 #define DS_RANGES_COUNT 3
-static drawsegs_xrange_t drawsegs_xranges[DS_RANGES_COUNT];
+static THREADLOCAL drawsegs_xrange_t drawsegs_xranges[DS_RANGES_COUNT];
 
-static drawseg_xrange_item_t *drawsegs_xrange;
-static unsigned int drawsegs_xrange_size = 0;
-static int drawsegs_xrange_count = 0;
+static THREADLOCAL drawseg_xrange_item_t *drawsegs_xrange;
+static THREADLOCAL unsigned int drawsegs_xrange_size = 0;
+static THREADLOCAL int drawsegs_xrange_count = 0;
 
 
 /*
@@ -205,6 +213,104 @@ static void R_InstallSpriteLump (const int lump, unsigned const frame, unsigned
     sprtemp[frame].flip[rotation] = (byte) flipped;
 }
 
+/*
+================================================================================
+=
+= Startup cache of sprite definitions: the frame count of each sprite,
+= followed by the frames of all sprites. The key is the list of sprite
+= names, as they may be changed by DEHACKED.
+=
+================================================================================
+*/
+
+static byte *SpriteDefsKey (char **namelist, size_t *keylen)
+{
+    const int info[2] = {
+        firstspritelump, lastspritelump
+    };
+    byte *key;
+
+    *keylen = sizeof(info) + numsprites * 4;
+    key = Z_Malloc(*keylen, PU_STATIC, NULL);
+    memcpy(key, info, sizeof(info));
+
+    for (int i = 0 ; i < numsprites ; i++)
+    {
+        strncpy((char *) key + sizeof(info) + i * 4, DEH_String(namelist[i]), 4);
+    }
+
+    return key;
+}
+
+static boolean LoadSpriteDefs (const byte *key, const size_t keylen)
+{
+    size_t length, numframes = 0;
+    int *data = M_LoadStartupCache("spritedefs", key, keylen, &length);
+    const spriteframe_t *frames;
+
+    if (data == NULL)
+    {
+        return false;
+    }
+
+    for (int i = 0 ; i < numsprites && length >= numsprites * sizeof(int) ; i++)
+    {
+        numframes += data[i] > 0 ? data[i] : 0;
+    }
+
+    if (length != numsprites * sizeof(int) + numframes * sizeof(spriteframe_t))
+    {
+        free(data);
+        return false;
+    }
+
+    frames = (const spriteframe_t *) (data + numsprites);
+
+    for (int i = 0 ; i < numsprites ; i++)
+    {
+        sprites[i].numframes = data[i];
+        sprites[i].spriteframes = NULL;
+
+        if (data[i] > 0)
+        {
+            sprites[i].spriteframes = Z_Malloc(data[i] * sizeof(spriteframe_t), PU_STATIC, NULL);
+            memcpy(sprites[i].spriteframes, frames, data[i] * sizeof(spriteframe_t));
+            frames += data[i];
+        }
+    }
+
+    free(data);
+    return true;
+}
+
+static void SaveSpriteDefs (const byte *key, const size_t keylen)
+{
+    size_t length = numsprites * sizeof(int);
+    byte *data, *p;
+
+    for (int i = 0 ; i < numsprites ; i++)
+    {
+        length += sprites[i].numframes * sizeof(spriteframe_t);
+    }
+
+    data = Z_Malloc(length, PU_STATIC, NULL);
+    p = data + numsprites * sizeof(int);
+
+    for (int i = 0 ; i < numsprites ; i++)
+    {
+        memcpy(data + i * sizeof(int), &sprites[i].numframes, sizeof(int));
+
+        if (sprites[i].numframes > 0)
+        {
+            memcpy(p, sprites[i].spriteframes, sprites[i].numframes * sizeof(spriteframe_t));
+            p += sprites[i].numframes * sizeof(spriteframe_t);
+        }
+    }
+
+    M_WriteStartupCache("spritedefs", key, keylen, data, length);
+    Z_Free(data);
+}
+
 /*
 ================================================================================
 =
@@ -228,6 +334,9 @@ static void R_InitSpriteDefs (char **namelist)
     char **check;
     int i, l, frame, rotation;
     int start, end;
+    byte *key;
+    size_t keylen;
+    const int starttime = I_GetTimeMS();
 
     // Count the number of sprite names
     check = namelist;
@@ -245,6 +354,15 @@ static void R_InitSpriteDefs (char **namelist)
 
     sprites = Z_Malloc(numsprites * sizeof(*sprites), PU_STATIC, NULL);
 
+    key = SpriteDefsKey(namelist, &keylen);
+
+    if (LoadSpriteDefs(key, keylen))
+    {
+        Z_Free(key);
+        M_StartupTime("spritedefs", true, starttime);
+        return;
+    }
+
     start = firstspritelump - 1;
     end = lastspritelump + 1;
 
@@ -317,6 +435,10 @@ static void R_InitSpriteDefs (char **namelist)
         sprites[i].spriteframes = Z_Malloc(maxframe * sizeof(spriteframe_t), PU_STATIC, NULL);
         memcpy(sprites[i].spriteframes, sprtemp, maxframe * sizeof(spriteframe_t));
     }
+
+    SaveSpriteDefs(key, keylen);
+    Z_Free(key);
+    M_StartupTime("spritedefs", false, starttime);
 }
 
 /*
@@ -453,19 +575,18 @@ void R_DrawMaskedColumn (const column_t *column, signed const int baseclip)
 = R_DrawVisSprite
 =
 = mfloorclip and mceilingclip should also be set.
+= [JN] Draws columns x1...x2 of the sprite, patch must be cached already.
 =
 ================================================================================
 */
 
 static void R_DrawVisSprite (const vissprite_t *vis, const int x1, const int x2)
 {
-    column_t *column;
-    int       texturecolumn;
-    fixed_t   frac;
-    patch_t  *patch;
-    fixed_t   baseclip;
-
-    patch = W_CacheLumpNum(vis->patch + firstspritelump, PU_CACHE);
+    const column_t *column;
+    int             texturecolumn;
+    fixed_t         frac;
+    const patch_t  *patch = vis->patchdata;
+    fixed_t         baseclip;
 
     // [crispy] brightmaps for select sprites
     dc_colormap[0] = vis->colormap[0];
@@ -514,7 +635,7 @@ static void R_DrawVisSprite (const vissprite_t *vis, const int x1, const int x2)
 
     dc_iscale = abs(vis->xiscale) >> (detailshift && !hires);
     dc_texturemid = vis->texturemid;
-    frac = vis->startfrac;
+    frac = vis->startfrac + (x1 - vis->x1) * vis->xiscale;
     spryscale = vis->scale;
 
     sprtopscreen = centeryfrac - FixedMul(dc_texturemid, spryscale);
@@ -536,7 +657,7 @@ static void R_DrawVisSprite (const vissprite_t *vis, const int x1, const int x2)
         baseclip = -1;
     }
 
-    for (dc_x = vis->x1; dc_x <= vis->x2; dc_x++, frac += vis->xiscale)
+    for (dc_x = x1; dc_x <= x2; dc_x++, frac += vis->xiscale)
     {
         texturecolumn = frac >> FRACBITS;
 #ifdef RANGECHECK
@@ -547,10 +668,13 @@ static void R_DrawVisSprite (const vissprite_t *vis, const int x1, const int x2)
                          "R_DrawSpriteRange: некорректныая информация texturecolumn");
         }
 #endif
-        column = (column_t *) ((byte *) patch + LONG(patch->columnofs[texturecolumn]));
+        column = (const column_t *) ((const byte *) patch + LONG(patch->columnofs[texturecolumn]));
         R_DrawMaskedColumn(column, baseclip);
     }
 
+    // [JN] Write out last queued columns.
+    R_FlushColumns();
+
     colfunc = basecolfunc;
 }
 
@@ -999,7 +1123,10 @@ static inline void R_ApplyChickenBob (fixed_t *sx, boolean bobx, fixed_t *sy, bo
 /*
 ================================================================================
 =
-= R_DrawPSprite
+= R_ProjectPSprite
+=
+= [JN] Generates a vissprite for the player sprite,
+= it is drawn by every strip in R_DrawMaskedSlice.
 =
 ================================================================================
 */
@@ -1017,7 +1144,7 @@ static const int PSpriteSY[NUMWEAPONS] =
     15 * FRACUNIT   // beak
 };
 
-void R_DrawPSprite (const pspdef_t *psp)
+static void R_ProjectPSprite (const pspdef_t *psp)
 {
     int             x1, x2;
     int             lump;
@@ -1025,7 +1152,7 @@ void R_DrawPSprite (const pspdef_t *psp)
     fixed_t         psp_sx = psp->sx, psp_sy = psp->sy;
     spritedef_t    *sprdef;
     spriteframe_t  *sprframe;
-    vissprite_t    *vis, avis;
+    vissprite_t    *vis;
     boolean         flip;
     
     // [JN] We need to define what "state" actually is (from Crispy)
@@ -1150,7 +1277,7 @@ void R_DrawPSprite (const pspdef_t *psp)
     }
 
     // Store information in a vissprite
-    vis = &avis;
+    vis = &pspritevis[numpspritevis++];
     vis->translation = NULL;
     vis->mobjflags = 0;
     vis->psprite = true;
@@ -1255,19 +1382,20 @@ void R_DrawPSprite (const pspdef_t *psp)
             skippsprinterp = false;
         }
     }
-
-    R_DrawVisSprite(vis, vis->x1, vis->x2);
 }
 
 /*
 ================================================================================
 =
-= R_DrawPlayerSprites
+= R_AddPSprites
+=
+= [JN] Projects the player sprites on the main thread,
+= weapon bobbing interpolation is not to be done twice.
 =
 ================================================================================
 */
 
-static void R_DrawPlayerSprites (void)
+void R_AddPSprites (void)
 {
     int i;
     const pspdef_t *psp;
@@ -1275,20 +1403,22 @@ static void R_DrawPlayerSprites (void)
     const int lightnum = (viewplayer->mo->subsector->sector->lightlevel >> LIGHTSEGSHIFT) + extralight;
 
     spritelights = scalelight[BETWEEN(0, LIGHTLEVELS-1, lightnum)];
+    numpspritevis = 0;
 
-    // Clip to screen bounds
-    mfloorclip = screenheightarray;
-    mceilingclip = negonearray;
+    // Draw the psprites on top of everything, but does not draw on side views.
+    if (viewangleoffset)
+    {
+        return;
+    }
 
     // Add all active psprites
     for (i = 0, psp = viewplayer->psprites ; i < NUMPSPRITES ; i++, psp++)
     {
         if (psp->state)
         {
-            R_DrawPSprite(psp);
+            R_ProjectPSprite(psp);
         }
     }
-
 }
 
 /*
@@ -1385,16 +1515,19 @@ void R_SortVisSprites (void)
 =
 = R_DrawSprite
 =
+= [JN] Draws the sprite within x1...x2 columns, i.e. within current strip.
+= Clipping arrays are shared, as strips never touch columns of each other.
+=
 ================================================================================
 */
 
-static void R_DrawSprite (vissprite_t *spr)
+static void R_DrawSprite (const vissprite_t *spr, const int x1, const int x2)
 {
     int x, r1, r2;
     drawseg_t *ds;
     fixed_t scale, lowscale;
 
-    for (x = spr->x1 ; x<=spr->x2 ; x++)
+    for (x = x1 ; x<=x2 ; x++)
     {
         clipbot[x] = cliptop[x] = -2;
     }
@@ -1411,7 +1544,7 @@ static void R_DrawSprite (vissprite_t *spr)
         while (++curr <= last)
         {
             // Determine if the drawseg obscures the sprite
-            if (curr->x1 > spr->x2 || curr->x2 < spr->x1)
+            if (curr->x1 > x2 || curr->x2 < x1)
             {
                 // Does not cover sprite
                 continue;
@@ -1436,16 +1569,16 @@ static void R_DrawSprite (vissprite_t *spr)
                 // Masked mid texture?
                 if (ds->maskedtexturecol)
                 {
-                    r1 = ds->x1 < spr->x1 ? spr->x1 : ds->x1;
-                    r2 = ds->x2 > spr->x2 ? spr->x2 : ds->x2;
+                    r1 = ds->x1 < x1 ? x1 : ds->x1;
+                    r2 = ds->x2 > x2 ? x2 : ds->x2;
                     R_RenderMaskedSegRange(ds, r1, r2);
                 }
                 // Seg is behind sprite
                 continue;
             }
 
-            r1 = ds->x1 < spr->x1 ? spr->x1 : ds->x1;
-            r2 = ds->x2 > spr->x2 ? spr->x2 : ds->x2;
+            r1 = ds->x1 < x1 ? x1 : ds->x1;
+            r2 = ds->x2 > x2 ? x2 : ds->x2;
 
             // Clip this piece of the sprite
             // [JN] killough 3/27/98: optimized and made much shorter
@@ -1464,7 +1597,7 @@ static void R_DrawSprite (vissprite_t *spr)
 
     // All clipping has been performed, so draw the sprite.
     // Check for unclipped columns.
-    for (x = spr->x1 ; x<=spr->x2 ; x++)
+    for (x = x1 ; x<=x2 ; x++)
     {
         if (clipbot[x] == -2)
         {
@@ -1478,23 +1611,29 @@ static void R_DrawSprite (vissprite_t *spr)
 
     mfloorclip = clipbot;
     mceilingclip = cliptop;
-    R_DrawVisSprite (spr, spr->x1, spr->x2);
+    R_DrawVisSprite (spr, x1, x2);
 }
 
 /*
 ================================================================================
 =
-= R_DrawMasked
+= R_DrawMaskedSlice
+=
+= [JN] Draws sprites, masked mid textures and player sprites of one strip.
 =
 ================================================================================
 */
 
-void R_DrawMasked (void)
+static void R_DrawMaskedSlice (const int slice, const int numslices, void *data)
 {
+    const viewstrip_t *strip = &strips[slice];
+    const int left = strip->left;
+    const int right = strip->right;
+    const int middle = (left + right + 1) / 2;
     int        i;
     drawseg_t *ds;
 
-    R_SortVisSprites();
+    colfunc = basecolfunc;
 
     // [JN] e6y
     // Makes sense for scenes with huge amount of drawsegs.
@@ -1505,9 +1644,9 @@ void R_DrawMasked (void)
 
     if (num_vissprite > 0)
     {
-        if (drawsegs_xrange_size < maxdrawsegs)
+        if (drawsegs_xrange_size < strip->maxdrawsegs)
         {
-            drawsegs_xrange_size = 2 * maxdrawsegs;
+            drawsegs_xrange_size = 2 * strip->maxdrawsegs;
 
             for (i = 0 ; i < DS_RANGES_COUNT ; i++)
             {
@@ -1517,7 +1656,7 @@ void R_DrawMasked (void)
             }
         }
 
-        for (ds = ds_p ; ds-- > drawsegs ; )
+        for (ds = strip->ds_p ; ds-- > strip->drawsegs ; )
         {
             if (ds->silhouette || ds->maskedtexturecol)
             {
@@ -1525,13 +1664,14 @@ void R_DrawMasked (void)
                 drawsegs_xranges[0].items[drawsegs_xranges[0].count].x2 = ds->x2;
                 drawsegs_xranges[0].items[drawsegs_xranges[0].count].user = ds;
 
-                if (ds->x1 < centerx)
+                // [JN] Split at the middle of the strip, not of the view.
+                if (ds->x1 < middle)
                 {
                     drawsegs_xranges[1].items[drawsegs_xranges[1].count] = 
                     drawsegs_xranges[0].items[drawsegs_xranges[0].count];
                     drawsegs_xranges[1].count++;
                 }
-                if (ds->x2 >= centerx)
+                if (ds->x2 >= middle)
                 {
                     drawsegs_xranges[2].items[drawsegs_xranges[2].count] = 
                     drawsegs_xranges[0].items[drawsegs_xranges[0].count];
@@ -1544,17 +1684,23 @@ void R_DrawMasked (void)
     }
 
     // Draw all vissprites back to front.
-    rendered_vissprites = num_vissprite;
     for (i = num_vissprite ; --i>=0 ; )
     {
-        vissprite_t* spr = vissprite_ptrs[i];
+        const vissprite_t *spr = vissprite_ptrs[i];
+        const int x1 = MAX(spr->x1, left);
+        const int x2 = MIN(spr->x2, right);
+
+        if (x1 > x2)
+        {
+            continue;
+        }
 
-        if (spr->x2 < centerx)
+        if (x2 < middle)
         {
             drawsegs_xrange = drawsegs_xranges[1].items;
             drawsegs_xrange_count = drawsegs_xranges[1].count;
         }
-        else if (spr->x1 >= centerx)
+        else if (x1 >= middle)
         {
             drawsegs_xrange = drawsegs_xranges[2].items;
             drawsegs_xrange_count = drawsegs_xranges[2].count;
@@ -1565,14 +1711,14 @@ void R_DrawMasked (void)
             drawsegs_xrange_count = drawsegs_xranges[0].count;
         }
 
-        R_DrawSprite(vissprite_ptrs[i]);
+        R_DrawSprite(spr, x1, x2);
     }
 
     // Render any remaining masked mid textures.
 
     // Modified by Lee Killough: (pointer check was originally
     // nonportable and buggy, by going past LEFT end of array).
-    for (ds=ds_p ; ds-- > drawsegs ; )
+    for (ds = strip->ds_p ; ds-- > strip->drawsegs ; )
     {
         if (ds->maskedtexturecol)
         {
@@ -1580,10 +1726,86 @@ void R_DrawMasked (void)
         }
     }
 
+    // Draw the psprites on top of everything.
+    // Clip to screen bounds.
+    mfloorclip = screenheightarray;
+    mceilingclip = negonearray;
 
-    // Draw the psprites on top of everything, but does not draw on side views.
-    if (!viewangleoffset)
+    for (i = 0 ; i < numpspritevis ; i++)
+    {
+        const vissprite_t *vis = &pspritevis[i];
+        const int x1 = MAX(vis->x1, left);
+        const int x2 = MIN(vis->x2, right);
+
+        if (x1 <= x2)
+        {
+            R_DrawVisSprite (vis, x1, x2);
+        }
+    }
+}
+
+/*
+================================================================================
+=
+= R_LockMaskedTextures
+=
+= [JN] Locks or releases patches of masked mid textures, seen by the strips.
+=
+================================================================================
+*/
+
+static void R_LockMaskedTextures (const boolean lock)
+{
+    for (int s = 0 ; s < numstrips ; s++)
+    {
+        for (const drawseg_t *ds = strips[s].drawsegs ; ds < strips[s].ds_p ; ds++)
+        {
+            if (ds->maskedtexturecol)
+            {
+                R_LockTexturePatches(texturetranslation[ds->curline->sidedef->midtexture], lock);
+            }
+        }
+    }
+}
+
+/*
+================================================================================
+=
+= R_DrawMasked
+=
+= [JN] Sprites are sorted and their patches are cached on the main
+= thread, and every view strip draws own part of them on its own thread.
+=
+================================================================================
+*/
+
+void R_DrawMasked (void)
+{
+    int i;
+
+    R_SortVisSprites();
+    R_AddPSprites();
+
+    for (i = 0 ; i < (int)num_vissprite ; i++)
+    {
+        vissprites[i].patchdata = W_CacheLumpNum(vissprites[i].patch + firstspritelump, PU_STATIC);
+    }
+    for (i = 0 ; i < numpspritevis ; i++)
+    {
+        pspritevis[i].patchdata = W_CacheLumpNum(pspritevis[i].patch + firstspritelump, PU_STATIC);
+    }
+    R_LockMaskedTextures(true);
+
+    rendered_vissprites = num_vissprite;
+    I_RunThreads(R_DrawMaskedSlice, NULL);
+
+    for (i = 0 ; i < (int)num_vissprite ; i++)
+    {
+        W_ReleaseLumpNum(vissprites[i].patch + firstspritelump);
+    }
+    for (i = 0 ; i < numpspritevis ; i++)
     {
-        R_DrawPlayerSprites ();
+        W_ReleaseLumpNum(pspritevis[i].patch + firstspritelump);
     }
+    R_LockMaskedTextures(false);
 }
@@ -26,7 +26,11 @@
 #include "i_system.h"
 #include "i_timer.h"
 #include "m_argv.h"
+#include "m_bench.h"
 #include "m_misc.h"
+#include "m_starttrace.h"
+#include "m_trace.h"
+#include "m_perf.h"
 #include "p_local.h"
 #include "rd_keybinds.h"
 #include "v_video.h"
@@ -78,6 +82,7 @@ boolean usergame;               // ok to save / end game
 
 boolean timingdemo;             // if true, exit with report on completion
 int starttime;                  // for comparative timing purposes      
+static int starttic;            // [JN] first gametic of timedemo run
 
 boolean viewactive;
 
@@ -764,7 +769,9 @@ void G_DoLoadLevel(void)
     }
 
     SN_StopAllSequences();
+    M_StartTraceBegin("P_SetupLevel");
     P_SetupLevel(gameepisode, gamemap, 0, gameskill);
+    M_StartTraceEnd();
     displayplayer = consoleplayer;      // view the guy you are playing   
     gameaction = ga_nothing;
     Z_CheckHeap();
@@ -1154,7 +1161,11 @@ void G_Ticker(void)
     switch (gamestate)
     {
         case GS_LEVEL:
+            M_PerfStart(PERF_TIC);
+            TRACE_BEGIN("P_Ticker");
             P_Ticker();
+            TRACE_END();
+            M_PerfStop(PERF_TIC);
             SB_Ticker();
             AM_Ticker();
             CT_Ticker();
@@ -2328,6 +2339,14 @@ void G_DoPlayDemo(void)
     precache = true;
     usergame = false;
     demoplayback = true;
+
+    // [JN] Next run of -timedemo -benchruns.
+    if (timingdemo)
+    {
+        starttime = I_GetTime();
+        starttic = gametic;
+        M_BenchStartRun();
+    }
 }
 
 
@@ -2344,6 +2363,10 @@ void G_TimeDemo(char *name)
     skill_t skill;
     int episode, map, i;
 
+    // [JN] Demo name is needed for releasing and replaying it.
+    defdemoname = name;
+    M_BenchInit(name);
+
     demobuffer = demo_p = W_CacheLumpName(name, PU_STATIC);
     skill = *demo_p++;
     episode = *demo_p++;
@@ -2364,6 +2387,8 @@ void G_TimeDemo(char *name)
 
     G_InitNew(skill, episode, map);
     starttime = I_GetTime();
+    starttic = gametic;
+    M_BenchStartRun();
 
     usergame = false;
     demoplayback = true;
@@ -2384,18 +2409,28 @@ void G_TimeDemo(char *name)
 
 boolean G_CheckDemoStatus(void)
 {
-    int endtime, realtics;
+    int endtime, realtics, gametics;
 
     if(timingdemo)
     {
         endtime = I_GetTime();
         realtics = endtime - starttime;
-        float fps = ((float) gametic * TICRATE) / realtics;
+        gametics = gametic - starttic;
+        float fps = ((float) gametics * TICRATE) / realtics;
+
+        // [JN] Play the demo once again for the next benchmark run.
+        if (M_BenchEndRun(gametics))
+        {
+            W_ReleaseLumpName(defdemoname);
+            demoplayback = false;
+            gameaction = ga_playdemo;
+            return true;
+        }
 
         I_QuitWithMessage(english_language ?
                           "Timed %i gametics in %i realtics (%f fps)" :
                           "Насчитано %i gametics в %i realtics.\nСреднее значение FPS: %f.",
-                          gametic, realtics, fps);
+                          gametics, realtics, fps);
     }
 
     if (demoplayback)
@@ -46,9 +46,15 @@
 #include "i_input.h"
 #include "i_glob.h"
 #include "i_system.h"
+#include "i_thread.h"
+#include "m_savebuf.h"
+#include "m_cache.h"
+#include "m_starttrace.h"
+#include "m_trace.h"
 #include "i_timer.h"
 #include "m_argv.h"
 #include "m_config.h"
+#include "m_perf.h"
 #include "net_client.h"
 #include "p_local.h"
 #include "v_trans.h"
@@ -351,6 +357,10 @@ void D_BindVariables(void)
     M_BindIntVariable("music_volume",           &snd_MusicVolume);
     M_BindIntVariable("snd_monomode",           &snd_monomode);
     M_BindIntVariable("screenblocks",           &screenblocks);
+    M_BindIntVariable("worker_threads",         &worker_threads);
+    M_BindIntVariable("prelit_flats",           &prelit_flats);
+    M_BindIntVariable("compress_savegames",     &compress_savegames);
+    M_BindIntVariable("startup_cache",          &startup_cache);
     M_BindIntVariable("snd_channels",           &snd_Channels);
     M_BindIntVariable("always_run",             &alwaysRun);
     M_BindIntVariable("mlook",                  &mlook);
@@ -772,7 +782,9 @@ void D_DoomMain(void)
 
     // Load defaults before initing other systems
     D_BindVariables();
+    M_StartTraceBegin("M_LoadConfig");
     M_LoadConfig();
+    M_StartTraceEnd();
 
     ST_Message(english_language ?
                "Z_Init: Init zone memory allocation daemon.\n" :
@@ -797,7 +809,9 @@ void D_DoomMain(void)
                "W_Init: Init WAD files.\n" :
                "W_Init: Инициализация WAD-файлов.\n");
 
+    M_StartTraceBegin("D_FindIWAD");
     iwadfile = D_FindIWAD(IWAD_MASK_HEXEN, &gamemission);
+    M_StartTraceEnd();
 
     if (iwadfile == NULL)
     {
@@ -850,8 +864,12 @@ void D_DoomMain(void)
                "I_Init: Инициализация состояния компьютера.\n");
     I_CheckIsScreensaver();
     I_InitTimer();
+    M_PerfInit();
+    I_InitThreads(worker_threads);
     I_InitController();
+    M_StartTraceBegin("I_InitSound");
     I_InitSound(false);
+    M_StartTraceEnd();
 
 #ifdef FEATURE_MULTIPLAYER
     ST_Message(english_language ?
@@ -861,7 +879,9 @@ void D_DoomMain(void)
 #endif
     D_ConnectNetGame();
 
+    M_StartTraceBegin("S_Init");
     S_Init();
+    M_StartTraceEnd();
     S_Start();
 
     ST_Message(english_language ?
@@ -873,7 +893,9 @@ void D_DoomMain(void)
     ST_Message(english_language ?
                "R_Init: Init Hexen render system - [" :
                "R_Init: Инициализация рендерера Hexen - [");
+    M_StartTraceBegin("R_Init");
     R_Init();
+    M_StartTraceEnd();
     ST_Message("]\n");
 
     //if (M_CheckParm("-net"))
@@ -882,7 +904,9 @@ void D_DoomMain(void)
     ST_Message(english_language ?
                "P_Init: Init Playloop state.\n" :
                "P_Init: Инициализация игрового окружения.\n");
+    M_StartTraceBegin("P_Init");
     P_Init();
+    M_StartTraceEnd();
 
     // Check for command line warping. Follows P_Init() because the
     // MAPINFO.TXT script must be already processed.
@@ -971,6 +995,8 @@ void D_DoomMain(void)
         }
     }
 
+    M_PrintStartupTimes();
+
     endtime = SDL_GetTicks() - starttime;
     ST_Message(english_language ? "Startup process took %d ms.\n" :
                                   "Процесс запуска занял %d мс.\n", endtime);
@@ -1134,7 +1160,9 @@ static void HandleArgs(void)
     }
 
     // [JN] Addition: also generate the WAD hash table.  Speed things up a bit.
+    M_StartTraceBegin("W_GenerateHashTable");
     W_GenerateHashTable();
+    M_StartTraceEnd();
 
     //!
     // @category demo
@@ -1219,7 +1247,9 @@ void H2_GameLoop(void)
     I_SetWindowTitle(gamedescription);
     I_GraphicsCheckCommandLine();
     I_SetGrabMouseCallback(D_GrabMouseCallback);
+    M_StartTraceBegin("I_InitGraphics");
     I_InitGraphics();
+    M_StartTraceEnd();
 
     while (1)
     {
@@ -1249,7 +1279,11 @@ void H2_GameLoop(void)
         }
 
         // Move positional sounds
+        M_PerfStart(PERF_SOUND);
+        TRACE_BEGIN("S_UpdateSounds");
         S_UpdateSounds(players[displayplayer].mo);
+        TRACE_END();
+        M_PerfStop(PERF_SOUND);
     }
 }
 
@@ -1342,7 +1376,9 @@ static void DrawAndBlit(void)
             if (automapactive)
             {
                 // [crispy] update automap while playing
+                TRACE_BEGIN("R_RenderPlayerView");
                 R_RenderPlayerView(&players[displayplayer]);
+                TRACE_END();
 
                 // [JN] Background opacity in automap overlay mode.
                 if (automap_overlay)
@@ -1360,11 +1396,16 @@ static void DrawAndBlit(void)
             }
             else
             {
+                TRACE_BEGIN("R_RenderPlayerView");
                 R_RenderPlayerView(&players[displayplayer]);
+                TRACE_END();
             }
+            M_PerfStart(PERF_HUD);
             CT_Drawer();
             UpdateState |= I_FULLVIEW;
+            TRACE_BEGIN("SB_Drawer");
             SB_Drawer();
+            TRACE_END();
             break;
         case GS_INTERMISSION:
             IN_Drawer();
@@ -1406,6 +1447,7 @@ static void DrawAndBlit(void)
 
     // [JN] Draw local time and FPS widgets on top of everything.
     DrawTimeAndFPS();
+    M_PerfStop(PERF_HUD);
 
     // [JN] Performance counters were drawn, reset them.
     R_ClearStats();
@@ -1647,6 +1689,9 @@ static void DrawTimeAndFPS(void)
                 sprintf (digit, "%9d", rendered_vissprites);
                 RD_M_DrawTextC("SPRITES", 285 + (wide_4_3 ? wide_delta : wide_delta*2), 92);
                 RD_M_DrawTextC(digit, 277 + (wide_4_3 ? wide_delta : wide_delta*2), 99);
+
+                // [JN] Frame phase timings, in milliseconds.
+                M_PerfDrawer(277 + (wide_4_3 ? wide_delta : wide_delta*2), 110);
             }
         }
     }
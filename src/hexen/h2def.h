@@ -172,6 +172,7 @@ typedef struct thinker_s
 {
     struct thinker_s *prev, *next;
     think_t function;
+    struct thinker_s *cprev, *cnext;  // [JN] Per-class list, see p_tick.c
 } thinker_t;
 
 struct player_s;
@@ -197,6 +198,7 @@ typedef struct mobj_s
 // interaction info
     struct mobj_s *bnext, *bprev;       // links in blocks (if needed)
     struct subsector_s *subsector;
+    struct msecnode_s *touching_sectorlist; // [JN] sectors touched by bounding box
     fixed_t floorz, ceilingz;   // closest together of contacted secs
     fixed_t floorpic;           // contacted sec floorpic
     fixed_t radius, height;     // for movement checking
@@ -30,6 +30,7 @@
 #include "i_timer.h" // [JN] I_GetTime()
 #include "i_video.h"
 #include "m_misc.h"
+#include "m_savebuf.h"
 #include "p_local.h"
 #include "s_sound.h"
 #include "v_trans.h"
@@ -2129,6 +2130,9 @@ static boolean ReadDescriptionForSlot(int slot, char *description)
 
     M_snprintf(name, sizeof(name), "%shexen-save-%d.sav", SavePath, slot);
 
+    // [JN] Make sure the latest savegame has reached the disk.
+    M_FinishSaveWrites();
+
     fp = M_fopen(name, "rb");
 
     if (fp == NULL)
@@ -247,6 +247,7 @@ void P_LineOpening(line_t * linedef);
 
 boolean P_BlockLinesIterator(int x, int y, boolean(*func) (line_t *));
 boolean P_BlockThingsIterator(int x, int y, boolean(*func) (mobj_t *));
+boolean P_SectorThingsIterator(sector_t * sector, boolean(*func) (mobj_t *));
 
 #define PT_ADDLINES             1
 #define PT_ADDTHINGS    2
@@ -258,6 +259,7 @@ boolean P_PathTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2,
 
 void P_UnsetThingPosition(mobj_t * thing);
 void P_SetThingPosition(mobj_t * thing);
+void P_InitSecnodes(void);
 mobj_t *P_RoughMonsterSearch(mobj_t * mo, int distance);
 
 // ***** P_MAP *****
@@ -498,8 +498,6 @@ static void P_LoadSectors (const int lump)
         ss->floor_yoffs = 0;
         ss->ceiling_xoffs = 0;
         ss->ceiling_yoffs = 0;
-        // [crispy] WiggleFix: [kb] for R_FixWiggle()
-        ss->cachedheight = 0;
         ss->seqType = SEQTYPE_STONE;    // default seqType
         // [AM] Sector interpolation.  Even if we're
         //      not running uncapped, the renderer still
@@ -1789,6 +1787,7 @@ void P_SetupLevel(int episode, int map, int playermask, skill_t skill)
     Z_FreeTags(PU_LEVEL, PU_PURGELEVEL - 1);
 
     P_InitThinkers();
+    P_InitSecnodes();
     leveltime = 0;
     oldleveltime = 0;  // [crispy] Track if game is running
 
@@ -21,6 +21,7 @@
 // HEADER FILES ------------------------------------------------------------
 
 #include "h2def.h"
+#include "m_trace.h"
 #include "p_local.h"
 
 // MACROS ------------------------------------------------------------------
@@ -34,6 +35,12 @@
 // PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
 
 static void RunThinkers(void);
+static void LinkClass(thinker_t * thinker, int class);
+static void UnlinkClass(thinker_t * thinker);
+static int ThinkerClass(const thinker_t * thinker);
+static void ClassifyPending(void);
+static void RunThinkerClass(int class);
+static void FreeRemovedThinkers(void);
 
 // EXTERNAL DATA DECLARATIONS ----------------------------------------------
 
@@ -45,6 +52,24 @@ thinker_t thinkercap;           // The head and tail of the thinker list
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
 
+// [JN] Besides the main list, which keeps vanilla order for demos, netgames
+// and savegames, every thinker is linked into the list of its class.
+// In single player each class is run in a tight loop. Thinkers which get
+// their function after P_AddThinker wait in the pending list.
+
+enum
+{
+    th_pending,
+    th_mobj,
+    th_mover,
+    th_light,
+    th_misc,
+    th_removed,
+    NUMTHINKERCLASSES
+};
+
+static thinker_t classcap[NUMTHINKERCLASSES];
+
 // CODE --------------------------------------------------------------------
 
 //==========================================================================
@@ -75,12 +100,158 @@ void P_Ticker(void)
             G_Completed(P_TranslateMap(P_GetMapNextMap(gamemap)), 0);
         }
     }
+    TRACE_BEGIN("P_RunThinkers");
     RunThinkers();
+    TRACE_END();
     P_UpdateSpecials();
     P_AnimateSurfaces();
     leveltime++;
 }
 
+//==========================================================================
+//
+// LinkClass
+//
+//==========================================================================
+
+static void LinkClass(thinker_t * thinker, int class)
+{
+    thinker_t *cap = &classcap[class];
+
+    cap->cprev->cnext = thinker;
+    thinker->cnext = cap;
+    thinker->cprev = cap->cprev;
+    cap->cprev = thinker;
+}
+
+//==========================================================================
+//
+// UnlinkClass
+//
+//==========================================================================
+
+static void UnlinkClass(thinker_t * thinker)
+{
+    thinker->cnext->cprev = thinker->cprev;
+    thinker->cprev->cnext = thinker->cnext;
+}
+
+//==========================================================================
+//
+// ThinkerClass
+//
+//==========================================================================
+
+static int ThinkerClass(const thinker_t * thinker)
+{
+    think_t func = thinker->function;
+
+    if (func == NULL)
+    {
+        return th_pending;
+    }
+    if (func == (think_t) - 1)
+    {
+        return th_removed;
+    }
+    if (func == P_MobjThinker || func == P_BlasterMobjThinker)
+    {
+        return th_mobj;
+    }
+    if (func == T_MoveCeiling || func == T_VerticalDoor
+     || func == T_MoveFloor || func == T_PlatRaise
+     || func == T_BuildPillar || func == T_FloorWaggle
+     || func == T_MovePoly || func == T_PolyDoor || func == T_RotatePoly)
+    {
+        return th_mover;
+    }
+    if (func == T_Light || func == T_Phase)
+    {
+        return th_light;
+    }
+    return th_misc;
+}
+
+//==========================================================================
+//
+// ClassifyPending
+//
+// Moves pending thinkers to the tails of their class lists.
+//
+//==========================================================================
+
+static void ClassifyPending(void)
+{
+    thinker_t *cap = &classcap[th_pending];
+
+    while (cap->cnext != cap)
+    {
+        thinker_t *thinker = cap->cnext;
+        int class = ThinkerClass(thinker);
+
+        UnlinkClass(thinker);
+        LinkClass(thinker, class == th_pending ? th_misc : class);
+    }
+}
+
+//==========================================================================
+//
+// RunThinkerClass
+//
+// [JN] Removed thinkers are moved to the removed class and freed once
+// every class has been run. Spawned thinkers are classified right away,
+// so they are run in this tic if their class is not done yet.
+//
+//==========================================================================
+
+static void RunThinkerClass(int class)
+{
+    thinker_t *cap = &classcap[class];
+    thinker_t *currentthinker, *nextthinker;
+
+    for (currentthinker = cap->cnext; currentthinker != cap;
+         currentthinker = nextthinker)
+    {
+        if (currentthinker->function == (think_t) - 1)
+        {
+            nextthinker = currentthinker->cnext;
+            UnlinkClass(currentthinker);
+            LinkClass(currentthinker, th_removed);
+            continue;
+        }
+        if (currentthinker->function)
+        {
+            currentthinker->function(currentthinker);
+        }
+        if (classcap[th_pending].cnext != &classcap[th_pending])
+        {
+            ClassifyPending();
+        }
+        nextthinker = currentthinker->cnext;
+    }
+}
+
+//==========================================================================
+//
+// FreeRemovedThinkers
+//
+//==========================================================================
+
+static void FreeRemovedThinkers(void)
+{
+    thinker_t *cap = &classcap[th_removed];
+
+    while (cap->cnext != cap)
+    {
+        thinker_t *thinker = cap->cnext;
+
+        UnlinkClass(thinker);
+        thinker->next->prev = thinker->prev;
+        thinker->prev->next = thinker->next;
+        Z_Free(thinker);
+    }
+}
+
 //==========================================================================
 //
 // RunThinkers
@@ -94,18 +265,16 @@ static void RunThinkers(void)
     // [JN] Prevent dropped item from jittering on moving platforms.
     // For single player only, really not safe for internal demos.
     // See: https://github.com/bradharding/doomretro/issues/501
+    // All mobjs are run first, then all sector thinkers.
     if (singleplayer)
     {
-        currentthinker = thinkercap.next;
-        while (currentthinker != &thinkercap)
-        {
-            if (currentthinker->function)
-                if (currentthinker->function == P_MobjThinker)
-                    currentthinker->function (currentthinker);
-
-            nextthinker = currentthinker->next;
-            currentthinker = nextthinker;
-        }
+        ClassifyPending();
+        RunThinkerClass(th_mobj);
+        RunThinkerClass(th_mover);
+        RunThinkerClass(th_light);
+        RunThinkerClass(th_misc);
+        FreeRemovedThinkers();
+        return;
     }
 
     currentthinker = thinkercap.next;
@@ -116,26 +285,15 @@ static void RunThinkers(void)
             nextthinker = currentthinker->next;
             currentthinker->next->prev = currentthinker->prev;
             currentthinker->prev->next = currentthinker->next;
+            UnlinkClass(currentthinker);
             Z_Free(currentthinker);
         }
         else
         {
-            // [JN] Prevent dropped item from jittering on moving platforms.
-            if (singleplayer)
-            {
-                if (currentthinker->function)
-                    if (currentthinker->function != P_MobjThinker)
-                        currentthinker->function (currentthinker);
-
-                nextthinker = currentthinker->next;
-            }
-            else
-            {
-                if (currentthinker->function)
-                    currentthinker->function(currentthinker);
-
-                nextthinker = currentthinker->next;
-            }
+            if (currentthinker->function)
+                currentthinker->function(currentthinker);
+
+            nextthinker = currentthinker->next;
         }
 
         currentthinker = nextthinker;
@@ -150,7 +308,13 @@ static void RunThinkers(void)
 
 void P_InitThinkers(void)
 {
+    int i;
+
     thinkercap.prev = thinkercap.next = &thinkercap;
+    for (i = 0; i < NUMTHINKERCLASSES; i++)
+    {
+        classcap[i].cprev = classcap[i].cnext = &classcap[i];
+    }
 }
 
 //==========================================================================
@@ -167,6 +331,7 @@ void P_AddThinker(thinker_t * thinker)
     thinker->next = &thinkercap;
     thinker->prev = thinkercap.prev;
     thinkercap.prev = thinker;
+    LinkClass(thinker, ThinkerClass(thinker));
 }
 
 //==========================================================================
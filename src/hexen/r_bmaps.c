@@ -21,8 +21,13 @@
 //
 
 
+#include <stdlib.h>
+#include <string.h>
+#include "SDL.h"
 #include "h2def.h"
+#include "i_system.h"
 #include "r_bmaps.h"
+#include "r_local.h"
 #include "jn.h"
 
 
@@ -236,7 +241,7 @@ static const byte blueonly[256] =
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 };
 
-const byte* dc_brightmap = nobrightmap;
+THREADLOCAL const byte* dc_brightmap = nobrightmap;
 
 /*
 ================================================================================
@@ -976,3 +981,156 @@ const byte* R_BrightmapForState(const int state)
 
     return nobrightmap;
 }
+
+/*
+================================================================================
+=
+= [JN] Fused brightmap and colormap tables.
+=
+= Instead of doing colormap[brightmap[src]][src] for every pixel, each
+= referenced combination of brightmap, colormap and bright colormap is
+= resolved once into a single 256 byte table. Tables are built on first use
+= and kept until exit, so memory is bounded by the combinations actually
+= drawn, i.e. by brightmaps * COLORMAP levels^2 at most.
+=
+= Every brightmap is registered by R_InitBrightmaps, so the list is never
+= grown while view strips are drawn. Tables may be built by any thread, and
+= are published with an atomic compare and swap; if two threads build the
+= same table at once, the one which lost just frees its copy.
+=
+================================================================================
+*/
+
+#define FUSEDMAPS (NUMCOLORMAPS + 2)  // Light levels and extra COLORMAP maps.
+
+typedef struct
+{
+    const byte    *brightmap;
+    lighttable_t  *tables[FUSEDMAPS][FUSEDMAPS];
+} fusedmaps_t;
+
+static fusedmaps_t **fusedmaps;
+static int           numfusedmaps;
+
+static fusedmaps_t *R_FusedMapsForBrightmap (const byte *brightmap)
+{
+    static THREADLOCAL fusedmaps_t *last;
+    fusedmaps_t *fused;
+
+    if (last != NULL && last->brightmap == brightmap)
+    {
+        return last;
+    }
+
+    for (int i = 0 ; i < numfusedmaps ; i++)
+    {
+        if (fusedmaps[i]->brightmap == brightmap)
+        {
+            return last = fusedmaps[i];
+        }
+    }
+
+    fused = Z_Malloc(sizeof(*fused), PU_STATIC, 0);
+    memset(fused, 0, sizeof(*fused));
+    fused->brightmap = brightmap;
+
+    fusedmaps = I_Realloc(fusedmaps, (numfusedmaps + 1) * sizeof(*fusedmaps));
+    fusedmaps[numfusedmaps++] = fused;
+
+    return last = fused;
+}
+
+static void R_InitFusedMaps (void)
+{
+    static const byte *const brightmaps[] = {
+        surfaces1, surfaces2, artifacts, flame1, flame2, firebull, mana,
+        greenonly, blueonly,
+    };
+
+    for (size_t i = 0 ; i < arrlen(brightmaps) ; i++)
+    {
+        R_FusedMapsForBrightmap(brightmaps[i]);
+    }
+}
+
+/*
+================================================================================
+=
+= R_BrightColormap
+=
+= Returns a table equal to colormap[brightmap[src]][src] for every src.
+= May be called from any thread.
+=
+================================================================================
+*/
+
+const lighttable_t *R_BrightColormap (const byte *brightmap,
+                                      const lighttable_t *colormap,
+                                      const lighttable_t *brightcolormap)
+{
+    static THREADLOCAL lighttable_t scratch[256];
+    ptrdiff_t level, brightlevel;
+    lighttable_t *table;
+
+    if (brightmap == nobrightmap || colormap == brightcolormap)
+    {
+        return colormap;
+    }
+    if (brightmap == fullbright)
+    {
+        return brightcolormap;
+    }
+
+    level = colormap - colormaps;
+    brightlevel = brightcolormap - colormaps;
+
+    // Colormaps from outside of COLORMAP lump are not cached.
+    if (level < 0 || level >= FUSEDMAPS * 256 || level & 255
+    ||  brightlevel < 0 || brightlevel >= FUSEDMAPS * 256 || brightlevel & 255)
+    {
+        for (int i = 0 ; i < 256 ; i++)
+        {
+            scratch[i] = brightmap[i] ? brightcolormap[i] : colormap[i];
+        }
+
+        return scratch;
+    }
+    else
+    {
+        fusedmaps_t *const fused = R_FusedMapsForBrightmap(brightmap);
+        void **const slot = (void **) &fused->tables[level >> 8][brightlevel >> 8];
+
+        if ((table = SDL_AtomicGetPtr(slot)) != NULL)
+        {
+            return table;
+        }
+
+        table = malloc(256);
+
+        for (int i = 0 ; i < 256 ; i++)
+        {
+            table[i] = brightmap[i] ? brightcolormap[i] : colormap[i];
+        }
+
+        if (!SDL_AtomicCASPtr(slot, NULL, table))
+        {
+            free(table);
+            table = SDL_AtomicGetPtr(slot);
+        }
+
+        return table;
+    }
+}
+
+/*
+================================================================================
+=
+= [crispy] initialize brightmaps
+=
+================================================================================
+*/
+
+void R_InitBrightmaps (void)
+{
+    R_InitFusedMaps();
+}
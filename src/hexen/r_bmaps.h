@@ -26,7 +26,7 @@
 
 #define MINBRIGHT   24  // [JN] Minimal COLORMAP level for half-brights.
 
-extern void R_InitBrightmaps ();
+extern void R_InitBrightmaps (void);
 
 extern const byte *R_BrightmapForTexName (const char *texname);
 extern const byte *R_BrightmapForSprite (const int state);
@@ -24,34 +24,16 @@
 #include "jn.h"
 
 
-seg_t     *curline;
-side_t    *sidedef;
-line_t    *linedef;
-sector_t  *frontsector, *backsector;
-drawseg_t *ds_p;
+THREADLOCAL seg_t     *curline;
+THREADLOCAL side_t    *sidedef;
+THREADLOCAL line_t    *linedef;
+THREADLOCAL sector_t  *frontsector, *backsector;
+THREADLOCAL int        lineflags;  // [JN] cph: r_flags of linedef
 
 // [JN] CPhipps - 
 // Instead of clipsegs, let's try using an array with one entry for each column, 
 // indicating whether it's blocked by a solid wall yet or not.
-byte *solidcol;
-
-// [JN] killough: New code which removes 2s linedef limit
-drawseg_t *drawsegs;
-unsigned   maxdrawsegs;
-
-
-/*
-================================================================================
-=
-= R_InitClipSegs
-=
-================================================================================
-*/
-
-void R_InitClipSegs(void)
-{
-    solidcol = calloc(screenwidth, sizeof(*solidcol));
-}
+// Each strip has own solidcol, see viewstrip_t.
 
 /*
 ================================================================================
@@ -63,7 +45,7 @@ void R_InitClipSegs(void)
 
 void R_ClearDrawSegs(void)
 {
-    ds_p = drawsegs;
+    curstrip->ds_p = curstrip->drawsegs;
 }
 
 /*
@@ -79,6 +61,8 @@ void R_ClearDrawSegs(void)
 
 static void R_ClipWallSegment (int first, int last, boolean solid)
 {
+    byte *const solidcol = curstrip->solidcol;
+    const int segstart = first;
     byte *p;
 
     while (first < last)
@@ -104,7 +88,7 @@ static void R_ClipWallSegment (int first, int last, boolean solid)
                 to = p - solidcol;
             }
 
-            R_StoreWallRange(first, to-1);
+            R_StoreWallRange(first, to-1, segstart, last-1);
 
             if (solid)
             {
@@ -120,13 +104,14 @@ static void R_ClipWallSegment (int first, int last, boolean solid)
 = 
 = R_RecalcLineFlags
 =
+= [JN] Cached in the linedef by R_AddLine only with one strip,
+= as several strips may look at it at once.
+=
 ================================================================================
 */
 
-static void R_RecalcLineFlags (line_t *linedef)
+static void R_RecalcLineFlags (const line_t *linedef)
 {
-    linedef->r_validcount = gametic;
-
     // First decide if the line is closed, normal, or invisible */
     if (!(linedef->flags & ML_TWOSIDED)
     || backsector->interpceilingheight <= frontsector->interpfloorheight
@@ -145,7 +130,7 @@ static void R_RecalcLineFlags (line_t *linedef)
     // properly render skies (consider door "open" if both ceilings are sky):
     && (backsector->ceilingpic !=skyflatnum || frontsector->ceilingpic!=skyflatnum)))
     {
-        linedef->r_flags = RF_CLOSED;
+        lineflags = RF_CLOSED;
     }
     else
     {
@@ -166,12 +151,12 @@ static void R_RecalcLineFlags (line_t *linedef)
         sizeof(frontsector->floorlightsec) + sizeof(frontsector->ceilinglightsec) +
         sizeof(frontsector->special)))
         {
-            linedef->r_flags = 0;
+            lineflags = 0;
             return;
         }
         else
         {
-            linedef->r_flags = RF_IGNORE;
+            lineflags = RF_IGNORE;
         }
     }
 
@@ -187,14 +172,14 @@ static void R_RecalcLineFlags (line_t *linedef)
         if ((c = frontsector->interpceilingheight - backsector->interpceilingheight) > 0
         && (textureheight[texturetranslation[curline->sidedef->toptexture]] > c))
         {
-            linedef->r_flags |= RF_TOP_TILE;
+            lineflags |= RF_TOP_TILE;
         }
 
         // Does bottom texture need tiling
         if ((c = frontsector->interpfloorheight - backsector->interpfloorheight) > 0
         && (textureheight[texturetranslation[curline->sidedef->bottomtexture]] > c))
         {
-            linedef->r_flags |= RF_BOT_TILE;
+            lineflags |= RF_BOT_TILE;
         }
     }
     else
@@ -205,7 +190,7 @@ static void R_RecalcLineFlags (line_t *linedef)
         if ((c = frontsector->interpceilingheight - frontsector->interpfloorheight) > 0
         && (textureheight[texturetranslation[curline->sidedef->midtexture]] > c))
         {
-            linedef->r_flags |= RF_MID_TILE;
+            lineflags |= RF_MID_TILE;
         }
     }
 }
@@ -220,7 +205,9 @@ static void R_RecalcLineFlags (line_t *linedef)
 
 void R_ClearClipSegs(void)
 {
-    memset(solidcol, 0, screenwidth);
+    // [JN] Columns of other strips are solid from the start.
+    memset(curstrip->solidcol, 1, screenwidth);
+    memset(curstrip->solidcol + curstrip->left, 0, curstrip->right - curstrip->left + 1);
 }
 
 /*
@@ -233,7 +220,7 @@ void R_ClearClipSegs(void)
 ================================================================================
 */
 
-void R_MaybeInterpolateSector(sector_t *sector)
+static void R_MaybeInterpolateSector(sector_t *sector)
 {
     if (uncapped_fps &&
         // Only if we moved the sector last tic.
@@ -344,14 +331,7 @@ static void R_AddLine (seg_t *line)
     backsector = line->backsector;
 
     // Single sided line?
-    if (backsector)
-    {
-        // [AM] Interpolate sector movement before
-        //      running clipping tests.  Frontsector
-        //      should already be interpolated.
-        R_MaybeInterpolateSector(backsector);
-    }
-    else
+    if (!backsector)
     {
         // [JN] If no backsector is present, 
         // just clip the line as a solid segment.
@@ -360,18 +340,29 @@ static void R_AddLine (seg_t *line)
     }
 
     // [JN] cph - roll up linedef properties in flags
-    if ((linedef = curline->linedef)->r_validcount != gametic) 
+    if (numstrips > 1)
     {
+        linedef = curline->linedef;
         R_RecalcLineFlags(linedef);
     }
+    else
+    {
+        if ((linedef = curline->linedef)->r_validcount != gametic) 
+        {
+            R_RecalcLineFlags(linedef);
+            linedef->r_validcount = gametic;
+            linedef->r_flags = lineflags;
+        }
+        lineflags = linedef->r_flags;
+    }
 
-    if (linedef->r_flags & RF_IGNORE)
+    if (lineflags & RF_IGNORE)
     {
         return;
     }
     else
     {
-        R_ClipWallSegment (x1, x2, linedef->r_flags & RF_CLOSED);
+        R_ClipWallSegment (x1, x2, lineflags & RF_CLOSED);
     }
 }
 
@@ -456,7 +447,7 @@ static boolean R_CheckBBox(fixed_t * bspcoord)
             return false;
         }
 
-        if (!memchr(solidcol+sx1, 0, sx2-sx1)) return false; 
+        if (!memchr(curstrip->solidcol+sx1, 0, sx2-sx1)) return false;
         // All columns it covers are already solidly covered
     }
 
@@ -468,13 +459,13 @@ static boolean R_CheckBBox(fixed_t * bspcoord)
 =
 = R_Subsector
 =
-= Determine floor/ceiling planes. Add sprites of things in sector.
+= Determine floor/ceiling planes.
 = Draw one or more line segments.
 =
 ================================================================================
 */
 
-void R_Subsector(int num)
+static void R_Subsector(int num)
 {
     subsector_t *sub = &subsectors[num];
     seg_t       *line = &segs[sub->firstline];
@@ -490,10 +481,7 @@ void R_Subsector(int num)
 #endif
 
     frontsector = sub->sector;
-
-    // [AM] Interpolate sector movement.  Usually only needed
-    //      when you're standing inside the sector.
-    R_MaybeInterpolateSector(frontsector);
+    curstrip->subsectorframe[num] = curstrip->validcount;
 
     floorplane = frontsector->interpfloorheight < viewz ?
                  R_FindPlane (frontsector->interpfloorheight,
@@ -518,17 +506,7 @@ void R_Subsector(int num)
         }
     }
 
-    // BSP is traversed by subsector.
-    // A sector might have been split into several 
-    //  subsectors during BSP building.
-    // Thus we check whether its already added.
-    if (sub->sector->validcount != validcount && (!automapactive || automap_overlay))
-    {
-        sub->sector->validcount = validcount;
-        R_AddSprites (frontsector);
-    }
-
-    while (count--)
+while (count--)
     {
         R_AddLine (line++);
     }
@@ -556,7 +534,9 @@ void R_RenderBSPNode (int bspnum)
         // Decide which side the view point is on.
         int side = R_PointOnSide(viewx, viewy, bsp);
 
-        // Recursively divide front space.
+        curstrip->nodeframe[bspnum] = curstrip->validcount;
+
+        // Recursivelydivide front space.
         R_RenderBSPNode(bsp->children[side]);
 
         // Possibly divide back space.
@@ -570,3 +550,123 @@ void R_RenderBSPNode (int bspnum)
 
     R_Subsector(bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR);
 }
+
+/*
+================================================================================
+=
+= R_InterpolateSectors
+=
+= [JN] Interpolates all sectors before the strips are walking the BSP tree,
+= so sectors are not written while they are looked at by other strips.
+=
+================================================================================
+*/
+
+void R_InterpolateSectors (void)
+{
+    for (int i = 0 ; i < numsectors ; i++)
+    {
+        R_MaybeInterpolateSector(&sectors[i]);
+    }
+}
+
+/*
+================================================================================
+=
+= R_StripsVisited
+=
+= [JN] Returns true if node or subsector was visited by some of the strips.
+=
+================================================================================
+*/
+
+static boolean R_StripsVisited (const int bspnum)
+{
+    for (int i = 0 ; i < numstrips ; i++)
+    {
+        const viewstrip_t *strip = &strips[i];
+
+        if (bspnum == -1 || (bspnum & NF_SUBSECTOR))
+        {
+            const int num = bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR;
+
+            if (strip->subsectorframe[num] == strip->validcount)
+            {
+                return true;
+            }
+        }
+        else if (strip->nodeframe[bspnum] == strip->validcount)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+================================================================================
+=
+= R_AddBSPSprites
+=
+= [JN] Adds sprites of things in sectors, seen by any of the strips.
+= Goes through the BSP tree in the same order as R_RenderBSPNode does,
+= so sprites are sorted the same way as if the view was not split at all.
+=
+================================================================================
+*/
+
+void R_AddBSPSprites (int bspnum)
+{
+    while (R_StripsVisited(bspnum))
+    {
+        const subsector_t *sub;
+
+        if (!(bspnum & NF_SUBSECTOR))
+        {
+            const node_t *bsp = &nodes[bspnum];
+            const int side = R_PointOnSide(viewx, viewy, bsp);
+
+            R_AddBSPSprites(bsp->children[side]);
+            bspnum = bsp->children[side^1];
+            continue;
+        }
+
+        // BSP is traversed by subsector.
+        // A sector might have been split into several 
+        //  subsectors during BSP building.
+        // Thus we check whether its already added.
+        sub = &subsectors[bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR];
+
+        if (sub->sector->validcount != validcount)
+        {
+            sub->sector->validcount = validcount;
+            R_AddSprites (sub->sector);
+        }
+        break;
+    }
+}
+
+/*
+================================================================================
+=
+= R_MarkMappedLines
+=
+= [JN] Marks lines, seen by the strips, on the automap.
+=
+================================================================================
+*/
+
+void R_MarkMappedLines (void)
+{
+    for (int i = 0 ; i < numstrips ; i++)
+    {
+        viewstrip_t *strip = &strips[i];
+
+        for (int j = 0 ; j < strip->nummapped ; j++)
+        {
+            strip->mapped[j]->flags |= ML_MAPPED;
+        }
+        strip->nummapped = 0;
+    }
+}
@@ -106,13 +106,11 @@ typedef struct
     degenmobj_t soundorg;       // for any sounds played by the sector
     int validcount;             // if == validcount, already checked
     mobj_t *thinglist;          // list of mobjs in sector
+    struct msecnode_s *touching_thinglist;  // [JN] killough 3/28/98: mobjs touching sector
     void *specialdata;          // thinker_t for reversable actions
     int linecount;
     struct line_s **lines;      // [linecount] size
-    // [crispy] WiggleFix: [kb] for R_FixWiggle()
-    int cachedheight;
-    int scaleindex;    
-    // [AM] Previous position of floor and ceiling before
+    // [AM]Previous position of floor and ceiling before
     //      think.  Used to interpolate between positions.
     fixed_t	oldfloorheight;
     fixed_t	oldceilingheight;
@@ -131,6 +129,20 @@ typedef struct
     fixed_t interpceilingheight;
 } sector_t;
 
+// [JN] phares 3/14/98: sector touching lists. Each node links a thing to
+// one of the sectors its bounding box touches, and is threaded both through
+// the list of the thing and the list of the sector.
+
+typedef struct msecnode_s
+{
+    sector_t *m_sector;         // a sector containing this object
+    struct mobj_s *m_thing;     // this object
+    struct msecnode_s *m_tnext; // next msecnode_t for this thing
+    struct msecnode_s *m_sprev; // prev msecnode_t for this sector
+    struct msecnode_s *m_snext; // next msecnode_t for this sector
+    boolean visited;            // already processed by sector iterator
+} msecnode_t;
+
 typedef struct
 {
     fixed_t textureoffset;      // add this to the calculated texture col
@@ -149,6 +161,18 @@ typedef enum
     ST_NEGATIVE
 } slopetype_t;
 
+// [JN] cph: linedef properties, rolled up by R_AddLine.
+// With more than one strip they are worked out again by every strip,
+// as lines are shared by all of them.
+enum
+{
+    RF_TOP_TILE  = 1,   // Upper texture needs tiling
+    RF_MID_TILE  = 2,   // Mid texture needs tiling
+    RF_BOT_TILE  = 4,   // Lower texture needs tiling
+    RF_IGNORE    = 8,   // Renderer can skip this line
+    RF_CLOSED    = 16,  // Line blocks view
+};
+
 typedef struct line_s
 {
     vertex_t *v1;
@@ -172,14 +196,7 @@ typedef struct line_s
 
     // [JN] Improved column clipping.
     int r_validcount;   // cph: if == gametic, r_flags already done
-    enum {              // cph:
-    RF_TOP_TILE  = 1,   // Upper texture needs tiling
-    RF_MID_TILE  = 2,   // Mid texture needs tiling
-    RF_BOT_TILE  = 4,   // Lower texture needs tiling
-    RF_IGNORE    = 8,   // Renderer can skip this line
-    RF_CLOSED    = 16,  // Line blocks view
-    } r_flags;
-
+    int r_flags;        // RF_* flags, cached with one strip only
 } line_t;
 
 typedef struct
@@ -260,6 +277,14 @@ typedef struct visplane_s
     int lightlevel;
     int special;
     int minx, maxx;
+    // [JN] Drawing data, resolved by R_DrawPlanes
+    // before the planes are split between threads.
+    byte          *source;
+    const byte   **skycolumns;            // sky 1 column for minx...maxx
+    const byte   **skycolumns2;           // sky 2 column for minx...maxx
+    lighttable_t **zlight;
+    fixed_t        planeheight;
+    fixed_t        scrollx, scrolly;
     unsigned int pad1;                    // [crispy] hires / 32-bit integer math
     unsigned int top[MAXWIDTH];           // [crispy] hires / 32-bit integer math
     unsigned int pad2;                    // [crispy] hires / 32-bit integer math
@@ -299,6 +324,7 @@ typedef struct vissprite_s
     fixed_t xiscale;            // negative if flipped
     fixed_t texturemid;
     int patch;
+    const patch_t *patchdata;   // [JN] Cached by R_DrawMasked.
     // [crispy] brightmaps for select sprites
     lighttable_t *colormap[2];
     const byte *brightmap;
@@ -310,7 +336,7 @@ typedef struct vissprite_s
 } vissprite_t;
 
 
-extern visplane_t *floorplane, *ceilingplane;
+extern THREADLOCAL visplane_t *floorplane, *ceilingplane;
 
 // Sprites are patches with a special naming convention so they can be
 // recognized by R_InitSprites.  The sprite and frame specified by a
@@ -394,7 +420,7 @@ extern lighttable_t *fixedcolormap;
 
 extern fixed_t viewcos, viewsin;
 
-extern void (*colfunc) (void);
+extern THREADLOCAL void (*colfunc) (void);
 extern void (*basecolfunc) (void);
 extern void (*tlcolfunc) (void);
 extern void (*alttlcolfunc) (void);
@@ -426,45 +452,86 @@ extern void R_ClearStats (void);
 extern int rendered_segs, rendered_visplanes, rendered_vissprites;
 
 //
-// R_bsp.c
+// View strips
+//
+// [JN] The view is split into vertical strips, one per thread. Every strip
+// walks the BSP tree with own clipping arrays, as if the view was as narrow
+// as the strip, and draws own walls, planes and sprites. Columns outside of
+// the strip are marked solid from the start, so nothing is drawn there.
+// Wall and sprite math doesn't depend on where walls are cut by other walls
+// or by strip edges, so the picture is the same for any number of strips.
 //
-extern seg_t *curline;
-extern side_t *sidedef;
-extern line_t *linedef;
-extern sector_t *frontsector, *backsector;
 
-extern int rw_x;
-extern int rw_stopx;
+typedef struct
+{
+    int left, right;  // Columns of the strip, inclusive.
+    int width;        // screenwidth the clipping arrays are allocated for.
 
-extern boolean markfloor;       // false if the back side is the same plane
-extern boolean markceiling;
+    byte *solidcol;
+    int  *floorclip, *ceilingclip;  // dropoff overflow
 
-extern drawseg_t *drawsegs; 
-extern drawseg_t *ds_p;
+    // [JN] killough: New code which removes 2s linedef limit
+    drawseg_t *drawsegs, *ds_p;
+    unsigned   maxdrawsegs;
 
-// [JN] killough: New code which removes 2s linedef limit
-extern unsigned maxdrawsegs;
+    // [JN] killough 1/6/98, 2/1/98: remove limit on openings
+    int    *openings, *lastopening;  // [crispy] 32-bit integer math
+    size_t  maxopenings;
 
-extern lighttable_t **hscalelight, **vscalelight, **dscalelight;
+    visplane_t  *visplanes[MAXVISPLANES];  // [JN] killough
+    visplane_t  *freetail;
+    visplane_t **freehead;
+
+    // Strip's own validcount, bumped every frame, and the frames
+    // in which nodes and subsectors were visited by the strip.
+    int  validcount;
+    int *nodeframe, *subsectorframe;
+    int  numnodes, numsubsectors;
+
+    // Lines to be marked on the automap once all strips are done.
+    line_t **mapped;
+    int      nummapped, maxmapped;
 
-// [JN] Improved column clipping.
-extern byte *solidcol;
-void R_InitClipSegs (void);
+    int segs;  // Rendered segs, for perfomance counter.
+} viewstrip_t;
+
+extern viewstrip_t strips[];
+extern int numstrips;
+extern THREADLOCAL viewstrip_t *curstrip;
+
+void R_BindStrip(int slice);
+
+//
+// R_bsp.c
+//
+extern THREADLOCAL seg_t *curline;
+extern THREADLOCAL side_t *sidedef;
+extern THREADLOCAL line_t *linedef;
+extern THREADLOCAL sector_t *frontsector, *backsector;
+extern THREADLOCAL int lineflags;
+
+extern THREADLOCAL boolean markfloor;       // false if the back side is the same plane
+extern THREADLOCAL boolean markceiling;
+
+extern lighttable_t **hscalelight, **vscalelight, **dscalelight;
 
 typedef void (*drawfunc_t) (int start, int stop);
 void R_ClearClipSegs(void);
 
+void R_AddBSPSprites(int bspnum);
 void R_ClearDrawSegs(void);
 void R_InitSkyMap(void);
+void R_InterpolateSectors(void);
+void R_MarkMappedLines(void);
 void R_RenderBSPNode(int bspnum);
 
-void R_StoreWallRange (int start, int stop);
+void R_StoreWallRange (int start, int stop, int segstart, int segstop);
 
 
 //
 // R_segs.c
 //
-extern int rw_angle1;           // angle to line origin
+extern THREADLOCAL int rw_angle1;           // angle to line origin
 extern int TransTextureStart;
 extern int TransTextureEnd;
 
@@ -476,16 +543,12 @@ void R_RenderMaskedSegRange(drawseg_t * ds, int x1, int x2);
 // R_plane.c
 //
 extern int  skyflatnum;
-extern int *lastopening; // [crispy] 32-bit integer math
 
 // [JN] e6y: resolution limitation is removed
-extern int *floorclip, *ceilingclip; // dropoff overflow
-
 extern fixed_t *yslope, *distscale;
 extern fixed_t yslopes[MAXHEIGHT][MAXHEIGHT];
 
 void R_InitPlanesRes(void);
-void R_InitVisplanesRes(void);
 void R_ClearPlanes(void);
 void R_MapPlane(int y, int x1, int x2);
 void R_DrawPlanes(void);
@@ -517,6 +580,8 @@ extern int firstspritelump, lastspritelump, numspritelumps;
 extern boolean LevelUseFullBright;
 
 byte *R_GetColumn(int tex, int col, boolean opaque);
+const byte *R_GetMaskedColumn(int tex, int col);
+void R_LockTexturePatches(int tex, boolean lock);
 void R_InitData(void);
 void R_PrecacheLevel(void);
 
@@ -530,10 +595,10 @@ extern int *negonearray;       // [JN] killough 2/8/98: // dropoff overflow
 extern int *screenheightarray; //      change to MAX_*  // dropoff overflow
 
 // vars for R_DrawMaskedColumn
-extern int*  mfloorclip;   // [crispy] 32-bit integer math
-extern int*  mceilingclip; // [crispy] 32-bit integer math
-extern fixed_t spryscale;
-extern int64_t sprtopscreen, sprbotscreen;
+extern THREADLOCAL int*  mfloorclip;   // [crispy] 32-bit integer math
+extern THREADLOCAL int*  mceilingclip; // [crispy] 32-bit integer math
+extern THREADLOCAL fixed_t spryscale;
+extern THREADLOCAL int64_t sprtopscreen, sprbotscreen;
 
 extern fixed_t pspritescale, pspriteiscale;
 
@@ -552,18 +617,25 @@ void R_ClipVisSprite(vissprite_t * vis, int xl, int xh);
 // R_draw.c
 //
 
-extern const lighttable_t *dc_colormap[2];
-extern int dc_x;
-extern int dc_yl;
-extern int dc_yh;
-extern fixed_t dc_iscale;
-extern fixed_t dc_texturemid;
-extern int dc_texheight;
-extern const byte *dc_source;         // first pixel in a column
-extern const byte *dc_brightmap;
+extern THREADLOCAL const lighttable_t *dc_colormap[2];
+extern THREADLOCAL int dc_x;
+extern THREADLOCAL int dc_yl;
+extern THREADLOCAL int dc_yh;
+extern THREADLOCAL fixed_t dc_iscale;
+extern THREADLOCAL fixed_t dc_texturemid;
+extern THREADLOCAL int dc_texheight;
+extern THREADLOCAL const byte *dc_source;         // first pixel in a column
+extern THREADLOCAL const byte *dc_brightmap;
+
+// [JN] r_bmaps.c
+extern const lighttable_t *R_BrightColormap (const byte *brightmap,
+                                             const lighttable_t *colormap,
+                                             const lighttable_t *brightcolormap);
 
 void R_DrawColumn(void);
 void R_DrawColumnLow(void);
+void R_QueueColumn(void);
+void R_FlushColumns(void);
 void R_DrawTLColumn(void);
 void R_DrawTLColumnLow(void);
 void R_DrawAltTLColumn(void);
@@ -576,16 +648,20 @@ void R_DrawTranslatedTLColumn(void);
 void R_DrawTranslatedTLColumnLow(void);
 
 
-extern const lighttable_t *ds_colormap;
-extern byte *ds_source;         // start of a 64*64 tile image
+extern THREADLOCAL const lighttable_t *ds_colormap;
+extern THREADLOCAL byte *ds_source;         // start of a 64*64 tile image
 extern const byte *ds_brightmap;
+extern unsigned int litflatframe;
 
 extern byte *translationtables;
-extern byte *dc_translation;
+extern THREADLOCAL byte *dc_translation;
 
 void R_DrawSpan(fixed_t x1, fixed_t x2, const fixed_t y,
                 fixed_t ds_xfrac, const fixed_t ds_xstep,
                 fixed_t ds_yfrac, const fixed_t ds_ystep);
+void R_DrawSpanLit(fixed_t x1, fixed_t x2, const fixed_t y,
+                   fixed_t ds_xfrac, const fixed_t ds_xstep,
+                   fixed_t ds_yfrac, const fixed_t ds_ystep);
 void R_DrawSpanLow(fixed_t x1, fixed_t x2, const fixed_t y,
                    fixed_t ds_xfrac, const fixed_t ds_xstep,
                    fixed_t ds_yfrac, const fixed_t ds_ystep);
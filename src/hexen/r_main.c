@@ -18,11 +18,15 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "m_random.h"
 #include "h2def.h"
+#include "i_system.h"
+#include "i_thread.h"
 #include "m_bbox.h"
 #include "r_local.h"
+#include "m_perf.h"
 #include "p_local.h"
 #include "i_timer.h"
 #include "v_video.h"
@@ -82,9 +86,8 @@ lighttable_t *scalelightfixed[MAXLIGHTSCALE];
 lighttable_t *zlight[LIGHTLEVELS][MAXLIGHTZ];
 
 lighttable_t *fixedcolormap;
-extern lighttable_t **walllights;
 
-void (*colfunc) (void);
+THREADLOCAL void (*colfunc) (void);
 void (*basecolfunc) (void);
 void (*tlcolfunc) (void);
 void (*alttlcolfunc) (void);
@@ -642,13 +645,14 @@ void R_ExecuteSetViewSize (void)
 
     if (!detailshift)
     {
-        colfunc = basecolfunc = R_DrawColumn;
+        // [JN] Walls, masked textures and sprites are drawn four columns at a time.
+        colfunc = basecolfunc = vanillaparm ? R_DrawColumn : R_QueueColumn;
         tlcolfunc = R_DrawTLColumn;
         alttlcolfunc = R_DrawAltTLColumn;
         extratlcolfunc = R_DrawExtraTLColumn;
         transcolfunc = R_DrawTranslatedColumn;
         transtlcolfunc = R_DrawTranslatedTLColumn;
-        spanfunc = R_DrawSpan;
+        spanfunc = prelit_flats ? R_DrawSpanLit : R_DrawSpan;
     }
     else
     {
@@ -778,10 +782,8 @@ void R_Init (void)
         lookdirs = LOOKDIRS;
     }
 
-    R_InitClipSegs ();
     R_InitSpritesRes ();
     R_InitPlanesRes ();
-    R_InitVisplanesRes ();
 
     R_InitData();
     // viewwidth / viewheight  are set by the defaults
@@ -931,7 +933,6 @@ static void R_SetupFrame (player_t *player)
     if (player->fixedcolormap)
     {
         fixedcolormap = colormaps + player->fixedcolormap * 256 * sizeof(lighttable_t);
-        walllights = scalelightfixed;
 
         for (int i = 0 ; i < MAXLIGHTSCALE ; i++)
         {
@@ -987,28 +988,141 @@ void R_ClearStats (void)
 /*
 ================================================================================
 =
-= R_RenderView
+= View strips
+=
+= [JN] See viewstrip_t.
 =
 ================================================================================
 */
 
-void R_RenderPlayerView (player_t *player)
+viewstrip_t strips[MAXTHREADS];
+int numstrips;
+THREADLOCAL viewstrip_t *curstrip;
+
+/*
+================================================================================
+=
+= R_BindStrip
+=
+= [JN] Makes the given strip current for the calling thread.
+=
+================================================================================
+*/
+
+void R_BindStrip (int slice)
 {
-    R_SetupFrame(player);
+    curstrip = &strips[slice];
+    colfunc = basecolfunc;
+}
+
+/*
+================================================================================
+=
+= R_SetupStrips
+=
+= [JN] Splits the view into one strip per thread,
+= and makes sure strip arrays are big enough for the level.
+=
+================================================================================
+*/
+
+static void R_SetupStrips (void)
+{
+    numstrips = I_NumThreads();
+
+    for (int i = 0 ; i < numstrips ; i++)
+    {
+        viewstrip_t *const strip = &strips[i];
+
+        strip->left = viewwidth * i / numstrips;
+        strip->right = viewwidth * (i + 1) / numstrips - 1;
+
+        if (strip->width != screenwidth)
+        {
+            strip->width = screenwidth;
+            strip->solidcol = I_Realloc(strip->solidcol, screenwidth * sizeof(*strip->solidcol));
+            strip->floorclip = I_Realloc(strip->floorclip, screenwidth * sizeof(*strip->floorclip));
+            strip->ceilingclip = I_Realloc(strip->ceilingclip, screenwidth * sizeof(*strip->ceilingclip));
+        }
+
+        if (strip->numnodes < numnodes)
+        {
+            strip->numnodes = numnodes;
+            strip->nodeframe = I_Realloc(strip->nodeframe, numnodes * sizeof(*strip->nodeframe));
+            memset(strip->nodeframe, 0, numnodes * sizeof(*strip->nodeframe));
+        }
+
+        if (strip->numsubsectors < numsubsectors)
+        {
+            strip->numsubsectors = numsubsectors;
+            strip->subsectorframe = I_Realloc(strip->subsectorframe, numsubsectors * sizeof(*strip->subsectorframe));
+            memset(strip->subsectorframe, 0, numsubsectors * sizeof(*strip->subsectorframe));
+        }
+
+        if (strip->freehead == NULL)
+        {
+            strip->freehead = &strip->freetail;
+        }
+
+        strip->validcount++;
+        strip->nummapped = 0;
+        strip->segs = 0;
+    }
+}
+
+/*
+================================================================================
+=
+= R_RenderStrip
+=
+= [JN] Walks the BSP tree and draws walls of one strip, marking visplanes.
+=
+================================================================================
+*/
+
+static void R_RenderStrip (const int slice, const int numslices, void *data)
+{
+    R_BindStrip(slice);
 
     // Clear buffers.
     R_ClearClipSegs();
     R_ClearDrawSegs();
+    R_ClearPlanes();
+
+    R_RenderBSPNode(numnodes - 1);  // head node is the last node output
+}
+
+/*
+================================================================================
+=
+= R_RenderView
+=
+= [JN] The view is rendered in strips, one per thread. Everything that is
+= shared by the strips, i.e. sectors, polyobjects, lines, sprites and lumps,
+= is prepared or applied here, on the main thread, so strips are only
+= reading it.
+=
+================================================================================
+*/
+
+void R_RenderPlayerView (player_t *player)
+{
+    R_SetupFrame(player);
+    R_SetupStrips();
+
+    // [AM] Interpolate sector movement before the strips walk the BSP tree.
+    R_InterpolateSectors();
+
     if (automapactive && !automap_overlay)
     {
-        R_RenderBSPNode (numnodes-1);
+        I_RunThreads(R_RenderStrip, NULL);
+        R_MarkMappedLines();
         return;
     }
 
     // [JN] Fill level's "out of bounds" with black color.
     V_DrawFilledBox(viewwindowx, viewwindowy, scaledviewwidth, scaledviewheight, 0);
 
-    R_ClearPlanes();
     R_ClearSprites();
 
     // [crispy] Interpolate polyobjects here
@@ -1023,25 +1137,39 @@ void R_RenderPlayerView (player_t *player)
         R_SmoothTextureScrolling();      
     }
 
+    M_PerfStart(PERF_BSP);
+    I_RunThreads(R_RenderStrip, NULL);
+    R_MarkMappedLines();
+
     // Make displayed player invisible locally
     if (localQuakeHappening[displayplayer] && gamestate == GS_LEVEL)
     {
         players[displayplayer].mo->flags2 |= MF2_DONTDRAW;
-        R_RenderBSPNode(numnodes - 1);  // head node is the last node output
+        R_AddBSPSprites(numnodes - 1);
         players[displayplayer].mo->flags2 &= ~MF2_DONTDRAW;
     }
     else
     {
-        R_RenderBSPNode(numnodes - 1);  // head node is the last node output
+        R_AddBSPSprites(numnodes - 1);
+    }
+
+    M_PerfStop(PERF_BSP);
+    for (int i = 0 ; i < numstrips ; i++)
+    {
+        rendered_segs += strips[i].segs;
     }
 
     // Check for new console commands.
     NetUpdate();
+    M_PerfStart(PERF_PLANES);
     R_DrawPlanes();
+    M_PerfStop(PERF_PLANES);
     
     // Check for new console commands.
     NetUpdate();
+    M_PerfStart(PERF_MASKED);
     R_DrawMasked();
+    M_PerfStop(PERF_MASKED);
     
     // Check for new console commands.
     NetUpdate();
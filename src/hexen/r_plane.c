@@ -20,6 +20,7 @@
 #include "h2def.h"
 #include "i_system.h"
 #include "r_local.h"
+#include "i_thread.h"
 #include "r_bmaps.h"
 #include "r_swirl.h"
 #include "v_video.h"
@@ -46,8 +47,8 @@ fixed_t Sky2SmoothScrollDelta;
 // [JN] Smooth plane scrolling.
 fixed_t FlatScrollFactor_X, FlatScrollFactor_X_old;
 fixed_t FlatScrollFactor_Y, FlatScrollFactor_Y_old;
-static fixed_t FlatScrollDelta_X;
-static fixed_t FlatScrollDelta_Y;
+static THREADLOCAL fixed_t FlatScrollDelta_X;
+static THREADLOCAL fixed_t FlatScrollDelta_Y;
 
 #define FLAT_SCROLL_SLOW  0.5;
 #define FLAT_SCROLL_FAST  2.0;
@@ -63,13 +64,13 @@ static fixed_t FlatScrollDelta_Y;
 =
 = Lee Killough
 =
+= [JN] Visplane hash tables, free lists, openings and clipping arrays are
+= kept by every view strip, see viewstrip_t.
+=
 ================================================================================
 */
 
-static visplane_t  *visplanes[MAXVISPLANES];   // [JN] killough
-static visplane_t  *freetail;                  // [JN] killough
-static visplane_t **freehead = &freetail;      // [JN] killough
-visplane_t         *floorplane, *ceilingplane;
+THREADLOCAL visplane_t *floorplane, *ceilingplane;
 
 // [JN] killough -- hash function for visplanes
 // Empirically verified to be fairly uniform:
@@ -77,32 +78,25 @@ visplane_t         *floorplane, *ceilingplane;
 #define visplane_hash(picnum, lightlevel, height) \
     ((unsigned int)((picnum) * 3 + (lightlevel) + (height) * 7) & (MAXVISPLANES - 1))
 
-// [JN] killough 8/1/98: set static number of openings to be large enough
-// (a static limit is okay in this case and avoids difficulties in r_segs.c)
-
-size_t  maxopenings;
-int    *openings, *lastopening;  // [crispy] 32-bit integer math   
-
-// Clip values are the solid pixel bounding the range.
-// floorclip start out SCREENHEIGHT, ceilingclip starts out -1
-// [JN] e6y: resolution limitation is removed
-
-int *floorclip = NULL;    // dropoff overflow
-int *ceilingclip = NULL;  // dropoff overflow
-
 // Spanstart holds the start of a plane span, initialized to 0.
-// [JN] e6y: resolution limitation is removed
+// [JN] Span and texture mapping state is thread local,
+// every thread draws its own vertical strip of planes.
 
-static int *spanstart = NULL;  // killough 2/8/98
+static THREADLOCAL int spanstart[MAXHEIGHT];  // killough 2/8/98
 
 // Texture mapping
 
-static lighttable_t **planezlight;
-static fixed_t planeheight;
-static fixed_t cachedheight[MAXHEIGHT];
-static fixed_t cacheddistance[MAXHEIGHT];
-static fixed_t cachedxstep[MAXHEIGHT];
-static fixed_t cachedystep[MAXHEIGHT];
+static THREADLOCAL lighttable_t **planezlight;
+static THREADLOCAL fixed_t planeheight;
+static THREADLOCAL fixed_t cachedheight[MAXHEIGHT];
+static THREADLOCAL fixed_t cacheddistance[MAXHEIGHT];
+static THREADLOCAL fixed_t cachedxstep[MAXHEIGHT];
+static THREADLOCAL fixed_t cachedystep[MAXHEIGHT];
+
+// [JN] Sky columns of current frame, looked up by R_DrawPlanes.
+// Each sky visplane gets its own part of this buffer.
+static const byte **skycolumns = NULL;
+static int numskycolumns = 0;
 
 // [JN] e6y: resolution limitation is removed
 fixed_t *yslope = NULL;
@@ -124,18 +118,6 @@ extern boolean isPSX;
 
 void R_InitPlanesRes (void)
 {
-    if (floorclip)
-    {
-        free(floorclip);
-    }
-    if (ceilingclip)
-    {
-        free(ceilingclip);
-    }
-    if (spanstart)
-    {
-        free(spanstart);
-    }
     if (yslope)
     {
         free(yslope);
@@ -145,32 +127,10 @@ void R_InitPlanesRes (void)
         free(distscale);
     }
 
-    floorclip = calloc(1, screenwidth * sizeof(*floorclip));
-    ceilingclip = calloc(1, screenwidth * sizeof(*ceilingclip));
-    spanstart = calloc(1, screenwidth * sizeof(*spanstart));
-    yslope = calloc(1, screenwidth * sizeof(*yslope));
+    yslope= calloc(1, screenwidth * sizeof(*yslope));
     distscale = calloc(1, screenwidth * sizeof(*distscale));
 }
 
-/*
-================================================================================
-=
-= R_InitVisplanesRes
-=
-================================================================================
-*/
-
-void R_InitVisplanesRes (void)
-{
-    freetail = NULL;
-    freehead = &freetail;
-
-    for (int i = 0; i < MAXVISPLANES; i++)
-    {
-        visplanes[i] = 0;
-    }
-}
-
 /*
 ================================================================================
 =
@@ -298,23 +258,22 @@ void R_MapPlane (int y, int x1, int x2)
 
 void R_ClearPlanes (void)
 {
+    viewstrip_t *const strip = curstrip;
     int i;
 
     // opening / clipping determination
-    for (i = 0; i < viewwidth; i++)
+    // floorclip starts out SCREENHEIGHT, ceilingclip starts out -1
+    for (i = strip->left; i <= strip->right; i++)
     {
-        floorclip[i] = viewheight;
-        ceilingclip[i] = -1;
+        strip->floorclip[i] = viewheight;
+        strip->ceilingclip[i] = -1;
     }
 
     for (i = 0; i < MAXVISPLANES; i++)
-        for (*freehead = visplanes[i], visplanes[i] = NULL; *freehead; )
-            freehead = &(*freehead)->next;
-
-    lastopening = openings;
+        for (*strip->freehead = strip->visplanes[i], strip->visplanes[i] = NULL; *strip->freehead; )
+            strip->freehead = &(*strip->freehead)->next;
 
-    // texture calculation
-    memset(cachedheight, 0, sizeof(cachedheight));
+    strip->lastopening = strip->openings;
 }
 
 /*
@@ -330,18 +289,19 @@ void R_ClearPlanes (void)
 
 static visplane_t *new_visplane(unsigned int hash)
 {
-    visplane_t *check = freetail;
+    viewstrip_t *const strip = curstrip;
+    visplane_t *check = strip->freetail;
 
     if (!check)
     {
         check = calloc(1, sizeof(*check));
     }
-    else if (!(freetail = freetail->next))
+    else if (!(strip->freetail = strip->freetail->next))
     {
-        freehead = &freetail;
+        strip->freehead = &strip->freetail;
     }
-    check->next = visplanes[hash];
-    visplanes[hash] = check;
+    check->next = strip->visplanes[hash];
+    strip->visplanes[hash] = check;
     return check;
 }
 
@@ -368,7 +328,7 @@ visplane_t *R_FindPlane(fixed_t height, int picnum, int lightlevel, int special)
     // New visplane algorithm uses hash table -- killough
     hash = visplane_hash(picnum, lightlevel, height);
 
-    for (check = visplanes[hash]; check; check = check->next)
+    for (check = curstrip->visplanes[hash]; check; check = check->next)
         if (height == check->height && picnum == check->picnum
         && lightlevel == check->lightlevel && special == check->special)
             return check;
@@ -382,7 +342,9 @@ visplane_t *R_FindPlane(fixed_t height, int picnum, int lightlevel, int special)
     check->minx = screenwidth;
     check->maxx = -1;
 
-    memset(check->top, 0xff, sizeof(check->top));
+    // [JN] Only columns of the strip are ever looked at.
+    memset(check->top + curstrip->left, 0xff,
+           (curstrip->right - curstrip->left + 1) * sizeof(*check->top));
 
     return (check);
 }
@@ -406,7 +368,7 @@ visplane_t *R_DupPlane (const visplane_t *pl, int start, int stop)
     new_pl->minx = start;
     new_pl->maxx = stop;
 
-    for (int i = 0; i != screenwidth; i++)
+    for (int i = curstrip->left; i <= curstrip->right; i++)
     {
         new_pl->top[i] = SHRT_MAX;
     }
@@ -498,9 +460,32 @@ static void R_MakeSpans (int x, unsigned int t1, unsigned int b1, // [crispy] 32
 /*
 ================================================================================
 =
-= R_DrawPlanes
+= R_DrawPlaneColumns
 =
-= At the end of each frame.
+= [JN] Draws columns x1...x2 of a plane. Columns outside of given range
+= are treated as empty, so a plane can be split between several threads.
+=
+================================================================================
+*/
+
+static void R_DrawPlaneColumns (const visplane_t *pl, const int x1, const int x2)
+{
+    R_MakeSpans(x1, UINT_MAX, 0, pl->top[x1], pl->bottom[x1]);
+
+    for (int x = x1 + 1 ; x <= x2 ; x++)
+    {
+        R_MakeSpans(x, pl->top[x-1], pl->bottom[x-1], pl->top[x], pl->bottom[x]);
+    }
+
+    R_MakeSpans(x2 + 1, pl->top[x2], pl->bottom[x2], UINT_MAX, 0);
+}
+
+/*
+================================================================================
+=
+= R_DrawPlanesSlice
+=
+= [JN] Draws visplanes of one view strip.
 = [JN] Emulate PSX double sky drawing with translucent foreground texture.
 = TODO - PSX MAPINFO lump should be changed to:
 =        SKY1: Foreground/translucent.
@@ -509,23 +494,25 @@ static void R_MakeSpans (int x, unsigned int t1, unsigned int b1, // [crispy] 32
 ================================================================================
 */
 
-void R_DrawPlanes(void)
+static void R_DrawPlanesSlice (const int slice, const int numslices, void *data)
 {
+    const viewstrip_t *strip = &strips[slice];
     visplane_t *pl;
-    int         i, x, stop;
-    int         light, angle, angle2;
-    int         offset, skyTexture, offset2, skyTexture2;
+    int         i, x, x1, x2;
     int         heightmask;
     int         count, frac, fracstep = (FRACUNIT >> !detailshift) >> quadres;
-    byte       *source, *source2, *tempSource;
+    const byte *source, *source2;
     byte       *dest, *dest1, *dest2, *dest3, *dest4;
 
     extern byte *ylookup[MAXHEIGHT];
     extern int columnofs[MAXWIDTH];
 
+    // texture calculation
+    memset(cachedheight, 0, sizeof(cachedheight));
+
     for (i = 0 ; i < MAXVISPLANES ; i++)
-    for (pl = visplanes[i] ; pl ; pl = pl->next, rendered_visplanes++)
-    if (pl->minx <= pl->maxx)
+    for (pl = strip->visplanes[i] ; pl ; pl = pl->next)
+    if ((x1 = pl->minx) <= (x2 = pl->maxx))
     {
         //
         // Sky flat
@@ -535,12 +522,7 @@ void R_DrawPlanes(void)
             // Render 2 layers, sky 1 in front
             if (DoubleSky)
             {
-                offset = Sky1ColumnOffset >> 16;
-                skyTexture = texturetranslation[Sky1Texture];
-                offset2 = Sky2ColumnOffset >> 16;
-                skyTexture2 = texturetranslation[Sky2Texture];
-
-                for (x = pl->minx; x <= pl->maxx; x++)
+                for (x = x1; x <= x2; x++)
                 {
                     dc_yl = pl->top[x];
                     dc_yh = pl->bottom[x];
@@ -551,15 +533,8 @@ void R_DrawPlanes(void)
                         {
                             return;
                         }
-                        // [crispy] Optionally draw skies horizontally linear.
-                        angle = ((viewangle + (uncapped_fps ? Sky1SmoothScrollDelta : 0)
-                              + (linear_sky && !vanillaparm ? linearskyangle[x] : xtoviewangle[x])) ^ flip_levels) >> ANGLETOSKYSHIFT;
-
-                        angle2 = ((viewangle + (uncapped_fps ? Sky2SmoothScrollDelta : 0)
-                               + (linear_sky && !vanillaparm ? linearskyangle[x] : xtoviewangle[x])) ^ flip_levels) >> ANGLETOSKYSHIFT;
-
-                        source = R_GetColumn(skyTexture, angle + (uncapped_fps ? 0 : offset), false);
-                        source2 = R_GetColumn(skyTexture2, angle2 + (uncapped_fps ? 0 : offset2), false);
+                        source = pl->skycolumns[x - pl->minx];
+                        source2 = pl->skycolumns2[x - pl->minx];
                         frac = SKYTEXTUREMIDSHIFTED * FRACUNIT + (dc_yl - centery) * fracstep;
                         heightmask = SKYTEXTUREMIDSHIFTED-1;
 
@@ -719,20 +694,7 @@ void R_DrawPlanes(void)
             //
             else
             {
-                if (pl->special == 200)
-                {
-                    // Use sky 2
-                    offset = Sky2ColumnOffset >> 16;
-                    skyTexture = texturetranslation[Sky2Texture];
-                }
-                else
-                {
-                    // Use sky 1
-                    offset = Sky1ColumnOffset >> 16;
-                    skyTexture = texturetranslation[Sky1Texture];
-                }
-
-                for (x = pl->minx; x <= pl->maxx; x++)
+                for (x = x1; x <= x2; x++)
                 {
                     dc_yl = pl->top[x];
                     dc_yh = pl->bottom[x];
@@ -743,10 +705,7 @@ void R_DrawPlanes(void)
                         {
                             return;
                         }
-                        // [crispy] Optionally draw skies horizontally linear.
-                        angle = ((viewangle + (uncapped_fps ? Sky1SmoothScrollDelta : 0)
-                              + (linear_sky && !vanillaparm ? linearskyangle[x] : xtoviewangle[x])) ^ flip_levels) >> ANGLETOSKYSHIFT;
-                        source = R_GetColumn(skyTexture, angle + (uncapped_fps ? 0 : offset), false);
+                        source = pl->skycolumns[x - pl->minx];
                         frac = SKYTEXTUREMIDSHIFTED * FRACUNIT + (dc_yl - centery) * fracstep;
                         heightmask = SKYTEXTUREMIDSHIFTED-1;
 
@@ -852,144 +811,190 @@ void R_DrawPlanes(void)
         // Regular flat
         //
         else
+        {
+            ds_source = pl->source;
+            FlatScrollDelta_X = pl->scrollx;
+            FlatScrollDelta_Y = pl->scrolly;
+            planeheight = pl->planeheight;
+            planezlight = pl->zlight;
+
+            R_DrawPlaneColumns(pl, x1, x2);
+        }
+    }
+}
+
+/*
+================================================================================
+=
+= R_DrawPlanes
+=
+= At the end of each frame.
+= [JN] Flat data and sky columns are looked up here, on the main thread,
+= and every view strip draws own visplanes on its own thread.
+=
+================================================================================
+*/
+
+void R_DrawPlanes(void)
+{
+    visplane_t *pl;
+    int         s, i, x, light, angle;
+    int         offset, skyTexture, offset2, skyTexture2;
+    int         count = 0;
+
+    for (s = 0 ; s < numstrips ; s++)
+    for (i = 0 ; i < MAXVISPLANES ; i++)
+    for (pl = strips[s].visplanes[i] ; pl ; pl = pl->next, rendered_visplanes++)
+    if (pl->minx <= pl->maxx)
+    {
+        //
+        // Sky flat
+        //
+        if (pl->picnum == skyflatnum)
+        {
+            count += pl->maxx - pl->minx + 1;
+        }
+        //
+        // Regular flat
+        //
+        else
         {
             // [crispy] add support for SMMU swirling flats
-            tempSource = (flattranslation[pl->picnum] == -1) ?
-                          R_DistortedFlat(pl->picnum) :
-                          W_CacheLumpNum(firstflat + flattranslation[pl->picnum], PU_STATIC);
+            pl->source = (flattranslation[pl->picnum] == -1) ?
+                         (byte *) R_DistortedFlat(pl->picnum) :
+                         W_CacheLumpNum(firstflat + flattranslation[pl->picnum], PU_STATIC);
 
             // [JN] Handle smooth scrolling flats.
             switch (pl->special)
             {
                 // Scroll_North_xxx
                 case 201: case 202: case 203:
-                    FlatScrollDelta_X = 0;
-                    FlatScrollDelta_Y = FlatScrollFactor_Y;
+                    pl->scrollx = 0;
+                    pl->scrolly = FlatScrollFactor_Y;
                     if (pl->special == 201)  
                     {
-                        FlatScrollDelta_Y *= FLAT_SCROLL_SLOW;
+                        pl->scrolly *= FLAT_SCROLL_SLOW;
                     }
                     if (pl->special == 203)
                     {
-                        FlatScrollDelta_Y *= FLAT_SCROLL_FAST;
+                        pl->scrolly *= FLAT_SCROLL_FAST;
                     }
                 break;
 
                 // Scroll_East_xxx
                 case 204: case 205: case 206:
-                    FlatScrollDelta_X = -FlatScrollFactor_X;
-                    FlatScrollDelta_Y = 0;
+                    pl->scrollx = -FlatScrollFactor_X;
+                    pl->scrolly = 0;
                     if (pl->special == 204)  
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_SLOW;
+                        pl->scrollx *= FLAT_SCROLL_SLOW;
                     }
                     if (pl->special == 206)
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_FAST;
+                        pl->scrollx *= FLAT_SCROLL_FAST;
                     }
                 break;
 
                 // Scroll_South_xxx
                 case 207: case 208: case 209:
-                    FlatScrollDelta_X = 0;
-                    FlatScrollDelta_Y = -FlatScrollFactor_Y;
+                    pl->scrollx = 0;
+                    pl->scrolly = -FlatScrollFactor_Y;
                     if (pl->special == 207)  
                     {
-                        FlatScrollDelta_Y *= FLAT_SCROLL_SLOW;
+                        pl->scrolly *= FLAT_SCROLL_SLOW;
                     }
                     if (pl->special == 209)
                     {
-                        FlatScrollDelta_Y *= FLAT_SCROLL_FAST;
+                        pl->scrolly *= FLAT_SCROLL_FAST;
                     }
                 break;
 
                 // Scroll_West_xxx
                 case 210: case 211: case 212:
-                    FlatScrollDelta_X = FlatScrollFactor_X;
-                    FlatScrollDelta_Y = 0;
+                    pl->scrollx = FlatScrollFactor_X;
+                    pl->scrolly = 0;
                     if (pl->special == 210)  
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_SLOW;
+                        pl->scrollx *= FLAT_SCROLL_SLOW;
                     }
                     if (pl->special == 212)
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_FAST;
+                        pl->scrollx *= FLAT_SCROLL_FAST;
                     }
                 break;
 
                 // Scroll_NorthWest_xxx
                 case 213: case 214: case 215:
-                    FlatScrollDelta_X = FlatScrollFactor_X;
-                    FlatScrollDelta_Y = FlatScrollFactor_Y;
+                    pl->scrollx = FlatScrollFactor_X;
+                    pl->scrolly = FlatScrollFactor_Y;
                     if (pl->special == 213)  
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_SLOW;
-                        FlatScrollDelta_Y *= FLAT_SCROLL_SLOW;
+                        pl->scrollx *= FLAT_SCROLL_SLOW;
+                        pl->scrolly *= FLAT_SCROLL_SLOW;
                     }
                     if (pl->special == 215)
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_FAST;
-                        FlatScrollDelta_Y *= FLAT_SCROLL_FAST;
+                        pl->scrollx *= FLAT_SCROLL_FAST;
+                        pl->scrolly *= FLAT_SCROLL_FAST;
                     }
                 break;
 
                 // Scroll_NorthEast_xxx
                 case 216: case 217: case 218:
-                    FlatScrollDelta_X = -FlatScrollFactor_X;
-                    FlatScrollDelta_Y = FlatScrollFactor_Y;
+                    pl->scrollx = -FlatScrollFactor_X;
+                    pl->scrolly = FlatScrollFactor_Y;
 
                     if (pl->special == 216)  
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_SLOW;
-                        FlatScrollDelta_Y *= FLAT_SCROLL_SLOW;
+                        pl->scrollx *= FLAT_SCROLL_SLOW;
+                        pl->scrolly *= FLAT_SCROLL_SLOW;
                     }
                     if (pl->special == 218)
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_FAST;
-                        FlatScrollDelta_Y *= FLAT_SCROLL_FAST;
+                        pl->scrollx *= FLAT_SCROLL_FAST;
+                        pl->scrolly *= FLAT_SCROLL_FAST;
                     }
                 break;
 
                 // Scroll_SouthEast_xxx
                 case 219: case 220: case 221:
-                    FlatScrollDelta_X = -FlatScrollFactor_X;
-                    FlatScrollDelta_Y = -FlatScrollFactor_Y;
+                    pl->scrollx = -FlatScrollFactor_X;
+                    pl->scrolly = -FlatScrollFactor_Y;
                     if (pl->special == 219)  
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_SLOW;
-                        FlatScrollDelta_Y *= FLAT_SCROLL_SLOW;
+                        pl->scrollx *= FLAT_SCROLL_SLOW;
+                        pl->scrolly *= FLAT_SCROLL_SLOW;
                     }
                     if (pl->special == 221)
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_FAST;
-                        FlatScrollDelta_Y *= FLAT_SCROLL_FAST;
+                        pl->scrollx *= FLAT_SCROLL_FAST;
+                        pl->scrolly *= FLAT_SCROLL_FAST;
                     }
                 break;
 
                 // Scroll_SouthWest_xxx
                 case 222: case 223: case 224:
-                    FlatScrollDelta_X = FlatScrollFactor_X;
-                    FlatScrollDelta_Y = -FlatScrollFactor_Y;
+                    pl->scrollx = FlatScrollFactor_X;
+                    pl->scrolly = -FlatScrollFactor_Y;
                     if (pl->special == 222)  
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_SLOW;
-                        FlatScrollDelta_Y *= FLAT_SCROLL_SLOW;
+                        pl->scrollx *= FLAT_SCROLL_SLOW;
+                        pl->scrolly *= FLAT_SCROLL_SLOW;
                     }
                     if (pl->special == 224)
                     {
-                        FlatScrollDelta_X *= FLAT_SCROLL_FAST;
-                        FlatScrollDelta_Y *= FLAT_SCROLL_FAST;
+                        pl->scrollx *= FLAT_SCROLL_FAST;
+                        pl->scrolly *= FLAT_SCROLL_FAST;
                     }
                 break;
 
                 default:
-                    FlatScrollDelta_X = 0;
-                    FlatScrollDelta_Y = 0;
+                    pl->scrollx = 0;
+                    pl->scrolly = 0;
                 break;
             }
 
-            ds_source = tempSource;
-            planeheight = abs(pl->height - viewz);
+            pl->planeheight = abs(pl->height - viewz);
             light = (pl->lightlevel >> LIGHTSEGSHIFT) + extralight;
 
             if (light >= LIGHTLEVELS)
@@ -1001,20 +1006,78 @@ void R_DrawPlanes(void)
                 light = 0;
             }
 
-            stop = pl->maxx + 1;
-            planezlight = zlight[light];
-            pl->top[pl->minx-1] = pl->top[stop] = UINT_MAX; // [crispy] 32-bit integer math
-            
-            for (x = pl->minx ; x <= stop ; x++)
-            {
-                R_MakeSpans(x,pl->top[x-1], pl->bottom[x-1], pl->top[x], pl->bottom[x]);
-            }
+            pl->zlight = zlight[light];
+        }
+    }
 
-            // [crispy] add support for SMMU swirling flats
-            if (flattranslation[pl->picnum] != -1)
+    // [JN] Sky columns are looked up after all flats are cached,
+    // since single patch skies may be purged by any zone allocation.
+    if (count * 2 > numskycolumns)
+    {
+        numskycolumns = count * 2;
+        skycolumns = I_Realloc(skycolumns, numskycolumns * sizeof(*skycolumns));
+    }
+
+    count = 0;
+
+    for (s = 0 ; s < numstrips ; s++)
+    for (i = 0 ; i < MAXVISPLANES ; i++)
+    for (pl = strips[s].visplanes[i] ; pl ; pl = pl->next)
+    if (pl->minx <= pl->maxx && pl->picnum == skyflatnum)
+    {
+        // Render 2 layers, sky 1 in front
+        if (DoubleSky || pl->special != 200)
+        {
+            // Use sky 1
+            offset = Sky1ColumnOffset >> 16;
+            skyTexture = texturetranslation[Sky1Texture];
+        }
+        else
+        {
+            // Use sky 2
+            offset = Sky2ColumnOffset >> 16;
+            skyTexture = texturetranslation[Sky2Texture];
+        }
+        offset2 = Sky2ColumnOffset >> 16;
+        skyTexture2 = texturetranslation[Sky2Texture];
+
+        pl->skycolumns = skycolumns + count;
+        count += pl->maxx - pl->minx + 1;
+        pl->skycolumns2 = skycolumns + count;
+        count += pl->maxx - pl->minx + 1;
+
+        for (x = pl->minx; x <= pl->maxx; x++)
+        {
+            // [crispy] Optionally draw skies horizontally linear.
+            angle = ((viewangle + (uncapped_fps ? Sky1SmoothScrollDelta : 0)
+                  + (linear_sky && !vanillaparm ? linearskyangle[x] : xtoviewangle[x])) ^ flip_levels) >> ANGLETOSKYSHIFT;
+
+            pl->skycolumns[x - pl->minx] = R_GetColumn(skyTexture, angle + (uncapped_fps ? 0 : offset), false);
+
+            if (DoubleSky)
             {
-                W_ReleaseLumpNum(firstflat + flattranslation[pl->picnum]);
+                angle = ((viewangle + (uncapped_fps ? Sky2SmoothScrollDelta : 0)
+                      + (linear_sky && !vanillaparm ? linearskyangle[x] : xtoviewangle[x])) ^ flip_levels) >> ANGLETOSKYSHIFT;
+
+                pl->skycolumns2[x - pl->minx] = R_GetColumn(skyTexture2, angle + (uncapped_fps ? 0 : offset2), false);
             }
         }
     }
+
+    // [JN] Lit flat tiles from the previous frame are stale now.
+    litflatframe++;
+
+    I_RunThreads(R_DrawPlanesSlice, NULL);
+
+    for (s = 0 ; s < numstrips ; s++)
+    for (i = 0 ; i < MAXVISPLANES ; i++)
+    for (pl = strips[s].visplanes[i] ; pl ; pl = pl->next)
+    if (pl->minx <= pl->maxx && pl->picnum != skyflatnum)
+    {
+        // [crispy] add support for SMMU swirling flats
+        if (flattranslation[pl->picnum] != -1)
+        {
+            W_ReleaseLumpNum(firstflat + flattranslation[pl->picnum]);
+        }
+    }
 }
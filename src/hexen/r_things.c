@@ -22,6 +22,9 @@
 #include "h2def.h"
 #include "i_system.h"
 #include "i_swap.h"
+#include "i_thread.h"
+#include "i_timer.h"
+#include "m_cache.h"
 #include "r_bmaps.h"
 #include "r_local.h"
 #include "v_trans.h"
@@ -52,14 +55,18 @@ spritedef_t   *sprites;
 static spriteframe_t  sprtemp[30];
 
 // Initialization functions.
-int *mfloorclip, *mceilingclip;   // [crispy] 32-bit integer math
+THREADLOCAL int *mfloorclip, *mceilingclip;   // [crispy] 32-bit integer math
 
-fixed_t spryscale;
-int64_t sprtopscreen, sprbotscreen;  // [crispy] WiggleFix
+THREADLOCAL fixed_t spryscale;
+THREADLOCAL int64_t sprtopscreen, sprbotscreen;  // [crispy] WiggleFix
 
 static size_t num_vissprite, num_vissprite_alloc, num_vissprite_ptrs; // [JN] killough
 static vissprite_t *vissprites, **vissprite_ptrs;                     // [JN] killough
 
+// [JN] Player sprites, projected by R_AddPSprites.
+static vissprite_t pspritevis[NUMPSPRITES];
+static int numpspritevis;
+
 
 typedef struct drawseg_xrange_item_s
 {
@@ -74,12 +81,13 @@ typedef struct drawsegs_xrange_s
 } drawsegs_xrange_t;
 
 
+// [JN] Drawseg ranges are built by every strip for own drawsegs.
 #define DS_RANGES_COUNT 3
-static drawsegs_xrange_t drawsegs_xranges[DS_RANGES_COUNT];
+static THREADLOCAL drawsegs_xrange_t drawsegs_xranges[DS_RANGES_COUNT];
 
-static drawseg_xrange_item_t *drawsegs_xrange;
-static unsigned int drawsegs_xrange_size = 0;
-static int drawsegs_xrange_count = 0;
+static THREADLOCAL drawseg_xrange_item_t *drawsegs_xrange;
+static THREADLOCAL unsigned int drawsegs_xrange_size = 0;
+static THREADLOCAL int drawsegs_xrange_count = 0;
 
 
 /*
@@ -207,6 +215,104 @@ void R_InstallSpriteLump(int lump, unsigned frame, unsigned rotation, boolean fl
     sprtemp[frame].flip[rotation] = (byte) flipped;
 }
 
+/*
+================================================================================
+=
+= Startup cache of sprite definitions: the frame count of each sprite,
+= followed by the frames of all sprites. The key is the list of sprite
+= names.
+=
+================================================================================
+*/
+
+static byte *SpriteDefsKey (char **namelist, size_t *keylen)
+{
+    const int info[2] = {
+        firstspritelump, lastspritelump
+    };
+    byte *key;
+
+    *keylen = sizeof(info) + numsprites * 4;
+    key = Z_Malloc(*keylen, PU_STATIC, NULL);
+    memcpy(key, info, sizeof(info));
+
+    for (int i = 0 ; i < numsprites ; i++)
+    {
+        strncpy((char *) key + sizeof(info) + i * 4, namelist[i], 4);
+    }
+
+    return key;
+}
+
+static boolean LoadSpriteDefs (const byte *key, const size_t keylen)
+{
+    size_t length, numframes = 0;
+    int *data = M_LoadStartupCache("spritedefs", key, keylen, &length);
+    const spriteframe_t *frames;
+
+    if (data == NULL)
+    {
+        return false;
+    }
+
+    for (int i = 0 ; i < numsprites && length >= numsprites * sizeof(int) ; i++)
+    {
+        numframes += data[i] > 0 ? data[i] : 0;
+    }
+
+    if (length != numsprites * sizeof(int) + numframes * sizeof(spriteframe_t))
+    {
+        free(data);
+        return false;
+    }
+
+    frames = (const spriteframe_t *) (data + numsprites);
+
+    for (int i = 0 ; i < numsprites ; i++)
+    {
+        sprites[i].numframes = data[i];
+        sprites[i].spriteframes = NULL;
+
+        if (data[i] > 0)
+        {
+            sprites[i].spriteframes = Z_Malloc(data[i] * sizeof(spriteframe_t), PU_STATIC, NULL);
+            memcpy(sprites[i].spriteframes, frames, data[i] * sizeof(spriteframe_t));
+            frames += data[i];
+        }
+    }
+
+    free(data);
+    return true;
+}
+
+static void SaveSpriteDefs (const byte *key, const size_t keylen)
+{
+    size_t length = numsprites * sizeof(int);
+    byte *data, *p;
+
+    for (int i = 0 ; i < numsprites ; i++)
+    {
+        length += sprites[i].numframes * sizeof(spriteframe_t);
+    }
+
+    data = Z_Malloc(length, PU_STATIC, NULL);
+    p = data + numsprites * sizeof(int);
+
+    for (int i = 0 ; i < numsprites ; i++)
+    {
+        memcpy(data + i * sizeof(int), &sprites[i].numframes, sizeof(int));
+
+        if (sprites[i].numframes > 0)
+        {
+            memcpy(p, sprites[i].spriteframes, sprites[i].numframes * sizeof(spriteframe_t));
+            p += sprites[i].numframes * sizeof(spriteframe_t);
+        }
+    }
+
+    M_WriteStartupCache("spritedefs", key, keylen, data, length);
+    Z_Free(data);
+}
+
 /*
 ================================================================================
 =
@@ -229,6 +335,9 @@ void R_InitSpriteDefs(char **namelist)
     int    i, l, frame, rotation;
     int    start, end;
     char **check;
+    byte  *key;
+    size_t keylen;
+    const int starttime = I_GetTimeMS();
 
     // Count the number of sprite names.
     check = namelist;
@@ -245,6 +354,16 @@ void R_InitSpriteDefs(char **namelist)
     }
 
     sprites = Z_Malloc(numsprites * sizeof(*sprites), PU_STATIC, NULL);
+
+    key = SpriteDefsKey(namelist, &keylen);
+
+    if (LoadSpriteDefs(key, keylen))
+    {
+        Z_Free(key);
+        M_StartupTime("spritedefs", true, starttime);
+        return;
+    }
+
     start = firstspritelump - 1;
     end = lastspritelump + 1;
 
@@ -319,6 +438,10 @@ void R_InitSpriteDefs(char **namelist)
         sprites[i].spriteframes = Z_Malloc(maxframe * sizeof(spriteframe_t), PU_STATIC, NULL);
         memcpy(sprites[i].spriteframes, sprtemp, maxframe * sizeof(spriteframe_t));
     }
+
+    SaveSpriteDefs(key, keylen);
+    Z_Free(key);
+    M_StartupTime("spritedefs", false, starttime);
 }
 
 /*
@@ -458,19 +581,18 @@ void R_DrawMaskedColumn (column_t *column, signed int baseclip)
 = R_DrawVisSprite
 =
 = mfloorclip and mceilingclip should also be set.
+= [JN] Draws columns x1...x2 of the sprite, patch must be cached already.
 =
 ================================================================================
 */
 
-void R_DrawVisSprite (vissprite_t *vis, int x1, int x2)
+static void R_DrawVisSprite (const vissprite_t *vis, int x1, int x2)
 {
-    column_t *column;
-    int       texturecolumn;
-    fixed_t   frac;
-    patch_t  *patch;
-    fixed_t   baseclip;
-
-    patch = W_CacheLumpNum(vis->patch + firstspritelump, PU_CACHE);
+    column_t      *column;
+    int            texturecolumn;
+    fixed_t        frac;
+    const patch_t *patch = vis->patchdata;
+    fixed_t        baseclip;
 
     // [crispy] brightmaps for select sprites
     dc_colormap[0] = vis->colormap[0];
@@ -524,7 +646,7 @@ void R_DrawVisSprite (vissprite_t *vis, int x1, int x2)
 
     dc_iscale = abs(vis->xiscale) >> (detailshift && !hires);
     dc_texturemid = vis->texturemid;
-    frac = vis->startfrac;
+    frac = vis->startfrac + (x1 - vis->x1) * vis->xiscale;
     spryscale = vis->scale;
     sprtopscreen = centeryfrac - FixedMul(dc_texturemid, spryscale);
 
@@ -545,7 +667,7 @@ void R_DrawVisSprite (vissprite_t *vis, int x1, int x2)
         baseclip = -1;
     }
 
-    for (dc_x = vis->x1 ; dc_x <= vis->x2 ; dc_x++, frac += vis->xiscale)
+    for (dc_x = x1 ; dc_x <= x2 ; dc_x++, frac += vis->xiscale)
     {
         texturecolumn = frac >> FRACBITS;
 #ifdef RANGECHECK
@@ -554,10 +676,13 @@ void R_DrawVisSprite (vissprite_t *vis, int x1, int x2)
                             "R_DrawSpriteRange: bad texturecolumn" :
                             "R_DrawSpriteRange: некорректныая информация texturecolumn");
 #endif
-        column = (column_t *) ((byte *) patch + LONG(patch->columnofs[texturecolumn]));
+        column = (column_t *) ((const byte *) patch + LONG(patch->columnofs[texturecolumn]));
         R_DrawMaskedColumn(column, baseclip);
     }
 
+    // [JN] Write out last queued columns.
+    R_FlushColumns();
+
     colfunc = basecolfunc;
 }
 
@@ -1041,7 +1166,10 @@ static inline void R_ApplyWeaponBob (fixed_t *sx, boolean bobx, fixed_t *sy, boo
 /*
 ================================================================================
 =
-= R_DrawPSprite
+= R_ProjectPSprite
+=
+= [JN] Generates a vissprite for the player sprite,
+= it is drawn by every strip in R_DrawMaskedSlice.
 =
 ================================================================================
 */
@@ -1054,13 +1182,13 @@ static const int PSpriteSY[NUMCLASSES][NUMWEAPONS] = {
     {10 * FRACUNIT, 10 * FRACUNIT, 10 * FRACUNIT, 10 * FRACUNIT}        // Pig
 };
 
-void R_DrawPSprite(pspdef_t * psp)
+static void R_ProjectPSprite(pspdef_t * psp)
 {
     int            x1, x2;
     int            lump;
     fixed_t        tx;
     boolean        flip;
-    vissprite_t   *vis, avis;
+    vissprite_t   *vis;
     spritedef_t   *sprdef;
     spriteframe_t *sprframe;
     int tempangle;
@@ -1145,7 +1273,7 @@ void R_DrawPSprite(pspdef_t * psp)
     }
 
     // Store information in a vissprite.
-    vis = &avis;
+    vis = &pspritevis[numpspritevis++];
     vis->translation = NULL;
     vis->mobjflags = 0;
     vis->class = 0;
@@ -1261,19 +1389,20 @@ void R_DrawPSprite(pspdef_t * psp)
             skippsprinterp = false;
         }
     }
-
-    R_DrawVisSprite(vis, vis->x1, vis->x2);
 }
 
 /*
 ================================================================================
 =
-= R_DrawPlayerSprites
+= R_AddPSprites
+=
+= [JN] Projects the player sprites on the main thread,
+= weapon bobbing interpolation is not to be done twice.
 =
 ================================================================================
 */
 
-void R_DrawPlayerSprites(void)
+void R_AddPSprites(void)
 {
     int i, lightnum;
     pspdef_t *psp;
@@ -1294,19 +1423,22 @@ void R_DrawPlayerSprites(void)
         spritelights = scalelight[lightnum];
     }
 
-    // Clip to screen bounds.
-    mfloorclip = screenheightarray;
-    mceilingclip = negonearray;
+    numpspritevis = 0;
+
+    // Draw the psprites on top of everything, but does not draw on side views.
+    if (viewangleoffset)
+    {
+        return;
+    }
 
     // Add all active psprites
     for (i = 0, psp = viewplayer->psprites ; i < NUMPSPRITES ; i++, psp++)
     {
         if (psp->state)
         {
-            R_DrawPSprite(psp);
+            R_ProjectPSprite(psp);
         }
     }
-
 }
 
 /*
@@ -1402,16 +1534,19 @@ void R_SortVisSprites (void)
 =
 = R_DrawSprite
 =
+= [JN] Draws the sprite within x1...x2 columns, i.e. within current strip.
+= Clipping arrays are shared, as strips never touch columns of each other.
+=
 ================================================================================
 */
 
-static void R_DrawSprite (vissprite_t *spr)
+static void R_DrawSprite (const vissprite_t *spr, const int x1, const int x2)
 {
     int x, r1, r2;
     drawseg_t *ds;
     fixed_t scale, lowscale;
 
-    for (x = spr->x1 ; x<=spr->x2 ; x++)
+    for (x = x1 ; x<=x2 ; x++)
     {
         clipbot[x] = cliptop[x] = -2;
     }
@@ -1429,7 +1564,7 @@ static void R_DrawSprite (vissprite_t *spr)
         while (++curr <= last)
         {
             // determine if the drawseg obscures the sprite
-            if (curr->x1 > spr->x2 || curr->x2 < spr->x1)
+            if (curr->x1 > x2 || curr->x2 < x1)
             {
                 // does not cover sprite
                 continue;
@@ -1454,16 +1589,16 @@ static void R_DrawSprite (vissprite_t *spr)
                 // masked mid texture?
                 if (ds->maskedtexturecol)
                 {
-                    r1 = ds->x1 < spr->x1 ? spr->x1 : ds->x1;
-                    r2 = ds->x2 > spr->x2 ? spr->x2 : ds->x2;
+                    r1 = ds->x1 < x1 ? x1 : ds->x1;
+                    r2 = ds->x2 > x2 ? x2 : ds->x2;
                     R_RenderMaskedSegRange(ds, r1, r2);
                 }
                 // seg is behind sprite
                 continue;
             }
 
-            r1 = ds->x1 < spr->x1 ? spr->x1 : ds->x1;
-            r2 = ds->x2 > spr->x2 ? spr->x2 : ds->x2;
+            r1 = ds->x1 < x1 ? x1 : ds->x1;
+            r2 = ds->x2 > x2 ? x2 : ds->x2;
 
             // clip this piece of the sprite
             // [JN] killough 3/27/98: optimized and made much shorter
@@ -1482,7 +1617,7 @@ static void R_DrawSprite (vissprite_t *spr)
 
     // all clipping has been performed, so draw the sprite
     // check for unclipped columns
-    for (x = spr->x1 ; x<=spr->x2 ; x++)
+    for (x = x1 ; x<=x2 ; x++)
     {
         if (clipbot[x] == -2)
         {
@@ -1497,23 +1632,29 @@ static void R_DrawSprite (vissprite_t *spr)
 
     mfloorclip = clipbot;
     mceilingclip = cliptop;
-    R_DrawVisSprite (spr, spr->x1, spr->x2);
+    R_DrawVisSprite (spr, x1, x2);
 }
 
 /*
 ================================================================================
 =
-= R_DrawMasked
+= R_DrawMaskedSlice
+=
+= [JN] Draws sprites, masked mid textures and player sprites of one strip.
 =
 ================================================================================
 */
 
-void R_DrawMasked (void)
+static void R_DrawMaskedSlice (const int slice, const int numslices, void *data)
 {
+    const viewstrip_t *strip = &strips[slice];
+    const int left = strip->left;
+    const int right = strip->right;
+    const int middle = (left + right + 1) / 2;
     int        i;
     drawseg_t *ds;
 
-    R_SortVisSprites();
+    colfunc = basecolfunc;
 
     // [JN] e6y
     // Makes sense for scenes with huge amount of drawsegs.
@@ -1524,9 +1665,9 @@ void R_DrawMasked (void)
 
     if (num_vissprite > 0)
     {
-        if (drawsegs_xrange_size < maxdrawsegs)
+        if (drawsegs_xrange_size < strip->maxdrawsegs)
         {
-            drawsegs_xrange_size = 2 * maxdrawsegs;
+            drawsegs_xrange_size = 2 * strip->maxdrawsegs;
 
             for(i = 0; i < DS_RANGES_COUNT; i++)
             {
@@ -1536,7 +1677,7 @@ void R_DrawMasked (void)
             }
         }
 
-        for (ds = ds_p; ds-- > drawsegs;)
+        for (ds = strip->ds_p; ds-- > strip->drawsegs;)
         {
             if (ds->silhouette || ds->maskedtexturecol)
             {
@@ -1544,13 +1685,14 @@ void R_DrawMasked (void)
                 drawsegs_xranges[0].items[drawsegs_xranges[0].count].x2 = ds->x2;
                 drawsegs_xranges[0].items[drawsegs_xranges[0].count].user = ds;
 
-                if (ds->x1 < centerx)
+                // [JN] Split at the middle of the strip, not of the view.
+                if (ds->x1 < middle)
                 {
                     drawsegs_xranges[1].items[drawsegs_xranges[1].count] = 
                     drawsegs_xranges[0].items[drawsegs_xranges[0].count];
                     drawsegs_xranges[1].count++;
                 }
-                if (ds->x2 >= centerx)
+                if (ds->x2 >= middle)
                 {
                     drawsegs_xranges[2].items[drawsegs_xranges[2].count] = 
                     drawsegs_xranges[0].items[drawsegs_xranges[0].count];
@@ -1563,17 +1705,23 @@ void R_DrawMasked (void)
     }
 
     // Draw all vissprites back to front.
-    rendered_vissprites = num_vissprite;
     for (i = num_vissprite ; --i>=0 ; )
     {
-        vissprite_t* spr = vissprite_ptrs[i];
+        const vissprite_t *spr = vissprite_ptrs[i];
+        const int x1 = MAX(spr->x1, left);
+        const int x2 = MIN(spr->x2, right);
+
+        if (x1 > x2)
+        {
+            continue;
+        }
 
-        if (spr->x2 < centerx)
+        if (x2 < middle)
         {
             drawsegs_xrange = drawsegs_xranges[1].items;
             drawsegs_xrange_count = drawsegs_xranges[1].count;
         }
-        else if (spr->x1 >= centerx)
+        else if (x1 >= middle)
         {
             drawsegs_xrange = drawsegs_xranges[2].items;
             drawsegs_xrange_count = drawsegs_xranges[2].count;
@@ -1584,20 +1732,96 @@ void R_DrawMasked (void)
             drawsegs_xrange_count = drawsegs_xranges[0].count;
         }
 
-        R_DrawSprite(vissprite_ptrs[i]);
+        R_DrawSprite(spr, x1, x2);
     }
 
     // Modified by Lee Killough:
     // (pointer check was originally nonportable
     // and buggy, by going past LEFT end of array):
-    for (ds = ds_p ; ds-- > drawsegs ; )
+    for (ds = strip->ds_p ; ds-- > strip->drawsegs ; )
         if (ds->maskedtexturecol)
             R_RenderMaskedSegRange(ds, ds->x1, ds->x2);
 
+    // Draw the psprites on top of everything.
+    // Clip to screen bounds.
+    mfloorclip = screenheightarray;
+    mceilingclip = negonearray;
+
+    for (i = 0 ; i < numpspritevis ; i++)
+    {
+        const vissprite_t *vis = &pspritevis[i];
+        const int x1 = MAX(vis->x1, left);
+        const int x2 = MIN(vis->x2, right);
 
-    // Draw the psprites on top of everything, but does not draw on side views.
-    if (!viewangleoffset)
+        if (x1 <= x2)
+        {
+            R_DrawVisSprite (vis, x1, x2);
+        }
+    }
+}
+
+/*
+================================================================================
+=
+= R_LockMaskedTextures
+=
+= [JN] Locks or releases patches of masked mid textures, seen by the strips.
+=
+================================================================================
+*/
+
+static void R_LockMaskedTextures (const boolean lock)
+{
+    for (int s = 0 ; s < numstrips ; s++)
+    {
+        for (const drawseg_t *ds = strips[s].drawsegs ; ds < strips[s].ds_p ; ds++)
+        {
+            if (ds->maskedtexturecol)
+            {
+                R_LockTexturePatches(texturetranslation[ds->curline->sidedef->midtexture], lock);
+            }
+        }
+    }
+}
+
+/*
+================================================================================
+=
+= R_DrawMasked
+=
+= [JN] Sprites are sorted and their patches are cached on the main
+= thread, and every view strip draws own part of them on its own thread.
+=
+================================================================================
+*/
+
+void R_DrawMasked (void)
+{
+    int i;
+
+    R_SortVisSprites();
+    R_AddPSprites();
+
+    for (i = 0 ; i < (int)num_vissprite ; i++)
+    {
+        vissprites[i].patchdata = W_CacheLumpNum(vissprites[i].patch + firstspritelump, PU_STATIC);
+    }
+    for (i = 0 ; i < numpspritevis ; i++)
+    {
+        pspritevis[i].patchdata = W_CacheLumpNum(pspritevis[i].patch + firstspritelump, PU_STATIC);
+    }
+    R_LockMaskedTextures(true);
+
+    rendered_vissprites = num_vissprite;
+    I_RunThreads(R_DrawMaskedSlice, NULL);
+
+    for (i = 0 ; i < (int)num_vissprite ; i++)
+    {
+        W_ReleaseLumpNum(vissprites[i].patch + firstspritelump);
+    }
+    for (i = 0 ; i < numpspritevis ; i++)
     {
-        R_DrawPlayerSprites ();
+        W_ReleaseLumpNum(pspritevis[i].patch + firstspritelump);
     }
+    R_LockMaskedTextures(false);
 }
@@ -23,6 +23,7 @@
 #include "h2def.h"
 #include "i_system.h"
 #include "m_misc.h"
+#include "m_savebuf.h"
 #include "i_swap.h"
 #include "p_local.h"
 #include "am_map.h"
@@ -36,6 +37,7 @@
 #define BASE_SLOT 7
 #define REBORN_SLOT 8
 #define REBORN_DESCRIPTION "TEMP GAME"
+#define GAME_RAW_LENGTH (HXS_DESCRIPTION_LENGTH + HXS_VERSION_TEXT_LENGTH)
 #define MAX_THINKER_SIZE 256
 
 // TYPES -------------------------------------------------------------------
@@ -88,6 +90,14 @@ typedef struct
     sector_t *sector;
 } ssthinker_t;
 
+// [JN] The archives of a save slot: the game file and one file per
+// visited map of the hub, kept deflated in memory.
+typedef struct
+{
+    savebuf_t game;
+    savebuf_t maps[MAX_MAPS + 1];
+} hubslot_t;
+
 // EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
 
 void P_SpawnPlayer(mapthing_t * mthing);
@@ -123,11 +133,16 @@ static void RestoreSSThinker(thinker_t *sst);
 static void RestorePlatRaise(thinker_t *thinker);
 static void RestoreMoveCeiling(thinker_t *thinker);
 static void AssertSegment(gameArchiveSegment_t segType);
-static void CopySaveSlot(int sourceSlot, int destSlot);
-static void CopyFile(char *sourceName, char *destName);
-static boolean ExistingFile(char *name);
-static void SV_OpenRead(char *fileName);
-static void SV_OpenWrite(char *fileName);
+static hubslot_t *MemorySlot(int slot);
+static void ClearHubSlot(hubslot_t *hub);
+static void CopyHubSlot(hubslot_t *dest, const hubslot_t *source);
+static void ReadSaveSlot(int slot, hubslot_t *hub);
+static void WriteArchive(const savebuf_t *archive, char *fileName,
+                         size_t rawLength);
+static void WriteSaveSlot(const hubslot_t *hub, int slot);
+static void SV_OpenRead(const savebuf_t *archive, size_t rawLength);
+static void SV_OpenWrite(void);
+static void SV_CloseWrite(savebuf_t *archive, size_t rawLength);
 static void SV_Close(void);
 static void SV_Read(void *buffer, int size);
 static byte SV_ReadByte(void);
@@ -157,7 +172,9 @@ static mobj_t **MobjList;
 static mobj_t ***TargetPlayerAddrs;
 static int TargetPlayerCount;
 static boolean SavingPlayers;
-static FILE *SavingFP;
+static savebuf_t SavingBuf;
+static hubslot_t BaseSlot;
+static hubslot_t RebornSlot;
 
 // CODE --------------------------------------------------------------------
 
@@ -1981,13 +1998,12 @@ static void StreamOut_floorWaggle_t(thinker_t *thinker)
 
 void SV_SaveGame(int slot, char *description)
 {
-    char fileName[RD_MAX_PATH];
     char versionText[HXS_VERSION_TEXT_LENGTH];
     unsigned int i;
+    hubslot_t *dest;
 
     // Open the output file
-    M_snprintf(fileName, sizeof(fileName), "%shexen-save-7.sav", SavePath);
-    SV_OpenWrite(fileName);
+    SV_OpenWrite();
 
     // Write game save description
     SV_Write(description, HXS_DESCRIPTION_LENGTH);
@@ -2021,16 +2037,22 @@ void SV_SaveGame(int slot, char *description)
     SV_WriteLong(ASEG_END);
 
     // Close the output file
-    SV_Close();
+    SV_CloseWrite(&BaseSlot.game, GAME_RAW_LENGTH);
 
     // Save out the current map
     SV_SaveMap(true);           // true = save player info
 
-    // Clear all save files at destination slot
-    SV_ClearSaveSlot(slot);
-
-    // Copy base slot to destination slot
-    CopySaveSlot(BASE_SLOT, slot);
+    // Copy base slot to destination slot. [JN] Only the slots shown in
+    // the menus are written to disk, in the background.
+    dest = MemorySlot(slot);
+    if (dest != NULL)
+    {
+        CopyHubSlot(dest, &BaseSlot);
+    }
+    else
+    {
+        WriteSaveSlot(&BaseSlot, slot);
+    }
 }
 
 //==========================================================================
@@ -2041,13 +2063,10 @@ void SV_SaveGame(int slot, char *description)
 
 void SV_SaveMap(boolean savePlayers)
 {
-    char fileName[RD_MAX_PATH];
-
     SavingPlayers = savePlayers;
 
     // Open the output file
-    M_snprintf(fileName, sizeof(fileName), "%shexen-save-7%02d.sav", SavePath, gamemap);
-    SV_OpenWrite(fileName);
+    SV_OpenWrite();
 
     // Place a header marker
     SV_WriteLong(ASEG_MAP_HEADER);
@@ -2071,7 +2090,7 @@ void SV_SaveMap(boolean savePlayers)
     SV_WriteLong(ASEG_END);
 
     // Close the output file
-    SV_Close();
+    SV_CloseWrite(&BaseSlot.maps[gamemap], 0);
 }
 
 //==========================================================================
@@ -2083,26 +2102,30 @@ void SV_SaveMap(boolean savePlayers)
 void SV_LoadGame(int slot)
 {
     int i;
-    char fileName[RD_MAX_PATH];
     char version_text[HXS_VERSION_TEXT_LENGTH];
     player_t playerBackup[MAXPLAYERS];
     mobj_t *mobj;
+    hubslot_t *source;
 
     // Copy all needed save files to the base slot
     if (slot != BASE_SLOT)
     {
-        SV_ClearSaveSlot(BASE_SLOT);
-        CopySaveSlot(slot, BASE_SLOT);
+        source = MemorySlot(slot);
+        if (source != NULL)
+        {
+            CopyHubSlot(&BaseSlot, source);
+        }
+        else
+        {
+            ReadSaveSlot(slot, &BaseSlot);
+        }
     }
 
-    // Create the name
-    M_snprintf(fileName, sizeof(fileName), "%shexen-save-7.sav", SavePath);
-
     // Load the file
-    SV_OpenRead(fileName);
+    SV_OpenRead(&BaseSlot.game, GAME_RAW_LENGTH);
 
     // Set the save pointer and skip the description field
-    fseek(SavingFP, HXS_DESCRIPTION_LENGTH, SEEK_CUR);
+    SavingBuf.pos += MIN(HXS_DESCRIPTION_LENGTH, SavingBuf.size);
 
     // Check the version text
 
@@ -2112,6 +2135,7 @@ void SV_LoadGame(int slot)
     }
     if (strncmp(version_text, HXS_VERSION_TEXT, HXS_VERSION_TEXT_LENGTH) != 0)
     {                           // Bad version
+        SV_Close();
         return;
     }
 
@@ -2186,8 +2210,7 @@ void SV_LoadGame(int slot)
 
 void SV_UpdateRebornSlot(void)
 {
-    SV_ClearSaveSlot(REBORN_SLOT);
-    CopySaveSlot(BASE_SLOT, REBORN_SLOT);
+    CopyHubSlot(&RebornSlot, &BaseSlot);
 }
 
 //==========================================================================
@@ -2211,7 +2234,6 @@ void SV_MapTeleport(int map, int position)
 {
     int i;
     int j;
-    char fileName[RD_MAX_PATH];
     player_t playerBackup[MAXPLAYERS];
     mobj_t *targetPlayerMobj;
     mobj_t *mobj;
@@ -2253,8 +2275,7 @@ void SV_MapTeleport(int map, int position)
     TargetPlayerAddrs = NULL;
 
     gamemap = map;
-    M_snprintf(fileName, sizeof(fileName), "%shexen-save-7%02d.sav", SavePath, gamemap);
-    if (!deathmatch && ExistingFile(fileName))
+    if (!deathmatch && BaseSlot.maps[gamemap].size > 0)
     {                           // Unarchive map
         SV_LoadMap();
     }
@@ -2401,10 +2422,7 @@ int SV_GetRebornSlot(void)
 
 boolean SV_RebornSlotAvailable(void)
 {
-    char fileName[RD_MAX_PATH];
-
-    M_snprintf(fileName, sizeof(fileName), "%shexen-save-%d.sav", SavePath, REBORN_SLOT);
-    return ExistingFile(fileName);
+    return RebornSlot.game.size > 0;
 }
 
 //==========================================================================
@@ -2415,19 +2433,14 @@ boolean SV_RebornSlotAvailable(void)
 
 void SV_LoadMap(void)
 {
-    char fileName[RD_MAX_PATH];
-
     // Load a base level
     G_InitNew(gameskill, gameepisode, gamemap);
 
     // Remove all thinkers
     RemoveAllThinkers();
 
-    // Create the name
-    M_snprintf(fileName, sizeof(fileName), "%shexen-save-7%02d.sav", SavePath, gamemap);
-
     // Load the file
-    SV_OpenRead(fileName);
+    SV_OpenRead(&BaseSlot.maps[gamemap], 0);
 
     AssertSegment(ASEG_MAP_HEADER);
 
@@ -3337,6 +3350,17 @@ void SV_ClearSaveSlot(int slot)
 {
     int i;
     char fileName[RD_MAX_PATH];
+    hubslot_t *hub;
+
+    hub = MemorySlot(slot);
+    if (hub != NULL)
+    {
+        ClearHubSlot(hub);
+        return;
+    }
+
+    // [JN] Don't let a pending write bring a file back.
+    M_FinishSaveWrites();
 
     for (i = 0; i < MAX_MAPS + 1; i++)
     {
@@ -3356,162 +3380,167 @@ void SV_ClearSaveSlot(int slot)
 
 //==========================================================================
 //
-// CopySaveSlot
+// MemorySlot
 //
-// Copies all the save game files from one slot to another.
+// [JN] The base and reborn slots never leave memory, so crossing a hub
+// portal does not touch the disk. Returns NULL for the other slots.
 //
 //==========================================================================
 
-static void CopySaveSlot(int sourceSlot, int destSlot)
+static hubslot_t *MemorySlot(int slot)
 {
-    int i;
-    char sourceName[RD_MAX_PATH];
-    char destName[RD_MAX_PATH];
-
-    for (i = 0; i < MAX_MAPS; i++)
+    switch (slot)
     {
-        M_snprintf(sourceName, sizeof(sourceName),
-                   "%shexen-save-%d%02d.sav", SavePath, sourceSlot, i);
-        if (ExistingFile(sourceName))
-        {
-            M_snprintf(destName, sizeof(destName),
-                       "%shexen-save-%d%02d.sav", SavePath, destSlot, i);
-            CopyFile(sourceName, destName);
-        }
-    }
-    M_snprintf(sourceName, sizeof(sourceName),
-               "%shexen-save-%d.sav", SavePath, sourceSlot);
-    if (ExistingFile(sourceName))
-    {
-        M_snprintf(destName, sizeof(destName),
-                   "%shexen-save-%d.sav", SavePath, destSlot);
-        CopyFile(sourceName, destName);
+        case BASE_SLOT:
+            return &BaseSlot;
+        case REBORN_SLOT:
+            return &RebornSlot;
+        default:
+            return NULL;
     }
 }
 
 //==========================================================================
 //
-// CopyFile
+// ClearHubSlot
 //
-// This function was rewritten to copy files with minimal strain on zone
-// allocation and allow for big maps that technically work in vanilla to
-// save without error.
 //==========================================================================
 
-static void CopyFile(char *source_name, char *dest_name)
+static void ClearHubSlot(hubslot_t *hub)
 {
-    const int BUFFER_CHUNK_SIZE = 0x10000;
-
-    byte *buffer;
-    int /*file_length,*/ file_remaining;
-    FILE *read_handle, *write_handle;
-    int buf_count, read_count, write_count;
+    int i;
 
-    read_handle = M_fopen(source_name, "rb");
-    if (read_handle == NULL)
+    M_SaveBufFree(&hub->game);
+    for (i = 0; i < MAX_MAPS + 1; i++)
     {
-        I_QuitWithError(english_language ?
-                        "Could not load savegame %s" :
-                        "Невозможно прочитать файл %s",
-                        source_name);
+        M_SaveBufFree(&hub->maps[i]);
     }
-    /*file_length = */file_remaining = M_FileLength(read_handle);
+}
 
-    // Vanilla savegame emulation.
-    //
-    // CopyFile() typically calls M_ReadFile() which stores the entire file
-    // in memory: Chocolate Hexen should force an allocation error here
-    // whenever it's appropriate.
+//==========================================================================
+//
+// CopyHubSlot
+//
+// Copies all the archives from one memory slot to another.
+//
+//==========================================================================
 
-    // [JN] Лимит сохранения отключен
-    /*
-    if (vanilla_savegame_limit)
-    {
-        buffer = Z_Malloc(file_length, PU_STATIC, NULL);
-        Z_Free(buffer);
-    }
-    */
+static void CopyHubSlot(hubslot_t *dest, const hubslot_t *source)
+{
+    int i;
 
-    write_handle = M_fopen(dest_name, "wb");
-    if (write_handle == NULL)
+    M_CopySaveBuf(&dest->game, &source->game);
+    for (i = 0; i < MAX_MAPS + 1; i++)
     {
-        I_QuitWithError(english_language ?
-                        "Couldn't read file %s" :
-                        "Невозможно прочитать файл %s",
-                        dest_name);
+        M_CopySaveBuf(&dest->maps[i], &source->maps[i]);
     }
+}
 
-    buffer = Z_Malloc (BUFFER_CHUNK_SIZE, PU_STATIC, NULL);
+//==========================================================================
+//
+// ReadSaveSlot
+//
+// Reads all the save game files of a slot into memory.
+//
+//==========================================================================
 
-    do
-    {
-        buf_count = BUFFER_CHUNK_SIZE;
-        if( file_remaining < BUFFER_CHUNK_SIZE)
-        {
-            buf_count = file_remaining;
-        }
+static void ReadSaveSlot(int slot, hubslot_t *hub)
+{
+    int i;
+    char fileName[RD_MAX_PATH];
 
-        read_count = fread(buffer, 1, buf_count, read_handle);
-        if (read_count < buf_count)
-        {
-            I_QuitWithError(english_language ?
-                            "Couldn't read file %s" :
-                            "Невозможно прочитать файл %s",
-                            source_name);
-        }
+    ClearHubSlot(hub);
 
-        write_count = fwrite(buffer, 1, buf_count, write_handle);
-        if (write_count < buf_count)
+    for (i = 0; i < MAX_MAPS + 1; i++)
+    {
+        M_snprintf(fileName, sizeof(fileName),
+                   "%shexen-save-%d%02d.sav", SavePath, slot, i);
+        if (M_ReadSaveFile(&hub->maps[i], fileName))
         {
-            I_QuitWithError(english_language ?
-                            "Couldn't write to file %s" :
-                            "Невозможно записать файл %s",
-                            dest_name);
+            M_PackSaveBuf(&hub->maps[i], 0);
         }
-
-        file_remaining -= buf_count;
-    } while (file_remaining > 0);
-
-    Z_Free(buffer);
-    fclose(read_handle);
-    fclose(write_handle);
+    }
+    M_snprintf(fileName, sizeof(fileName), "%shexen-save-%d.sav", SavePath, slot);
+    if (!M_ReadSaveFile(&hub->game, fileName))
+    {
+        I_QuitWithError(english_language ?
+                        "Could not load savegame %s" :
+                        "Невозможно прочитать файл %s",
+                        fileName);
+    }
+    M_PackSaveBuf(&hub->game, GAME_RAW_LENGTH);
 }
 
 //==========================================================================
 //
-// ExistingFile
+// WriteSaveSlot
+//
+// Replaces the save game files of a slot. The files are written in the
+// background, in the same format as before (see compress_savegames).
 //
 //==========================================================================
 
-static boolean ExistingFile(char *name)
+static void WriteArchive(const savebuf_t *archive, char *fileName,
+                         size_t rawLength)
 {
-    FILE *fp;
+    savebuf_t copy = {0};
 
-    if ((fp = M_fopen(name, "rb")) != NULL)
+    M_CopySaveBuf(&copy, archive);
+
+    if (!M_UnpackSaveBuf(&copy, rawLength)
+     || !M_WriteSaveBuf(&copy, fileName, NULL, rawLength))
     {
-        fclose(fp);
-        return true;
+        I_QuitWithError(english_language ?
+                        "Couldn't write to file %s" :
+                        "Невозможно записать файл %s",
+                        fileName);
     }
-    else
+}
+
+static void WriteSaveSlot(const hubslot_t *hub, int slot)
+{
+    int i;
+    char fileName[RD_MAX_PATH];
+
+    SV_ClearSaveSlot(slot);
+
+    for (i = 0; i < MAX_MAPS + 1; i++)
     {
-        return false;
+        if (hub->maps[i].size > 0)
+        {
+            M_snprintf(fileName, sizeof(fileName),
+                       "%shexen-save-%d%02d.sav", SavePath, slot, i);
+            WriteArchive(&hub->maps[i], fileName, 0);
+        }
     }
+    M_snprintf(fileName, sizeof(fileName), "%shexen-save-%d.sav", SavePath, slot);
+    WriteArchive(&hub->game, fileName, GAME_RAW_LENGTH);
 }
 
 //==========================================================================
 //
 // SV_Open
 //
+// [JN] Archives are read from and built in memory. rawLength is the
+// part of an archive which is never compressed.
+//
 //==========================================================================
 
-static void SV_OpenRead(char *fileName)
+static void SV_OpenRead(const savebuf_t *archive, size_t rawLength)
 {
-    SavingFP = M_fopen(fileName, "rb");
+    M_CopySaveBuf(&SavingBuf, archive);
+
+    if (!M_UnpackSaveBuf(&SavingBuf, rawLength))
+    {
+        I_QuitWithError(english_language ?
+                        "Bad savegame" :
+                        "Некорректный файл сохранения");
+    }
 }
 
-static void SV_OpenWrite(char *fileName)
+static void SV_OpenWrite(void)
 {
-    SavingFP = M_fopen(fileName, "wb");
+    M_SaveBufFree(&SavingBuf);
 }
 
 //==========================================================================
@@ -3520,12 +3549,18 @@ static void SV_OpenWrite(char *fileName)
 //
 //==========================================================================
 
+static void SV_CloseWrite(savebuf_t *archive, size_t rawLength)
+{
+    M_SaveBufFree(archive);
+    *archive = SavingBuf;
+    memset(&SavingBuf, 0, sizeof(SavingBuf));
+
+    M_PackSaveBuf(archive, rawLength);
+}
+
 static void SV_Close(void)
 {
-    if (SavingFP)
-    {
-        fclose(SavingFP);
-    }
+    M_SaveBufFree(&SavingBuf);
 }
 
 //==========================================================================
@@ -3536,7 +3571,7 @@ static void SV_Close(void)
 
 static void SV_Read(void *buffer, int size)
 {
-    int retval = fread(buffer, 1, size, SavingFP);
+    int retval = M_SaveBufRead(&SavingBuf, buffer, size);
     if (retval != size)
     {
         I_QuitWithError(english_language ?
@@ -3549,7 +3584,11 @@ static void SV_Read(void *buffer, int size)
 static byte SV_ReadByte(void)
 {
     byte result;
-    SV_Read(&result, sizeof(byte));
+
+    if (!M_SaveBufRead8(&SavingBuf, &result))
+    {
+        SV_Read(&result, sizeof(byte));
+    }
     return result;
 }
 
@@ -3587,24 +3626,24 @@ static void *SV_ReadPtr(void)
 
 static void SV_Write(void *buffer, int size)
 {
-    fwrite(buffer, size, 1, SavingFP);
+    M_SaveBufWrite(&SavingBuf, buffer, size);
 }
 
 static void SV_WriteByte(byte val)
 {
-    fwrite(&val, sizeof(byte), 1, SavingFP);
+    M_SaveBufWrite8(&SavingBuf, val);
 }
 
 static void SV_WriteWord(unsigned short val)
 {
     val = SHORT(val);
-    fwrite(&val, sizeof(unsigned short), 1, SavingFP);
+    M_SaveBufWrite(&SavingBuf, &val, sizeof(unsigned short));
 }
 
 static void SV_WriteLong(unsigned int val)
 {
     val = LONG(val);
-    fwrite(&val, sizeof(int), 1, SavingFP);
+    M_SaveBufWrite(&SavingBuf, &val, sizeof(int));
 }
 
 static void SV_WriteLongLong(int64_t val)
@@ -51,6 +51,8 @@
 #include "i_system.h"
 #include "m_argv.h"
 #include "m_misc.h"
+#include "m_starttrace.h"
+#include "m_trace.h"
 #include "jn.h"
 
 #include "git_info.h"
@@ -293,6 +295,9 @@ int main(int argc, char **argv)
         return 0;
     }
 
+    M_StartTraceInit();
+    TRACE_INIT();
+
     M_SetExeDir();
 #ifdef __APPLE__
     packageResourcesDir = SDL_GetBasePath();
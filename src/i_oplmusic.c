@@ -28,6 +28,7 @@
 #include "i_sound.h"
 #include "i_swap.h"
 #include "m_misc.h"
+#include "m_trace.h"
 #include "w_wad.h"
 #include "z_zone.h"
 #include "opl.h"
@@ -1399,10 +1400,13 @@ static void TrackTimerCallback(void *arg)
     opl_track_data_t *track = arg;
     midi_event_t *event;
 
+    TRACE_BEGIN("OPL callback");
+
     // Get the next event and process it.
 
     if (!MIDI_GetNextEvent(track->iter, &event))
     {
+        TRACE_END();
         return;
     }
 
@@ -1427,12 +1431,15 @@ static void TrackTimerCallback(void *arg)
             OPL_SetCallback(5000, RestartSong, NULL);
         }
 
+        TRACE_END();
         return;
     }
 
     // Reschedule the callback for the next event in the track.
 
     ScheduleTrack(track);
+
+    TRACE_END();
 }
 
 static void ScheduleTrack(opl_track_data_t *track)
@@ -35,6 +35,7 @@
 #include "m_argv.h"
 #include "m_config.h"
 #include "m_misc.h"
+#include "m_starttrace.h"
 #include "os_compat.h"
 
 // Sound sample rate to use for digital output (Hz)
@@ -366,7 +367,9 @@ void I_PrecacheSounds(sfxinfo_t *sounds, int num_sounds)
 {
     if (sound_module != NULL && sound_module->CacheSounds != NULL)
     {
+        M_StartTraceBegin("I_PrecacheSounds");
         sound_module->CacheSounds(sounds, num_sounds);
+        M_StartTraceEnd();
     }
 }
 
@@ -34,6 +34,7 @@
 #include <conio.h>
 #else
 #include <unistd.h>
+#include <sys/resource.h>
 #endif
 
 #include "SDL.h"
@@ -445,6 +446,27 @@ boolean I_GetMemoryValue(unsigned int offset, void *value, int size)
     return false;
 }
 
+// Page faults taken by the process so far, and how many of them had
+// to wait for the disk. Returns false if the system does not tell.
+
+boolean I_GetPageFaults(long *minor, long *major)
+{
+#ifdef _WIN32
+    return false;
+#else
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return false;
+    }
+
+    *minor = usage.ru_minflt;
+    *major = usage.ru_majflt;
+    return true;
+#endif
+}
+
 #ifdef _WIN32
 void I_ConsolePause(void)
 {
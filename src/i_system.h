@@ -74,6 +74,8 @@ void *I_Realloc(void *ptr, size_t size);
 
 boolean I_GetMemoryValue(unsigned int offset, void *value, int size);
 
+boolean I_GetPageFaults(long *minor, long *major);
+
 // Schedule a function to be called when the program exits.
 // If run_if_error is true, the function is called if the exit
 // is due to an error (I_QuitWithError)
@@ -0,0 +1,462 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Job system on a fixed pool of worker threads.
+//      Every thread owns a work-stealing deque: it pushes and pops its
+//      own jobs at the bottom, while idle threads steal from the top of
+//      other deques. Sleeping workers are woken by a semaphore, which is
+//      posted once per queued job.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SDL.h"
+
+#include "doomtype.h"
+#include "i_system.h"
+#include "i_thread.h"
+#include "m_argv.h"
+#include "m_trace.h"
+#include "jn.h"
+
+
+// Must be a power of two. Jobs which don't fit are run immediately.
+#define DEQUESIZE 256
+#define DEQUEMASK (DEQUESIZE - 1)
+
+typedef struct
+{
+    job_func_t  func;
+    void       *data;
+    jobgroup_t *group;
+} job_t;
+
+typedef struct
+{
+    SDL_atomic_t top;
+    SDL_atomic_t bottom;
+    job_t        jobs[DEQUESIZE];
+} deque_t;
+
+typedef struct
+{
+    thread_func_t func;
+    void         *data;
+    int           slice;
+    int           numslices;
+} slice_t;
+
+typedef struct
+{
+    range_func_t func;
+    void        *data;
+    int          start;
+    int          end;
+    int          grain;
+} range_t;
+
+int worker_threads = 1;
+
+static SDL_Thread  *workers[MAXTHREADS];
+static deque_t      deques[MAXTHREADS];
+static SDL_sem     *work_sem;
+static SDL_atomic_t quitting;
+
+static int numthreads = 1;
+
+// Deque of the current thread, -1 for threads outside of the job system.
+static THREADLOCAL int thread_index = -1;
+
+
+//
+// Work-stealing deque, after Chase and Lev.
+//
+
+// SDL_AtomicSet is not a full memory barrier on every platform.
+static void AtomicSetFull (SDL_atomic_t *a, const int value)
+{
+    int old;
+
+    do
+    {
+        old = SDL_AtomicGet(a);
+    } while (!SDL_AtomicCAS(a, old, value));
+}
+
+static boolean PushJob (deque_t *d, const job_t *job)
+{
+    const int b = SDL_AtomicGet(&d->bottom);
+    const int t = SDL_AtomicGet(&d->top);
+
+    if (b - t >= DEQUESIZE)
+    {
+        return false;
+    }
+
+    d->jobs[b & DEQUEMASK] = *job;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&d->bottom, b + 1);
+
+    return true;
+}
+
+static boolean PopJob (deque_t *d, job_t *job)
+{
+    const int b = SDL_AtomicGet(&d->bottom) - 1;
+    boolean found = true;
+    int t;
+
+    AtomicSetFull(&d->bottom, b);
+    t = SDL_AtomicGet(&d->top);
+
+    if (t > b)
+    {
+        SDL_AtomicSet(&d->bottom, b + 1);
+        return false;
+    }
+
+    *job = d->jobs[b & DEQUEMASK];
+
+    if (t == b)
+    {
+        // Last job, thieves may be after it as well.
+        found = SDL_AtomicCAS(&d->top, t, t + 1);
+        SDL_AtomicSet(&d->bottom, b + 1);
+    }
+
+    return found;
+}
+
+static boolean StealJob (deque_t *d, job_t *job)
+{
+    const int t = SDL_AtomicGet(&d->top);
+    const int b = SDL_AtomicGet(&d->bottom);
+
+    if (t >= b)
+    {
+        return false;
+    }
+
+    SDL_MemoryBarrierAcquire();
+    *job = d->jobs[t & DEQUEMASK];
+
+    return SDL_AtomicCAS(&d->top, t, t + 1);
+}
+
+//
+// Job execution.
+//
+
+static void RunJob (const job_t *job)
+{
+    job->func(job->data);
+
+    // Group may be gone once its last job is done.
+    SDL_AtomicAdd(&job->group->pending, -1);
+}
+
+// Run one job from own deque or stolen from another thread.
+static boolean TryRunJob (const int self)
+{
+    job_t job;
+
+    if (PopJob(&deques[self], &job))
+    {
+        RunJob(&job);
+        return true;
+    }
+
+    for (int i = 1 ; i < numthreads ; i++)
+    {
+        if (StealJob(&deques[(self + i) % numthreads], &job))
+        {
+            RunJob(&job);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int WorkerThread (void *arg)
+{
+    thread_index = (int)(intptr_t) arg;
+    TRACE_THREAD_NAME("Worker thread");
+
+    while (!SDL_AtomicGet(&quitting))
+    {
+        if (!TryRunJob(thread_index))
+        {
+            SDL_SemWait(work_sem);
+        }
+    }
+
+    return 0;
+}
+
+static void I_ShutdownThreads (void)
+{
+    if (numthreads <= 1)
+    {
+        return;
+    }
+
+    SDL_AtomicSet(&quitting, 1);
+
+    for (int i = 1 ; i < numthreads ; i++)
+    {
+        SDL_SemPost(work_sem);
+    }
+
+    for (int i = 1 ; i < numthreads ; i++)
+    {
+        SDL_WaitThread(workers[i], NULL);
+        workers[i] = NULL;
+    }
+
+    // Drop wakeups which were never consumed.
+    while (SDL_SemTryWait(work_sem) == 0);
+
+    for (int i = 0 ; i < MAXTHREADS ; i++)
+    {
+        SDL_AtomicSet(&deques[i].top, 0);
+        SDL_AtomicSet(&deques[i].bottom, 0);
+    }
+
+    numthreads = 1;
+    SDL_AtomicSet(&quitting, 0);
+}
+
+boolean I_ThreadsDisabled (void)
+{
+    static int nothreads = -1;
+
+    if (nothreads < 0)
+    {
+        //!
+        // @category obscure
+        //
+        // Run everything on the main thread: disable the job system.
+        // Useful for debugging determinism issues.
+        //
+
+        nothreads = M_ParmExists("-nothreads");
+    }
+
+    return nothreads;
+}
+
+void I_InitThreads (int count)
+{
+    static boolean atexit_set = false;
+    int p;
+
+    //!
+    // @category obscure
+    // @arg <n>
+    //
+    // Use n threads for rendering and game jobs, overriding the
+    // worker_threads config variable. 0 uses every CPU core.
+    //
+
+    p = M_CheckParmWithArgs("-threads", 1);
+
+    if (p > 0)
+    {
+        count = atoi(myargv[p + 1]);
+    }
+
+    if (I_ThreadsDisabled())
+    {
+        count = 1;
+    }
+    else if (count < 1)
+    {
+        count = SDL_GetCPUCount();
+    }
+
+    count = BETWEEN(1, MAXTHREADS, count);
+
+    // Calling thread becomes the main thread of the job system.
+    thread_index = 0;
+
+    if (count == numthreads)
+    {
+        return;
+    }
+
+    I_ShutdownThreads();
+
+    if (count == 1)
+    {
+        return;
+    }
+
+    if (work_sem == NULL)
+    {
+        work_sem = SDL_CreateSemaphore(0);
+    }
+
+    if (!atexit_set)
+    {
+        I_AtExit(I_ShutdownThreads, true);
+        atexit_set = true;
+    }
+
+    numthreads = count;
+
+    for (int i = 1 ; i < count ; i++)
+    {
+        workers[i] = SDL_CreateThread(WorkerThread, "Worker thread", (void *)(intptr_t) i);
+
+        if (workers[i] == NULL)
+        {
+            printf(english_language ?
+                   "I_InitThreads: failed to create worker thread: %s\n" :
+                   "I_InitThreads: ошибка создания рабочего потока: %s\n",
+                   SDL_GetError());
+            numthreads = i;
+            break;
+        }
+    }
+}
+
+int I_NumThreads (void)
+{
+    return numthreads;
+}
+
+void I_ForkJob (jobgroup_t *group, job_func_t func, void *data)
+{
+    const job_t job = { func, data, group };
+
+    SDL_AtomicAdd(&group->pending, 1);
+
+    if (numthreads <= 1 || thread_index < 0
+    || !PushJob(&deques[thread_index], &job))
+    {
+        RunJob(&job);
+        return;
+    }
+
+    SDL_SemPost(work_sem);
+}
+
+void I_JoinJobs (jobgroup_t *group)
+{
+    int spins = 0;
+
+    while (SDL_AtomicGet(&group->pending) > 0)
+    {
+        // Help with the remaining jobs instead of waiting for them.
+        if (thread_index >= 0 && TryRunJob(thread_index))
+        {
+            spins = 0;
+        }
+        else if (++spins > 64)
+        {
+            SDL_Delay(0);
+        }
+    }
+}
+
+//
+// Fork/join helpers.
+//
+
+static void RunSlice (void *data)
+{
+    const slice_t *s = data;
+
+    s->func(s->slice, s->numslices, s->data);
+}
+
+void I_RunThreads (thread_func_t func, void *data)
+{
+    const int count = thread_index < 0 ? 1 : numthreads;
+    slice_t slices[MAXTHREADS];
+    jobgroup_t group = {0};
+
+    if (count <= 1)
+    {
+        func(0, 1, data);
+        return;
+    }
+
+    for (int i = 1 ; i < count ; i++)
+    {
+        slices[i].func = func;
+        slices[i].data = data;
+        slices[i].slice = i;
+        slices[i].numslices = count;
+        I_ForkJob(&group, RunSlice, &slices[i]);
+    }
+
+    func(0, count, data);
+
+    I_JoinJobs(&group);
+}
+
+// Fork the upper half of the range until it is small enough,
+// then run the rest and wait for the forked halves.
+static void RunRange (void *arg)
+{
+    range_t range = *(const range_t *) arg;
+    range_t halves[32];
+    jobgroup_t group = {0};
+    int n = 0;
+
+    while (range.end - range.start > range.grain && n < arrlen(halves))
+    {
+        const int mid = range.start + (range.end - range.start) / 2;
+
+        halves[n] = range;
+        halves[n].start = mid;
+        range.end = mid;
+        I_ForkJob(&group, RunRange, &halves[n++]);
+    }
+
+    range.func(range.start, range.end, range.data);
+
+    I_JoinJobs(&group);
+}
+
+void I_ParallelFor (int count, int grain, range_func_t func, void *data)
+{
+    range_t range;
+
+    if (count <= 0)
+    {
+        return;
+    }
+
+    if (numthreads <= 1 || thread_index < 0)
+    {
+        func(0, count, data);
+        return;
+    }
+
+    // No more than a few ranges per thread.
+    range.func = func;
+    range.data = data;
+    range.start = 0;
+    range.end = count;
+    range.grain = MAX(MAX(grain, 1), count / (numthreads * 4));
+
+    RunRange(&range);
+}
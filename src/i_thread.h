@@ -0,0 +1,72 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Job system on a fixed pool of worker threads.
+//
+
+
+#pragma once
+
+#include "SDL.h"
+
+#include "doomtype.h"
+
+
+#define MAXTHREADS 16
+
+// Called once per slice. Slice 0 always runs on the calling thread.
+typedef void (*thread_func_t)(int slice, int numslices, void *data);
+
+// A single job, forked with I_ForkJob.
+typedef void (*job_func_t)(void *data);
+
+// Called for the [start, end) part of a parallel for loop.
+typedef void (*range_func_t)(int start, int end, void *data);
+
+// Jobs forked into one group are waited for with I_JoinJobs.
+// Group must be zeroed before the first fork.
+typedef struct
+{
+    SDL_atomic_t pending;
+} jobgroup_t;
+
+// Number of threads in the job system, including the main thread.
+// 0 means one thread per CPU core, 1 disables the worker pool.
+extern int worker_threads;
+
+// Start (or restart) the pool with the given number of threads.
+// Must be called from the main thread.
+void I_InitThreads(int count);
+
+// Number of threads jobs are run on.
+int I_NumThreads(void);
+
+// True if -nothreads is given, and everything must run on one thread.
+boolean I_ThreadsDisabled(void);
+
+// Queue func(data) to be run by any thread. Jobs may fork other jobs.
+// Threads not belonging to the job system run the job immediately.
+void I_ForkJob(jobgroup_t *group, job_func_t func, void *data);
+
+// Run queued jobs until every job of the group is done.
+void I_JoinJobs(jobgroup_t *group);
+
+// Run func once per thread and wait until every slice is done.
+void I_RunThreads(thread_func_t func, void *data);
+
+// Split [0, count) into ranges of at least grain iterations and run
+// them in parallel. Returns when the whole range is done.
+void I_ParallelFor(int count, int grain, range_func_t func, void *data);
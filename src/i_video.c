@@ -46,6 +46,10 @@
 #include "m_argv.h"
 #include "m_config.h"
 #include "m_misc.h"
+#include "m_bench.h"
+#include "m_perf.h"
+#include "m_starttrace.h"
+#include "m_trace.h"
 #include "os_compat.h"
 #include "tables.h"
 #include "v_diskicon.h"
@@ -86,6 +90,13 @@ static SDL_Rect blit_rect = {
 
 static uint32_t pixel_format;
 
+// [JN] Palette colors in the texture pixel format. When the texture can be
+// locked, paletted screen buffer is expanded straight into its pixels,
+// bypassing the RGBA buffer and the SDL_UpdateTexture copy.
+
+static uint32_t palette_lut[256];
+static boolean  nolocktexture;
+
 // palette
 
 static SDL_Color palette[256];
@@ -871,6 +882,90 @@ void I_DrawBlackBorders (void)
     SDL_RenderFillRect(renderer, &rectangle_right);
 }
 
+//
+// UpdatePaletteLUT
+// [JN] Map current palette to the texture pixel format.
+//
+
+static void UpdatePaletteLUT (void)
+{
+    for (int i = 0 ; i < 256 ; i++)
+    {
+        palette_lut[i] = SDL_MapRGB(argbbuffer->format,
+                                    palette[i].r, palette[i].g, palette[i].b);
+    }
+}
+
+//
+// ExpandPaletteRow
+// [JN] Expand one row of palette indices, eight pixels at a time.
+//
+
+static void ExpandPaletteRow (uint32_t *restrict dest,
+                              const byte *restrict src, int count)
+{
+    const uint32_t *const lut = palette_lut;
+
+    for ( ; count >= 8 ; count -= 8, src += 8, dest += 8)
+    {
+        dest[0] = lut[src[0]];
+        dest[1] = lut[src[1]];
+        dest[2] = lut[src[2]];
+        dest[3] = lut[src[3]];
+        dest[4] = lut[src[4]];
+        dest[5] = lut[src[5]];
+        dest[6] = lut[src[6]];
+        dest[7] = lut[src[7]];
+    }
+
+    while (count--)
+    {
+        *dest++ = lut[*src++];
+    }
+}
+
+//
+// BlitToLockedTexture
+// [JN] Expand the screen buffer straight into the locked streaming texture.
+// Returns false if the texture can't be locked, so the caller has to go
+// through the intermediate RGBA buffer.
+//
+
+static boolean BlitToLockedTexture (void)
+{
+    const byte *src = screenbuffer->pixels;
+    byte *dest;
+    int pitch;
+
+    if (nolocktexture || argbbuffer->format->BytesPerPixel != 4)
+    {
+        return false;
+    }
+
+    M_PerfStart(PERF_UPLOAD);
+    if (SDL_LockTexture(texture, NULL, (void **) &dest, &pitch) != 0)
+    {
+        M_PerfStop(PERF_UPLOAD);
+        return false;
+    }
+    M_PerfStop(PERF_UPLOAD);
+
+    M_PerfStart(PERF_BLIT);
+    for (int y = 0 ; y < screenbuffer->h ; y++)
+    {
+        ExpandPaletteRow((uint32_t *) dest, src, screenbuffer->w);
+        src += screenbuffer->pitch;
+        dest += pitch;
+    }
+    M_PerfStop(PERF_BLIT);
+
+    M_PerfStart(PERF_UPLOAD);
+    SDL_UnlockTexture(texture);
+    M_PerfStop(PERF_UPLOAD);
+
+    return true;
+}
+
 //
 // I_FinishUpdate
 //
@@ -947,6 +1042,8 @@ void I_FinishUpdate (void)
 		}
 	}
 
+    TRACE_BEGIN("I_FinishUpdate");
+
     // Draw disk icon before blit, if necessary.
     if (RD_GameType == gt_Doom && show_diskicon)
     {
@@ -956,6 +1053,7 @@ void I_FinishUpdate (void)
     if (palette_to_set)
     {
         SDL_SetPaletteColors(screenbuffer->format->palette, palette, 0, 256);
+        UpdatePaletteLUT();
         palette_to_set = false;
     }
 
@@ -967,17 +1065,25 @@ void I_FinishUpdate (void)
             palette[0].b, SDL_ALPHA_OPAQUE);
     }
 
-    // Blit from the paletted 8-bit screen buffer to the intermediate
-    // 32-bit RGBA buffer that we can load into the texture.
-
-    SDL_BlitSurface(screenbuffer, &blit_rect, argbbuffer, &blit_rect);
+    // [JN] Expand the paletted screen buffer straight into the texture.
+    // Otherwise, blit from the paletted 8-bit screen buffer to the
+    // intermediate 32-bit RGBA buffer that we can load into the texture,
+    // and update the intermediate texture with its contents.
 
-    // Update the intermediate texture with the contents of the RGBA buffer.
+    if (!BlitToLockedTexture())
+    {
+        M_PerfStart(PERF_BLIT);
+        SDL_BlitSurface(screenbuffer, &blit_rect, argbbuffer, &blit_rect);
+        M_PerfStop(PERF_BLIT);
 
-    SDL_UpdateTexture(texture, NULL, argbbuffer->pixels, argbbuffer->pitch);
+        M_PerfStart(PERF_UPLOAD);
+        SDL_UpdateTexture(texture, NULL, argbbuffer->pixels, argbbuffer->pitch);
+        M_PerfStop(PERF_UPLOAD);
+    }
 
     // Make sure the pillarboxes are kept clear each frame.
 
+    M_PerfStart(PERF_PRESENT);
     SDL_RenderClear(renderer);
 
     if (smoothing)
@@ -1007,6 +1113,13 @@ void I_FinishUpdate (void)
     // Draw!
 
     SDL_RenderPresent(renderer);
+    M_PerfStop(PERF_PRESENT);
+    TRACE_END();
+
+    // [JN] Frame is on screen, collect its phase times.
+    M_PerfEndFrame();
+    M_BenchFrame();
+    M_StartTraceFinish();
 
     if (uncapped_fps && !singletics)
     {
@@ -1205,6 +1318,15 @@ void I_GraphicsCheckCommandLine(void)
 
     noblit = M_CheckParm ("-noblit");
 
+    //!
+    // @category video
+    //
+    // Convert the screen through an intermediate RGBA surface instead of
+    // writing it straight into the locked texture.
+    //
+
+    nolocktexture = M_ParmExists("-nolocktexture");
+
     //!
     // @category video 
     //
@@ -144,6 +144,8 @@ extern int vsync;
 extern int uncapped_fps;
 extern int show_fps, real_fps;
 extern int max_fps;
+extern int prelit_flats;
+extern int build_reject;
 extern int smoothlight;
 extern int show_diskicon;
 extern int screen_wiping;
@@ -0,0 +1,342 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Timedemo benchmark statistics.
+//      Every presented frame of a timedemo run is timed. When the run
+//      ends, frame time percentiles and histogram are printed, and the
+//      demo is played again until -benchruns runs are done. Results of
+//      all runs are then written to the -benchlog file as JSON.
+//
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomtype.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_bench.h"
+#include "m_misc.h"
+#include "jn.h"
+
+
+// Frame time histogram: under 1 ms, 1-2 ms, 2-4 ms ... 64 ms and over.
+#define NUMBUCKETS 8
+
+typedef struct
+{
+    int      gametics;
+    int      frames;
+    double   seconds;
+    double   fps;
+    double   min, mean, p50, p95, p99, max;  // Frame times in milliseconds.
+    int      histogram[NUMBUCKETS];
+} benchrun_t;
+
+static const char *benchdemo;
+static const char *benchlog;
+static int         benchruns = 1;
+static int         benchrun;
+static benchrun_t *runs;
+
+static boolean   running;
+static uint64_t  runstart;
+static uint64_t  lastframe;
+static uint32_t *frametimes;     // Microseconds.
+static int       numframes;
+static int       maxframes;
+
+void M_BenchInit (const char *demoname)
+{
+    int p;
+
+    //!
+    // @arg <n>
+    // @category video
+    //
+    // Play the -timedemo demo <n> times in a row, and print frame time
+    // statistics of each run and a summary of all runs.
+    //
+
+    p = M_CheckParmWithArgs("-benchruns", 1);
+
+    if (p)
+    {
+        benchruns = BETWEEN(1, 1000, atoi(myargv[p + 1]));
+    }
+
+    //!
+    // @arg <file>
+    // @category video
+    //
+    // Write frame time statistics of -timedemo runs to <file> as JSON.
+    //
+
+    p = M_CheckParmWithArgs("-benchlog", 1);
+
+    if (p)
+    {
+        benchlog = myargv[p + 1];
+    }
+
+    benchdemo = demoname;
+    benchrun = 0;
+    runs = I_Realloc(NULL, benchruns * sizeof(*runs));
+}
+
+void M_BenchStartRun (void)
+{
+    running = true;
+    numframes = 0;
+    runstart = lastframe = I_GetTimeUS();
+}
+
+void M_BenchFrame (void)
+{
+    uint64_t now;
+
+    if (!running)
+    {
+        return;
+    }
+
+    now = I_GetTimeUS();
+
+    if (numframes == maxframes)
+    {
+        maxframes = maxframes ? maxframes * 2 : 4096;
+        frametimes = I_Realloc(frametimes, maxframes * sizeof(*frametimes));
+    }
+
+    frametimes[numframes++] = (uint32_t) (now - lastframe);
+    lastframe = now;
+}
+
+static int CompareFrameTimes (const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *) a;
+    const uint32_t y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted frame times, in milliseconds.
+static double Percentile (const int percent)
+{
+    int rank = (percent * numframes + 99) / 100;
+
+    return frametimes[BETWEEN(1, numframes, rank) - 1] / 1000.0;
+}
+
+static void ComputeRun (benchrun_t *run, const int gametics)
+{
+    uint64_t sum = 0;
+
+    memset(run, 0, sizeof(*run));
+    run->gametics = gametics;
+    run->frames = numframes;
+    run->seconds = (lastframe - runstart) / 1000000.0;
+
+    if (numframes == 0)
+    {
+        return;
+    }
+
+    run->fps = run->seconds > 0 ? numframes / run->seconds : 0;
+
+    qsort(frametimes, numframes, sizeof(*frametimes), CompareFrameTimes);
+
+    for (int i = 0 ; i < numframes ; i++)
+    {
+        uint32_t ms = frametimes[i] / 1000;
+        int bucket = 0;
+
+        sum += frametimes[i];
+
+        while (ms && bucket < NUMBUCKETS - 1)
+        {
+            ms >>= 1;
+            bucket++;
+        }
+
+        run->histogram[bucket]++;
+    }
+
+    run->min = frametimes[0] / 1000.0;
+    run->max = frametimes[numframes - 1] / 1000.0;
+    run->mean = sum / 1000.0 / numframes;
+    run->p50 = Percentile(50);
+    run->p95 = Percentile(95);
+    run->p99 = Percentile(99);
+}
+
+static void PrintRun (const benchrun_t *run)
+{
+    static const char *const buckets[NUMBUCKETS] =
+    {
+        "  <1", " 1-2", " 2-4", " 4-8", "8-16", "16-32", "32-64", " 64+"
+    };
+
+    printf(english_language ?
+           "Run %i/%i: %i gametics, %i frames in %.3f s (%.2f fps)\n" :
+           "Прогон %i/%i: %i gametics, %i кадров за %.3f с (%.2f fps)\n",
+           benchrun + 1, benchruns, run->gametics, run->frames,
+           run->seconds, run->fps);
+
+    if (run->frames == 0)
+    {
+        return;
+    }
+
+    printf(english_language ?
+           "  frame ms: min %.2f, mean %.2f, p50 %.2f, p95 %.2f, p99 %.2f, max %.2f\n" :
+           "  кадр, мс: мин %.2f, сред %.2f, p50 %.2f, p95 %.2f, p99 %.2f, макс %.2f\n",
+           run->min, run->mean, run->p50, run->p95, run->p99, run->max);
+
+    for (int i = 0 ; i < NUMBUCKETS ; i++)
+    {
+        printf("  %5s ms: %i\n", buckets[i], run->histogram[i]);
+    }
+}
+
+// Write s as a quoted JSON string.
+static void WriteString (FILE *f, const char *s)
+{
+    fputc('"', f);
+
+    for ( ; *s ; s++)
+    {
+        const unsigned char c = *s;
+
+        if (c == '"' || c == '\\')
+        {
+            fprintf(f, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(f, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, f);
+        }
+    }
+
+    fputc('"', f);
+}
+
+static void WriteLog (const double mean, const double stddev,
+                      const double min, const double max)
+{
+    FILE *f = M_fopen(benchlog, "w");
+
+    if (f == NULL)
+    {
+        printf(english_language ?
+               "M_BenchEndRun: unable to open %s\n" :
+               "M_BenchEndRun: невозможно открыть %s\n",
+               benchlog);
+        return;
+    }
+
+    fprintf(f, "{\n  \"demo\": ");
+    WriteString(f, benchdemo);
+    fprintf(f, ",\n  \"runs\": [");
+
+    for (int i = 0 ; i < benchruns ; i++)
+    {
+        const benchrun_t *run = &runs[i];
+
+        fprintf(f, "%s\n    {\"gametics\": %i, \"frames\": %i, "
+                   "\"seconds\": %.6f, \"fps\": %.3f, "
+                   "\"frame_ms\": {\"min\": %.3f, \"mean\": %.3f, "
+                   "\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}, "
+                   "\"histogram\": [",
+                i ? "," : "", run->gametics, run->frames, run->seconds,
+                run->fps, run->min, run->mean, run->p50, run->p95,
+                run->p99, run->max);
+
+        for (int j = 0 ; j < NUMBUCKETS ; j++)
+        {
+            fprintf(f, "%s%i", j ? ", " : "", run->histogram[j]);
+        }
+
+        fprintf(f, "]}");
+    }
+
+    fprintf(f, "\n  ],\n  \"summary\": {\"runs\": %i, \"fps_mean\": %.3f, "
+               "\"fps_stddev\": %.3f, \"fps_min\": %.3f, \"fps_max\": %.3f}\n}\n",
+            benchruns, mean, stddev, min, max);
+
+    fclose(f);
+}
+
+boolean M_BenchEndRun (const int gametics)
+{
+    double mean = 0, stddev = 0, min, max;
+
+    if (!running)
+    {
+        return false;
+    }
+
+    running = false;
+
+    ComputeRun(&runs[benchrun], gametics);
+    PrintRun(&runs[benchrun]);
+
+    if (++benchrun < benchruns)
+    {
+        return true;
+    }
+
+    // All runs are done, summarize them.
+    min = max = runs[0].fps;
+
+    for (int i = 0 ; i < benchruns ; i++)
+    {
+        mean += runs[i].fps;
+        min = MIN(min, runs[i].fps);
+        max = MAX(max, runs[i].fps);
+    }
+
+    mean /= benchruns;
+
+    for (int i = 0 ; i < benchruns ; i++)
+    {
+        stddev += (runs[i].fps - mean) * (runs[i].fps - mean);
+    }
+
+    stddev = sqrt(stddev / benchruns);
+
+    if (benchruns > 1)
+    {
+        printf(english_language ?
+               "%i runs: mean %.2f fps, stddev %.2f, min %.2f, max %.2f\n" :
+               "%i прогонов: среднее %.2f fps, откл. %.2f, мин %.2f, макс %.2f\n",
+               benchruns, mean, stddev, min, max);
+    }
+
+    if (benchlog != NULL)
+    {
+        WriteLog(mean, stddev, min, max);
+    }
+
+    return false;
+}
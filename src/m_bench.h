@@ -0,0 +1,37 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Timedemo benchmark statistics.
+//
+
+
+#pragma once
+
+#include "doomtype.h"
+
+
+// Read -benchruns and -benchlog parameters for timing given demo.
+void M_BenchInit (const char *demoname);
+
+// Start recording frame times of a timedemo run.
+void M_BenchStartRun (void);
+
+// Print statistics of the finished run, which took given amount of
+// gametics. Returns true if the demo should be played once again.
+boolean M_BenchEndRun (int gametics);
+
+// Called by I_FinishUpdate once a frame is presented.
+void M_BenchFrame (void);
@@ -0,0 +1,322 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      On-disk cache of data derived from the loaded WAD files.
+//      Startup steps which only depend on the loaded files (and some
+//      small key, like the palette) store their results here and load
+//      them back on the next start with the same files.
+//
+//      Items are stored in flat files, holding no pointers, so they
+//      can be read back with a single call:
+//
+//          [CACHE_MAGIC] [uint32 length] [item digest] [pad] [data]
+//
+//      File names are digests of the loaded files, the item name and
+//      its key. The files are identified by the WAD directory checksum
+//      and the size and modification time of each file.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_cache.h"
+#include "m_config.h"
+#include "m_misc.h"
+#include "sha1.h"
+#include "w_checksum.h"
+#include "w_file.h"
+#include "w_wad.h"
+#include "jn.h"
+
+
+// Bump when the layout of any cached item changes.
+#define CACHEVERSION    1
+
+#define CACHE_MAGIC     "JNC\x1a"
+#define HEADERSIZE      32
+#define MAXTIMES        16
+
+typedef struct
+{
+    const char   *item;
+    boolean       cached;
+    unsigned int  ms;
+} startuptime_t;
+
+int startup_cache = 0;
+
+static sha1_digest_t files_digest;
+
+static startuptime_t times[MAXTIMES];
+static int           numtimes;
+
+// -----------------------------------------------------------------------------
+// Item files
+// -----------------------------------------------------------------------------
+
+boolean M_StartupCacheEnabled (void)
+{
+    //!
+    // @category obscure
+    //
+    // Do not read or write the startup cache, even if it is enabled
+    // in the config file.
+    //
+
+    return startup_cache && !M_ParmExists("-nocache");
+}
+
+static void HashLoadedFiles (void)
+{
+    const wad_file_t *last = NULL;
+    sha1_digest_t directory;
+    sha1_context_t sha1;
+
+    W_Checksum(directory);
+
+    SHA1_Init(&sha1);
+    SHA1_UpdateInt32(&sha1, CACHEVERSION);
+    SHA1_Update(&sha1, directory, sizeof(directory));
+
+    // The directory does not change when lump data is edited in place,
+    // so also take the file sizes and modification times.
+    for (unsigned int i = 0 ; i < numlumps ; i++)
+    {
+        const wad_file_t *wad = lumpinfo[i]->wad_file;
+        struct stat st;
+
+        if (wad == last || wad == NULL || wad->path == NULL)
+        {
+            continue;
+        }
+
+        last = wad;
+
+        SHA1_UpdateString(&sha1, (char *) wad->path);
+        SHA1_UpdateInt32(&sha1, wad->length);
+
+        if (M_stat(wad->path, &st) == 0)
+        {
+            SHA1_UpdateInt32(&sha1, (unsigned int) st.st_mtime);
+        }
+    }
+
+    SHA1_Final(files_digest, &sha1);
+}
+
+static char *ItemPath (const char *item, const void *key, const size_t keylen,
+                       sha1_digest_t digest)
+{
+    char name[2 * sizeof(sha1_digest_t) + 5];
+    sha1_context_t sha1;
+    char *dir, *path;
+
+    // Merges and reloads change the directory, so hash it every time.
+    HashLoadedFiles();
+
+    SHA1_Init(&sha1);
+    SHA1_Update(&sha1, files_digest, sizeof(files_digest));
+    SHA1_UpdateString(&sha1, (char *) item);
+    SHA1_Update(&sha1, (byte *) key, keylen);
+    SHA1_Final(digest, &sha1);
+
+    for (int i = 0 ; i < sizeof(sha1_digest_t) ; i++)
+    {
+        M_snprintf(name + i * 2, 3, "%02x", digest[i]);
+    }
+
+    M_StringCopy(name + 2 * sizeof(sha1_digest_t), ".jnc", 5);
+
+    dir = M_GetCacheDir();
+    path = M_StringJoin(dir, DIR_SEPARATOR_S, name, NULL);
+    free(dir);
+
+    return path;
+}
+
+// Open an item and check its header. Returns the stream positioned at
+// the item data, or NULL.
+
+static FILE *OpenItem (const char *item, const void *key, const size_t keylen,
+                       size_t *length)
+{
+    byte header[HEADERSIZE];
+    sha1_digest_t digest;
+    FILE *stream;
+    char *path;
+    long filelen;
+
+    if (!M_StartupCacheEnabled())
+    {
+        return NULL;
+    }
+
+    path = ItemPath(item, key, keylen, digest);
+    stream = M_fopen(path, "rb");
+    free(path);
+
+    if (stream == NULL)
+    {
+        return NULL;
+    }
+
+    filelen = M_FileLength(stream);
+
+    if (filelen < HEADERSIZE
+    || fread(header, 1, HEADERSIZE, stream) != HEADERSIZE
+    || memcmp(header, CACHE_MAGIC, 4)
+    || memcmp(header + 8, digest, sizeof(digest)))
+    {
+        fclose(stream);
+        return NULL;
+    }
+
+    *length = header[4] | (header[5] << 8) | (header[6] << 16)
+            | ((size_t) header[7] << 24);
+
+    // Cut short by a crash, or a full disk.
+    if ((size_t) filelen != HEADERSIZE + *length)
+    {
+        fclose(stream);
+        return NULL;
+    }
+
+    return stream;
+}
+
+boolean M_ReadStartupCache (const char *item, const void *key, size_t keylen,
+                            void *dest, size_t length)
+{
+    size_t itemlen;
+    FILE *stream = OpenItem(item, key, keylen, &itemlen);
+    boolean ok;
+
+    if (stream == NULL)
+    {
+        return false;
+    }
+
+    ok = itemlen == length && fread(dest, 1, length, stream) == length;
+    fclose(stream);
+
+    return ok;
+}
+
+void *M_LoadStartupCache (const char *item, const void *key, size_t keylen,
+                          size_t *length)
+{
+    FILE *stream = OpenItem(item, key, keylen, length);
+    void *data;
+
+    if (stream == NULL)
+    {
+        return NULL;
+    }
+
+    data = malloc(*length > 0 ? *length : 1);
+
+    if (data != NULL && fread(data, 1, *length, stream) != *length)
+    {
+        free(data);
+        data = NULL;
+    }
+
+    fclose(stream);
+
+    return data;
+}
+
+void M_WriteStartupCache (const char *item, const void *key, size_t keylen,
+                          const void *data, size_t length)
+{
+    byte header[HEADERSIZE] = {0};
+    sha1_digest_t digest;
+    FILE *stream;
+    char *path;
+    boolean ok;
+
+    if (!M_StartupCacheEnabled())
+    {
+        return;
+    }
+
+    path = ItemPath(item, key, keylen, digest);
+    stream = M_fopen(path, "wb");
+
+    if (stream == NULL)
+    {
+        free(path);
+        return;
+    }
+
+    memcpy(header, CACHE_MAGIC, 4);
+    header[4] = length & 0xff;
+    header[5] = (length >> 8) & 0xff;
+    header[6] = (length >> 16) & 0xff;
+    header[7] = (length >> 24) & 0xff;
+    memcpy(header + 8, digest, sizeof(digest));
+
+    ok = fwrite(header, 1, HEADERSIZE, stream) == HEADERSIZE
+      && fwrite(data, 1, length, stream) == length;
+    ok &= fclose(stream) == 0;
+
+    if (!ok)
+    {
+        M_remove(path);
+    }
+
+    free(path);
+}
+
+// -----------------------------------------------------------------------------
+// Startup times
+// -----------------------------------------------------------------------------
+
+void M_StartupTime (const char *item, boolean cached, int starttime)
+{
+    if (numtimes < MAXTIMES)
+    {
+        times[numtimes].item = item;
+        times[numtimes].cached = cached;
+        times[numtimes].ms = I_GetTimeMS() - starttime;
+        numtimes++;
+    }
+}
+
+void M_PrintStartupTimes (void)
+{
+    if ((!startup_cache && !M_ParmExists("-nocache")) || numtimes == 0)
+    {
+        return;
+    }
+
+    printf(english_language ? "Startup cache%s:\n" : "Кэш запуска%s:\n",
+           M_StartupCacheEnabled() ? "" : " (-nocache)");
+
+    for (int i = 0 ; i < numtimes ; i++)
+    {
+        printf(english_language ? "    %-12s %s in %u ms.\n" :
+                                  "    %-12s %s за %u мс.\n",
+               times[i].item,
+               english_language ? (times[i].cached ? "loaded from cache" : "built") :
+                                  (times[i].cached ? "загружено из кэша" : "построено"),
+               times[i].ms);
+    }
+}
@@ -0,0 +1,55 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      On-disk cache of data derived from the loaded WAD files.
+//
+
+
+#pragma once
+
+#include <stddef.h>
+#include "doomtype.h"
+
+
+// If non-zero, data derived from the loaded files at startup is kept in
+// the cache directory and reused while the files stay the same.
+extern int startup_cache;
+
+// True if the cache is enabled and not bypassed with -nocache.
+boolean M_StartupCacheEnabled (void);
+
+// Read the cached item into dest. key is any data the item depends on
+// besides the loaded files. Returns false if the item is not cached or
+// is not exactly length bytes long.
+boolean M_ReadStartupCache (const char *item, const void *key, size_t keylen,
+                            void *dest, size_t length);
+
+// Read a cached item of any length. The result is freed with free(),
+// NULL is returned if the item is not cached.
+void *M_LoadStartupCache (const char *item, const void *key, size_t keylen,
+                          size_t *length);
+
+// Store an item, replacing the previous one for the same files and key.
+void M_WriteStartupCache (const char *item, const void *key, size_t keylen,
+                          const void *data, size_t length);
+
+// Note how long a startup step took since starttime (from I_GetTimeMS),
+// and whether it was loaded from the cache.
+void M_StartupTime (const char *item, boolean cached, int starttime);
+
+// Print the noted startup times, if the cache is enabled or bypassed
+// with -nocache for comparison.
+void M_PrintStartupTimes (void);
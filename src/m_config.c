@@ -539,6 +539,11 @@ static default_t defaults_list[] =
     CONFIG_VARIABLE_INT(screen_wiping),
     CONFIG_VARIABLE_INT(png_screenshots),
     CONFIG_VARIABLE_INT(flashing_hom),
+    CONFIG_VARIABLE_INT(worker_threads),
+    CONFIG_VARIABLE_INT(prelit_flats),
+    CONFIG_VARIABLE_INT(build_reject),
+    CONFIG_VARIABLE_INT(compress_savegames),
+    CONFIG_VARIABLE_INT(startup_cache),
 
     // Display
     CONFIG_VARIABLE_INT(screenblocks),
@@ -1350,3 +1355,15 @@ char* M_GetAutoloadDir(void)
     free(prefix);
     return autoload_path;
 }
+
+char* M_GetCacheDir(void)
+{
+    char* prefix = M_DirName(configPath.savePath);
+    char* cache_path = M_StringJoin(prefix, DIR_SEPARATOR_S, "cache", NULL);
+    free(prefix);
+    if (!M_FileExists(cache_path))
+    {
+        M_MakeDirectory(cache_path);
+    }
+    return cache_path;
+}
@@ -0,0 +1,221 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Frame phase profiler.
+//      Phase times are accumulated until the frame is presented, then
+//      written to the -perflog file and averaged for the on-screen
+//      counters (show_fps == 2).
+//
+
+
+#include <stdio.h>
+
+#include "SDL.h"
+
+#include "doomtype.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "m_perf.h"
+#include "rd_text.h"
+#include "jn.h"
+
+
+static const char *const phasenames[NUMPERFPHASES] =
+{
+    "bsp", "planes", "masked", "hud", "blit", "upload", "present", "tic", "sound"
+};
+
+static const char *const phaselabels[NUMPERFPHASES] =
+{
+    "BSP", "PLN", "MSK", "HUD", "BLT", "UPL", "PRS", "TIC", "SND"
+};
+
+static FILE    *perflog;
+static boolean  perflog_json;
+static int      perfframe;
+
+static uint64_t starttime[NUMPERFPHASES];
+static SDL_atomic_t phasetime[NUMPERFPHASES];  // Microseconds of current frame.
+
+static uint64_t framestart;
+static uint64_t avgstart;
+static int      avgframes;
+static int      avgsum[NUMPERFPHASES];
+static int      average[NUMPERFPHASES];
+
+static boolean M_PerfActive (void)
+{
+    return perflog != NULL || show_fps == 2;
+}
+
+static void M_PerfCloseLog (void)
+{
+    if (perflog_json)
+    {
+        fprintf(perflog, "\n]\n");
+    }
+
+    fclose(perflog);
+    perflog = NULL;
+}
+
+void M_PerfInit (void)
+{
+    //!
+    // @arg <file>
+    // @category video
+    //
+    // Write timings of renderer, blit and tic phases to <file>, one row
+    // per frame. The file is written as JSON if its name ends with
+    // ".json", otherwise as CSV.
+    //
+
+    const int p = M_CheckParmWithArgs("-perflog", 1);
+
+    if (!p)
+    {
+        return;
+    }
+
+    perflog = M_fopen(myargv[p + 1], "w");
+
+    if (perflog == NULL)
+    {
+        printf(english_language ?
+               "M_PerfInit: unable to open %s\n" :
+               "M_PerfInit: невозможно открыть %s\n",
+               myargv[p + 1]);
+        return;
+    }
+
+    perflog_json = M_StringEndsWith(myargv[p + 1], ".json");
+
+    if (perflog_json)
+    {
+        fprintf(perflog, "[");
+    }
+    else
+    {
+        fprintf(perflog, "frame,time_us,frame_us");
+
+        for (int i = 0 ; i < NUMPERFPHASES ; i++)
+        {
+            fprintf(perflog, ",%s_us", phasenames[i]);
+        }
+
+        fprintf(perflog, "\n");
+    }
+
+    I_AtExit(M_PerfCloseLog, true);
+}
+
+void M_PerfStart (perfphase_t phase)
+{
+    if (M_PerfActive())
+    {
+        starttime[phase] = I_GetTimeUS();
+    }
+}
+
+void M_PerfStop (perfphase_t phase)
+{
+    // Phase might be started before the profiler was turned on.
+    if (M_PerfActive() && starttime[phase] != 0)
+    {
+        SDL_AtomicAdd(&phasetime[phase], (int)(I_GetTimeUS() - starttime[phase]));
+        starttime[phase] = 0;
+    }
+}
+
+void M_PerfEndFrame (void)
+{
+    const uint64_t now = I_GetTimeUS();
+    int times[NUMPERFPHASES];
+
+    if (!M_PerfActive())
+    {
+        framestart = 0;
+        return;
+    }
+
+    for (int i = 0 ; i < NUMPERFPHASES ; i++)
+    {
+        times[i] = SDL_AtomicSet(&phasetime[i], 0);
+        avgsum[i] += times[i];
+    }
+
+    if (perflog != NULL && framestart != 0)
+    {
+        if (perflog_json)
+        {
+            fprintf(perflog, "%s\n{\"frame\":%d,\"time_us\":%llu,\"frame_us\":%d",
+                    perfframe ? "," : "", perfframe,
+                    (unsigned long long) now, (int)(now - framestart));
+
+            for (int i = 0 ; i < NUMPERFPHASES ; i++)
+            {
+                fprintf(perflog, ",\"%s_us\":%d", phasenames[i], times[i]);
+            }
+
+            fprintf(perflog, "}");
+        }
+        else
+        {
+            fprintf(perflog, "%d,%llu,%d", perfframe,
+                    (unsigned long long) now, (int)(now - framestart));
+
+            for (int i = 0 ; i < NUMPERFPHASES ; i++)
+            {
+                fprintf(perflog, ",%d", times[i]);
+            }
+
+            fprintf(perflog, "\n");
+        }
+
+        perfframe++;
+    }
+
+    framestart = now;
+
+    // Update averages once per second, same as FPS counter.
+    avgframes++;
+
+    if (now - avgstart >= 1000000)
+    {
+        for (int i = 0 ; i < NUMPERFPHASES ; i++)
+        {
+            average[i] = avgsum[i] / avgframes;
+            avgsum[i] = 0;
+        }
+
+        avgframes = 0;
+        avgstart = now;
+    }
+}
+
+void M_PerfDrawer (int x, int y)
+{
+    char digit[16];
+
+    for (int i = 0 ; i < NUMPERFPHASES ; i++, y += 7)
+    {
+        M_snprintf(digit, sizeof(digit), "%6.2f", average[i] / 1000.0);
+        RD_M_DrawTextC((char *) phaselabels[i], x, y);
+        RD_M_DrawTextC(digit, x + 16, y);
+    }
+}
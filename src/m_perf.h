@@ -0,0 +1,50 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Frame phase profiler.
+//
+
+
+#pragma once
+
+
+typedef enum
+{
+    PERF_BSP,      // R_RenderBSPNode
+    PERF_PLANES,   // R_DrawPlanes
+    PERF_MASKED,   // R_DrawMasked
+    PERF_HUD,      // Status bar, widgets and menus
+    PERF_BLIT,     // I_FinishUpdate: palette conversion
+    PERF_UPLOAD,   // I_FinishUpdate: texture upload
+    PERF_PRESENT,  // I_FinishUpdate: render copy and present
+    PERF_TIC,      // P_Ticker
+    PERF_SOUND,    // S_UpdateSounds
+    NUMPERFPHASES
+} perfphase_t;
+
+// Open the -perflog file, if given.
+void M_PerfInit (void);
+
+// Measure time spent in a phase. Phases may be measured from different
+// threads, but each phase only from one thread at a time.
+void M_PerfStart (perfphase_t phase);
+void M_PerfStop (perfphase_t phase);
+
+// Called by I_FinishUpdate once a frame is presented.
+void M_PerfEndFrame (void);
+
+// Draw average phase times of the last second, in milliseconds.
+void M_PerfDrawer (int x, int y);
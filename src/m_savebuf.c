@@ -0,0 +1,476 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      In-memory savegame buffers, written to disk in the background.
+//
+//      Savegames are serialized into a growing memory buffer instead of
+//      being written one byte at a time. Once complete, the buffer is
+//      handed to a writer thread which (optionally) deflates it and
+//      writes it out with a single call, so the game does not stall on
+//      disk I/O.
+//
+//      A compressed file keeps its first rawlen bytes as is, so the
+//      menus can read slot descriptions without inflating anything:
+//
+//          [rawlen bytes] [SAVEBUF_MAGIC] [uint32 length] [zlib stream]
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+#include "miniz.h"
+#include "i_system.h"
+#include "m_misc.h"
+#include "m_savebuf.h"
+#include "jn.h"
+
+
+#define SAVEBUF_MAGIC   "JNZ\x1a"
+#define MAXPENDING      128
+
+int compress_savegames = 0;
+
+typedef struct
+{
+    byte   *data;
+    size_t  size;
+    size_t  rawlen;
+    boolean compress;
+    FILE   *stream;
+    char   *filename;
+    char   *finalname;
+    boolean failed;     // Write failed, reported by M_FinishSaveWrites.
+    SDL_atomic_t done;  // Set by the writer thread once the file is closed.
+} savewrite_t;
+
+static savewrite_t pending[MAXPENDING];
+static int         numpending;
+
+// -----------------------------------------------------------------------------
+// Buffer access
+// -----------------------------------------------------------------------------
+
+static void GrowSaveBuf (savebuf_t *buf, size_t needed)
+{
+    size_t alloced = buf->alloced ? buf->alloced : 64 * 1024;
+
+    while (alloced < needed)
+    {
+        alloced *= 2;
+    }
+
+    buf->data = I_Realloc(buf->data, alloced);
+    buf->alloced = alloced;
+}
+
+void M_SaveBufWrite (savebuf_t *buf, const void *data, size_t len)
+{
+    if (buf->size + len > buf->alloced)
+    {
+        GrowSaveBuf(buf, buf->size + len);
+    }
+
+    memcpy(buf->data + buf->size, data, len);
+    buf->size += len;
+}
+
+void M_SaveBufWrite8 (savebuf_t *buf, byte value)
+{
+    if (buf->size >= buf->alloced)
+    {
+        GrowSaveBuf(buf, buf->size + 1);
+    }
+
+    buf->data[buf->size++] = value;
+}
+
+size_t M_SaveBufRead (savebuf_t *buf, void *data, size_t len)
+{
+    if (len > buf->size - buf->pos)
+    {
+        len = buf->size - buf->pos;
+    }
+
+    memcpy(data, buf->data + buf->pos, len);
+    buf->pos += len;
+
+    return len;
+}
+
+boolean M_SaveBufRead8 (savebuf_t *buf, byte *value)
+{
+    if (buf->pos >= buf->size)
+    {
+        return false;
+    }
+
+    *value = buf->data[buf->pos++];
+    return true;
+}
+
+void M_SaveBufFree (savebuf_t *buf)
+{
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+void M_CopySaveBuf (savebuf_t *dest, const savebuf_t *src)
+{
+    M_SaveBufFree(dest);
+
+    if (src->size > 0)
+    {
+        dest->data = I_Realloc(NULL, src->size);
+        dest->alloced = src->size;
+        memcpy(dest->data, src->data, src->size);
+        dest->size = src->size;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Compression
+// -----------------------------------------------------------------------------
+
+static boolean IsPacked (const savebuf_t *buf, size_t rawlen)
+{
+    return buf->size >= rawlen + 8
+        && !memcmp(buf->data + rawlen, SAVEBUF_MAGIC, 4);
+}
+
+// Deflate everything past the raw prefix. Returns NULL if it does not pay.
+static byte *DeflateSaveData (const byte *data, size_t size, size_t rawlen,
+                              size_t *outlen)
+{
+    const size_t length = size - rawlen;
+    mz_ulong packedlen = mz_compressBound(length);
+    byte *out;
+
+    out = malloc(rawlen + 8 + packedlen);
+
+    if (out == NULL)
+    {
+        return NULL;
+    }
+
+    if (mz_compress2(out + rawlen + 8, &packedlen,
+                     data + rawlen, length, MZ_BEST_SPEED) != MZ_OK
+    || packedlen + 8 >= length)
+    {
+        free(out);
+        return NULL;
+    }
+
+    memcpy(out, data, rawlen);
+    memcpy(out + rawlen, SAVEBUF_MAGIC, 4);
+    out[rawlen + 4] = length & 0xff;
+    out[rawlen + 5] = (length >> 8) & 0xff;
+    out[rawlen + 6] = (length >> 16) & 0xff;
+    out[rawlen + 7] = (length >> 24) & 0xff;
+
+    *outlen = rawlen + 8 + packedlen;
+    return out;
+}
+
+void M_PackSaveBuf (savebuf_t *buf, size_t rawlen)
+{
+    byte *out;
+    size_t outlen;
+
+    if (buf->size <= rawlen || IsPacked(buf, rawlen))
+    {
+        return;
+    }
+
+    out = DeflateSaveData(buf->data, buf->size, rawlen, &outlen);
+
+    if (out != NULL)
+    {
+        free(buf->data);
+        buf->data = out;
+        buf->size = buf->alloced = outlen;
+    }
+
+    buf->pos = 0;
+}
+
+boolean M_UnpackSaveBuf (savebuf_t *buf, size_t rawlen)
+{
+    const byte *header;
+    mz_ulong length, outlen;
+    byte *out;
+
+    buf->pos = 0;
+
+    if (!IsPacked(buf, rawlen))
+    {
+        return true;
+    }
+
+    header = buf->data + rawlen + 4;
+    length = header[0] | (header[1] << 8)
+           | (header[2] << 16) | ((mz_ulong) header[3] << 24);
+    outlen = length;
+    out = malloc(rawlen + length);
+
+    if (out == NULL)
+    {
+        return false;
+    }
+
+    memcpy(out, buf->data, rawlen);
+
+    if (mz_uncompress(out + rawlen, &outlen, header + 4,
+                      buf->size - rawlen - 8) != MZ_OK || outlen != length)
+    {
+        free(out);
+        return false;
+    }
+
+    free(buf->data);
+    buf->data = out;
+    buf->size = buf->alloced = rawlen + length;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Savegame files
+// -----------------------------------------------------------------------------
+
+boolean M_ReadSaveFile (savebuf_t *buf, const char *filename)
+{
+    FILE *stream;
+    long length;
+
+    // The file may still be on its way to the disk.
+    M_FinishSaveWrites();
+
+    memset(buf, 0, sizeof(*buf));
+
+    stream = M_fopen(filename, "rb");
+
+    if (stream == NULL)
+    {
+        return false;
+    }
+
+    length = M_FileLength(stream);
+    buf->data = malloc(length > 0 ? length : 1);
+
+    if (buf->data == NULL || fread(buf->data, 1, length, stream) != (size_t) length)
+    {
+        fclose(stream);
+        M_SaveBufFree(buf);
+        return false;
+    }
+
+    fclose(stream);
+
+    buf->size = buf->alloced = length;
+
+    return true;
+}
+
+boolean M_LoadSaveBuf (savebuf_t *buf, const char *filename, size_t rawlen)
+{
+    if (!M_ReadSaveFile(buf, filename))
+    {
+        return false;
+    }
+
+    if (!M_UnpackSaveBuf(buf, rawlen))
+    {
+        printf(english_language ?
+               "M_LoadSaveBuf: Failed to decompress %s\n" :
+               "M_LoadSaveBuf: ошибка распаковки %s\n",
+               filename);
+        M_SaveBufFree(buf);
+        return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// M_WriteSaveBuf
+// -----------------------------------------------------------------------------
+
+static int SaveWriteThread (void *data)
+{
+    savewrite_t *w = data;
+    byte *out = NULL;
+    size_t outlen = 0;
+    boolean ok;
+
+    if (w->compress && w->size > w->rawlen)
+    {
+        out = DeflateSaveData(w->data, w->size, w->rawlen, &outlen);
+    }
+
+    if (out == NULL)
+    {
+        out = w->data;
+        outlen = w->size;
+    }
+
+    ok = fwrite(out, 1, outlen, w->stream) == outlen;
+    ok &= fclose(w->stream) == 0;
+
+    if (out != w->data)
+    {
+        free(out);
+    }
+
+    w->failed = !ok;
+
+    if (!ok)
+    {
+        // Leave the previous savegame in place, and drop the partial file.
+        if (w->finalname != NULL)
+        {
+            M_remove(w->filename);
+        }
+    }
+    else if (w->finalname != NULL)
+    {
+        M_remove(w->finalname);
+        M_rename(w->filename, w->finalname);
+    }
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&w->done, 1);
+
+    return 0;
+}
+
+static void FinishSaveWritesAtExit (void)
+{
+    M_FinishSaveWrites();
+}
+
+static boolean IsPending (const char *filename)
+{
+    int i;
+
+    for (i = 0; i < numpending; ++i)
+    {
+        if (!strcmp(pending[i].filename, filename)
+        || (pending[i].finalname && !strcmp(pending[i].finalname, filename)))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+boolean M_WriteSaveBuf (savebuf_t *buf, const char *filename,
+                        const char *finalname, size_t rawlen)
+{
+    static boolean atexit_set = false;
+    savewrite_t *w;
+    SDL_Thread *thread;
+    FILE *stream;
+
+    if (numpending == MAXPENDING || IsPending(filename)
+    || (finalname != NULL && IsPending(finalname)))
+    {
+        M_FinishSaveWrites();
+    }
+
+    // Open the file now, so callers can still fall back to another one.
+    stream = M_fopen(filename, "wb");
+
+    if (stream == NULL)
+    {
+        return false;
+    }
+
+    if (!atexit_set)
+    {
+        I_AtExit(FinishSaveWritesAtExit, true);
+        atexit_set = true;
+    }
+
+    w = &pending[numpending++];
+    w->data = buf->data;
+    w->size = buf->size;
+    w->rawlen = MIN(rawlen, buf->size);
+    w->compress = compress_savegames != 0;
+    w->stream = stream;
+    w->filename = M_StringDuplicate(filename);
+    w->finalname = finalname ? M_StringDuplicate(finalname) : NULL;
+    w->failed = false;
+    SDL_AtomicSet(&w->done, 0);
+
+    memset(buf, 0, sizeof(*buf));
+
+    thread = SDL_CreateThread(SaveWriteThread, "Savegame writer", w);
+
+    if (thread != NULL)
+    {
+        SDL_DetachThread(thread);
+    }
+    else
+    {
+        // No thread to spare, write it right away.
+        SaveWriteThread(w);
+    }
+
+    return true;
+}
+
+boolean M_FinishSaveWrites (void)
+{
+    boolean ok = true;
+    int i;
+
+    if (numpending == 0)
+    {
+        return true;
+    }
+
+    for (i = 0; i < numpending; ++i)
+    {
+        while (!SDL_AtomicGet(&pending[i].done))
+        {
+            SDL_Delay(1);
+        }
+
+        SDL_MemoryBarrierAcquire();
+
+        // Writer threads leave reporting to the main thread.
+        if (pending[i].failed)
+        {
+            printf(english_language ?
+                   "M_WriteSaveBuf: Error while writing %s\n" :
+                   "M_WriteSaveBuf: ошибка записи %s\n",
+                   pending[i].finalname ? pending[i].finalname : pending[i].filename);
+            ok = false;
+        }
+
+        free(pending[i].data);
+        free(pending[i].filename);
+        free(pending[i].finalname);
+    }
+
+    numpending = 0;
+
+    return ok;
+}
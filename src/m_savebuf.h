@@ -0,0 +1,79 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      In-memory savegame buffers, written to disk in the background.
+//
+
+
+#pragma once
+
+#include <stddef.h>
+#include "doomtype.h"
+
+
+typedef struct
+{
+    byte   *data;
+    size_t  size;     // Bytes written, or length of the loaded file
+    size_t  pos;      // Read position
+    size_t  alloced;
+} savebuf_t;
+
+// If non-zero, savegames are written deflated. The first bytes
+// (the description shown in the menus) are always left as is.
+extern int compress_savegames;
+
+// Append bytes to the end of the buffer, growing it as needed.
+void M_SaveBufWrite (savebuf_t *buf, const void *data, size_t len);
+void M_SaveBufWrite8 (savebuf_t *buf, byte value);
+
+// Copy bytes from the read position. Returns the number of bytes read,
+// which is less than len at the end of the buffer.
+size_t M_SaveBufRead (savebuf_t *buf, void *data, size_t len);
+boolean M_SaveBufRead8 (savebuf_t *buf, byte *value);
+
+// Free the buffer contents and reset it for reuse.
+void M_SaveBufFree (savebuf_t *buf);
+
+// Replace dest with a copy of src.
+void M_CopySaveBuf (savebuf_t *dest, const savebuf_t *src);
+
+// Deflate the buffer in place, in the same format used for compressed
+// files. Everything up to rawlen is left as is.
+void M_PackSaveBuf (savebuf_t *buf, size_t rawlen);
+
+// Inflate a packed buffer in place and rewind it. Unpacked buffers are
+// left as they are. Returns false if the data is corrupt.
+boolean M_UnpackSaveBuf (savebuf_t *buf, size_t rawlen);
+
+// Read a file into buf exactly as it is on disk.
+boolean M_ReadSaveFile (savebuf_t *buf, const char *filename);
+
+// Read a whole savegame file into buf with a single read, inflating it
+// if it was written compressed. rawlen is the length of the
+// uncompressed prefix used when it was written.
+boolean M_LoadSaveBuf (savebuf_t *buf, const char *filename, size_t rawlen);
+
+// Open filename for writing and hand the buffer over to a writer
+// thread, which compresses and writes it, then renames the file to
+// finalname (if not NULL). Returns false, leaving buf untouched, if the
+// file can not be opened. On success buf is reset.
+boolean M_WriteSaveBuf (savebuf_t *buf, const char *filename,
+                        const char *finalname, size_t rawlen);
+
+// Wait until every savegame write is on disk. Failed writes are
+// reported here, on the calling thread. Returns false if any failed.
+boolean M_FinishSaveWrites (void);
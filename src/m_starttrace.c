@@ -0,0 +1,248 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Startup timeline tracer.
+//      With -starttrace, every stage from main() up to the first
+//      presented frame is timed, along with the bytes it read from
+//      WAD files. The stages are printed as a tree and may also be
+//      written as Chrome trace-event JSON, to be loaded into a trace
+//      viewer (chrome://tracing, Perfetto) and compared between builds.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SDL.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "m_starttrace.h"
+#include "jn.h"
+
+
+#define MAXSTAGES   512
+#define MAXDEPTH    16
+
+typedef struct
+{
+    char      name[40];
+    int       depth;
+    uint64_t  start;    // Microseconds since M_StartTraceInit
+    uint64_t  end;
+    uint64_t  bytes;    // Bytes read, including nested stages
+} tracestage_t;
+
+static boolean       tracing;
+static const char   *tracefile;
+
+static tracestage_t  stages[MAXSTAGES];
+static int           numstages;
+static int           openstages[MAXDEPTH];
+static int           depth;
+static int           dropped;
+
+static uint64_t      basecounter;
+static uint64_t      bytesread;
+
+static uint64_t TraceTime (void)
+{
+    return (SDL_GetPerformanceCounter() - basecounter) * 1000000ull
+         / SDL_GetPerformanceFrequency();
+}
+
+void M_StartTraceInit (void)
+{
+    //!
+    // @arg [<file>]
+    // @category obscure
+    //
+    // Print how long each startup stage took, up to the first frame.
+    // If a file is given, also write the stages to it as Chrome
+    // trace-event JSON.
+    //
+
+    const int p = M_CheckParm("-starttrace");
+
+    if (!p)
+    {
+        return;
+    }
+
+    if (p + 1 < myargc && myargv[p + 1][0] != '-')
+    {
+        tracefile = myargv[p + 1];
+    }
+
+    basecounter = SDL_GetPerformanceCounter();
+    tracing = true;
+
+    M_StartTraceBegin("startup");
+}
+
+void M_StartTraceBegin (const char *stage)
+{
+    tracestage_t *s;
+
+    if (!tracing)
+    {
+        return;
+    }
+
+    if (numstages == MAXSTAGES || depth == MAXDEPTH)
+    {
+        // Still nest, so the matching M_StartTraceEnd is dropped too.
+        if (depth < MAXDEPTH)
+        {
+            openstages[depth] = -1;
+        }
+        dropped++;
+        depth++;
+        return;
+    }
+
+    s = &stages[numstages];
+    M_StringCopy(s->name, stage, sizeof(s->name));
+    s->depth = depth;
+    s->start = TraceTime();
+    s->end = s->start;
+    s->bytes = bytesread;
+
+    openstages[depth++] = numstages++;
+}
+
+void M_StartTraceEnd (void)
+{
+    tracestage_t *s;
+
+    if (!tracing || depth == 0)
+    {
+        return;
+    }
+
+    depth--;
+
+    if (depth >= MAXDEPTH || openstages[depth] < 0)
+    {
+        return;
+    }
+
+    s = &stages[openstages[depth]];
+    s->end = TraceTime();
+    s->bytes = bytesread - s->bytes;
+    openstages[depth] = -1;
+}
+
+void M_StartTraceBytes (size_t bytes)
+{
+    bytesread += bytes;
+}
+
+// -----------------------------------------------------------------------------
+// Output
+// -----------------------------------------------------------------------------
+
+static void PrintTree (void)
+{
+    if (english_language)
+    {
+        printf("%-52s %10s %10s\n", "Startup trace:", "ms", "KiB");
+    }
+    else
+    {
+        printf("%-52s %10s %10s\n", "Трассировка запуска:", "мс", "КиБ");
+    }
+
+    for (int i = 0 ; i < numstages ; i++)
+    {
+        const tracestage_t *s = &stages[i];
+
+        printf("  %*s%-*s %10.1f %10llu\n",
+               s->depth * 2, "", 50 - s->depth * 2, s->name,
+               (s->end - s->start) / 1000.0,
+               (unsigned long long) (s->bytes / 1024));
+    }
+
+    if (dropped > 0)
+    {
+        printf(english_language ?
+               "  (%d stages not recorded)\n" :
+               "  (%d этапов не записано)\n", dropped);
+    }
+}
+
+static void WriteTraceFile (void)
+{
+    FILE *f = M_fopen(tracefile, "w");
+
+    if (f == NULL)
+    {
+        printf(english_language ?
+               "M_StartTraceFinish: unable to open %s\n" :
+               "M_StartTraceFinish: невозможно открыть %s\n", tracefile);
+        return;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (int i = 0 ; i < numstages ; i++)
+    {
+        const tracestage_t *s = &stages[i];
+
+        // Stage names are function and file names, print them escaped
+        // only as far as JSON strings need it.
+        fprintf(f, "%s{\"name\":\"", i ? ",\n" : "");
+
+        for (const char *c = s->name ; *c ; c++)
+        {
+            if (*c == '"' || *c == '\\')
+            {
+                fputc('\\', f);
+            }
+            fputc((unsigned char) *c < 0x20 ? '?' : *c, f);
+        }
+
+        fprintf(f, "\",\"cat\":\"startup\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                   "\"ts\":%llu,\"dur\":%llu,\"args\":{\"bytes\":%llu}}",
+                (unsigned long long) s->start,
+                (unsigned long long) (s->end - s->start),
+                (unsigned long long) s->bytes);
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+}
+
+void M_StartTraceFinish (void)
+{
+    if (!tracing)
+    {
+        return;
+    }
+
+    while (depth > 0)
+    {
+        M_StartTraceEnd();
+    }
+
+    tracing = false;
+
+    PrintTree();
+
+    if (tracefile != NULL)
+    {
+        WriteTraceFile();
+    }
+}
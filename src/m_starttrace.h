@@ -0,0 +1,39 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Startup timeline tracer.
+//
+
+
+#pragma once
+
+#include <stddef.h>
+
+
+// Check for -starttrace and start timing the "startup" stage.
+void M_StartTraceInit (void);
+
+// Open and close a nested stage. Stages still open are closed by
+// M_StartTraceFinish.
+void M_StartTraceBegin (const char *stage);
+void M_StartTraceEnd (void);
+
+// Count bytes read from WAD files by the open stages.
+void M_StartTraceBytes (size_t bytes);
+
+// Called once the first frame is presented: print the stage tree and
+// write the trace file. Later calls do nothing.
+void M_StartTraceFinish (void);
@@ -0,0 +1,255 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Trace-event instrumentation.
+//      Every thread records its events into its own ring buffer, so
+//      recording takes no locks: only the owning thread writes the
+//      ring, and publishes each event by advancing the ring head. The
+//      last RINGSIZE events of every thread are written as Chrome
+//      trace-event JSON on exit, or when bk_trace_dump is pressed, to
+//      be loaded into chrome://tracing or Perfetto.
+//
+
+
+#ifdef RD_TRACE_EVENTS
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SDL.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "m_trace.h"
+#include "jn.h"
+
+
+#define MAXTRACETHREADS 32
+#define RINGSIZE        (1 << 16)   // Events kept per thread, power of two
+#define MAXNESTING      32
+
+// Events this close to being overwritten are not dumped, as the owning
+// thread may be writing them while the dump runs.
+#define DUMPMARGIN      1024
+
+typedef struct
+{
+    const char *name;
+    uint64_t    start;      // Performance counter values
+    uint64_t    end;
+} traceevent_t;
+
+typedef struct
+{
+    traceevent_t  events[RINGSIZE];
+    SDL_atomic_t  head;     // Number of events written
+
+    // Only accessed by the owning thread.
+    int           depth;
+    const char   *openname[MAXNESTING];
+    uint64_t      openstart[MAXNESTING];
+
+    char          name[32];
+} tracering_t;
+
+static tracering_t *rings[MAXTRACETHREADS];
+static SDL_atomic_t numrings;
+
+static THREADLOCAL tracering_t *ring;
+static THREADLOCAL boolean      noring;
+
+static uint64_t     basecounter;
+static uint64_t     frequency;
+static const char  *tracefile = "trace.json";
+
+// -----------------------------------------------------------------------------
+// Recording
+// -----------------------------------------------------------------------------
+
+static tracering_t *ThreadRing (void)
+{
+    int index;
+
+    if (ring != NULL || noring)
+    {
+        return ring;
+    }
+
+    index = SDL_AtomicAdd(&numrings, 1);
+
+    if (index >= MAXTRACETHREADS || (ring = calloc(1, sizeof(*ring))) == NULL)
+    {
+        noring = true;
+        return NULL;
+    }
+
+    M_snprintf(ring->name, sizeof(ring->name), "Thread %d", index);
+
+    SDL_MemoryBarrierRelease();
+    rings[index] = ring;
+
+    return ring;
+}
+
+void M_TraceThreadName (const char *name)
+{
+    tracering_t *r = ThreadRing();
+
+    if (r != NULL)
+    {
+        M_StringCopy(r->name, name, sizeof(r->name));
+    }
+}
+
+void M_TraceBegin (const char *name)
+{
+    tracering_t *r = ThreadRing();
+
+    if (r == NULL)
+    {
+        return;
+    }
+
+    if (r->depth < MAXNESTING)
+    {
+        r->openname[r->depth] = name;
+        r->openstart[r->depth] = SDL_GetPerformanceCounter();
+    }
+
+    r->depth++;
+}
+
+void M_TraceEnd (unsigned int min_us)
+{
+    tracering_t *r = ring;
+    uint64_t end;
+    int head;
+    traceevent_t *e;
+
+    if (r == NULL || r->depth == 0 || --r->depth >= MAXNESTING)
+    {
+        return;
+    }
+
+    end = SDL_GetPerformanceCounter();
+
+    if (min_us > 0 && (end - r->openstart[r->depth]) * 1000000 < min_us * frequency)
+    {
+        return;
+    }
+
+    head = SDL_AtomicGet(&r->head);
+    e = &r->events[head & (RINGSIZE - 1)];
+    e->name = r->openname[r->depth];
+    e->start = r->openstart[r->depth];
+    e->end = end;
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&r->head, head + 1);
+}
+
+// -----------------------------------------------------------------------------
+// Output
+// -----------------------------------------------------------------------------
+
+static double TraceTime (uint64_t counter)
+{
+    return (double) (counter - basecounter) * 1000000.0 / frequency;
+}
+
+void M_TraceDump (void)
+{
+    const int count = MIN(SDL_AtomicGet(&numrings), MAXTRACETHREADS);
+    FILE *f = M_fopen(tracefile, "w");
+    int written = 0;
+
+    if (f == NULL)
+    {
+        printf(english_language ?
+               "M_TraceDump: unable to open %s\n" :
+               "M_TraceDump: невозможно открыть %s\n", tracefile);
+        return;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+               "\"args\":{\"name\":\"%s\"}}", PACKAGE_TARNAME);
+
+    for (int i = 0 ; i < count ; i++)
+    {
+        const tracering_t *r = rings[i];
+        int head, first;
+
+        SDL_MemoryBarrierAcquire();
+
+        if (r == NULL)
+        {
+            continue;
+        }
+
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                   "\"tid\":%d,\"args\":{\"name\":\"%s\"}}", i + 1, r->name);
+
+        head = SDL_AtomicGet(&r->head);
+        SDL_MemoryBarrierAcquire();
+        first = head > RINGSIZE - DUMPMARGIN ? head - RINGSIZE + DUMPMARGIN : 0;
+
+        for (int j = first ; j < head ; j++)
+        {
+            const traceevent_t *e = &r->events[j & (RINGSIZE - 1)];
+
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                       "\"ts\":%.3f,\"dur\":%.3f}",
+                    e->name, i + 1, TraceTime(e->start),
+                    TraceTime(e->end) - TraceTime(e->start));
+            written++;
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    printf(english_language ?
+           "M_TraceDump: %d events written to %s\n" :
+           "M_TraceDump: %d событий записано в %s\n", written, tracefile);
+}
+
+void M_TraceInit (void)
+{
+    //!
+    // @arg <file>
+    // @category obscure
+    //
+    // File to write trace events to, on exit and when the trace dump
+    // key is pressed. Only in builds with RD_TRACE_EVENTS. Default is
+    // trace.json in the current directory.
+    //
+
+    const int p = M_CheckParmWithArgs("-tracefile", 1);
+
+    if (p)
+    {
+        tracefile = myargv[p + 1];
+    }
+
+    basecounter = SDL_GetPerformanceCounter();
+    frequency = SDL_GetPerformanceFrequency();
+
+    M_TraceThreadName("Main thread");
+    I_AtExit(M_TraceDump, true);
+}
+
+#endif
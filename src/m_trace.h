@@ -0,0 +1,62 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Trace-event instrumentation.
+//      Only compiled in when the RD_TRACE_EVENTS CMake option is set.
+//      Otherwise every macro expands to nothing.
+//
+
+
+#pragma once
+
+
+#ifdef RD_TRACE_EVENTS
+
+void M_TraceInit (void);
+void M_TraceThreadName (const char *name);
+void M_TraceBegin (const char *name);
+void M_TraceEnd (unsigned int min_us);
+void M_TraceDump (void);
+
+// Start tracing. Must be called on the main thread, before any other
+// thread is started.
+#define TRACE_INIT()            M_TraceInit()
+
+// Name the calling thread in the trace viewer.
+#define TRACE_THREAD_NAME(name) M_TraceThreadName(name)
+
+// Open and close a nested event on the calling thread. Name must be a
+// string literal, only the pointer is stored.
+#define TRACE_BEGIN(name)       M_TraceBegin(name)
+#define TRACE_END()             M_TraceEnd(0)
+
+// Close an event, dropping it if it took less than us microseconds.
+// Used for calls which are only interesting when they spike.
+#define TRACE_END_LONGER(us)    M_TraceEnd(us)
+
+// Write recorded events of all threads to the trace file.
+#define TRACE_DUMP()            M_TraceDump()
+
+#else
+
+#define TRACE_INIT()            ((void) 0)
+#define TRACE_THREAD_NAME(name) ((void) 0)
+#define TRACE_BEGIN(name)       ((void) 0)
+#define TRACE_END()             ((void) 0)
+#define TRACE_END_LONGER(us)    ((void) 0)
+#define TRACE_DUMP()            ((void) 0)
+
+#endif
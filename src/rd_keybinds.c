@@ -613,6 +613,10 @@ void BK_AddBindingsToSystemKeys()
     BK_AddBind(bk_abort, keyboard, SDL_SCANCODE_N);
     BK_AddBind(bk_abort, keyboard, SDL_SCANCODE_ESCAPE);
 
+#ifdef RD_TRACE_EVENTS
+    BK_AddBind(bk_trace_dump, keyboard, SDL_SCANCODE_SCROLLLOCK);
+#endif
+
     // Mouse
     BK_AddBind(bk_left, mouse, MOUSE_SCROLL_LEFT);
     BK_AddBind(bk_right, mouse, MOUSE_SCROLL_RIGHT);
@@ -161,6 +161,8 @@ typedef enum
     bk_confirm,
     bk_abort,
 
+    bk_trace_dump, // Only bound in RD_TRACE_EVENTS builds
+
     bk__size, // size of bound_key_t
     bk__null,
     bk__serializable = bk_left,
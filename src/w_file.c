@@ -24,6 +24,7 @@
 
 #include "doomtype.h"
 #include "m_argv.h"
+#include "m_starttrace.h"
 
 #include "w_file.h"
 
@@ -58,7 +59,7 @@ wad_file_t *W_OpenFile(char *path)
     // directly into memory.
     //
 
-    if (!M_CheckParm("-mmap"))
+    if (!M_CheckParm("-mmap") && !M_CheckParm("-mmapshared"))
     {
         return stdc_wad_file.OpenFile(path);
     }
@@ -88,6 +89,18 @@ void W_CloseFile(wad_file_t *wad)
 size_t W_Read(wad_file_t *wad, unsigned int offset,
               void *buffer, size_t buffer_len)
 {
-    return wad->file_class->Read(wad, offset, buffer, buffer_len);
+    const size_t result = wad->file_class->Read(wad, offset, buffer, buffer_len);
+
+    M_StartTraceBytes(result);
+
+    return result;
+}
+
+void W_Prefetch(wad_file_t *wad, unsigned int offset, size_t len)
+{
+    if (wad->mapped != NULL && wad->file_class->Prefetch != NULL)
+    {
+        wad->file_class->Prefetch(wad, offset, len);
+    }
 }
 
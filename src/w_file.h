@@ -39,6 +39,10 @@ typedef struct
     // provided buffer.  Returns the number of bytes read.
     size_t (*Read)(wad_file_t *file, unsigned int offset,
                    void *buffer, size_t buffer_len);
+
+    // Hint that the given range of a mapped file will be needed soon,
+    // so it can be read in the background. May be NULL.
+    void (*Prefetch)(wad_file_t *file, unsigned int offset, size_t len);
 } wad_file_class_t;
 
 struct _wad_file_s
@@ -72,3 +76,6 @@ void W_CloseFile(wad_file_t *wad);
 
 size_t W_Read(wad_file_t *wad, unsigned int offset,
               void *buffer, size_t buffer_len);
+
+// Ask for a range of a memory-mapped file to be read ahead.
+void W_Prefetch(wad_file_t *wad, unsigned int offset, size_t len);
@@ -27,6 +27,7 @@
 #include <sys/mman.h>
 #include <string.h>
 
+#include "m_argv.h"
 #include "m_misc.h"
 #include "w_file.h"
 #include "z_zone.h"
@@ -46,31 +47,51 @@ static void MapFile(posix_wad_file_t *wad, char *filename)
     int protection;
     int flags;
 
-    // Mapped area can be read and written to.  Ideally
-    // this should be read-only, as none of the Doom code should 
-    // change the WAD files after being read.  However, there may
-    // be code lurking in the source that does.
+    //!
+    // @category obscure
+    //
+    // Like -mmap, but map WAD files read-only and shared, so that
+    // several running copies of the game use the same pages of memory.
+    // Anything that writes into a lump crashes the game.
+    //
 
-    protection = PROT_READ|PROT_WRITE;
+    if (M_ParmExists("-mmapshared"))
+    {
+        protection = PROT_READ;
+        flags = MAP_SHARED;
+    }
+    else
+    {
+        // Mapped area can be read and written to.  Ideally
+        // this should be read-only, as none of the Doom code should
+        // change the WAD files after being read.  However, there may
+        // be code lurking in the source that does.
 
-    // Writes to the mapped area result in private changes that are
-    // *not* written to disk.
+        protection = PROT_READ|PROT_WRITE;
 
-    flags = MAP_PRIVATE;
+        // Writes to the mapped area result in private changes that are
+        // *not* written to disk.
+
+        flags = MAP_PRIVATE;
+    }
 
     result = mmap(NULL, wad->wad.length,
                   protection, flags, 
                   wad->handle, 0);
 
-    wad->wad.mapped = result;
-
-    if (result == NULL)
+    if (result == MAP_FAILED)
     {
+        // Fall back to reading the lumps.
+        wad->wad.mapped = NULL;
+
         printf(english_language ?
                         "W_POSIX_OpenFile: Unable to mmap() %s - %s\n" :
                         "W_POSIX_OpenFile: ошибка mmap() %s - %s\n",
                         filename, strerror(errno));
+        return;
     }
+
+    wad->wad.mapped = result;
 }
 
 unsigned int GetFileLength(int handle)
@@ -162,11 +183,39 @@ size_t W_POSIX_Read(wad_file_t *wad, unsigned int offset,
 }
 
 
+static void W_POSIX_Prefetch(wad_file_t *wad, unsigned int offset, size_t len)
+{
+#ifdef MADV_WILLNEED
+    static size_t pagesize;
+    size_t start;
+
+    if (pagesize == 0)
+    {
+        pagesize = sysconf(_SC_PAGESIZE);
+    }
+
+    if (offset >= wad->length)
+    {
+        return;
+    }
+
+    len = MIN(len, wad->length - offset);
+
+    // madvise() wants a page aligned address.
+
+    start = offset & ~(pagesize - 1);
+
+    madvise(wad->mapped + start, len + offset - start, MADV_WILLNEED);
+#endif
+}
+
+
 wad_file_class_t posix_wad_file = 
 {
     W_POSIX_OpenFile,
     W_POSIX_CloseFile,
     W_POSIX_Read,
+    W_POSIX_Prefetch,
 };
 
 
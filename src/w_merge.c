@@ -46,6 +46,7 @@ typedef struct
 {
     lumpinfo_t **lumps;
     int numlumps;
+    lumptable_t table;  // [JN] Built by FindInList
 } searchlist_t;
 
 typedef struct
@@ -68,8 +69,17 @@ static sprite_frame_t *sprite_frames;
 static int num_sprite_frames;
 static int sprite_frames_alloced;
 
-// Search in a list to find a lump with a particular name
-// Linear search (slow!)
+// [JN] Point a list at a new range of lumps.
+
+static void SetList(searchlist_t *list, lumpinfo_t **lumps, int numlumps)
+{
+    W_FreeLumpTable(&list->table);
+    list->lumps = lumps;
+    list->numlumps = numlumps;
+}
+
+// Search in a list to find the first lump with a particular name
+// [JN] The names are hashed on the first search.
 //
 // Returns -1 if not found
 
@@ -77,13 +87,18 @@ static int FindInList(searchlist_t *list, char *name)
 {
     int i;
 
-    for (i=0; i<list->numlumps; ++i)
+    if (list->table.keys == NULL)
     {
-        if (!strncasecmp(list->lumps[i]->name, name, 8))
-            return i;
+        W_InitLumpTable(&list->table, list->numlumps);
+
+        // Add backwards, so the first lump of a name is kept.
+        for (i = list->numlumps - 1; i >= 0; --i)
+        {
+            W_AddToLumpTable(&list->table, W_LumpKey(list->lumps[i]->name), i);
+        }
     }
 
-    return -1;
+    return W_FindInLumpTable(&list->table, W_LumpKey(name));
 }
 
 static boolean SetupList(searchlist_t *list, searchlist_t *src_list,
@@ -92,7 +107,7 @@ static boolean SetupList(searchlist_t *list, searchlist_t *src_list,
 {
     int startlump, endlump;
 
-    list->numlumps = 0;
+    SetList(list, NULL, 0);
     startlump = FindInList(src_list, startname);
 
     if (startname2 != NULL && startlump < 0)
@@ -111,8 +126,8 @@ static boolean SetupList(searchlist_t *list, searchlist_t *src_list,
 
         if (endlump > startlump)
         {
-            list->lumps = src_list->lumps + startlump + 1;
-            list->numlumps = endlump - startlump - 1;
+            SetList(list, src_list->lumps + startlump + 1,
+                    endlump - startlump - 1);
             return true;
         }
     }
@@ -589,11 +604,8 @@ void W_MergeFile(char *filename)
 
     // IWAD is at the start, PWAD was appended to the end
 
-    iwad.lumps = lumpinfo;
-    iwad.numlumps = old_numlumps;
-
-    pwad.lumps = lumpinfo + old_numlumps;
-    pwad.numlumps = numlumps - old_numlumps;
+    SetList(&iwad, lumpinfo, old_numlumps);
+    SetList(&pwad, lumpinfo + old_numlumps, numlumps - old_numlumps);
     
     // Setup sprite/flat lists
 
@@ -646,11 +658,8 @@ void W_NWTMergeFile(char *filename, int flags)
 
     // IWAD is at the start, PWAD was appended to the end
 
-    iwad.lumps = lumpinfo;
-    iwad.numlumps = old_numlumps;
-
-    pwad.lumps = lumpinfo + old_numlumps;
-    pwad.numlumps = numlumps - old_numlumps;
+    SetList(&iwad, lumpinfo, old_numlumps);
+    SetList(&pwad, lumpinfo + old_numlumps, numlumps - old_numlumps);
 
     // Setup sprite/flat lists
 
@@ -698,11 +707,8 @@ void W_NWTDashMerge(char *filename)
 
     // IWAD is at the start, PWAD was appended to the end
 
-    iwad.lumps = lumpinfo;
-    iwad.numlumps = old_numlumps;
-
-    pwad.lumps = lumpinfo + old_numlumps;
-    pwad.numlumps = numlumps - old_numlumps;
+    SetList(&iwad, lumpinfo, old_numlumps);
+    SetList(&pwad, lumpinfo + old_numlumps, numlumps - old_numlumps);
 
     // Setup sprite/flat lists
 
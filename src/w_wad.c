@@ -29,8 +29,11 @@
 
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_timer.h"
 #include "i_video.h"
+#include "m_cache.h"
 #include "m_misc.h"
+#include "m_starttrace.h"
 #include "v_diskicon.h"
 #include "z_zone.h"
 #include "w_wad.h"
@@ -60,8 +63,14 @@ typedef PACKED_STRUCT (
 lumpinfo_t **lumpinfo;
 unsigned int numlumps = 0;
 
-// Hash table for fast lookups
-static lumpindex_t *lumphash;
+// [JN] Name tables for fast lookups, one per namespace. Only the last
+// loaded lump of each name is in a table, see lumpinfo_t for the others.
+// There is no table for ns_patches.
+static lumptable_t lumptables[NUMLUMPNAMESPACES];
+
+// Marks a free slot. No lump name has a zero first character and
+// something after it.
+#define EMPTYKEY ((lumpkey_t) 0xff << 56)
 
 // Variables for the reload hack: filename of the PWAD to reload, and the
 // lumps from WADs before the reload file, so we can resent numlumps and
@@ -88,6 +97,106 @@ unsigned int W_LumpNameHash(const char *s)
     return result;
 }
 
+//
+// Lump name tables.
+//
+
+lumpkey_t W_LumpKey(const char *name)
+{
+    lumpkey_t key = 0;
+    int i;
+
+    for (i = 0; i < 8 && name[i] != '\0'; ++i)
+    {
+        key |= (lumpkey_t) toupper((unsigned char) name[i]) << (i * 8);
+    }
+
+    return key;
+}
+
+static unsigned int LumpKeySlot(const lumptable_t *table, lumpkey_t key)
+{
+    return (unsigned int) ((key * 0x9e3779b97f4a7c15ULL) >> 32) & table->mask;
+}
+
+static void AllocLumpTable(lumptable_t *table, unsigned int size)
+{
+    table->keys = malloc(size * sizeof(*table->keys));
+    table->lumps = malloc(size * sizeof(*table->lumps));
+    table->mask = size - 1;
+
+    if (table->keys == NULL || table->lumps == NULL)
+    {
+        I_QuitWithError(english_language ?
+                        "Failed to allocate lump name table" :
+                        "Ошибка выделения памяти для таблицы блоков");
+    }
+}
+
+void W_InitLumpTable(lumptable_t *table, int count)
+{
+    unsigned int size = 16;
+    unsigned int i;
+
+    // Keep the table at most half full.
+    while (size < (unsigned int) count * 2)
+    {
+        size *= 2;
+    }
+
+    AllocLumpTable(table, size);
+
+    for (i = 0; i < size; ++i)
+    {
+        table->keys[i] = EMPTYKEY;
+    }
+}
+
+void W_FreeLumpTable(lumptable_t *table)
+{
+    free(table->keys);
+    free(table->lumps);
+    table->keys = NULL;
+    table->lumps = NULL;
+}
+
+lumpindex_t W_AddToLumpTable(lumptable_t *table, lumpkey_t key, lumpindex_t lump)
+{
+    unsigned int i;
+    lumpindex_t old;
+
+    for (i = LumpKeySlot(table, key); table->keys[i] != key;
+         i = (i + 1) & table->mask)
+    {
+        if (table->keys[i] == EMPTYKEY)
+        {
+            table->keys[i] = key;
+            table->lumps[i] = lump;
+            return -1;
+        }
+    }
+
+    old = table->lumps[i];
+    table->lumps[i] = lump;
+    return old;
+}
+
+lumpindex_t W_FindInLumpTable(const lumptable_t *table, lumpkey_t key)
+{
+    unsigned int i;
+
+    for (i = LumpKeySlot(table, key); table->keys[i] != key;
+         i = (i + 1) & table->mask)
+    {
+        if (table->keys[i] == EMPTYKEY)
+        {
+            return -1;
+        }
+    }
+
+    return table->lumps[i];
+}
+
 //
 // LUMP BASED ROUTINES.
 //
@@ -112,6 +221,10 @@ wad_file_t *W_AddFile (char *filename)
     filelump_t *filerover;
     lumpinfo_t *filelumps;
     int numfilelumps;
+    char stage[40];
+
+    M_snprintf(stage, sizeof(stage), "W_AddFile %s", M_FileName(filename));
+    M_StartTraceBegin(stage);
 
     // If the filename begins with a ~, it indicates that we should use the
     // reload hack.
@@ -148,6 +261,7 @@ wad_file_t *W_AddFile (char *filename)
         printf (english_language ?
         " couldn't open %s\n" :
         " невозможно открыть %s\n", filename);
+        M_StartTraceEnd();
         return NULL;
     }
 
@@ -251,10 +365,9 @@ wad_file_t *W_AddFile (char *filename)
 
     Z_Free(fileinfo);
 
-    if (lumphash != NULL)
+    for (i = 0; i < NUMLUMPNAMESPACES; ++i)
     {
-        Z_Free(lumphash);
-        lumphash = NULL;
+        W_FreeLumpTable(&lumptables[i]);
     }
 
     // If this is the reload file, we need to save some details about the
@@ -265,6 +378,8 @@ wad_file_t *W_AddFile (char *filename)
         reloadlumps = filelumps;
     }
 
+    M_StartTraceEnd();
+
     return wad_file;
 }
 
@@ -291,21 +406,11 @@ lumpindex_t W_CheckNumForName(char* name)
 
     // Do we have a hash table yet?
 
-    if (lumphash != NULL)
+    if (lumptables[ns_global].keys != NULL)
     {
-        int hash;
-
         // We do! Excellent.
 
-        hash = W_LumpNameHash(name) % numlumps;
-
-        for (i = lumphash[hash]; i != -1; i = lumpinfo[i]->next)
-        {
-            if (!strncasecmp(lumpinfo[i]->name, name, 8))
-            {
-                return i;
-            }
-        }
+        return W_FindInLumpTable(&lumptables[ns_global], W_LumpKey(name));
     }
     else
     {
@@ -327,25 +432,42 @@ lumpindex_t W_CheckNumForName(char* name)
     return -1;
 }
 
+lumpindex_t W_CheckNumForNameNS(const char *name, lumpns_t ns)
+{
+    lumpindex_t i;
+
+    if (lumptables[ns_global].keys == NULL)
+    {
+        return W_CheckNumForName((char *) name);
+    }
+
+    if (ns == ns_patches)
+    {
+        // [crispy] prevent flat lumps from being mistaken as patches
+        for (i = W_FindInLumpTable(&lumptables[ns_global], W_LumpKey(name));
+             i != -1 && lumpinfo[i]->ns == ns_flats; i = lumpinfo[i]->next);
+
+        return i;
+    }
+
+    return W_FindInLumpTable(&lumptables[ns], W_LumpKey(name));
+}
+
 lumpindex_t W_CheckNumForNameRevers(char* name)
 {
     lumpindex_t i;
 
     // Do we have a hash table yet?
-    if(lumphash != NULL)
+    if(lumptables[ns_global].keys != NULL)
     {
-        // We do! Excellent.
-        int hash = W_LumpNameHash(name) % numlumps;
-        lumpindex_t lastFound = -1;
+        // We do! Excellent. Follow the older lumps to the first one.
+        i = W_FindInLumpTable(&lumptables[ns_global], W_LumpKey(name));
 
-        for(i = lumphash[hash]; i != -1; i = lumpinfo[i]->next)
+        while (i != -1 && lumpinfo[i]->next != -1)
         {
-            if(!strncasecmp(lumpinfo[i]->name, name, 8))
-            {
-                lastFound = i;
-            }
+            i = lumpinfo[i]->next;
         }
-        return lastFound;
+        return i;
     }
     else
     {
@@ -375,6 +497,14 @@ int W_CheckMultipleLumps(char *name)
 {
     int count = 0;
 
+    if (lumptables[ns_global].keys != NULL)
+    {
+        for (lumpindex_t i = W_CheckNumForName(name); i != -1; i = lumpinfo[i]->next)
+            count++;
+
+        return count;
+    }
+
     for (lumpindex_t i = numlumps - 1; i >= 0; i--)
         if (!strncasecmp(lumpinfo[i]->name, name, 8))
             count++;
@@ -439,16 +569,10 @@ lumpindex_t W_CheckNextNum(lumpindex_t lumpIndex)
     lumpindex_t i;
 
     // Do we have a hash table yet?
-    if(lumphash != NULL)
+    if(lumptables[ns_global].keys != NULL)
     {
         // We do! Excellent.
-        for(i = lumpinfo[lumpIndex]->prev; i != -1; i = lumpinfo[i]->prev)
-        {
-            if(!strncasecmp(lumpinfo[i]->name, lumpinfo[lumpIndex]->name, 8))
-            {
-                return i;
-            }
-        }
+        return lumpinfo[lumpIndex]->prev;
     }
     else
     {
@@ -568,6 +692,26 @@ void *W_CacheLumpNum(lumpindex_t lumpnum, int tag)
     return result;
 }
 
+//
+// W_LockedLumpNum
+//
+// Return a pointer to the data of a lump, which is already loaded
+// by W_CacheLumpNum with PU_STATIC tag. Unlike W_CacheLumpNum, the
+// zone tag is not touched, so several threads may call this at once.
+//
+
+const void *W_LockedLumpNum(lumpindex_t lumpnum)
+{
+    const lumpinfo_t *lump = lumpinfo[lumpnum];
+
+    if (lump->wad_file->mapped != NULL)
+    {
+        return lump->wad_file->mapped + lump->position;
+    }
+
+    return lump->cache;
+}
+
 
 
 //
@@ -614,6 +758,66 @@ void W_ReleaseLumpName(char *name)
     W_ReleaseLumpNum(W_GetNumForName(name));
 }
 
+//
+// Ask for lumps in memory-mapped files to be read ahead, instead of
+// touching them. Requests close to each other are merged into a single
+// range, which is passed on by W_FinishPrefetch.
+//
+
+#define PREFETCH_GAP (64 * 1024)
+
+static wad_file_t  *prefetch_wad;
+static unsigned int prefetch_start, prefetch_end;
+
+boolean W_PrefetchLumpNum(lumpindex_t lumpnum)
+{
+    lumpinfo_t *lump;
+    unsigned int start, end;
+
+    if((unsigned)lumpnum >= numlumps)
+    {
+        I_QuitWithError("W_PrefetchLumpNum: %i >= numlumps", lumpnum);
+    }
+
+    lump = lumpinfo[lumpnum];
+
+    if (lump->wad_file->mapped == NULL)
+    {
+        return false;
+    }
+
+    start = lump->position;
+    end = lump->position + lump->size;
+
+    if (lump->wad_file == prefetch_wad
+    &&  start <= prefetch_end + PREFETCH_GAP
+    &&  end + PREFETCH_GAP >= prefetch_start)
+    {
+        prefetch_start = MIN(prefetch_start, start);
+        prefetch_end = MAX(prefetch_end, end);
+    }
+    else
+    {
+        W_FinishPrefetch();
+
+        prefetch_wad = lump->wad_file;
+        prefetch_start = start;
+        prefetch_end = end;
+    }
+
+    return true;
+}
+
+void W_FinishPrefetch(void)
+{
+    if (prefetch_wad != NULL)
+    {
+        W_Prefetch(prefetch_wad, prefetch_start,
+                   prefetch_end - prefetch_start);
+        prefetch_wad = NULL;
+    }
+}
+
 #if 0
 
 //
@@ -680,44 +884,229 @@ void W_Profile (void)
 
 #endif
 
+// [JN] Mark the lumps strictly between the last loaded start and end
+// markers as belonging to a namespace.
+static void MarkNamespace(lumpns_t ns, char *start, char *end)
+{
+    lumpindex_t first = W_CheckNumForName(start);
+    lumpindex_t last = W_CheckNumForName(end);
+    lumpindex_t i;
+
+    if (first == -1 || last == -1)
+    {
+        return;
+    }
+
+    for (i = first + 1; i < last; ++i)
+    {
+        lumpinfo[i]->ns = ns;
+    }
+}
+
+// [JN] The name tables and lump chains only hold lump indices, so they
+// are kept in the startup cache as they are: next, prev and namespace
+// of every lump, then the size, keys and lumps of every table.
+
+#define LUMPLINKS 3
+
+static size_t LumpTableSize(unsigned int size)
+{
+    return sizeof(size) + size * (sizeof(lumpkey_t) + sizeof(lumpindex_t));
+}
+
+static boolean ReadLumpTables(void)
+{
+    size_t length, offset;
+    byte *data;
+    int *links;
+    int ns;
+
+    data = M_LoadStartupCache("lumptables", &numlumps, sizeof(numlumps), &length);
+
+    if (data == NULL)
+    {
+        return false;
+    }
+
+    // Check the layout before using any of it.
+    offset = numlumps * LUMPLINKS * sizeof(int);
+
+    for (ns = 0; ns < ns_patches && offset + sizeof(unsigned int) <= length; ++ns)
+    {
+        unsigned int size;
+
+        memcpy(&size, data + offset, sizeof(size));
+
+        if (size == 0 || (size & (size - 1)) != 0 || size > numlumps * 4 + 16)
+        {
+            break;
+        }
+
+        offset += LumpTableSize(size);
+    }
+
+    if (ns < ns_patches || offset != length)
+    {
+        free(data);
+        return false;
+    }
+
+    links = (int *) data;
+
+    for (unsigned int i = 0; i < numlumps; ++i)
+    {
+        lumpinfo[i]->next = links[i * LUMPLINKS];
+        lumpinfo[i]->prev = links[i * LUMPLINKS + 1];
+        lumpinfo[i]->ns = links[i * LUMPLINKS + 2];
+    }
+
+    offset = numlumps * LUMPLINKS * sizeof(int);
+
+    for (ns = 0; ns < ns_patches; ++ns)
+    {
+        lumptable_t *table = &lumptables[ns];
+        unsigned int size;
+
+        memcpy(&size, data + offset, sizeof(size));
+        offset += sizeof(size);
+
+        AllocLumpTable(table, size);
+        table->mask = size - 1;
+
+        memcpy(table->keys, data + offset, size * sizeof(*table->keys));
+        offset += size * sizeof(*table->keys);
+        memcpy(table->lumps, data + offset, size * sizeof(*table->lumps));
+        offset += size * sizeof(*table->lumps);
+    }
+
+    free(data);
+
+    return true;
+}
+
+static void WriteLumpTables(void)
+{
+    size_t length, offset;
+    byte *data;
+    int *links;
+    int ns;
+
+    if (!M_StartupCacheEnabled())
+    {
+        return;
+    }
+
+    length = numlumps * LUMPLINKS * sizeof(int);
+
+    for (ns = 0; ns < ns_patches; ++ns)
+    {
+        length += LumpTableSize(lumptables[ns].mask + 1);
+    }
+
+    data = malloc(length);
+
+    if (data == NULL)
+    {
+        return;
+    }
+
+    links = (int *) data;
+
+    for (unsigned int i = 0; i < numlumps; ++i)
+    {
+        links[i * LUMPLINKS] = lumpinfo[i]->next;
+        links[i * LUMPLINKS + 1] = lumpinfo[i]->prev;
+        links[i * LUMPLINKS + 2] = lumpinfo[i]->ns;
+    }
+
+    offset = numlumps * LUMPLINKS * sizeof(int);
+
+    for (ns = 0; ns < ns_patches; ++ns)
+    {
+        const lumptable_t *table = &lumptables[ns];
+        const unsigned int size = table->mask + 1;
+
+        memcpy(data + offset, &size, sizeof(size));
+        offset += sizeof(size);
+        memcpy(data + offset, table->keys, size * sizeof(*table->keys));
+        offset += size * sizeof(*table->keys);
+        memcpy(data + offset, table->lumps, size * sizeof(*table->lumps));
+        offset += size * sizeof(*table->lumps);
+    }
+
+    M_WriteStartupCache("lumptables", &numlumps, sizeof(numlumps), data, length);
+    free(data);
+}
+
 // Generate a hash table for fast lookups
 
 void W_GenerateHashTable(void)
 {
     lumpindex_t i;
+    int count[NUMLUMPNAMESPACES] = {0};
+    int ns;
+    const int starttime = I_GetTimeMS();
+    boolean cached;
 
-    // Free the old hash table, if there is one:
-    if (lumphash != NULL)
+    // Free the old hash tables, if there are any:
+    for (ns = 0; ns < NUMLUMPNAMESPACES; ++ns)
     {
-        Z_Free(lumphash);
+        W_FreeLumpTable(&lumptables[ns]);
     }
 
-    // Generate hash table
-    if (numlumps > 0)
+    // [JN] Reuse the tables of the same directory from the startup cache,
+    // unless a file is reloaded on every level for being edited meanwhile.
+    cached = numlumps > 0 && reloadname == NULL && ReadLumpTables();
+
+    // Generate hash tables
+    if (numlumps > 0 && !cached)
     {
-        lumphash = Z_Malloc(sizeof(lumpindex_t) * numlumps, PU_STATIC, NULL);
+        W_InitLumpTable(&lumptables[ns_global], numlumps);
 
         for (i = 0; i < numlumps; ++i)
         {
-            lumphash[i] = -1;
+            lumpinfo_t *lump = lumpinfo[i];
+
+            // The new lump hides the old one, and is chained to it.
+            lump->next = W_AddToLumpTable(&lumptables[ns_global],
+                                          W_LumpKey(lump->name), i);
+            lump->prev = -1;
+            lump->ns = ns_global;
+            if (lump->next != -1)
+                lumpinfo[lump->next]->prev = i;
         }
 
+        MarkNamespace(ns_flats, "F_START", "F_END");
+        MarkNamespace(ns_sprites, "S_START", "S_END");
+        MarkNamespace(ns_colormaps, "C_START", "C_END");
+
         for (i = 0; i < numlumps; ++i)
         {
-            unsigned int hash;
+            count[lumpinfo[i]->ns]++;
+        }
 
-            hash = W_LumpNameHash(lumpinfo[i]->name) % numlumps;
+        for (ns = ns_global + 1; ns < ns_patches; ++ns)
+        {
+            W_InitLumpTable(&lumptables[ns], count[ns]);
+        }
 
-            // Hook into the hash table
+        for (i = 0; i < numlumps; ++i)
+        {
+            if (lumpinfo[i]->ns != ns_global)
+            {
+                W_AddToLumpTable(&lumptables[lumpinfo[i]->ns],
+                                 W_LumpKey(lumpinfo[i]->name), i);
+            }
+        }
 
-            lumpinfo[i]->next = lumphash[hash];
-            lumpinfo[i]->prev = -1;
-            if(lumphash[hash] != -1)
-                lumpinfo[lumphash[hash]]->prev = i;
-            lumphash[hash] = i;
+        if (reloadname == NULL)
+        {
+            WriteLumpTables();
         }
     }
 
+    M_StartupTime("lumptables", cached, starttime);
+
     // All done!
 }
 
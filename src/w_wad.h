@@ -22,6 +22,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdint.h>
 #include "doomtype.h"
 #include "w_file.h"
 
@@ -37,6 +38,22 @@
 typedef struct lumpinfo_s lumpinfo_t;
 typedef int lumpindex_t;
 
+// Lump name, upper-cased and packed into an integer.
+typedef uint64_t lumpkey_t;
+
+// [JN] Lumps between the F_START/F_END, S_START/S_END and C_START/C_END
+// markers, as found by W_CheckNumForName. Patches are any lumps which
+// are not flats.
+typedef enum
+{
+    ns_global,
+    ns_flats,
+    ns_sprites,
+    ns_colormaps,
+    ns_patches,
+    NUMLUMPNAMESPACES
+} lumpns_t;
+
 struct lumpinfo_s
 {
     char	name[8];
@@ -45,11 +62,21 @@ struct lumpinfo_s
     int		size;
     void       *cache;
 
-    // Used for hash table lookups
+    // Lumps with the same name: next was loaded before this one,
+    // prev after it. Set by W_GenerateHashTable.
     lumpindex_t next;
     lumpindex_t prev;
+    lumpns_t    ns;
 };
 
+// Open addressing table of lump name keys.
+typedef struct
+{
+    lumpkey_t   *keys;
+    lumpindex_t *lumps;
+    unsigned int mask;
+} lumptable_t;
+
 int W_CheckMultipleLumps(char *name);
 
 extern lumpinfo_t **lumpinfo;
@@ -60,6 +87,13 @@ void W_Reload(void);
 
 lumpindex_t W_CheckNumForName(char *name);
 
+/**
+ * Find the last loaded lump with the given name in a namespace.
+ * Before W_GenerateHashTable this is the same as W_CheckNumForName.
+ * @return lump index or -1 if name not found.
+ */
+lumpindex_t W_CheckNumForNameNS(const char *name, lumpns_t ns);
+
 /**
  * Search for lump in reverse order relative to W_CheckNumForName i.e. find firstly loaded lump with given name.
  * @Returns lump index or -1 if name not found.
@@ -84,11 +118,27 @@ int W_LumpLength(lumpindex_t lump);
 void W_ReadLump(lumpindex_t lump, void *dest);
 
 void *W_CacheLumpNum(lumpindex_t lumpnum, int tag);
+const void *W_LockedLumpNum(lumpindex_t lumpnum);
 void *W_CacheLumpName(char *name, int tag);
 
 void W_GenerateHashTable(void);
 
 extern unsigned int W_LumpNameHash(const char *s);
 
+lumpkey_t W_LumpKey(const char *name);
+
+// Tables for count keys. Adding a key that is already in the table
+// replaces its lump, and returns the old one (or -1).
+void W_InitLumpTable(lumptable_t *table, int count);
+void W_FreeLumpTable(lumptable_t *table);
+lumpindex_t W_AddToLumpTable(lumptable_t *table, lumpkey_t key, lumpindex_t lump);
+lumpindex_t W_FindInLumpTable(const lumptable_t *table, lumpkey_t key);
+
 void W_ReleaseLumpNum(lumpindex_t lumpnum);
 void W_ReleaseLumpName(char *name);
+
+// Ask for a lump to be read ahead. Returns false, doing nothing, if
+// the lump is not in a memory-mapped file. Pending requests are only
+// issued by W_FinishPrefetch.
+boolean W_PrefetchLumpNum(lumpindex_t lumpnum);
+void W_FinishPrefetch(void);
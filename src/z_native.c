@@ -26,7 +26,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "z_pool.h"
 #include "z_zone.h"
+#include "m_trace.h"
 #include "i_system.h"
 #include "doomtype.h"
 #include "jn.h"
@@ -242,6 +244,8 @@ void *Z_Malloc(int size, int tag, void *user)
     unsigned char *data;
     void *result;
 
+    TRACE_BEGIN("Z_Malloc");
+
     if(tag < 0 || tag >= PU_NUM_TAGS || tag == PU_FREE)
     {
         I_QuitWithError(english_language ?
@@ -295,6 +299,9 @@ void *Z_Malloc(int size, int tag, void *user)
         *newblock->user = result;
     }
     
+    // Only allocations which stall for longer than 0.1 ms.
+    TRACE_END_LONGER(100);
+
     return result;
 }
 
@@ -379,6 +386,8 @@ void Z_DumpHeap(int lowtag, int	hightag)
 	    printf ("ERROR: two consecutive free blocks\n");
     }
 #endif
+
+    Z_DumpPools(stdout);
 }
 
 
@@ -414,6 +423,8 @@ void Z_FileDumpHeap(FILE *f)
 	    fprintf (f,"ERROR: two consecutive free blocks\n");
     }
 #endif
+
+    Z_DumpPools(f);
 }
 
 
@@ -0,0 +1,178 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Fixed size object pools on top of the zone.
+//
+//      Objects are carved from slabs of SLABSIZE bytes, aligned to
+//      cache lines, so objects allocated together stay close in memory.
+//      Freed objects are kept in a free list. Slab addresses are kept
+//      sorted, so the pool can tell its objects from the others.
+//
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "i_system.h"
+#include "z_pool.h"
+#include "z_zone.h"
+#include "jn.h"
+
+
+#define SLABSIZE (16 * 1024)
+
+static zpool_t *pools;
+
+//
+// Z_InitPool
+//
+void Z_InitPool (zpool_t *pool, const char *name, int size, int tag)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->name = name;
+    pool->size = (size + POOLALIGN - 1) & ~(POOLALIGN - 1);
+    pool->tag = tag;
+    pool->next = pools;
+    pools = pool;
+}
+
+//
+// FindSlab
+// Returns index of the last slab starting at or below ptr, or -1.
+//
+static int FindSlab (const zpool_t *pool, const byte *ptr)
+{
+    int lo = 0, hi = pool->numslabs - 1, found = -1;
+
+    while (lo <= hi)
+    {
+        const int mid = (lo + hi) / 2;
+
+        if (pool->slabs[mid] <= ptr)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+
+    return found;
+}
+
+//
+// AddSlab
+// Allocates a slab and puts all its objects into the free list.
+//
+static void AddSlab (zpool_t *pool)
+{
+    const int count = MAX(SLABSIZE / pool->size, 1);
+    byte *raw = Z_Malloc(count * pool->size + POOLALIGN - 1, pool->tag, NULL);
+    byte *slab = (byte *) (((uintptr_t) raw + POOLALIGN - 1) & ~(uintptr_t) (POOLALIGN - 1));
+    int pos;
+
+    if (pool->numslabs == pool->maxslabs)
+    {
+        pool->maxslabs = pool->maxslabs ? pool->maxslabs * 2 : 16;
+        pool->slabs = I_Realloc(pool->slabs, pool->maxslabs * sizeof(*pool->slabs));
+    }
+
+    pos = FindSlab(pool, slab) + 1;
+    memmove(&pool->slabs[pos + 1], &pool->slabs[pos],
+            (pool->numslabs - pos) * sizeof(*pool->slabs));
+    pool->slabs[pos] = slab;
+    pool->numslabs++;
+
+    for (int i = count - 1 ; i >= 0 ; i--)
+    {
+        void **obj = (void **) (slab + i * pool->size);
+
+        *obj = pool->freelist;
+        pool->freelist = obj;
+    }
+}
+
+//
+// Z_PoolAlloc
+//
+void *Z_PoolAlloc (zpool_t *pool)
+{
+    void **obj;
+
+    if (pool->freelist == NULL)
+    {
+        AddSlab(pool);
+    }
+
+    obj = pool->freelist;
+    pool->freelist = *obj;
+
+    pool->allocs++;
+    pool->used++;
+    pool->peak = MAX(pool->peak, pool->used);
+
+    return obj;
+}
+
+//
+// Z_PoolFree
+//
+boolean Z_PoolFree (zpool_t *pool, void *ptr)
+{
+    const int count = MAX(SLABSIZE / pool->size, 1);
+    const int slab = FindSlab(pool, ptr);
+
+    if (slab < 0 || (byte *) ptr >= pool->slabs[slab] + count * pool->size)
+    {
+        return false;
+    }
+
+    *(void **) ptr = pool->freelist;
+    pool->freelist = ptr;
+    pool->used--;
+
+    return true;
+}
+
+//
+// Z_ResetPool
+//
+void Z_ResetPool (zpool_t *pool)
+{
+    pool->freelist = NULL;
+    pool->numslabs = 0;
+    pool->used = 0;
+    pool->allocs = 0;
+}
+
+//
+// Z_DumpPools
+//
+void Z_DumpPools (FILE *f)
+{
+    for (zpool_t *pool = pools ; pool ; pool = pool->next)
+    {
+        const int count = MAX(SLABSIZE / pool->size, 1);
+
+        fprintf(f, english_language ?
+                "pool %s: object %i bytes, %i used, %i peak, %i allocs, %i slabs (%i KB)\n" :
+                "пул %s: объект %i байт, %i занято, %i пик, %i выделений, %i блоков (%i КБ)\n",
+                pool->name, pool->size, pool->used, pool->peak, pool->allocs,
+                pool->numslabs, pool->numslabs * count * pool->size / 1024);
+    }
+}
@@ -0,0 +1,61 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Fixed size object pools on top of the zone.
+//
+
+
+#pragma once
+
+#include <stdio.h>
+
+#include "doomtype.h"
+
+
+// Objects are placed at cache line boundaries.
+#define POOLALIGN 64
+
+typedef struct zpool_s
+{
+    const char     *name;
+    int             size;       // object size, multiple of POOLALIGN
+    int             tag;        // zone tag of slabs
+    void           *freelist;
+    byte          **slabs;      // sorted by address
+    int             numslabs;
+    int             maxslabs;
+    int             used;       // objects in use
+    int             peak;
+    int             allocs;     // since the last reset
+    struct zpool_s *next;
+} zpool_t;
+
+// Register a pool of objects of the given size. Slabs are allocated
+// from the zone with the given tag.
+void Z_InitPool (zpool_t *pool, const char *name, int size, int tag);
+
+// Allocate an object. Memory is not cleared.
+void *Z_PoolAlloc (zpool_t *pool);
+
+// Return an object to the pool. Returns false if it doesn't belong
+// to the pool, so it can be freed some other way.
+boolean Z_PoolFree (zpool_t *pool, void *ptr);
+
+// Forget all slabs. Called once the zone has freed memory of their tag.
+void Z_ResetPool (zpool_t *pool);
+
+// Print statistics of all pools.
+void Z_DumpPools (FILE *f);
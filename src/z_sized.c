@@ -0,0 +1,672 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+// Copyright(C) 2016-2023 Julian Nechaevsky
+// Copyright(C) 2020-2024 Leonid Murin (Dasperal)
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Zone Memory Allocation with size classes and level arenas.
+//
+//	This is an implementation of the zone memory API which keeps
+//	per-size-class free lists for small blocks, and a bump arena
+//	for each level tag (PU_LEVEL, PU_LEVSPEC). Freeing the level
+//	tags resets their arenas without walking their blocks.
+//
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "z_pool.h"
+#include "z_zone.h"
+#include "m_trace.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "doomtype.h"
+#include "jn.h"
+
+#define ZONEID	0x1d4a11
+
+#define MEM_ALIGN   sizeof(void *)
+
+// Small blocks are rounded up to a multiple of CLASSSTEP
+// and recycled through free lists of their size class.
+#define CLASSSTEP   16
+#define MAXSMALL    512
+#define NUMCLASSES  (MAXSMALL / CLASSSTEP)
+
+// Special size classes of blocks which are not recycled.
+#define CLASS_BUMP  NUMCLASSES          // carved from an arena chunk
+#define CLASS_LARGE (NUMCLASSES + 1)    // allocated with malloc()
+
+// Arena chunks. Level blocks bigger than MAXBUMP get their own malloc().
+#define CHUNKSIZE   (256 * 1024)
+#define MAXBUMP     (CHUNKSIZE / 4)
+
+#define IS_ARENA(tag) ((tag) == PU_LEVEL || (tag) == PU_LEVSPEC)
+
+typedef struct chunk_s chunk_t;
+typedef struct memblock_s memblock_t;
+
+struct memblock_s
+{
+    int id; // = ZONEID
+    short tag;
+    byte home;      // Tag of the arena the block was carved from.
+    byte sclass;
+    int size;
+    void **user;
+    chunk_t *chunk; // Chunk of the block, NULL if not in an arena.
+    memblock_t *prev;
+    memblock_t *next;
+};
+
+struct chunk_s
+{
+    chunk_t *next;
+    int used;
+    int escaped;    // Live blocks which don't belong to the arena anymore.
+    boolean orphan; // Arena was freed, chunk waits for escaped blocks.
+};
+
+#define CHUNKHEADER ((sizeof(chunk_t) + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1))
+
+typedef struct
+{
+    chunk_t *chunks;                    // Current chunk first.
+    memblock_t *freelist[NUMCLASSES];
+    memblock_t *owned;                  // Blocks with a user pointer.
+} arena_t;
+
+// Blocks which are not in an arena, or are in one and have a user,
+// are kept in linked lists. Arena blocks without users aren't
+// linked anywhere, they are freed along with their arena.
+
+static memblock_t *allocated_blocks[PU_NUM_TAGS];
+static arena_t arenas[PU_NUM_TAGS];
+
+// Small blocks of other tags.
+static memblock_t *freelist[NUMCLASSES];
+static chunk_t *general_chunks;
+
+// Chunks of freed arenas, ready for the next level.
+static chunk_t *spare_chunks;
+
+static boolean zero_on_free;
+
+
+static int SizeClass (int size)
+{
+    return size > 0 ? (size - 1) / CLASSSTEP : 0;
+}
+
+// Does the block still belong to its arena?
+static boolean InArena (const memblock_t *block)
+{
+    return block->chunk != NULL && !block->chunk->orphan
+        && block->tag == block->home;
+}
+
+static memblock_t **BlockList (memblock_t *block)
+{
+    if (!InArena(block))
+    {
+        return &allocated_blocks[block->tag];
+    }
+
+    return block->user != NULL ? &arenas[block->tag].owned : NULL;
+}
+
+// Add a block into the linked list it belongs to.
+
+static void Z_InsertBlock(memblock_t *block)
+{
+    memblock_t **list = BlockList(block);
+
+    if (list == NULL)
+    {
+        return;
+    }
+
+    block->prev = NULL;
+    block->next = *list;
+    *list = block;
+
+    if (block->next != NULL)
+    {
+        block->next->prev = block;
+    }
+}
+
+// Remove a block from its linked list.
+
+static void Z_RemoveBlock(memblock_t *block)
+{
+    memblock_t **list = BlockList(block);
+
+    if (list == NULL)
+    {
+        return;
+    }
+
+    if (block->prev == NULL)
+    {
+        *list = block->next;
+    }
+    else
+    {
+        block->prev->next = block->next;
+    }
+
+    if (block->next != NULL)
+    {
+        block->next->prev = block->prev;
+    }
+}
+
+// Empty data from the cache list to allocate enough data of the size
+// required.
+//
+// Returns true if any blocks were freed.
+
+static boolean ClearCache(int size)
+{
+    memblock_t *block;
+    memblock_t *next_block;
+    int remaining;
+
+    block = allocated_blocks[PU_CACHE];
+
+    if (block == NULL)
+    {
+        return false;
+    }
+
+    // The blocks at the end of the PU_CACHE list are the ones that
+    // have been free for longer and are more likely to be unneeded now.
+
+    while (block->next != NULL)
+    {
+        block = block->next;
+    }
+
+    remaining = size;
+
+    while (remaining > 0 && block != NULL)
+    {
+        next_block = block->prev;
+        remaining -= block->size;
+        Z_Free((byte *) block + sizeof(memblock_t));
+        block = next_block;
+    }
+
+    return true;
+}
+
+static void *AllocSystem (int size)
+{
+    void *result;
+
+    while ((result = malloc(size)) == NULL)
+    {
+        if (!ClearCache(size))
+        {
+            I_QuitWithError(english_language ?
+                            "Z_Malloc: failed on allocation of %i bytes" :
+                            "Z_Malloc: ошибка обнаружения %i байт памяти",
+                            size);
+        }
+    }
+
+    return result;
+}
+
+static chunk_t *NewChunk (chunk_t *next)
+{
+    chunk_t *chunk = spare_chunks;
+
+    if (chunk != NULL)
+    {
+        spare_chunks = chunk->next;
+    }
+    else
+    {
+        chunk = AllocSystem(CHUNKSIZE);
+    }
+
+    chunk->next = next;
+    chunk->used = CHUNKHEADER;
+    chunk->escaped = 0;
+    chunk->orphan = false;
+
+    return chunk;
+}
+
+// Carve a block from the first chunk of the list, adding a new one
+// if it doesn't fit.
+
+static memblock_t *BumpBlock (chunk_t **chunks, int size)
+{
+    memblock_t *block;
+
+    if (*chunks == NULL || (*chunks)->used + size > CHUNKSIZE)
+    {
+        *chunks = NewChunk(*chunks);
+    }
+
+    block = (memblock_t *) ((byte *) *chunks + (*chunks)->used);
+    (*chunks)->used += size;
+    block->chunk = *chunks;
+
+    return block;
+}
+
+static memblock_t *NewBlock (int size, int tag)
+{
+    memblock_t *block;
+    int sclass;
+
+    size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+
+    if (size <= MAXSMALL)
+    {
+        memblock_t **list;
+
+        sclass = SizeClass(size);
+        list = IS_ARENA(tag) ? &arenas[tag].freelist[sclass] : &freelist[sclass];
+
+        if (*list != NULL)
+        {
+            block = *list;
+            *list = block->next;
+            block->sclass = sclass;
+            return block;
+        }
+
+        size = (sclass + 1) * CLASSSTEP + sizeof(memblock_t);
+
+        if (IS_ARENA(tag))
+        {
+            block = BumpBlock(&arenas[tag].chunks, size);
+            block->home = tag;
+        }
+        else
+        {
+            block = BumpBlock(&general_chunks, size);
+            block->chunk = NULL;
+            block->home = 0;
+        }
+    }
+    else if (IS_ARENA(tag) && size <= MAXBUMP)
+    {
+        sclass = CLASS_BUMP;
+        block = BumpBlock(&arenas[tag].chunks, size + sizeof(memblock_t));
+        block->home = tag;
+    }
+    else
+    {
+        sclass = CLASS_LARGE;
+        block = AllocSystem(size + sizeof(memblock_t));
+        block->chunk = NULL;
+        block->home = 0;
+    }
+
+    block->sclass = sclass;
+
+    return block;
+}
+
+//
+// Z_Init
+//
+void Z_Init (void)
+{
+    memset(allocated_blocks, 0, sizeof(allocated_blocks));
+    memset(arenas, 0, sizeof(arenas));
+    memset(freelist, 0, sizeof(freelist));
+
+    // [Deliberately undocumented]
+    // Zone memory debugging flag. If set, memory is zeroed after it is freed
+    // to deliberately break any code that attempts to use it after free.
+    //
+    zero_on_free = M_ParmExists("-zonezero");
+
+    printf(english_language ?
+           "zone memory: Using size class allocator.\n" :
+           "zone memory: используется распределитель по размерам блоков.\n");
+}
+
+
+//
+// Z_Free
+//
+void Z_Free (void* ptr)
+{
+    memblock_t*		block;
+    chunk_t*		chunk;
+
+    block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
+
+    if(block->id != ZONEID)
+    {
+        I_QuitWithError(english_language ?
+                        "Z_Free: freed a pointer without ZONEID" :
+                        "Z_Free: высвобождение указателя без ZONEID");
+    }
+
+    if (block->user != NULL)
+    {
+        // clear the user's mark
+
+        *block->user = NULL;
+    }
+
+    Z_RemoveBlock(block);
+
+    block->id = 0;
+    block->user = NULL;
+
+    if (zero_on_free)
+    {
+        memset(ptr, 0, block->size);
+    }
+
+    chunk = block->chunk;
+
+    if (chunk != NULL && !InArena(block))
+    {
+        if (--chunk->escaped == 0 && chunk->orphan)
+        {
+            // Last block of a freed arena.
+            chunk->next = spare_chunks;
+            spare_chunks = chunk;
+            return;
+        }
+    }
+
+    if (chunk != NULL && chunk->orphan)
+    {
+        return;
+    }
+
+    if (block->sclass < NUMCLASSES)
+    {
+        memblock_t **list = chunk != NULL ?
+                            &arenas[block->home].freelist[block->sclass] :
+                            &freelist[block->sclass];
+
+        block->next = *list;
+        *list = block;
+    }
+    else if (block->sclass == CLASS_LARGE)
+    {
+        free(block);
+    }
+
+    // Bump blocks are reclaimed along with their arena.
+}
+
+//
+// Z_Malloc
+// You can pass a NULL user if the tag is < PU_PURGELEVEL.
+//
+
+void *Z_Malloc(int size, int tag, void *user)
+{
+    memblock_t *newblock;
+    void *result;
+
+    TRACE_BEGIN("Z_Malloc");
+
+    if(tag < 0 || tag >= PU_NUM_TAGS || tag == PU_FREE)
+    {
+        I_QuitWithError(english_language ?
+                        "Z_Malloc: attempted to allocate a block with an invalid tag: %i" :
+                        "Z_Malloc: попытка обнаружения блока с некорректным номером: %i",
+                        tag);
+    }
+
+    if(user == NULL && tag >= PU_PURGELEVEL)
+    {
+        I_QuitWithError(english_language ?
+                        "Z_Malloc: an owner is required for purgable blocks" :
+                        "Z_Malloc: для очищаемых блоков памяти требуется административный объект");
+    }
+
+    newblock = NewBlock(size, tag);
+
+    newblock->id = ZONEID;
+    newblock->tag = tag;
+    newblock->user = user;
+    newblock->size = size;
+
+    Z_InsertBlock(newblock);
+
+    result = (byte *) newblock + sizeof(memblock_t);
+
+    if (user != NULL)
+    {
+        *newblock->user = result;
+    }
+
+    // Only allocations which stall for longer than 0.1 ms.
+    TRACE_END_LONGER(100);
+
+    return result;
+}
+
+// Free every block of an arena at once. Chunks which still hold
+// blocks of other tags are kept until these blocks are freed.
+
+static void ResetArena (arena_t *arena)
+{
+    memblock_t *block;
+    chunk_t *chunk, *next;
+
+    for (block = arena->owned ; block != NULL ; block = block->next)
+    {
+        *block->user = NULL;
+        block->id = 0;
+    }
+
+    for (chunk = arena->chunks ; chunk != NULL ; chunk = next)
+    {
+        next = chunk->next;
+
+        if (chunk->escaped > 0)
+        {
+            chunk->orphan = true;
+        }
+        else
+        {
+            chunk->next = spare_chunks;
+            spare_chunks = chunk;
+        }
+    }
+
+    memset(arena, 0, sizeof(*arena));
+}
+
+//
+// Z_FreeTags
+//
+
+void Z_FreeTags(int lowtag, int hightag)
+{
+    int i;
+
+    for (i = MAX(lowtag, 0) ; i <= hightag && i < PU_NUM_TAGS ; ++i)
+    {
+        if (IS_ARENA(i))
+        {
+            ResetArena(&arenas[i]);
+        }
+
+        // Free blocks which are not in the arena one by one.
+
+        while (allocated_blocks[i] != NULL)
+        {
+            Z_Free((byte *) allocated_blocks[i] + sizeof(memblock_t));
+        }
+    }
+}
+
+//
+// Z_DumpHeap
+//
+void Z_DumpHeap(int lowtag, int hightag)
+{
+    Z_FileDumpHeap(stdout);
+}
+
+//
+// Z_FileDumpHeap
+//
+void Z_FileDumpHeap(FILE *f)
+{
+    for (int i = 0 ; i < PU_NUM_TAGS ; i++)
+    {
+        int blocks = 0, bytes = 0, chunks = 0;
+
+        for (memblock_t *block = allocated_blocks[i] ; block ; block = block->next)
+        {
+            blocks++;
+            bytes += block->size;
+        }
+
+        for (chunk_t *chunk = arenas[i].chunks ; chunk ; chunk = chunk->next)
+        {
+            chunks++;
+        }
+
+        fprintf(f, english_language ?
+                "tag %i: %i listed blocks, %i bytes, %i arena chunks\n" :
+                "тег %i: %i блоков в списке, %i байт, %i блоков арены\n",
+                i, blocks, bytes, chunks);
+    }
+
+    Z_DumpPools(f);
+}
+
+//
+// Z_CheckHeap
+//
+void Z_CheckHeap (void)
+{
+    for (int i = 0 ; i < PU_NUM_TAGS ; i++)
+    {
+        memblock_t *lists[2] = { allocated_blocks[i], arenas[i].owned };
+
+        for (int j = 0 ; j < 2 ; j++)
+        {
+            memblock_t *prev = NULL;
+
+            for (memblock_t *block = lists[j] ; block ; block = block->next)
+            {
+                if (block->id != ZONEID)
+                {
+                    I_QuitWithError(english_language ?
+                                    "Z_CheckHeap: Block without a ZONEID!" :
+                                    "Z_CheckHeap: блок без ZONEID!");
+                }
+
+                if (block->prev != prev)
+                {
+                    I_QuitWithError(english_language ?
+                                    "Z_CheckHeap: Doubly-linked list corrupted!" :
+                                    "Z_CheckHeap: двусвязный блок поврежден!");
+                }
+
+                prev = block;
+            }
+        }
+    }
+}
+
+//
+// Z_ChangeTag
+//
+
+void Z_ChangeTag2(void *ptr, int tag, char *file, int line)
+{
+    memblock_t*	block;
+    boolean	wasinarena;
+
+    block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
+
+    if(block->id != ZONEID)
+        I_QuitWithError(english_language ?
+                        "%s:%i: Z_ChangeTag: block without a ZONEID!" :
+                        "%s:%i: Z_ChangeTag: блок без ZONEID!",
+                        file, line);
+
+    if(tag >= PU_PURGELEVEL && block->user == NULL)
+        I_QuitWithError(english_language ?
+                        "%s:%i: Z_ChangeTag: an owner is required for purgable blocks" :
+                        "%s:%i: Z_ChangeTag: для очищаемых блоков памяти требуется административный объект",
+                        file, line);
+
+    // Remove the block from its current list, and rehook it into
+    // its new list. Arena blocks which change their tag escape from
+    // the arena, so it is not freed under them.
+
+    wasinarena = InArena(block);
+    Z_RemoveBlock(block);
+    block->tag = tag;
+
+    if (wasinarena && !InArena(block))
+    {
+        block->chunk->escaped++;
+    }
+    else if (!wasinarena && InArena(block))
+    {
+        block->chunk->escaped--;
+    }
+
+    Z_InsertBlock(block);
+}
+
+void Z_ChangeUser(void *ptr, void **user)
+{
+    memblock_t*	block;
+
+    block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
+
+    if(block->id != ZONEID)
+    {
+        I_QuitWithError(english_language ?
+                        "Z_ChangeUser: Tried to change user for invalid block!" :
+                        "Z_ChangeUser: попытка смены пользователя для некорректного блока!");
+    }
+
+    Z_RemoveBlock(block);
+    block->user = user;
+    Z_InsertBlock(block);
+    *user = ptr;
+}
+
+//
+// Z_FreeMemory
+//
+
+int Z_FreeMemory(void)
+{
+    // Limited by the system??
+
+    return -1;
+}
+
+unsigned int Z_ZoneSize(void)
+{
+    return 0;
+}
@@ -25,6 +25,8 @@
 #include "doomtype.h"
 #include "i_system.h"
 #include "m_argv.h"
+#include "m_trace.h"
+#include "z_pool.h"
 #include "z_zone.h"
 #include "jn.h"
 
@@ -264,6 +266,8 @@ Z_Malloc
     memblock_t*	base;
     void *result;
 
+    TRACE_BEGIN("Z_Malloc");
+
     size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
     
     // scan through the block list,
@@ -365,6 +369,9 @@ Z_Malloc
 	
     base->id = ZONEID;
    
+    // Only allocations which stall for longer than 0.1 ms.
+    TRACE_END_LONGER(100);
+
     return result;
 }
 
@@ -449,6 +456,8 @@ Z_DumpHeap
                 "ERROR: two consecutive free blocks\n" :
                 "ОШИБКА: два последовательных свободных блока\n");
     }
+
+    Z_DumpPools(stdout);
 }
 
 
@@ -492,6 +501,8 @@ void Z_FileDumpHeap (FILE* f)
                     "ERROR: two consecutive free blocks\n" :
                     "ОШИБКА: два последовательных свободных блока\n");
     }
+
+    Z_DumpPools(f);
 }
 
 